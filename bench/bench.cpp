@@ -0,0 +1,274 @@
+#include "bench.h"
+#include "common/logger.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <new>
+
+// Allocation counting. operator new is replaced here; malloc and friends are
+// wrapped at link time (-Wl,--wrap=malloc,...) for the objects under test.
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+}
+
+namespace {
+
+uint64_t allocation_count = 0;
+
+const int64_t MIN_SAMPLE_NS = 20 * 1000 * 1000;
+const int64_t MAX_SAMPLE_FACTOR = 10; // wall time a sample may take while calibrating, over the minimum
+const int SAMPLES = 5;
+const double DEFAULT_TOLERANCE = 0.25;
+const int REGRESSION_RETRIES = 2; // re-runs before a slowdown counts, to ride out noisy hosts
+const uint64_t DEFAULT_FUZZ_ROUNDS = 100000;
+const uint64_t FUZZ_SEED = 0x6e5a11;
+const uint64_t DEFAULT_ALLOC_ROUNDS = 100000;
+
+} // namespace
+
+extern "C" {
+void* __wrap_malloc(size_t size) {
+    ++allocation_count;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    ++allocation_count;
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    ++allocation_count;
+    return __real_realloc(ptr, size);
+}
+}
+
+void* operator new(size_t size) {
+    ++allocation_count;
+    void* ptr = __real_malloc(size ? size : 1);
+    if (!ptr) {
+        abort();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+namespace bench {
+
+int64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+uint64_t allocations() {
+    return allocation_count;
+}
+
+} // namespace bench
+
+using namespace bench;
+
+static BenchResult run_case(const BenchCase& bench_case, uint64_t& warm_allocations) {
+    // Grow the iteration count until one sample takes long enough to time
+    int64_t min_sample = bench_case.min_sample_ns ? bench_case.min_sample_ns : MIN_SAMPLE_NS;
+    uint64_t iterations = 1;
+    while (true) {
+        int64_t start = now_ns();
+        int64_t timed = bench_case.run(iterations);
+        int64_t wall = now_ns() - start;
+        if (timed >= min_sample || wall >= min_sample * MAX_SAMPLE_FACTOR) {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    double best = 0;
+    uint64_t allocs_before = allocations();
+    for (int i = 0; i < SAMPLES; ++i) {
+        double ns = (double)bench_case.run(iterations) / (double)(iterations * bench_case.ops_per_iteration);
+        if (i == 0 || ns < best) {
+            best = ns;
+        }
+    }
+    warm_allocations = allocations() - allocs_before;
+
+    return {bench_case.name, best, iterations,
+            (double)warm_allocations / (double)(SAMPLES * iterations * bench_case.ops_per_iteration)};
+}
+
+static int write_results(const char* path, const std::vector<BenchResult>& results) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        return -1;
+    }
+    fprintf(file, "# name\tns_per_op\titerations\tallocs_per_op\n");
+    for (const BenchResult& result : results) {
+        fprintf(file, "%s\t%.2f\t%llu\t%.3f\n", result.name.c_str(), result.ns_per_op,
+                (unsigned long long)result.iterations, result.allocs_per_op);
+    }
+    return fclose(file);
+}
+
+static int read_baseline(const char* path, std::map<std::string, double>& baseline) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        char name[128];
+        double ns_per_op;
+        if (sscanf(line, "%127s %lf", name, &ns_per_op) == 2) {
+            baseline[name] = ns_per_op;
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+static void print_usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --output FILE      Write results to FILE (default bench_output.txt)\n"
+            "  --baseline FILE    Compare against FILE and fail on regressions\n"
+            "  --tolerance F      Allowed slowdown against the baseline (default %.2f)\n"
+            "  --filter TEXT      Only run cases whose name contains TEXT\n"
+            "  --fuzz N           Hellos to check the fast parser against the generic one on (default %llu, 0 skips)\n"
+            "  --alloc-check N    Known-neighbour hellos that must ingest without allocating (default %llu, 0 skips)\n"
+            "  --checks-only      Run the parser and allocation checks, without timings or a results file\n",
+            program, DEFAULT_TOLERANCE, (unsigned long long)DEFAULT_FUZZ_ROUNDS,
+            (unsigned long long)DEFAULT_ALLOC_ROUNDS);
+}
+
+int main(int argc, char* argv[]) {
+    const char* output_path = "bench_output.txt";
+    const char* baseline_path = nullptr;
+    const char* filter = nullptr;
+    double tolerance = DEFAULT_TOLERANCE;
+    uint64_t fuzz_rounds = DEFAULT_FUZZ_ROUNDS;
+    uint64_t alloc_rounds = DEFAULT_ALLOC_ROUNDS;
+    bool checks_only = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (strcmp(argv[i], "--output") == 0 && value) {
+            output_path = value;
+            ++i;
+        } else if (strcmp(argv[i], "--baseline") == 0 && value) {
+            baseline_path = value;
+            ++i;
+        } else if (strcmp(argv[i], "--tolerance") == 0 && value && atof(value) > 0) {
+            tolerance = atof(value);
+            ++i;
+        } else if (strcmp(argv[i], "--filter") == 0 && value) {
+            filter = value;
+            ++i;
+        } else if (strcmp(argv[i], "--fuzz") == 0 && value) {
+            fuzz_rounds = strtoull(value, nullptr, 10);
+            ++i;
+        } else if (strcmp(argv[i], "--alloc-check") == 0 && value) {
+            alloc_rounds = strtoull(value, nullptr, 10);
+            ++i;
+        } else if (strcmp(argv[i], "--checks-only") == 0) {
+            checks_only = true;
+        } else {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    logger::set_level(LogLevel::Error);
+
+    std::vector<BenchCase> cases;
+    register_discovery_benchmarks(cases);
+
+    std::map<std::string, double> baseline;
+    if (baseline_path && read_baseline(baseline_path, baseline) < 0) {
+        fprintf(stderr, "Cannot read baseline %s: %s\n", baseline_path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    std::vector<BenchResult> results;
+    int failures = 0;
+    if (fuzz_rounds > 0 && check_hello_parser(fuzz_rounds, FUZZ_SEED) > 0) {
+        ++failures;
+    }
+    if (alloc_rounds > 0 && check_ingest_allocations(alloc_rounds) > 0) {
+        ++failures;
+    }
+    if (checks_only) {
+        if (failures > 0) {
+            printf("FAILED: %d check(s) failed\n", failures);
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    printf("%-32s %12s %12s %8s\n", "benchmark", "ns/op", "baseline", "change");
+    for (const BenchCase& bench_case : cases) {
+        if (filter && bench_case.name.find(filter) == std::string::npos) {
+            continue;
+        }
+
+        uint64_t warm_allocations = 0;
+        BenchResult result = run_case(bench_case, warm_allocations);
+        auto base = baseline.find(result.name);
+        for (int retry = 0; retry < REGRESSION_RETRIES && base != baseline.end() &&
+                            result.ns_per_op > base->second * (1.0 + tolerance); ++retry) {
+            uint64_t retry_allocations = 0;
+            BenchResult retried = run_case(bench_case, retry_allocations);
+            if (retried.ns_per_op < result.ns_per_op) {
+                result = retried;
+            }
+            warm_allocations += retry_allocations;
+        }
+        results.push_back(result);
+        logger::flush();
+
+        if (base == baseline.end()) {
+            printf("%-32s %12.2f %12s %8s\n", result.name.c_str(), result.ns_per_op, "-", "new");
+        } else {
+            double change = result.ns_per_op / base->second - 1.0;
+            printf("%-32s %12.2f %12.2f %+7.1f%%\n", result.name.c_str(), result.ns_per_op, base->second,
+                   change * 100.0);
+            if (change > tolerance) {
+                printf("REGRESSION: %s is %.1f%% slower than the baseline (tolerance %.0f%%)\n",
+                       result.name.c_str(), change * 100.0, tolerance * 100.0);
+                ++failures;
+            }
+        }
+        if (bench_case.zero_alloc && warm_allocations != 0) {
+            printf("ALLOCATION: %s allocated %llu times, expected none\n", result.name.c_str(),
+                   (unsigned long long)warm_allocations);
+            ++failures;
+        }
+    }
+
+    if (write_results(output_path, results) != 0) {
+        fprintf(stderr, "Cannot write %s: %s\n", output_path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    if (failures > 0) {
+        printf("FAILED: %d benchmark check(s) failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All benchmark checks passed, results in %s\n", output_path);
+    return EXIT_SUCCESS;
+}
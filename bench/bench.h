@@ -0,0 +1,56 @@
+#ifndef BENCH_BENCH_H
+#define BENCH_BENCH_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+struct BenchCase {
+    std::string name;
+    uint64_t ops_per_iteration;
+    // Runs the operation iterations times and returns the nanoseconds spent
+    // in the timed part. Setup that is not part of the measurement is left
+    // out of the returned time.
+    std::function<int64_t(uint64_t iterations)> run;
+    // Fail the run if the case allocates at all once warmed up
+    bool zero_alloc;
+    // Shortest timed sample; 0 for the default. Cases that lean on the
+    // allocator and memory need longer samples to time steadily.
+    int64_t min_sample_ns = 0;
+};
+
+struct BenchResult {
+    std::string name;
+    double ns_per_op;
+    uint64_t iterations;
+    double allocs_per_op;
+};
+
+int64_t now_ns();
+
+// Heap allocations (operator new, malloc, calloc, realloc) since startup
+uint64_t allocations();
+
+// Keeps the compiler from discarding a computed value
+template <typename T>
+inline void do_not_optimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+void register_discovery_benchmarks(std::vector<BenchCase>& cases);
+
+// Compares the fast hello parser with the generic one on rounds random and
+// mutated hellos, on every instruction set the CPU supports. Returns the
+// number of mismatches.
+size_t check_hello_parser(uint64_t rounds, uint64_t seed);
+
+// Feeds rounds hellos from known neighbours through the receive path.
+// Returns the number of them that allocated.
+size_t check_ingest_allocations(uint64_t rounds);
+
+} // namespace bench
+
+#endif // BENCH_BENCH_H
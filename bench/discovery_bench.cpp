@@ -0,0 +1,379 @@
+#include "bench.h"
+#include "neighbour_discovery.h"
+#include "service.h"
+
+#include <algorithm>
+#include <dirent.h>
+#include <memory>
+#include <random>
+
+namespace bench {
+
+namespace {
+
+const size_t TABLE_SIZES[] = {100, 1000, 10000, 100000};
+const size_t INGEST_SOURCES = 256;
+const int64_t RENDER_SAMPLE_NS = 200 * 1000 * 1000; // 20 ms samples of render_list swing by 2x
+const int64_t JOURNAL_SAMPLE_NS = 200 * 1000 * 1000; // spans dozens of segments
+const size_t MAX_REPORTED = 5;
+const char* SAMPLE_HELLO = "HELLO from eth0 NodeID:2dbe0f0789384b48822e2bfe524db290 MAC:52:54:0:33:47:db IP:192.168.100.191\n";
+// A periodic hello from a current sender, with every optional field
+const char* FULL_HELLO = "HELLO from eth0 NodeID:2dbe0f0789384b48822e2bfe524db290 MAC:52:54:0:33:47:db IP:192.168.100.191 "
+                         "INT:1000 HOLD:3500 TS:81234567890 SEQ:48213 "
+                         "ECHO:7f3a0c99e1d24b6a8c0e5b1d2f4a6c8e:81234501234:1520\n";
+
+std::vector<NodeID> random_ids(size_t count, uint64_t seed) {
+    std::mt19937_64 gen(seed);
+    std::vector<NodeID> ids(count);
+    for (NodeID& id : ids) {
+        uint64_t halves[2] = {gen(), gen()};
+        std::memcpy(id.data(), halves, sizeof(halves));
+    }
+    return ids;
+}
+
+NeighbourTable make_table(size_t entries) {
+    NeighbourTable table(16, 0x5eed);
+    table.set_limits(entries * 2, entries * 2 * NeighbourTable::bytes_per_slot * 4, EvictionPolicy::PreferUnconfirmed);
+    return table;
+}
+
+std::vector<NetworkInterface> bench_interfaces() {
+    std::vector<NetworkInterface> interfaces(2);
+    const char* names[] = {"bench0", "bench1"};
+    const char* addresses[] = {"10.1.0.1", "10.2.0.1"};
+    for (size_t i = 0; i < interfaces.size(); ++i) {
+        NetworkInterface& interface = interfaces[i];
+        interface.name = names[i];
+        interface.ip_address = addresses[i];
+        interface.mac_address = "52:54:0:12:34:56";
+        interface.subnet_mask = "255.255.0.0";
+        interface.network_cidr = helper::network_cidr(interface.ip_address, 16);
+        interface.broadcast_address = helper::broadcast_address(interface.network_cidr);
+        interface.ipv4_address = inet_addr(interface.ip_address.c_str());
+        interface.ipv4_netmask = inet_addr(interface.subnet_mask.c_str());
+        interface.ipv4_broadcast = inet_addr(interface.broadcast_address.c_str());
+    }
+    return interfaces;
+}
+
+void add_table_benchmarks(std::vector<BenchCase>& cases, size_t size) {
+    std::string suffix = "/" + std::to_string(size);
+    auto ids = std::make_shared<std::vector<NodeID>>(random_ids(size, size));
+
+    cases.push_back({"table_insert" + suffix, size, [ids](uint64_t iterations) {
+        int64_t timed = 0;
+        for (uint64_t i = 0; i < iterations; ++i) {
+            NeighbourTable table = make_table(ids->size());
+            int64_t start = now_ns();
+            for (const NodeID& id : *ids) {
+                bool inserted;
+                do_not_optimize(table.refresh(id, 30, inserted));
+            }
+            timed += now_ns() - start;
+        }
+        return timed;
+    }, false});
+
+    // Refreshing known neighbours is the steady state and must not allocate
+    auto table = std::make_shared<NeighbourTable>(make_table(size));
+    auto order = std::make_shared<std::vector<NodeID>>(*ids);
+    for (const NodeID& id : *ids) {
+        bool inserted;
+        table->refresh(id, 30, inserted);
+    }
+    std::shuffle(order->begin(), order->end(), std::mt19937_64(size));
+    cases.push_back({"table_refresh" + suffix, size, [table, order](uint64_t iterations) {
+        int64_t start = now_ns();
+        for (uint64_t i = 0; i < iterations; ++i) {
+            for (const NodeID& id : *order) {
+                bool inserted;
+                do_not_optimize(table->refresh(id, 30 + i, inserted));
+            }
+        }
+        return now_ns() - start;
+    }, true});
+
+    cases.push_back({"table_expire" + suffix, size, [ids](uint64_t iterations) {
+        int64_t timed = 0;
+        for (uint64_t i = 0; i < iterations; ++i) {
+            NeighbourTable table = make_table(ids->size());
+            for (const NodeID& id : *ids) {
+                bool inserted;
+                table.refresh(id, 30, inserted);
+            }
+            int64_t start = now_ns();
+            size_t removed = table.erase_if(
+                [](const NeighbourSlot& slot, const NetworkNeighbor&) { return !slot.is_active(31); },
+                [](const NeighbourSlot&, const NetworkNeighbor&) {});
+            timed += now_ns() - start;
+            do_not_optimize(removed);
+        }
+        return timed;
+    }, false});
+}
+
+void add_list_benchmark(std::vector<BenchCase>& cases, size_t size) {
+    auto interfaces = std::make_shared<std::vector<NetworkInterface>>(bench_interfaces());
+    auto table = std::make_shared<NeighbourTable>(make_table(size));
+    std::vector<NodeID> ids = random_ids(size, size + 1);
+    for (size_t i = 0; i < ids.size(); ++i) {
+        bool inserted;
+        NetworkNeighbor& neighbor = table->refresh(ids[i], 30, inserted);
+        // Every fourth neighbour is reachable on both interfaces
+        for (uint16_t iface = 0; iface < (i % 4 == 0 ? 2 : 1); ++iface) {
+            NetworkConnection connection;
+            connection.ip = htonl(ntohl((*interfaces)[iface].ipv4_address) + 1 + (uint32_t)i);
+            connection.mac_address = {0x52, 0x54, 0x00, (uint8_t)(i >> 16), (uint8_t)(i >> 8), (uint8_t)i};
+            connection.interface_id = iface;
+            bool changed;
+            table->add_connection(neighbor, connection, changed);
+        }
+    }
+
+    cases.push_back({"render_list/" + std::to_string(size), 1, [table, interfaces](uint64_t iterations) {
+        int64_t start = now_ns();
+        for (uint64_t i = 0; i < iterations; ++i) {
+            std::string response = render_neighbour_list(*table, *interfaces, 0);
+            do_not_optimize(response.size());
+        }
+        return now_ns() - start;
+    }, false, RENDER_SAMPLE_NS});
+}
+
+// Full receive path after recvfrom: admission, interface matching, parsing
+// and the table update, for known neighbours arriving from many sources.
+// Runs the engine graw_service runs, on the system clock.
+void add_ingest_benchmark(std::vector<BenchCase>& cases) {
+    struct IngestState {
+        std::vector<NetworkInterface> interfaces = bench_interfaces();
+        MetricsRegistry registry;
+        SystemClock clock;
+        SeededRandom random{1};
+        UdpTransport transport;
+        std::unique_ptr<NeighbourDiscovery> discovery;
+        std::vector<std::string> datagrams;
+        std::vector<in_addr_t> sources;
+    };
+    auto state = std::make_shared<IngestState>();
+
+    DiscoveryConfig config;
+    config.admission.source_rate = 1000000;
+    config.admission.node_rate = 1000000;
+    config.admission.global_rate = 1000000;
+    NodeID self{};
+    state->discovery = std::make_unique<NeighbourDiscovery>(state->interfaces, 0, self, state->registry, state->clock,
+                                                            state->random, state->transport, config);
+
+    std::vector<NodeID> ids = random_ids(INGEST_SOURCES, 7);
+    for (size_t i = 0; i < INGEST_SOURCES; ++i) {
+        in_addr_t ip = htonl(ntohl(state->interfaces[0].ipv4_address) + 1 + (uint32_t)i);
+        std::string mac = "52:54:0:0:" + std::to_string(i / 16) + ":" + std::to_string(i % 16);
+        state->datagrams.push_back("HELLO from bench0 NodeID:" + node_id_to_hex(ids[i]) + " MAC:" + mac +
+                                   " IP:" + helper::ip_to_string(ip) + "\n");
+        state->sources.push_back(ip);
+        state->discovery->process_datagram(state->datagrams.back(), ip);
+    }
+
+    cases.push_back({"ingest_hello", 1, [state](uint64_t iterations) {
+        int64_t start = now_ns();
+        for (uint64_t i = 0; i < iterations; ++i) {
+            size_t n = i % INGEST_SOURCES;
+            state->discovery->process_datagram(state->datagrams[n], state->sources[n]);
+        }
+        return now_ns() - start;
+    }, true});
+}
+
+// Appending neighbour events to the journal. The append that rotates to a
+// new segment file runs untimed between stretches, and the segments live
+// on tmpfs where there is one, so neither file system calls nor disk
+// writeback end up in the numbers.
+void add_journal_benchmark(std::vector<BenchCase>& cases) {
+    struct JournalState {
+        std::string directory;
+        NeighbourJournal journal;
+        uint64_t capacity = 0; // records per segment
+        uint64_t written = 0;
+
+        ~JournalState() {
+            if (DIR* dir = opendir(directory.c_str())) {
+                while (dirent* entry = readdir(dir)) {
+                    if (entry->d_name[0] != '.') {
+                        unlink((directory + "/" + entry->d_name).c_str());
+                    }
+                }
+                closedir(dir);
+            }
+            rmdir(directory.c_str());
+        }
+    };
+    char shm_directory[] = "/dev/shm/graw_bench_journal.XXXXXX";
+    char tmp_directory[] = "/tmp/graw_bench_journal.XXXXXX";
+    const char* directory = mkdtemp(shm_directory);
+    if (!directory && !(directory = mkdtemp(tmp_directory))) {
+        return;
+    }
+    auto state = std::make_shared<JournalState>();
+    state->directory = directory;
+    JournalConfig config;
+    config.directory = directory;
+    config.segments = 2;
+    if (state->journal.open(config) < 0) {
+        return;
+    }
+    state->capacity = (config.segment_bytes - sizeof(JournalHeader)) / sizeof(JournalRecord);
+
+    std::vector<NodeID> ids = random_ids(INGEST_SOURCES, 11);
+    cases.push_back({"journal_append", 1, [state, ids](uint64_t iterations) {
+        const std::string interface = "bench0";
+        MAC_Bytes mac = {0x52, 0x54, 0x00, 0x12, 0x34, 0x56};
+        int64_t timed = 0;
+        for (uint64_t done = 0; done < iterations;) {
+            if (state->written != 0 && state->written % state->capacity == 0) {
+                state->journal.append(JournalEvent::LinkUp, ids[0], 0, mac, interface);
+                ++state->written;
+            }
+            uint64_t batch = std::min(iterations - done, state->capacity - state->written % state->capacity);
+            int64_t start = now_ns();
+            for (uint64_t i = done; i < done + batch; ++i) {
+                state->journal.append(JournalEvent::LinkUp, ids[i % INGEST_SOURCES], (in_addr_t)i, mac, interface);
+            }
+            timed += now_ns() - start;
+            done += batch;
+            state->written += batch;
+        }
+        return timed;
+    }, false, JOURNAL_SAMPLE_NS});
+}
+
+void add_parse_benchmark(std::vector<BenchCase>& cases, const std::string& name, const char* message,
+                         bool (*parse)(std::string_view, DiscoveryPackage&)) {
+    cases.push_back({name, 1, [message, parse](uint64_t iterations) {
+        std::string_view hello(message);
+        int64_t start = now_ns();
+        for (uint64_t i = 0; i < iterations; ++i) {
+            DiscoveryPackage pkg;
+            do_not_optimize(hello);
+            do_not_optimize(parse(hello, pkg));
+            do_not_optimize(pkg);
+        }
+        return now_ns() - start;
+    }, true});
+}
+
+} // namespace
+
+void register_discovery_benchmarks(std::vector<BenchCase>& cases) {
+    add_parse_benchmark(cases, "from_string", SAMPLE_HELLO, DiscoveryPackage::from_string);
+    add_parse_benchmark(cases, "from_string/full", FULL_HELLO, DiscoveryPackage::from_string);
+    add_parse_benchmark(cases, "from_string_generic", SAMPLE_HELLO, DiscoveryPackage::from_string_generic);
+    add_parse_benchmark(cases, "from_string_generic/full", FULL_HELLO, DiscoveryPackage::from_string_generic);
+
+    cases.push_back({"is_ip_in_network", 1, [](uint64_t iterations) {
+        std::string ip = "192.168.100.191";
+        std::string network = "192.168.100.0/24";
+        int64_t start = now_ns();
+        for (uint64_t i = 0; i < iterations; ++i) {
+            do_not_optimize(ip);
+            do_not_optimize(helper::is_ip_in_network(ip, network));
+        }
+        return now_ns() - start;
+    }, false});
+
+    NodeID id = random_ids(1, 1)[0];
+    cases.push_back({"node_id_to_hex", 1, [id](uint64_t iterations) {
+        char out[33];
+        int64_t start = now_ns();
+        for (uint64_t i = 0; i < iterations; ++i) {
+            do_not_optimize(id);
+            node_id_to_hex(id, out);
+            do_not_optimize(out);
+        }
+        return now_ns() - start;
+    }, true});
+
+    auto interfaces = std::make_shared<std::vector<NetworkInterface>>(bench_interfaces());
+    auto message = std::make_shared<std::string>();
+    message->reserve(MAX_MESSAGE_SIZE);
+    cases.push_back({"build_hello_message", 1, [interfaces, message, id](uint64_t iterations) {
+        char id_hex[33];
+        node_id_to_hex(id, id_hex);
+        LivenessConfig liveness;
+        int64_t start = now_ns();
+        for (uint64_t i = 0; i < iterations; ++i) {
+            build_hello_message(*message, (*interfaces)[0], id_hex, liveness);
+            do_not_optimize(*message);
+        }
+        return now_ns() - start;
+    }, true});
+
+    for (size_t size : TABLE_SIZES) {
+        add_table_benchmarks(cases, size);
+    }
+    add_list_benchmark(cases, 100);
+    add_list_benchmark(cases, 1000);
+    add_ingest_benchmark(cases);
+    add_journal_benchmark(cases);
+}
+
+// Refreshes known neighbours through the whole receive path at the service's
+// default log level and counts heap allocations around each datagram
+size_t check_ingest_allocations(uint64_t rounds) {
+    std::vector<NetworkInterface> interfaces = bench_interfaces();
+    MetricsRegistry registry;
+    SystemClock clock;
+    SeededRandom random{1};
+    UdpTransport transport;
+    DiscoveryConfig config;
+    config.admission.source_rate = 1000000;
+    config.admission.node_rate = 1000000;
+    config.admission.global_rate = 1000000;
+    NodeID self{};
+    NeighbourDiscovery discovery(interfaces, 0, self, registry, clock, random, transport, config);
+
+    std::vector<NodeID> ids = random_ids(INGEST_SOURCES, 11);
+    std::vector<std::string> prefixes;
+    std::vector<in_addr_t> sources;
+    for (size_t i = 0; i < INGEST_SOURCES; ++i) {
+        in_addr_t ip = htonl(ntohl(interfaces[0].ipv4_address) + 1 + (uint32_t)i);
+        std::string mac = "52:54:0:1:" + std::to_string(i / 16) + ":" + std::to_string(i % 16);
+        prefixes.push_back("HELLO from bench0 NodeID:" + node_id_to_hex(ids[i]) + " MAC:" + mac +
+                           " IP:" + helper::ip_to_string(ip) + " INT:1000 HOLD:3500 SEQ:");
+        sources.push_back(ip);
+    }
+    char datagram[256];
+    auto hello = [&](size_t i, uint64_t sequence) {
+        int length = snprintf(datagram, sizeof(datagram), "%s%llu\n", prefixes[i].c_str(),
+                              (unsigned long long)sequence);
+        return std::string_view(datagram, (size_t)length);
+    };
+    // First sight of a neighbour adds it to the table and may allocate
+    for (size_t i = 0; i < INGEST_SOURCES; ++i) {
+        discovery.process_datagram(hello(i, 0), sources[i]);
+    }
+
+    logger::set_level(LogLevel::Info);
+    size_t allocating = 0;
+    for (uint64_t round = 0; round < rounds; ++round) {
+        size_t i = round % INGEST_SOURCES;
+        std::string_view data = hello(i, round / INGEST_SOURCES + 1);
+        uint64_t before = allocations();
+        discovery.process_datagram(data, sources[i]);
+        uint64_t allocated = allocations() - before;
+        if (allocated && allocating++ < MAX_REPORTED) {
+            printf("ALLOCATION: refreshing a known neighbour allocated %llu times on \"%.*s\"\n",
+                   (unsigned long long)allocated, (int)data.size() - 1, data.data());
+        }
+    }
+    logger::flush();
+    logger::set_level(LogLevel::Error);
+
+    if (allocating == 0) {
+        printf("Hello ingest made no allocation on %llu refreshes of known neighbours\n",
+               (unsigned long long)rounds);
+    }
+    return allocating;
+}
+
+} // namespace bench
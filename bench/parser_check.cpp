@@ -0,0 +1,168 @@
+#include "bench.h"
+#include "common/hello_scan.h"
+#include "common/types.h"
+
+#include <cstdio>
+#include <random>
+
+namespace bench {
+
+namespace {
+
+const size_t MAX_REPORTED = 5;
+// Bytes that mutations splice in: delimiters, digits at the edges of the
+// hex ranges, and bytes the signed compares could misread
+const char MUTATION_BYTES[] = {' ', ':', '\r', '\n', '.', '0', '9', 'a', 'f', 'A', 'F', 'g', 'G', '/', '@', '`',
+                               '\0', '\t', (char)0x80, (char)0xB0, (char)0xE6, (char)0xFF};
+const char* FIELD_NAMES[] = {"NodeID:", "MAC:", "IP:", "INT:", "HOLD:", "SEQ:", "TS:", "ECHO:", "HELLO from ",
+                             "PROBE "};
+
+std::string random_hex(std::mt19937_64& gen, size_t digits) {
+    static const char lower[] = "0123456789abcdef";
+    static const char upper[] = "0123456789ABCDEF";
+    std::string hex;
+    bool mixed_case = gen() % 8 == 0;
+    for (size_t i = 0; i < digits; ++i) {
+        hex += (mixed_case && gen() % 2 ? upper : lower)[gen() % 16];
+    }
+    return hex;
+}
+
+std::string random_octet(std::mt19937_64& gen) {
+    switch (gen() % 16) {
+        case 0: return "0";
+        case 1: return "255";
+        case 2: return "256";
+        case 3: return "010";
+        case 4: return "";
+        default: return std::to_string(gen() % 256);
+    }
+}
+
+// A hello as senders write it, with the occasional odd field
+std::string random_hello(std::mt19937_64& gen) {
+    std::string hello = gen() % 4 ? "HELLO from " : "PROBE from ";
+    // Names of every length move the later fields across block boundaries
+    size_t name_length = gen() % 8 ? 1 + gen() % 15 : gen() % 200;
+    for (size_t i = 0; i < name_length; ++i) {
+        hello += "abcdefghijklmnopqrstuvwxyz0123456789-._"[gen() % 39];
+    }
+    hello += " NodeID:" + random_hex(gen, gen() % 16 ? 32 : gen() % 40);
+    hello += " MAC:";
+    for (int octet = 0; octet < 6; ++octet) {
+        hello += random_hex(gen, gen() % 32 ? 1 + gen() % 2 : gen() % 4);
+        if (octet < 5) {
+            hello += ':';
+        }
+    }
+    hello += " IP:" + random_octet(gen);
+    for (int octet = 1; octet < 4; ++octet) {
+        hello += "." + random_octet(gen);
+    }
+    if (gen() % 2) {
+        hello += " INT:" + std::to_string(gen() % 100000) + " HOLD:" + std::to_string(gen() % 300000);
+    }
+    hello += " TS:" + std::to_string(gen() >> (gen() % 64));
+    if (gen() % 2) {
+        hello += " SEQ:" + std::to_string((uint32_t)gen());
+    }
+    if (gen() % 3 == 0) {
+        hello += " ECHO:" + random_hex(gen, 32) + ":" + std::to_string(gen() % 1000000000) + ":" +
+                 std::to_string(gen() % 100000);
+    }
+    if (gen() % 16 == 0) {
+        hello += " X-FUTURE:" + random_hex(gen, gen() % 300);
+    }
+    return hello + (gen() % 8 ? "\n" : gen() % 2 ? "\r\n" : "");
+}
+
+void mutate(std::mt19937_64& gen, std::string& hello) {
+    size_t mutations = gen() % 4;
+    for (size_t i = 0; i < mutations && !hello.empty(); ++i) {
+        size_t at = gen() % hello.size();
+        char byte = MUTATION_BYTES[gen() % sizeof(MUTATION_BYTES)];
+        switch (gen() % 6) {
+            case 0: hello[at] = byte; break;
+            case 1: hello.insert(at, 1, byte); break;
+            case 2: hello.erase(at, 1 + gen() % 4); break;
+            case 3: hello.resize(at); break;
+            case 4: hello.insert(at, FIELD_NAMES[gen() % (sizeof(FIELD_NAMES) / sizeof(FIELD_NAMES[0]))]); break;
+            default: hello.insert(at, hello.substr(gen() % hello.size(), gen() % 48)); break;
+        }
+    }
+}
+
+bool same_package(const DiscoveryPackage& a, const DiscoveryPackage& b) {
+    return a.interface_name == b.interface_name && a.sender_id == b.sender_id && a.sender_mac == b.sender_mac &&
+           a.sender_ip == b.sender_ip && a.interval_ms == b.interval_ms && a.hold_ms == b.hold_ms &&
+           a.probe == b.probe && a.has_sequence == b.has_sequence && a.sequence == b.sequence &&
+           a.timestamp_us == b.timestamp_us && a.echo_id == b.echo_id &&
+           a.echo_timestamp_us == b.echo_timestamp_us && a.echo_delay_us == b.echo_delay_us;
+}
+
+void report(size_t& mismatches, SimdLevel level, const char* what, const std::string& input) {
+    if (mismatches++ < MAX_REPORTED) {
+        std::string printable;
+        for (unsigned char c : input) {
+            if (c >= 0x20 && c < 0x7F) {
+                printable += (char)c;
+            } else {
+                char escaped[5];
+                snprintf(escaped, sizeof(escaped), "\\x%02x", c);
+                printable += escaped;
+            }
+        }
+        printf("MISMATCH: %s %s on \"%s\"\n", simd_level_name(level), what, printable.c_str());
+    }
+}
+
+} // namespace
+
+// Differential fuzzing: every hello parses the same with from_string on
+// each instruction set the CPU has as with the generic parser, and node IDs
+// decode the same as with node_id_from_hex
+size_t check_hello_parser(uint64_t rounds, uint64_t seed) {
+    SimdLevel original = simd_level();
+    size_t mismatches = 0;
+    std::string levels;
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2}) {
+        if (!set_simd_level(level)) {
+            continue;
+        }
+        levels += levels.empty() ? simd_level_name(level) : std::string(", ") + simd_level_name(level);
+        std::mt19937_64 gen(seed);
+        for (uint64_t round = 0; round < rounds; ++round) {
+            std::string hello = random_hello(gen);
+            mutate(gen, hello);
+
+            DiscoveryPackage fast = DiscoveryPackage();
+            DiscoveryPackage generic = DiscoveryPackage();
+            bool fast_ok = DiscoveryPackage::from_string(hello, fast);
+            bool generic_ok = DiscoveryPackage::from_string_generic(hello, generic);
+            if (fast_ok != generic_ok || (fast_ok && !same_package(fast, generic))) {
+                report(mismatches, level, fast_ok != generic_ok ? "accepts differently" : "parses differently",
+                       hello);
+            }
+
+            std::string hex = random_hex(gen, 32);
+            if (gen() % 2) {
+                mutate(gen, hex);
+                hex.resize(32, 'x');
+            }
+            NodeID decoded{}, expected{};
+            bool decoded_ok = decode_node_id(hex.data(), decoded);
+            if (decoded_ok != node_id_from_hex(hex, expected) || (decoded_ok && decoded != expected)) {
+                report(mismatches, level, "decodes a node ID differently", hex);
+            }
+        }
+    }
+    set_simd_level(original);
+
+    if (mismatches == 0) {
+        printf("Hello parser matches the generic parser on %llu fuzzed datagrams (%s)\n",
+               (unsigned long long)rounds, levels.c_str());
+    }
+    return mismatches;
+}
+
+} // namespace bench
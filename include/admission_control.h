@@ -0,0 +1,69 @@
+#ifndef ADMISSION_CONTROL_H
+#define ADMISSION_CONTROL_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <netinet/in.h>
+
+#include "common/node_id.h"
+
+const size_t ADMISSION_TABLE_SIZE = 1024; // buckets per key type, power of two
+const size_t ADMISSION_WAYS = 8;          // buckets a key may occupy
+const int64_t ADMISSION_TRUST_IDLE_MS = 600000; // a trusted bucket is kept until idle this long
+
+struct AdmissionConfig {
+    uint32_t source_rate = 20;     // packets per second per source IP
+    uint32_t node_rate = 20;       // packets per second per NodeID
+    uint32_t global_rate = 5000;   // packets per second from untrusted sources
+};
+
+struct AdmissionStats {
+    uint64_t admitted = 0;
+    uint64_t dropped_source = 0;
+    uint64_t dropped_node = 0;
+    uint64_t dropped_global = 0;
+
+    uint64_t dropped() const { return dropped_source + dropped_node + dropped_global; }
+};
+
+// Token buckets checked before a datagram is parsed. Buckets live in small
+// set-associative tables indexed by a seeded hash, so peers cannot aim keys
+// at one set. A new key takes the least recently used untrusted bucket of
+// its set. Sources that have refreshed a known neighbour are marked trusted
+// and bypass the global budget, so a storm from new sources cannot starve
+// existing peers; their buckets are never taken over while in use, and a
+// new source that finds its set full of them is held to the global budget.
+class AdmissionControl {
+    struct Bucket {
+        uint64_t key = 0;
+        int64_t updated_ms = 0;
+        uint32_t tokens = 0;    // thousandths of a packet
+        bool used = false;
+        bool trusted = false;
+    };
+
+    AdmissionConfig config;
+    AdmissionStats admission_stats;
+    std::array<Bucket, ADMISSION_TABLE_SIZE> source_buckets;
+    std::array<Bucket, ADMISSION_TABLE_SIZE> node_buckets;
+    Bucket global_bucket;
+    uint64_t seed;
+
+    static bool take(Bucket& bucket, int64_t now_ms, uint32_t rate);
+    uint64_t hash(uint64_t lo, uint64_t hi) const;
+    // Returns nullptr when every bucket of the set is trusted and in use
+    static Bucket* lookup(std::array<Bucket, ADMISSION_TABLE_SIZE>& buckets, uint64_t key, int64_t now_ms);
+public:
+    explicit AdmissionControl(const AdmissionConfig& config = AdmissionConfig(), uint64_t seed = 0);
+
+    // Checked right after receive, before any parsing
+    bool admit_source(in_addr_t source, int64_t now_ms);
+    // Checked once the NodeID is known, before the neighbour table is touched
+    bool admit_node(const NodeID& id, int64_t now_ms);
+    void mark_trusted(in_addr_t source, int64_t now_ms);
+
+    const AdmissionStats& stats() const { return admission_stats; }
+};
+
+#endif // ADMISSION_CONTROL_H
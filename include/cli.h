@@ -9,22 +9,28 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <string>
 
 #include "common/helper.h"
-#include "service_connection.h"
+#include "graw_client.h"
 
 using namespace std;
 
 const char* SERVICE_PID_PATH = "/tmp/graw_service.pid";
 const char* CLI_SOCKET_PATH = "/tmp/graw_service.sock";
 const char* SERVICE_BINARY = "./graw_service";
+const int SERVICE_READY_TIMEOUT_MS = 10000;
 pid_t service_pid = -1;
 
 pid_t read_pid_file();
 bool is_service_running();
 int start_service();
 void stop_service();
-int main();
+void print_help();
+void print_status();
+int run_once(int argc, char* argv[]);
+int main(int argc, char* argv[]);
 
 #endif // CLI_H
@@ -0,0 +1,32 @@
+#ifndef COMMON_CLOCK_H
+#define COMMON_CLOCK_H
+
+#include <cstdint>
+
+// Monotonic time source for the discovery engine. The service uses the
+// system clock; the simulator drives a ManualClock through virtual time.
+class Clock {
+public:
+    virtual ~Clock() = default;
+    virtual int64_t now_ms() const = 0;
+    virtual int64_t now_us() const = 0;
+};
+
+class SystemClock final : public Clock {
+public:
+    int64_t now_ms() const override;
+    int64_t now_us() const override;
+};
+
+class ManualClock : public Clock {
+    int64_t current_ms;
+public:
+    explicit ManualClock(int64_t start_ms = 0) : current_ms(start_ms) {}
+
+    int64_t now_ms() const override { return current_ms; }
+    int64_t now_us() const override { return current_ms * 1000; }
+    void set(int64_t ms) { current_ms = ms; }
+    void advance(int64_t ms) { current_ms += ms; }
+};
+
+#endif // COMMON_CLOCK_H
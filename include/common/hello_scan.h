@@ -0,0 +1,50 @@
+#ifndef COMMON_HELLO_SCAN_H
+#define COMMON_HELLO_SCAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "node_id.h"
+
+const size_t HELLO_SCAN_BYTES = 256; // start of a datagram classified in one pass
+const size_t HELLO_SCAN_WORDS = HELLO_SCAN_BYTES / 64;
+
+// Instruction set the text hello parser runs on. The best one the CPU
+// supports is picked on first use.
+enum class SimdLevel : uint8_t {
+    Scalar,
+    SSE2,
+    AVX2,
+};
+
+// One bit per byte of the start of a datagram for each byte class the
+// hello parser looks for, so finding the next delimiter or checking that a
+// field is all hex digits is a few bit operations. Bits past size are clear.
+struct HelloScan {
+    size_t size;                       // bytes classified, at most HELLO_SCAN_BYTES
+    uint64_t ends[HELLO_SCAN_WORDS];   // ' ', '\r' and '\n', which end a field
+    uint64_t breaks[HELLO_SCAN_WORDS]; // '\r' and '\n'
+    uint64_t colons[HELLO_SCAN_WORDS];
+    uint64_t hex[HELLO_SCAN_WORDS];    // 0-9, a-f and A-F
+
+    // First set bit at or after from, or size if there is none
+    size_t next(const uint64_t* mask, size_t from) const;
+    // Whether any bit in [from, to) is set
+    bool any(const uint64_t* mask, size_t from, size_t to) const;
+    // Number of set bits in [from, to)
+    size_t count(const uint64_t* mask, size_t from, size_t to) const;
+};
+
+// Classifies the first HELLO_SCAN_BYTES of data
+void scan_hello(std::string_view data, HelloScan& scan);
+// Decodes the 32 hex digits at hex; false if any of them is not a hex digit
+bool decode_node_id(const char* hex, NodeID& id);
+
+SimdLevel simd_level();
+const char* simd_level_name(SimdLevel level);
+// Switches the implementation, for comparing them in tests and benchmarks.
+// Returns false if the CPU does not support level.
+bool set_simd_level(SimdLevel level);
+
+#endif // COMMON_HELLO_SCAN_H
@@ -3,6 +3,7 @@
 
 #include <ifaddrs.h>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
@@ -20,8 +21,14 @@ std::string network_cidr(const std::string& ip, int cidr);
 IP_Address broadcast_address(const std::string& network_cidr);
 MAC_Address get_mac_address(const std::string& interface_name);
 bool is_ip_in_network(const std::string& ip, const std::string& network_cidr);
-void log_error(const std::string& message, bool quiet_mode);
-void log_info(const std::string& message, bool quiet_mode);
+std::string ip_to_string(in_addr_t ip);
+std::string mac_to_string(const MAC_Bytes& mac);
+bool parse_mac(std::string_view text, MAC_Bytes& mac);
+int64_t monotonic_ms();
+int64_t monotonic_us();
+int64_t realtime_ms();
+void log_error(std::string_view message, bool quiet_mode);
+void log_info(std::string_view message, bool quiet_mode);
 
 } // namespace helper
 
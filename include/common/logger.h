@@ -0,0 +1,79 @@
+#ifndef COMMON_LOGGER_H
+#define COMMON_LOGGER_H
+
+#include <cstddef>
+#include <cstdint>
+
+enum class LogLevel : uint8_t {
+    Debug,
+    Info,
+    Warn,
+    Error,
+    Off,
+};
+
+// Calls below this level are compiled out entirely
+#ifndef GRAW_LOG_MIN_LEVEL
+#define GRAW_LOG_MIN_LEVEL 0
+#endif
+
+const LogLevel LOG_MIN_LEVEL = static_cast<LogLevel>(GRAW_LOG_MIN_LEVEL);
+
+const size_t LOG_RECORD_SIZE = 256;
+const size_t LOG_RING_SIZE = 1024;          // records, power of two
+const uint32_t LOG_RATE_LIMIT_BURST = 5;    // messages per call site per window
+const int64_t LOG_RATE_LIMIT_WINDOW_MS = 1000;
+
+namespace logger {
+
+// Per call site state for repeat suppression
+struct RateLimit {
+    int64_t window_start = 0;
+    uint32_t emitted = 0;
+    uint32_t suppressed = 0;
+};
+
+extern LogLevel current_level;
+
+inline bool enabled(LogLevel level) { return level >= current_level; }
+void set_level(LogLevel level);
+bool parse_level(const char* text, LogLevel& level);
+
+// Formats straight into a slot of the in-memory ring; nothing is written
+// until flush(). Records are dropped (and counted) when the ring is full.
+void write(LogLevel level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+// Same, but at most LOG_RATE_LIMIT_BURST messages per window per call site;
+// the number of suppressed repeats is reported when the next window opens.
+void write_limited(RateLimit& limit, LogLevel level, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
+
+// Drains the ring with batched writev calls. Called once per loop tick.
+// The writes are synchronous: a stdout or stderr that does not drain
+// stalls the tick that flushes, though not the formatting in between.
+void flush();
+uint64_t dropped();
+
+} // namespace logger
+
+#define GRAW_LOG(level, ...)                                                    \
+    do {                                                                        \
+        if ((level) >= LOG_MIN_LEVEL && logger::enabled(level)) {               \
+            logger::write(level, __VA_ARGS__);                                  \
+        }                                                                       \
+    } while (0)
+
+#define GRAW_LOG_RATE_LIMITED(level, ...)                                       \
+    do {                                                                        \
+        if ((level) >= LOG_MIN_LEVEL && logger::enabled(level)) {               \
+            static logger::RateLimit graw_log_limit_;                           \
+            logger::write_limited(graw_log_limit_, level, __VA_ARGS__);         \
+        }                                                                       \
+    } while (0)
+
+#define LOG_DEBUG(...) GRAW_LOG(LogLevel::Debug, __VA_ARGS__)
+#define LOG_INFO(...) GRAW_LOG(LogLevel::Info, __VA_ARGS__)
+#define LOG_WARN(...) GRAW_LOG(LogLevel::Warn, __VA_ARGS__)
+#define LOG_ERROR(...) GRAW_LOG(LogLevel::Error, __VA_ARGS__)
+#define LOG_WARN_RATE_LIMITED(...) GRAW_LOG_RATE_LIMITED(LogLevel::Warn, __VA_ARGS__)
+#define LOG_ERROR_RATE_LIMITED(...) GRAW_LOG_RATE_LIMITED(LogLevel::Error, __VA_ARGS__)
+
+#endif // COMMON_LOGGER_H
@@ -0,0 +1,98 @@
+#ifndef COMMON_METRICS_H
+#define COMMON_METRICS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+// Histogram bucket upper bounds in microseconds; one extra +Inf bucket follows
+const size_t HISTOGRAM_BUCKETS = 12;
+const uint64_t HISTOGRAM_BOUNDS_US[HISTOGRAM_BUCKETS] = {
+    10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 100000, 1000000,
+};
+
+enum class MetricType : uint8_t {
+    Counter,
+    Gauge,
+    Histogram,
+};
+
+// Metrics are only touched from the event loop thread, so updates are plain
+// increments with no atomics or locking.
+struct Counter {
+    uint64_t value = 0;
+
+    void inc(uint64_t n = 1) { value += n; }
+};
+
+struct Gauge {
+    int64_t value = 0;
+
+    void set(int64_t v) { value = v; }
+};
+
+struct Histogram {
+    uint64_t buckets[HISTOGRAM_BUCKETS + 1] = {};
+    uint64_t count = 0;
+    uint64_t sum_us = 0;
+
+    void observe(uint64_t us) {
+        size_t i = 0;
+        while (i < HISTOGRAM_BUCKETS && us > HISTOGRAM_BOUNDS_US[i]) {
+            ++i;
+        }
+        ++buckets[i];
+        ++count;
+        sum_us += us;
+    }
+};
+
+// Owns every metric of the process. Metrics are registered once at startup
+// and handed out by reference, so the hot path never looks anything up.
+// Storage is a deque so references stay valid as more metrics are added.
+class MetricsRegistry {
+    struct Entry {
+        const char* name;
+        const char* help;
+        std::string labels; // preformatted, e.g. interface="eth0"
+        MetricType type;
+        size_t index;
+    };
+
+    std::deque<Counter> counters;
+    std::deque<Gauge> gauges;
+    std::deque<Histogram> histograms;
+    std::vector<Entry> entries;
+    std::string scope_labels;
+
+    std::string scoped(const std::string& labels) const;
+    void render_entry(const Entry& entry, std::string& out) const;
+public:
+    Counter& counter(const char* name, const char* help, const std::string& labels = "");
+    Gauge& gauge(const char* name, const char* help, const std::string& labels = "");
+    Histogram& histogram(const char* name, const char* help, const std::string& labels = "");
+    // Labels put in front of those of every metric registered from now on,
+    // e.g. domain="tenant-a" while one discovery domain registers its own
+    void set_scope(const std::string& labels) { scope_labels = labels; }
+
+    // Prometheus text exposition format, one HELP/TYPE header per name
+    std::string render() const;
+    // Writes render() to path.tmp and renames it over path, so readers such
+    // as node_exporter's textfile collector never see a partial file
+    int write_textfile(const std::string& path) const;
+};
+
+// Records the time from construction to destruction into a histogram
+class ScopedTimer {
+    Histogram& histogram;
+    int64_t start_us;
+public:
+    explicit ScopedTimer(Histogram& histogram);
+    ~ScopedTimer();
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+};
+
+#endif // COMMON_METRICS_H
@@ -6,6 +6,7 @@
 #include <cstdio>
 #include <cstring>
 #include <string>
+#include <string_view>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <sys/random.h>
@@ -14,7 +15,11 @@
 using NodeID = std::array<uint8_t, 16>; // 16 bytes for Node ID
 typedef std::string NodeIDHex;
 
-NodeID generate_node_id();
+// Loads the persistent NodeID, creating it on first use. Each named
+// discovery domain keeps its own, in node_id.<domain>.
+NodeID generate_node_id(const std::string& domain = "");
 NodeIDHex node_id_to_hex(const NodeID& id);
+void node_id_to_hex(const NodeID& id, char* out); // out must hold 33 bytes
+bool node_id_from_hex(std::string_view hex, NodeID& id);
 
 #endif // COMMON_NODE_ID_H
\ No newline at end of file
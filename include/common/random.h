@@ -0,0 +1,26 @@
+#ifndef COMMON_RANDOM_H
+#define COMMON_RANDOM_H
+
+#include <cstdint>
+#include <random>
+
+// Random source for the discovery engine, injectable so simulations are
+// reproducible from a seed.
+class Random {
+public:
+    virtual ~Random() = default;
+    virtual uint64_t next() = 0;
+
+    // Uniform in [0, bound); the modulo bias is irrelevant for jitter
+    uint64_t below(uint64_t bound) { return bound ? next() % bound : 0; }
+};
+
+class SeededRandom final : public Random {
+    std::mt19937_64 generator;
+public:
+    explicit SeededRandom(uint64_t seed) : generator(seed) {}
+
+    uint64_t next() override { return generator(); }
+};
+
+#endif // COMMON_RANDOM_H
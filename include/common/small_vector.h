@@ -0,0 +1,116 @@
+#ifndef COMMON_SMALL_VECTOR_H
+#define COMMON_SMALL_VECTOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+
+// Vector for trivially copyable types that keeps the first N elements inline
+// and only goes to the heap once it outgrows them.
+template <typename T, size_t N>
+class SmallVector {
+    static_assert(std::is_trivially_copyable<T>::value, "SmallVector only holds trivially copyable types");
+
+    T* heap = nullptr;
+    uint32_t count = 0;
+    uint32_t capacity = N;
+    T inline_storage[N];
+
+    bool grow() {
+        uint32_t new_capacity = capacity * 2;
+        T* new_heap = static_cast<T*>(std::malloc(sizeof(T) * new_capacity));
+        if (!new_heap) return false;
+        std::memcpy(new_heap, data(), sizeof(T) * count);
+        std::free(heap);
+        heap = new_heap;
+        capacity = new_capacity;
+        return true;
+    }
+
+    void copy_from(const SmallVector& other) {
+        if (other.count > N) {
+            heap = static_cast<T*>(std::malloc(sizeof(T) * other.capacity));
+            if (!heap) return;
+            capacity = other.capacity;
+        }
+        std::memcpy(data(), other.data(), sizeof(T) * other.count);
+        count = other.count;
+    }
+
+    void move_from(SmallVector& other) {
+        if (other.heap) {
+            heap = other.heap;
+            capacity = other.capacity;
+            other.heap = nullptr;
+            other.capacity = N;
+        } else {
+            std::memcpy(inline_storage, other.inline_storage, sizeof(T) * other.count);
+        }
+        count = other.count;
+        other.count = 0;
+    }
+
+public:
+    SmallVector() = default;
+    SmallVector(const SmallVector& other) { copy_from(other); }
+    SmallVector(SmallVector&& other) noexcept { move_from(other); }
+    ~SmallVector() { std::free(heap); }
+
+    SmallVector& operator=(const SmallVector& other) {
+        if (this != &other) {
+            release();
+            copy_from(other);
+        }
+        return *this;
+    }
+
+    SmallVector& operator=(SmallVector&& other) noexcept {
+        if (this != &other) {
+            release();
+            move_from(other);
+        }
+        return *this;
+    }
+
+    T* data() { return heap ? heap : inline_storage; }
+    const T* data() const { return heap ? heap : inline_storage; }
+    T* begin() { return data(); }
+    T* end() { return data() + count; }
+    const T* begin() const { return data(); }
+    const T* end() const { return data() + count; }
+    T& operator[](size_t i) { return data()[i]; }
+    const T& operator[](size_t i) const { return data()[i]; }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    bool is_inline() const { return heap == nullptr; }
+    size_t heap_bytes() const { return heap ? sizeof(T) * capacity : 0; }
+    // Heap bytes held once one more element has been pushed
+    size_t heap_bytes_after_push() const { return count < capacity ? heap_bytes() : sizeof(T) * capacity * 2; }
+
+    bool push_back(const T& value) {
+        if (count == capacity && !grow()) return false;
+        data()[count++] = value;
+        return true;
+    }
+
+    void erase(T* pos) {
+        size_t index = pos - data();
+        std::memmove(data() + index, data() + index + 1, sizeof(T) * (count - index - 1));
+        --count;
+    }
+
+    void clear() { count = 0; }
+
+    // Drops the heap buffer (if any) and returns to inline storage.
+    void release() {
+        std::free(heap);
+        heap = nullptr;
+        capacity = N;
+        count = 0;
+    }
+};
+
+#endif // COMMON_SMALL_VECTOR_H
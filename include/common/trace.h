@@ -0,0 +1,69 @@
+#ifndef COMMON_TRACE_H
+#define COMMON_TRACE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+const size_t TRACE_RING_SIZE = 4096;  // events, power of two
+const size_t TRACE_MAX_PHASES = 8;    // phases remembered per loop iteration
+
+struct TraceEvent {
+    const char* name; // must be a string literal
+    int64_t start_us;
+    uint32_t duration_us;
+};
+
+// Time spent in each phase of the current event loop iteration, kept for
+// the stall detector whether or not tracing is enabled.
+struct LoopBreakdown {
+    const char* phases[TRACE_MAX_PHASES];
+    uint32_t durations_us[TRACE_MAX_PHASES];
+    size_t count = 0;
+
+    void clear() { count = 0; }
+    void add(const char* name, uint32_t duration_us) {
+        if (count < TRACE_MAX_PHASES) {
+            phases[count] = name;
+            durations_us[count] = duration_us;
+            ++count;
+        }
+    }
+    // Writes "name 1.234 ms, name 0.010 ms, ..." into out
+    void format(char* out, size_t size) const;
+};
+
+namespace trace {
+
+extern bool enabled;
+
+inline bool is_enabled() { return enabled; }
+void set_enabled(bool value);
+
+// Spans go into a fixed ring that overwrites the oldest events, so the
+// buffer always holds the most recent TRACE_RING_SIZE spans.
+void record(const char* name, int64_t start_us, int64_t end_us);
+// Chrome trace-event JSON, loadable in chrome://tracing or Perfetto
+std::string to_chrome_json();
+
+} // namespace trace
+
+// Times a scope. The span is recorded in the trace ring when tracing is
+// enabled and added to breakdown when one is given; with neither, it never
+// reads the clock.
+class TraceSpan {
+    const char* name;
+    LoopBreakdown* breakdown;
+    int64_t start_us;
+public:
+    explicit TraceSpan(const char* name, LoopBreakdown* breakdown = nullptr);
+    ~TraceSpan();
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+};
+
+#define GRAW_TRACE_CONCAT_(a, b) a##b
+#define GRAW_TRACE_CONCAT(a, b) GRAW_TRACE_CONCAT_(a, b)
+#define TRACE_SPAN(name) TraceSpan GRAW_TRACE_CONCAT(graw_trace_span_, __LINE__)(name)
+
+#endif // COMMON_TRACE_H
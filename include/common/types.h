@@ -2,6 +2,7 @@
 #define COMMON_TYPES_H
 
 #include <string>
+#include <string_view>
 #include <ifaddrs.h>
 #include <netinet/in.h>
 #include <net/if.h> 
@@ -13,8 +14,14 @@
 
 typedef std::string MAC_Address; 
 typedef std::string IP_Address;
+typedef std::array<uint8_t, 6> MAC_Bytes;
 
 #include "node_id.h"
+#include "small_vector.h"
+#include "hello_scan.h"
+
+const size_t MAX_CONNECTIONS_PER_NEIGHBOUR = 16;
+const uint16_t LOSS_WINDOW = 256; // hellos over which link loss is averaged
 
 struct NetworkInterface {
     std::string name;
@@ -26,35 +33,168 @@ struct NetworkInterface {
     bool is_ipv4;
     bool is_active;
 
+    // Binary copies for the packet path, network byte order
+    in_addr_t ipv4_address = 0;
+    in_addr_t ipv4_netmask = 0;
+    in_addr_t ipv4_broadcast = INADDR_BROADCAST;
+
+    bool contains(in_addr_t ip) const { return (ip & ipv4_netmask) == (ipv4_address & ipv4_netmask); }
+
     static NetworkInterface from_ifaddrs(struct ifaddrs* ifa);
 };
 
+// Appends the interfaces with an IPv4 address; loopback only if asked.
+// Returns -1 if getifaddrs fails.
+int list_network_interfaces(std::vector<NetworkInterface>& interfaces, bool include_loopback);
+
+// Health of one connection, measured from the neighbour's hellos. Kept to
+// 32 bytes since every table record holds some inline.
+struct LinkStats {
+    int64_t last_seen_ms = 0;
+    uint32_t hold_ms = 0;         // the connection expires hold_ms after last_seen_ms
+    uint32_t last_transit_us = 0; // arrival time minus the sender's timestamp, low 32 bits
+    uint32_t jitter_us = 0;       // RFC 3550 interarrival jitter
+    uint32_t rtt_us = 0;          // smoothed round trip time, 0 until measured
+    uint16_t last_sequence = 0;   // low bits of the last SEQ, enough for gaps within LOSS_WINDOW
+    uint16_t expected = 0;        // hellos expected in the current loss window, 0 before the first
+    uint16_t received = 0;
+    bool has_transit = false;     // last_transit_us is set, so jitter can be measured
+    bool via_digest = false;      // learned from a designated reporter's digest, not heard directly
+
+    int64_t deadline_ms() const { return last_seen_ms + hold_ms; }
+    double loss() const { return expected ? 1.0 - (double)received / expected : 0; }
+};
+
 struct NetworkConnection {
-    IP_Address ip;
-    MAC_Address mac_address;
+    in_addr_t ip;           // network byte order
+    MAC_Bytes mac_address;
+    uint16_t interface_id;  // index into the service's interface table
+    LinkStats link;
 };
 
+// Cold per-neighbour data. Liveness lives in the table's hot slots.
+// Connections past the first spill to the heap; the table adds them so it
+// can count those bytes against its memory budget.
 struct NetworkNeighbor {
-    std::vector<std::string> interface_names;
-    std::vector<NetworkConnection> connections;
-    int last_seen;
+    SmallVector<NetworkConnection, 1> connections;
+    uint32_t interval_ms = 0; // advertised hello interval, 0 for peers that do not advertise one
+
+    NetworkConnection* find_connection(const MAC_Bytes& mac_address);
+    bool has_interface(uint16_t interface_id) const;
 
-    void update_last_seen();
-    bool is_active() const;
-    void add_interface(const NetworkInterface& interface);
-    void add_connection(const NetworkConnection& connection);
+private:
+    friend class NeighbourTable;
+    // Returns the stored connection with the same MAC, updated to the new
+    // address and interface (which resets its link stats), or a newly added
+    // one. changed is set when the connection list changed. Returns nullptr
+    // when the neighbour already has the maximum number of connections.
+    NetworkConnection* add_connection(const NetworkConnection& connection, bool& changed);
 };
 
+// Parsed hello or probe. Views point into the receive buffer the package was parsed from.
 struct DiscoveryPackage {
-    std::string hello_message;
-    NodeIDHex sender_id;
-    IP_Address sender_ip;
-    MAC_Address sender_mac;
+    std::string_view interface_name;
+    NodeID sender_id;
+    MAC_Bytes sender_mac;
+    in_addr_t sender_ip;
+    uint32_t interval_ms = 0; // INT: field, 0 when absent
+    uint32_t hold_ms = 0;     // HOLD: field, 0 when absent
+    bool probe = false;       // PROBE asks for an immediate unicast hello back
+    bool has_sequence = false;
+    uint32_t sequence = 0;    // SEQ: per-interface broadcast hello counter
+    int64_t timestamp_us = -1; // TS: sender's monotonic clock at send time, -1 when absent
+    // ECHO:<node id>:<ts>:<delay> returns the TS of a hello from echo_id,
+    // with the time the sender held it before echoing
+    NodeID echo_id;
+    int64_t echo_timestamp_us = -1;
+    int64_t echo_delay_us = 0;
+
+    // The usual field layout is parsed in one vectorised pass; anything
+    // else goes through from_string_generic
+    static bool from_string(std::string_view data, DiscoveryPackage& pkg);
+    // Searches for each field on its own. Accepts exactly what from_string
+    // does, and is the reference the fast path is checked against.
+    static bool from_string_generic(std::string_view data, DiscoveryPackage& pkg);
+
+private:
+    friend struct DiscoveryDigest;
+    friend struct GossipMessage;
+    enum class Layout {
+        Parsed,
+        Invalid,
+        Unusual, // not the usual layout, left to the generic parser
+    };
+    static Layout parse_layout(std::string_view data, const HelloScan& scan, DiscoveryPackage& pkg);
+    static bool parse_optional(std::string_view data, size_t pos, const HelloScan* scan, DiscoveryPackage& pkg);
+    static std::string_view extract_field(std::string_view message, std::string_view field_name);
+    template <typename T>
+    static bool parse_number(std::string_view text, T& value);
+    static bool parse_echo(std::string_view text, DiscoveryPackage& pkg);
+};
+
+// One member listed in a designated reporter's digest:
+// <node id> <mac> <ip> <age ms> <hold ms>
+struct DigestEntry {
+    NodeID id;
+    MAC_Bytes mac;
+    in_addr_t ip;
+    uint32_t age_ms;  // since the reporter last heard the member
+    uint32_t hold_ms; // the member's hold time at the reporter
+};
+
+// Parsed member list: a header line, then one entry per line. Entries are
+// parsed one at a time with next(). Two kinds share the format:
+//   DIGEST from <interface> NodeID:<reporter> INT:<ms>
+//     a designated reporter's digest of its segment
+//   RELAY from <interface> NodeID:<relay> SNAP:<n> PART:<i> PARTS:<n> TTL:<ms>
+//     part i of snapshot n of a relay's neighbour table, sent upstream
+struct DiscoveryDigest {
+    NodeID reporter_id;
+    bool relay = false;
+    uint32_t interval_ms = 0; // time between the reporter's digests
+    uint32_t snapshot = 0;
+    uint32_t part = 0;
+    uint32_t parts = 0;
+    uint32_t ttl_ms = 0;      // how long the upstream keeps the entries
+    std::string_view entries; // entry lines not parsed yet
+
+    static bool is_digest(std::string_view data) { return data.substr(0, 7) == "DIGEST "; }
+    static bool is_relay(std::string_view data) { return data.substr(0, 6) == "RELAY "; }
+    static bool from_string(std::string_view data, DiscoveryDigest& digest);
+    // Returns false at the end of the digest or on a malformed line
+    bool next(DigestEntry& entry);
+};
+
+enum class GossipKind : uint8_t {
+    Tree,
+    Hashes,
+    Links,
+};
 
-    static DiscoveryPackage from_string(std::string& data);
+// Parsed topology anti-entropy datagram: a header line, then one entry per
+// line, parsed one at a time.
+//   GOSSIP TREE from <interface> NodeID:<sender> PREFIX:<hex digits, - for none>
+//     <hash> <count>, for each of the 16 subtrees under the prefix
+//   GOSSIP HASHES from <interface> NodeID:<sender> PREFIX:<p>[,<p>...] ASK:<0|1>
+//     <hash> of every link the sender has under the prefixes; ASK:1 wants
+//     the receiver's list back if it lacks some of them
+//   GOSSIP LINKS from <interface> NodeID:<sender>
+//     <origin><neighbour> <version> <1 alive, 0 tombstone>
+struct GossipMessage {
+    NodeID sender_id;
+    GossipKind kind = GossipKind::Tree;
+    bool ask = false;
+    std::string_view prefix;  // comma separated for HASHES
+    std::string_view entries; // entry lines not parsed yet
 
+    static bool is_gossip(std::string_view data) { return data.substr(0, 7) == "GOSSIP "; }
+    static bool from_string(std::string_view data, GossipMessage& message);
+    // All return false at the end of the message or on a malformed line
+    bool next_summary(uint64_t& hash, uint32_t& count);
+    bool next_hash(uint64_t& hash);
+    bool next_link(NodeID& origin, NodeID& neighbour, uint32_t& version, bool& alive);
 private:
-    static std::string extract_field(const std::string& message, const std::string& field_name);
+    std::string_view next_line();
 };
 
 #endif // COMMON_TYPES_H
\ No newline at end of file
@@ -0,0 +1,88 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "transport.h"
+
+enum class IoBackend : uint8_t {
+    Auto,   // io_uring when the kernel supports it, else epoll
+    Select,
+    Epoll,
+    Uring,
+};
+
+bool parse_io_backend(std::string_view text, IoBackend& backend);
+const char* io_backend_name(IoBackend backend);
+
+// Receives the connections accepted on a listening socket
+class AcceptHandler {
+public:
+    virtual ~AcceptHandler() = default;
+    virtual void on_accept(int client_fd) = 0;
+};
+
+// Told when a connected stream socket has data or the peer closed it, and
+// when it has room again if the handler asked for that. The handler reads
+// and writes the socket itself, until EAGAIN.
+class StreamHandler {
+public:
+    virtual ~StreamHandler() = default;
+    virtual void on_readable(int fd) = 0;
+    virtual void on_writable(int /*fd*/) {}
+};
+
+// Waits for socket activity and dispatches it. The select and epoll
+// backends are readiness based and read each socket when it becomes
+// readable; the io_uring backend keeps multishot receives and accepts
+// armed and queues sends until the next wait.
+class EventLoop {
+protected:
+    uint64_t syscall_count = 0;
+public:
+    virtual ~EventLoop() = default;
+
+    virtual IoBackend backend() const = 0;
+    // Datagrams arriving on fd go to sink, tagged with device (nullptr if
+    // the socket is not bound to one) and their kernel receive time
+    virtual int watch_datagrams(int fd, const std::string* device, DatagramSink& sink) = 0;
+    virtual int watch_listener(int fd, AcceptHandler& handler) = 0;
+    // Reports fd readable until set_stream_interest says otherwise
+    virtual int watch_stream(int fd, StreamHandler& handler) = 0;
+    // Chooses whether a watched stream reports readable, writable or both.
+    // Safe from inside a handler.
+    virtual int set_stream_interest(int fd, bool readable, bool writable) = 0;
+    // Stops reporting fd; call before closing it. Safe from inside a handler.
+    virtual void unwatch_stream(int fd) = 0;
+    // Returns the bytes sent or -1 with errno set. Queued sends report
+    // success; a later failure is logged when it completes.
+    virtual ssize_t send_to(int fd, const sockaddr_in& destination, std::string_view data) = 0;
+    // Waits up to timeout_ms for activity; returns the number of ready
+    // events, 0 on timeout or -1 with errno set
+    virtual int wait(int64_t timeout_ms) = 0;
+    // Handles everything the last wait() reported
+    virtual void dispatch() = 0;
+    // One descriptor that becomes readable when wait() has something to
+    // report, for nesting in another event loop; -1 if the backend has none
+    virtual int poll_fd() const { return -1; }
+
+    // System calls made for I/O so far
+    uint64_t syscalls() const { return syscall_count; }
+};
+
+// Creates the requested backend. io_uring falls back to epoll when the
+// kernel lacks it (Linux 6.3 or later is needed) or it is disabled.
+std::unique_ptr<EventLoop> make_event_loop(IoBackend backend);
+std::unique_ptr<EventLoop> make_uring_loop(); // nullptr when unavailable
+
+// Receive time on the monotonic clock from a SCM_TIMESTAMPNS control
+// message, or 0 when the datagram carries none
+int64_t kernel_rx_us(const msghdr& msg);
+
+#endif // EVENT_LOOP_H
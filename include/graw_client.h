@@ -0,0 +1,81 @@
+#ifndef GRAW_CLIENT_H
+#define GRAW_CLIENT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+
+const int GRAW_CLIENT_TIMEOUT_MS = 5000;
+const int GRAW_CLIENT_ATTEMPTS = 2;        // tries per request across reconnects
+
+// Answer to one submitted request. ok is false when the connection failed
+// and the request could not be retried; error then says why.
+struct GrawReply {
+    uint64_t id;
+    bool ok;
+    std::string body;
+    std::string error;
+};
+
+// Client for the service's CLI socket, for graw_cli and agents that query
+// the service often. One connection is kept open and reopened on demand;
+// requests are pipelined and their replies come back in order.
+//
+// Non-blocking use from the caller's event loop: submit() requests, wait
+// for fd() to become readable (and writable while wants_write()), call
+// on_readable() / on_writable(), then collect answers with next_reply().
+// request() does all of that in one blocking call.
+class GrawClient {
+    struct Request {
+        uint64_t id;
+        std::string command;
+        int attempts;
+    };
+
+    std::string socket_path;
+    int socket_fd = -1;
+    uint64_t next_id = 1;
+    std::deque<Request> waiting;   // queued or written, waiting for their replies, in order
+    std::string output;            // commands not written yet
+    size_t output_sent = 0;
+    std::string input;             // partial reply
+    std::deque<GrawReply> replies;
+    std::string error;
+
+    int connect_socket();
+    // Reconnects and resends what was waiting, failing the requests that
+    // are out of attempts (or all of them if the service is gone)
+    void connection_lost(const std::string& reason);
+    void fail(const Request& request, const std::string& reason);
+public:
+    explicit GrawClient(std::string socket_path);
+    ~GrawClient();
+    GrawClient(const GrawClient&) = delete;
+    GrawClient& operator=(const GrawClient&) = delete;
+
+    // Queues a command and connects if needed. Returns the request id. A
+    // command that is empty or contains a newline fails at once, unsent.
+    uint64_t submit(std::string_view command);
+    // Socket to watch, -1 while disconnected
+    int fd() const { return socket_fd; }
+    bool wants_write() const { return socket_fd >= 0 && output_sent < output.size(); }
+    // Reads and writes what the socket allows; both return -1 when the
+    // connection was lost
+    int on_readable();
+    int on_writable();
+    // Takes the oldest finished reply; false if there is none
+    bool next_reply(GrawReply& reply);
+    size_t pending() const { return waiting.size(); }
+    // Closes the connection and drops waiting requests
+    void disconnect();
+    const std::string& last_error() const { return error; }
+
+    // Sends command and waits up to timeout_ms for the reply
+    bool request(std::string_view command, std::string& reply, int timeout_ms = GRAW_CLIENT_TIMEOUT_MS);
+    // Whether the service answers a PING
+    bool ping(int timeout_ms = GRAW_CLIENT_TIMEOUT_MS);
+};
+
+#endif // GRAW_CLIENT_H
@@ -0,0 +1,138 @@
+#ifndef GRAW_DISCOVERY_H
+#define GRAW_DISCOVERY_H
+
+/* Neighbour discovery for embedding in another program's event loop, as
+ * build/libgraw_discovery.a or build/libgraw_discovery.so. The same engine
+ * as graw_service, on the host's own sockets; nothing is shared with a
+ * running service except the NodeID files.
+ *
+ * Watch graw_discovery_fd() for readability and call
+ * graw_discovery_process() when it is readable or graw_discovery_timeout_ms()
+ * has passed. Nothing blocks and no threads are started. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__GNUC__)
+#define GRAW_API __attribute__((visibility("default")))
+#else
+#define GRAW_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GRAW_DISCOVERY_DEFAULT_PORT 50000
+
+/* Neighbour table events; the same ones the service journals */
+enum graw_event {
+    GRAW_EVENT_ADDED = 1,   /* first hello, or first digest listing */
+    GRAW_EVENT_REMOVED,     /* expired after its hold time and probe */
+    GRAW_EVENT_EVICTED,     /* pushed out of a full table; only id is set */
+    GRAW_EVENT_LINK_UP,     /* heard on another address or interface as well */
+    GRAW_EVENT_LINK_DOWN,   /* one of several links stopped hearing hellos */
+    GRAW_EVENT_LINK_MOVED,  /* same MAC on a new address or interface */
+};
+
+/* One link to a neighbour; a neighbour heard on several addresses or
+ * interfaces has one per link, all with the same id. Filled from the table
+ * for the duration of one callback and not valid after it returns. */
+typedef struct graw_neighbour {
+    uint8_t id[16];
+    uint32_t ip;              /* network byte order */
+    uint8_t mac[6];
+    const char* interface;
+    int64_t last_seen_ms;     /* CLOCK_MONOTONIC */
+    uint32_t hold_ms;         /* the link expires hold_ms after last_seen_ms */
+    uint32_t rtt_us;          /* smoothed round trip time, 0 until measured */
+    uint32_t jitter_us;
+    double loss;              /* 0 to 1 over the last 256 hellos */
+} graw_neighbour;
+
+/* Return nonzero to stop the iteration */
+typedef int (*graw_neighbour_fn)(const graw_neighbour* neighbour, void* user);
+typedef void (*graw_event_fn)(int event, const graw_neighbour* neighbour, void* user);
+
+typedef struct graw_discovery_options {
+    int port;                 /* UDP port hellos use */
+    const char* interfaces;   /* comma separated names; NULL or "" for every interface but loopback */
+    const char* domain;       /* NodeID file name as for --domain; NULL shares the service's NodeID */
+    size_t max_neighbours;
+    int64_t interval_ms;      /* between hellos */
+    uint32_t multiplier;      /* intervals without a hello before a neighbour is down */
+    const char* log_level;    /* debug, info, warn, error or off; info and debug go to stdout */
+    graw_event_fn on_event;   /* called from graw_discovery_process(), may be NULL */
+    void* user;               /* passed to on_event */
+} graw_discovery_options;
+
+typedef struct graw_discovery graw_discovery;
+
+/* Fills options with the defaults graw_service runs with, logging warnings only */
+GRAW_API void graw_discovery_options_init(graw_discovery_options* options);
+/* Binds the port on the interfaces and sends the first hellos. Returns
+ * NULL on failure, with the reason in error if it is not NULL. */
+GRAW_API graw_discovery* graw_discovery_open(const graw_discovery_options* options, char* error, size_t error_size);
+GRAW_API void graw_discovery_close(graw_discovery* discovery);
+
+/* Becomes readable when hellos are waiting */
+GRAW_API int graw_discovery_fd(const graw_discovery* discovery);
+/* Milliseconds until graw_discovery_process() has timed work, 0 if now */
+GRAW_API int graw_discovery_timeout_ms(const graw_discovery* discovery);
+/* Reads waiting hellos, sends due ones and expires silent neighbours.
+ * Returns -1 with errno set if waiting on the sockets failed. */
+GRAW_API int graw_discovery_process(graw_discovery* discovery);
+
+GRAW_API size_t graw_discovery_size(const graw_discovery* discovery);
+/* Moves on every change of the table, so a poller can tell nothing changed */
+GRAW_API uint32_t graw_discovery_sequence(const graw_discovery* discovery);
+GRAW_API void graw_discovery_node_id(const graw_discovery* discovery, uint8_t id[16]);
+/* Calls fn for every link of every neighbour, straight from the table.
+ * Returns what fn returned if it stopped early, else 0. */
+GRAW_API int graw_discovery_for_each(const graw_discovery* discovery, graw_neighbour_fn fn, void* user);
+
+#ifdef __cplusplus
+}
+
+#include <memory>
+#include <string>
+#include <type_traits>
+
+// C++ view of the same library. fn in for_each takes a const
+// graw_neighbour& and returns false to stop.
+class GRAW_API GrawDiscovery {
+    struct Engine;
+    std::unique_ptr<Engine> engine;
+    std::string error;
+public:
+    GrawDiscovery();
+    ~GrawDiscovery();
+    GrawDiscovery(const GrawDiscovery&) = delete;
+    GrawDiscovery& operator=(const GrawDiscovery&) = delete;
+
+    // Returns -1 on failure; last_error() says why
+    int open(const graw_discovery_options& options);
+    void close();
+    bool is_open() const { return engine != nullptr; }
+
+    int fd() const;
+    int timeout_ms() const;
+    int process();
+
+    size_t size() const;
+    uint32_t sequence() const;
+    const uint8_t* node_id() const;
+    int for_each_link(graw_neighbour_fn fn, void* user) const;
+    template <typename Fn>
+    void for_each(Fn&& fn) const {
+        using Callable = std::remove_reference_t<Fn>;
+        for_each_link([](const graw_neighbour* neighbour, void* user) {
+            return (*static_cast<Callable*>(user))(*neighbour) ? 0 : 1;
+        }, const_cast<void*>(static_cast<const void*>(&fn)));
+    }
+    const std::string& last_error() const { return error; }
+};
+
+#endif // __cplusplus
+
+#endif // GRAW_DISCOVERY_H
@@ -0,0 +1,45 @@
+#ifndef HELLO_RECORDER_H
+#define HELLO_RECORDER_H
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <netinet/in.h>
+
+#include "common/types.h"
+#include "common/node_id.h"
+
+struct RecordedHello {
+    int64_t time_ms;
+    in_addr_t sender_ip;
+    std::string device; // empty when the receiving socket was not bound to one
+    std::string data;
+};
+
+struct HelloTrace {
+    NodeID node_id{}; // the recording node, so replay can ignore its own hellos
+    std::vector<NetworkInterface> interfaces;
+    std::vector<RecordedHello> hellos;
+};
+
+// Appends every received datagram to a text file that graw_sim can replay.
+// The header names the recording node and lists its interfaces; each record is one line of
+// "time_ms<TAB>sender_ip<TAB>device<TAB>payload", with the payload escaped.
+class HelloRecorder {
+    FILE* file = nullptr;
+public:
+    HelloRecorder() = default;
+    ~HelloRecorder();
+    HelloRecorder(const HelloRecorder&) = delete;
+    HelloRecorder& operator=(const HelloRecorder&) = delete;
+
+    int open(const std::string& path, const char* node_id_hex, const std::vector<NetworkInterface>& interfaces);
+    bool is_open() const { return file != nullptr; }
+    void record(int64_t time_ms, in_addr_t sender_ip, const std::string* device, std::string_view data);
+    void flush();
+};
+
+int load_hello_trace(const std::string& path, HelloTrace& trace);
+
+#endif // HELLO_RECORDER_H
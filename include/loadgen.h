@@ -0,0 +1,69 @@
+#ifndef LOADGEN_H
+#define LOADGEN_H
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "common/types.h"
+#include "common/helper.h"
+#include "common/node_id.h"
+#include "neighbour_table.h"
+
+struct LoadgenConfig {
+    std::string target = "127.0.0.1";          // where hellos are sent
+    int port = 50000;
+    std::string source_base = "127.1.0.1";     // node i sends from source_base + i
+    std::string interface_name = "lo";         // interface name advertised in hellos
+    std::string cli_socket = "/tmp/graw_service.sock";
+    size_t nodes = 1000;
+    double hello_interval = 5.0;               // seconds between hellos of one node
+    double churn_rate = 0;                     // join/leave/IP change events per second
+    double duration = 60;                      // seconds of traffic
+    double linger = 0;                         // seconds to keep polling LIST after traffic stops
+    double list_interval = 0.5;                // seconds between LIST polls
+    int expected_timeout = NEIGHBOUR_TIMEOUT_SECONDS;
+    uint64_t seed = 1;
+};
+
+struct VirtualNode {
+    NodeID id;
+    MAC_Bytes mac;
+    in_addr_t ip;
+    std::string hello;
+    bool active = false;
+    bool listed = false;          // present in the last LIST reply
+    bool awaiting_discovery = false;
+    bool awaiting_expiry = false;
+    bool awaiting_ip_change = false;
+    int64_t next_hello_us = 0;
+    int64_t joined_us = 0;        // first hello of the current session, 0 until sent
+    int64_t last_hello_us = 0;
+    int64_t ip_changed_us = 0;
+};
+
+struct LoadgenStats {
+    uint64_t hellos_sent = 0;
+    uint64_t send_errors = 0;
+    uint64_t joins = 0;
+    uint64_t leaves = 0;
+    uint64_t ip_changes = 0;
+    uint64_t list_failures = 0;
+    std::vector<int64_t> discovery_us;     // first hello to first LIST containing the node
+    std::vector<int64_t> ip_change_us;     // IP change to first LIST showing the new IP
+    std::vector<int64_t> expiry_error_us;  // removal time minus last hello minus the timeout
+    std::vector<int64_t> list_us;          // LIST request round trip
+    size_t max_list_bytes = 0;
+    size_t max_listed = 0;
+};
+
+void print_usage(const char* program);
+int parse_arguments(int argc, char* argv[], LoadgenConfig& config);
+int main(int argc, char* argv[]);
+
+#endif // LOADGEN_H
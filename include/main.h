@@ -8,6 +8,7 @@
 #include <sys/un.h>
 #include <sys/select.h>
 #include <fcntl.h>
+#include <strings.h>
 #include <string>
 #include <iostream>
 #include <vector>
@@ -15,7 +16,9 @@
 #include "common/types.h"
 #include "common/helper.h"
 #include "common/node_id.h"
+#include "common/logger.h"
 #include "service.h"
+#include "readiness.h"
 
 using namespace std;
 
@@ -23,7 +26,6 @@ const int DISCOVERY_PORT = 50000;
 const char* PID_FILE = "/tmp/graw_service.pid";
 const char* CLI_SOCKET_PATH = "/tmp/graw_service.sock";
 int cli_socket_fd = -1;
-bool quiet_mode = true;
 bool running = true;
 
 vector<NetworkInterface> network_interfaces;
@@ -31,6 +33,8 @@ vector<NetworkInterface> network_interfaces;
 void write_pid_file();
 void cleanup_pid_file();
 vector<NetworkInterface> get_network_interfaces();
-int main();
+void print_usage(const char* program);
+int parse_arguments(int argc, char* argv[], DiscoveryConfig& config, ServiceConfig& service_config);
+int main(int argc, char* argv[]);
 
 #endif // MAIN_H
\ No newline at end of file
@@ -0,0 +1,58 @@
+#ifndef NEIGHBOUR_CACHE_H
+#define NEIGHBOUR_CACHE_H
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <netinet/in.h>
+
+#include "common/types.h"
+#include "event_loop.h"
+
+const size_t NEIGHBOUR_CACHE_BUFFER = 32 * 1024;
+const int NEIGHBOUR_CACHE_RCVBUF = 1024 * 1024;  // bursts of ARP changes on a busy segment
+
+enum class KernelNeighbourState : uint8_t {
+    Known,    // has a link-layer address: reachable, stale, delay, probe or permanent
+    Failed,   // address resolution failed
+    Deleted,  // dropped from the cache
+};
+
+// One IPv4 entry of the kernel's neighbour (ARP) cache. device points
+// into the monitor and is only valid during the callback.
+struct KernelNeighbour {
+    const std::string* device;
+    in_addr_t ip;
+    MAC_Bytes mac;  // zero unless Known
+    KernelNeighbourState state;
+};
+
+// Follows the kernel's IPv4 neighbour cache on an rtnetlink socket
+// (RTM_NEWNEIGH / RTM_DELNEIGH). open() also asks for a dump of the
+// current cache, so the handler first sees every entry already there.
+// If the socket overflows, events are lost and the cache is dumped again.
+class NeighbourCacheMonitor : public StreamHandler {
+public:
+    using Handler = std::function<void(const KernelNeighbour&)>;
+private:
+    int socket_fd = -1;
+    uint32_t dump_sequence = 0;
+    Handler handler;
+    std::unordered_map<int, std::string> devices;  // ifindex -> name
+
+    int request_dump();
+    const std::string* device_name(int ifindex);
+    void handle_message(const struct nlmsghdr* header);
+public:
+    NeighbourCacheMonitor() = default;
+    ~NeighbourCacheMonitor() override;
+    NeighbourCacheMonitor(const NeighbourCacheMonitor&) = delete;
+    NeighbourCacheMonitor& operator=(const NeighbourCacheMonitor&) = delete;
+
+    int open(Handler handler);
+    bool is_open() const { return socket_fd >= 0; }
+    int attach(EventLoop& loop) { return loop.watch_stream(socket_fd, *this); }
+    void on_readable(int fd) override;
+};
+
+#endif // NEIGHBOUR_CACHE_H
@@ -1,9 +1,10 @@
 #ifndef DISCOVERY_H
 #define DISCOVERY_H
 
+#include <functional>
+#include <map>
 #include <unordered_map>
 #include <ifaddrs.h>
-#include <unordered_map>
 #include <fcntl.h>
 #include <sys/socket.h>
 #include <sys/un.h>
@@ -14,33 +15,347 @@
 #include "common/types.h"
 #include "common/helper.h"
 #include "common/node_id.h"
+#include "common/logger.h"
+#include "common/metrics.h"
+#include "common/trace.h"
+#include "common/clock.h"
+#include "common/random.h"
+#include "neighbour_table.h"
+#include "admission_control.h"
+#include "packet_filter.h"
+#include "transport.h"
+#include "hello_recorder.h"
+#include "neighbour_journal.h"
+#include "neighbour_cache.h"
+#include "relay_cache.h"
+#include "topology.h"
+
+const int64_t BROADCAST_INTERVAL_MS = 6000;
+const uint32_t DEFAULT_HOLD_MULTIPLIER = 5;
+const int64_t FAST_INTERVAL_MS = 100;
+const uint32_t FAST_HOLD_MULTIPLIER = 3;
+const int64_t MIN_INTERVAL_MS = 10;
+const int64_t MIN_HOLD_MS = 30;                 // floor for advertised hold times
+const int64_t MAX_HOLD_MS = 3600 * 1000;
+const int64_t MAX_PROBE_WAIT_MS = 1000;
+const size_t ECHO_QUEUE_SIZE = 16;              // hellos waiting to be echoed, per interface
+const size_t MAX_MESSAGE_SIZE = 512;
+const int64_t DIGEST_INTERVAL_MS = 3 * BROADCAST_INTERVAL_MS;
+const size_t MAX_DIGEST_SIZE = MAX_DATAGRAM_SIZE;
+const uint32_t DIGEST_SLACK_INTERVALS = 2;      // digests a learned member survives missing
+const int64_t RELAY_INTERVAL_MS = 5000;
+const int64_t RELAY_REFRESH_MS = 60000;
+const uint32_t RELAY_TTL_REFRESHES = 3;         // refreshes an upstream keeps entries through
+const size_t RELAY_PARTS_PER_TICK = 10;         // stays under the upstream's per-source admission rate
+const int64_t RELAY_PACING_MS = 1000;
+const int64_t GOSSIP_INTERVAL_MS = 2000;
+const size_t GOSSIP_FANOUT = 2;
+const size_t GOSSIP_LEAF_LINKS = 64;            // subtrees this small are compared link by link
+const size_t GOSSIP_MAX_REPLIES = 8;            // datagrams sent in answer to one gossip datagram
+const uint32_t GOSSIP_ORPHAN_INTERVALS = 10;    // rounds before the links of a node nobody hears are dropped
+const uint32_t GOSSIP_TOMBSTONE_INTERVALS = 30; // rounds a removed link is remembered
+const int64_t PASSIVE_INTERVAL_MS = 60000;
+const size_t KERNEL_NEIGHBOURS_SIZE = 4096;     // kernel cache entries remembered over all passive interfaces
+const int64_t KERNEL_CHECK_INTERVAL_MS = 100;   // kernel events are checked against the table in batches this far apart
+
+// Hello timing of one interface. Hellos go out every 75-100% of interval_ms
+// and a neighbour is declared down after multiplier intervals without one.
+struct LivenessConfig {
+    int64_t interval_ms = BROADCAST_INTERVAL_MS;
+    uint32_t multiplier = DEFAULT_HOLD_MULTIPLIER;
+
+    int64_t hold_ms() const { return interval_ms * multiplier; }
+};
+
+// Designated reporter mode of one interface. The two lowest NodeIDs on the
+// segment (reporter and backup) broadcast their hellos; every other node
+// sends its hellos unicast to those two, and the reporter broadcasts a
+// digest of the members it hears every digest_interval_ms.
+struct AggregationConfig {
+    int64_t digest_interval_ms = DIGEST_INTERVAL_MS;
+};
+
+// Passive mode of one interface, fed from the kernel's neighbour cache.
+// Addresses that appear in the cache are probed by unicast straight away,
+// so periodic broadcasts go out only every interval_ms. Failed entries
+// and MACs that disagree with a known link bring that link's probe forward.
+struct PassiveConfig {
+    int64_t interval_ms = PASSIVE_INTERVAL_MS;
+};
+
+// A kernel cache change waiting to be compared with the table's links
+struct KernelCheck {
+    MAC_Bytes mac;
+    bool resolved; // mac is set; false when resolution failed
+    bool known;    // a link with this MAC was found
+};
+
+// Forwarding of the neighbour table to discovery services on other subnets.
+// A snapshot goes to every upstream each interval_ms if the table changed,
+// and at least every refresh_ms. With accept set, snapshots from downstream
+// relays are cached and listed by the RELAYED command.
+struct RelayConfig {
+    std::vector<in_addr_t> upstreams;
+    int64_t interval_ms = RELAY_INTERVAL_MS;
+    int64_t refresh_ms = RELAY_REFRESH_MS;
+    bool accept = false;
+    size_t cache_size = RELAY_CACHE_SIZE;
+};
+
+// Gossip of the segment topology. Every interval_ms each node folds its
+// own links into its replica and compares replicas with fanout random
+// direct neighbours; the TOPOLOGY command lists the result.
+struct GossipConfig {
+    bool enabled = false;
+    int64_t interval_ms = GOSSIP_INTERVAL_MS;
+    size_t fanout = GOSSIP_FANOUT;
+    size_t max_links = TOPOLOGY_MAX_LINKS;
+};
+
+// Filled at run time from options, so it is not a DiscoveryPolicy parameter
+struct DiscoveryConfig {
+    size_t max_neighbours = 4096;
+    size_t memory_budget = 1024 * 1024; // bytes of neighbour table storage
+    EvictionPolicy eviction_policy = EvictionPolicy::PreferUnconfirmed;
+    AdmissionConfig admission;
+    std::string record_trace_path; // append every received datagram here for replay in graw_sim
+    JournalConfig journal;         // binary journal of neighbour events, for the HISTORY command
+    LivenessConfig liveness;
+    std::map<std::string, LivenessConfig> interface_liveness; // per interface name, e.g. fast mode
+    std::map<std::string, AggregationConfig> interface_aggregation; // interfaces in designated reporter mode
+    std::map<std::string, PassiveConfig> interface_passive; // interfaces following the kernel neighbour cache
+    RelayConfig relay;
+    GossipConfig gossip;
+    // Called on every neighbour table event the journal records, with the
+    // link it concerns (nullptr for evictions); for embedding applications
+    std::function<void(JournalEvent, const NodeID&, const NetworkConnection*)> on_event;
+};
+
+// Per-interface traffic counters. Interfaces sharing a device name share
+// the same counters.
+struct InterfaceMetrics {
+    Counter* rx_packets;
+    Counter* rx_bytes;
+    Counter* tx_packets;
+    Counter* tx_bytes;
+    Counter* tx_errors;
+};
+
+struct DiscoveryMetrics {
+    std::vector<InterfaceMetrics> interfaces; // indexed by interface id
+    Counter* recv_errors;
+    Counter* unmatched_drops;
+    Counter* parse_failures;
+    Counter* admission_drops_source;
+    Counter* admission_drops_node;
+    Counter* admission_drops_global;
+    Counter* neighbours_added;
+    Counter* neighbours_expired;
+    Counter* neighbours_evicted;
+    Counter* neighbours_recovered;
+    Counter* links_refused;
+    Counter* probes_sent;
+    Counter* probes_answered;
+    Counter* digests_sent;
+    Counter* digests_received;
+    Counter* relay_parts_sent;
+    Counter* relay_parts_received;
+    Counter* relayed_dropped;
+    Counter* gossip_sent;
+    Counter* gossip_received;
+    Counter* journal_dropped;
+    Counter* kernel_events;
+    Counter* kernel_probes;
+    Counter* kernel_mac_mismatches;
+    Gauge* neighbours;
+    Gauge* relayed_neighbours;
+    Gauge* topology_nodes;
+    Gauge* topology_links;
+    Gauge* table_bytes;
+    Histogram* packet_time;
+    Histogram* broadcast_time;
+    Histogram* cleanup_time;
+};
+
+// A received timestamp to return in one of our next hellos, for the
+// sender to measure the round trip time
+struct PendingEcho {
+    NodeID id;
+    int64_t timestamp_us; // sender's TS
+    int64_t arrival_us;   // our receive time
+};
+
+enum class SegmentRole : uint8_t {
+    Reporter, // lowest NodeID: broadcasts hellos and digests
+    Backup,   // second lowest: broadcasts hellos, takes over when the reporter goes
+    Member,   // sends hellos unicast to the reporter and backup
+};
+
+// Where an aggregated interface stands in the last election
+struct SegmentState {
+    bool aggregated = false;
+    SegmentRole role = SegmentRole::Reporter;
+    NodeID reporter{};
+    in_addr_t reporter_ip = 0;  // unicast hello targets while a member
+    in_addr_t backup_ip = 0;    // 0 when there is no backup yet
+    int64_t digest_interval_ms = 0;
+    int64_t next_digest_ms = INT64_MAX;
+};
+
+struct EchoQueue {
+    PendingEcho entries[ECHO_QUEUE_SIZE];
+    size_t head = 0;
+    size_t count = 0;
+
+    // Replaces a pending echo for the same sender; drops the echo when full
+    void push(const PendingEcho& echo);
+    bool pop(PendingEcho& echo);
+};
+
+// Formats the fixed part of the hello (or, with magic "PROBE", the probe)
+// advertised on interface into out, reusing its capacity. Timestamps,
+// sequence numbers and echoes are appended per message.
+void build_hello_message(std::string& out, const NetworkInterface& interface, const char* node_id_hex,
+                         const LivenessConfig& liveness, const char* magic = "HELLO");
+
+// The clock, random source and transport an engine is built over. The
+// engine calls them through these exact types, so naming final classes
+// makes those calls direct. Datagrams still arrive through the virtual
+// DatagramSink::on_datagram, and UdpTransport sends through the virtual
+// EventLoop::send_to once attached.
+template <typename ClockT, typename RandomT, typename TransportT>
+struct DiscoveryPolicy {
+    using Clock = ClockT;
+    using Random = RandomT;
+    using Transport = TransportT;
+};
+
+// graw_service: real time and sockets
+using SystemDiscoveryPolicy = DiscoveryPolicy<SystemClock, SeededRandom, UdpTransport>;
+// Any implementation of the interfaces, for graw_sim and trace replay
+using DynamicDiscoveryPolicy = DiscoveryPolicy<Clock, Random, DiscoveryTransport>;
+
+// The discovery engine. Time, randomness and the network all come in from
+// outside, so the same code runs against real sockets in graw_service and
+// against virtual time in graw_sim. Instantiated for the policies above in
+// neighbour_discovery.cpp.
+template <typename Policy>
+class BasicNeighbourDiscovery : public DatagramSink {
+    using ClockType = typename Policy::Clock;
+    using RandomType = typename Policy::Random;
+    using TransportType = typename Policy::Transport;
 
-class NeighbourDiscovery {
     NodeID node_id;
     int discovery_port;
     const std::vector<NetworkInterface>& interfaces;
-    std::unordered_map<NodeIDHex, NetworkNeighbor> neighbors;
-    int socket_fd = -1;
-    bool quiet_mode;
-
-    void handle_discovery_packet(int socket_fd);
-    int bind_to_interface(const NetworkInterface& interface);
-    int bind_all_interfaces();
-    void cleanup_bound_sockets();
-    bool neighbor_exists(const NodeIDHex& id) const;
-    NetworkNeighbor* get_neighbor(const NodeIDHex& id);
-    void add_or_update_neighbor(const NodeIDHex& id, const NetworkInterface& interface, const NetworkConnection& connection);
+    ClockType& clock;
+    RandomType& random;
+    TransportType& transport;
+    NeighbourTable neighbors;
+    char node_id_hex[33];
+    uint64_t reported_evictions = 0;
+    AdmissionControl admission;
+    uint64_t reported_drops = 0;
+    DiscoveryMetrics metrics;
+    std::vector<LivenessConfig> liveness;     // per interface id
+    std::vector<int64_t> next_broadcast_ms;   // per interface id
+    int64_t next_hello_ms = INT64_MAX;        // earliest of next_broadcast_ms
+    int64_t next_expiry_ms = INT64_MAX;       // no neighbour expires before this
+    std::vector<std::string> hello_messages;  // per interface id, fixed part formatted once
+    std::vector<std::string> probe_messages;  // per interface id, fixed part formatted once
+    std::vector<uint32_t> hello_sequence;     // per interface id, SEQ of the next broadcast
+    std::vector<EchoQueue> echoes;            // per interface id
+    std::vector<SegmentState> segments;       // per interface id
+    std::vector<bool> passive;                // per interface id
+    std::unordered_map<uint64_t, MAC_Bytes> kernel_neighbours; // interface id << 32 | IP -> MAC the kernel knows
+    std::unordered_map<uint64_t, KernelCheck> kernel_checks;   // same keys, events waiting for the next batch
+    int64_t last_kernel_check_ms = 0;
+    int64_t next_kernel_check_ms = INT64_MAX;
+    HelloRecorder recorder;
+    NeighbourJournal journal;
+    std::function<void(JournalEvent, const NodeID&, const NetworkConnection*)> on_event;
+    RelayConfig relay;
+    std::vector<uint16_t> upstream_interfaces; // per upstream, the interface sends go out of
+    std::vector<std::string> relay_parts;      // entry lines of the snapshot being sent
+    size_t relay_next_part = 0;
+    uint32_t relay_snapshot = 0;
+    uint32_t relayed_sequence = 0;             // table sequence the last snapshot was taken at
+    int64_t last_snapshot_ms = 0;
+    int64_t next_relay_ms = INT64_MAX;
+    RelayCache relay_cache;
+    GossipConfig gossip;
+    Topology topology;
+    int64_t next_gossip_ms = INT64_MAX;
+
+    void register_metrics(MetricsRegistry& registry);
+    bool neighbor_exists(const NodeID& id) const;
+    NetworkNeighbor* get_neighbor(const NodeID& id);
+    NetworkConnection* add_or_update_neighbor(const NodeID& id, const NetworkConnection& connection, int64_t hold_ms,
+                                              uint32_t interval_ms);
+    void update_link(NetworkConnection& connection, const DiscoveryPackage& pkg, int64_t hold_ms, int64_t arrival_us);
+    void neighbour_event(JournalEvent event, const NodeID& id, const NetworkConnection* connection);
+    bool expire_links(const NeighbourSlot& slot, NetworkNeighbor& neighbor, int64_t now);
+    void check_kernel_links(int64_t now);
+    void queue_kernel_check(uint64_t key, const MAC_Bytes* mac);
+    std::string_view format_message(char* buffer, const std::string& fixed, const uint32_t* sequence,
+                                    const PendingEcho* echo);
+    int64_t hello_gap(size_t interface_id);
+    bool send_hello(size_t interface_id, in_addr_t destination, const uint32_t* sequence, const PendingEcho* echo);
+    void send_periodic_hello(size_t interface_id, const PendingEcho* echo);
+    bool probe(const NetworkNeighbor& neighbor);
+    void elect_reporter(size_t interface_id);
+    void send_digest(size_t interface_id);
+    void handle_digest(std::string_view data, in_addr_t sender_ip, uint16_t interface_id);
+    void learn_member(const DigestEntry& entry, uint16_t interface_id, int64_t last_seen_ms, int64_t hold_ms);
+    void take_relay_snapshot(int64_t now);
+    void send_relay_parts(int64_t now);
+    void handle_relay(std::string_view data, in_addr_t sender_ip);
+    void gossip_round(int64_t now);
+    bool send_gossip(uint16_t interface_id, in_addr_t destination, std::string_view message);
+    bool send_tree(uint16_t interface_id, in_addr_t destination, std::string_view prefix);
+    size_t send_hashes(uint16_t interface_id, in_addr_t destination, const std::vector<std::string>& prefixes,
+                       bool ask, size_t limit);
+    size_t send_links(uint16_t interface_id, in_addr_t destination,
+                      const std::vector<std::pair<LinkKey, LinkState>>& links, size_t limit);
+    void handle_gossip(std::string_view data, in_addr_t sender_ip, uint16_t interface_id);
 public:
-    NeighbourDiscovery(const std::vector<NetworkInterface>& interfaces, int discovery_port, NodeID node_id, bool quiet_mode);
-    ~NeighbourDiscovery();
+    BasicNeighbourDiscovery(const std::vector<NetworkInterface>& interfaces, int discovery_port, NodeID node_id,
+                            MetricsRegistry& registry, ClockType& clock, RandomType& random, TransportType& transport,
+                            const DiscoveryConfig& config = DiscoveryConfig());
+    ~BasicNeighbourDiscovery() override;
 
-    void handle_activity(const fd_set& read_fds);
+    // Receives hellos through loop from now on
+    void attach(EventLoop& loop);
+    // Broadcasts on interfaces whose interval is up, probes neighbours whose
+    // hold time has passed and expires those that did not answer
     void update();
+    // Clock time at which update() next has work to do
+    int64_t next_deadline() const { return std::min(next_hello_ms, next_expiry_ms); }
     void cleanup_inactive_neighbors();
+    // Refreshes gauges and counters mirrored from the table and admission control
+    void update_metrics();
     void broadcast_hello();
-    void listen_for_hello(std::string& hello_message, IP_Address sender_ip, const NetworkInterface& interface);
-    const std::unordered_map<NodeIDHex, NetworkNeighbor>& get_neighbours() const;
-    int get_socket_fd() const { return socket_fd; }
+    void process_datagram(std::string_view data, in_addr_t sender_ip, const std::string* device = nullptr,
+                          int64_t rx_us = 0);
+    void on_datagram(std::string_view data, in_addr_t sender_ip, const std::string* device, int64_t rx_us) override;
+    void on_receive_error(int error) override;
+    void listen_for_hello(std::string_view hello_message, in_addr_t sender_ip, uint16_t interface_id, int64_t rx_us);
+    // An entry of the kernel neighbour cache changed; only passive
+    // interfaces act on it
+    void on_kernel_neighbour(const KernelNeighbour& entry);
+    const NeighbourTable& get_neighbours() const;
+    const AdmissionStats& get_admission_stats() const { return admission.stats(); }
+    const DiscoveryMetrics& get_metrics() const { return metrics; }
+    const SegmentState& get_segment(size_t interface_id) const { return segments[interface_id]; }
+    const RelayCache& get_relay_cache() const { return relay_cache; }
+    const Topology& get_topology() const { return topology; }
+    const NeighbourJournal& get_journal() const { return journal; }
 };
 
+extern template class BasicNeighbourDiscovery<SystemDiscoveryPolicy>;
+extern template class BasicNeighbourDiscovery<DynamicDiscoveryPolicy>;
+
+using NeighbourDiscovery = BasicNeighbourDiscovery<SystemDiscoveryPolicy>;
+using DynamicNeighbourDiscovery = BasicNeighbourDiscovery<DynamicDiscoveryPolicy>;
+
 #endif // DISCOVERY_H
\ No newline at end of file
@@ -0,0 +1,131 @@
+#ifndef NEIGHBOUR_JOURNAL_H
+#define NEIGHBOUR_JOURNAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+
+#include "common/types.h"
+#include "common/node_id.h"
+
+const size_t JOURNAL_SEGMENT_BYTES = 4 * 1024 * 1024;
+const size_t JOURNAL_MIN_SEGMENT_BYTES = 64 * 1024;
+const size_t JOURNAL_SEGMENTS = 8;             // segments kept, the one being written included
+const size_t JOURNAL_HEADER_BYTES = 4096;
+const size_t JOURNAL_BLOOM_BYTES = JOURNAL_HEADER_BYTES - 64;
+const uint32_t JOURNAL_BLOOM_HASHES = 4;
+const int64_t JOURNAL_RETRY_MS = 10000;
+
+enum class JournalEvent : uint8_t {
+    Added = 1,  // first hello, or first digest listing
+    Removed,    // expired after its hold time and probe
+    Evicted,    // pushed out of a full table
+    LinkUp,     // heard on another address or interface as well
+    LinkDown,   // one of several links stopped hearing hellos
+    LinkMoved,  // same MAC on a new address or interface
+};
+
+const char* journal_event_name(JournalEvent event);
+
+// One event as stored. Times are wall clock milliseconds, never decreasing
+// within a segment; the interface is stored by name so records stay
+// readable across restarts.
+struct JournalRecord {
+    int64_t time_ms;
+    NodeID id;
+    in_addr_t ip;
+    MAC_Bytes mac;
+    JournalEvent event;
+    uint8_t reserved[5];
+    char interface[16];  // NUL padded, not terminated at 16 characters
+};
+static_assert(sizeof(JournalRecord) == 56, "journal records are fixed size");
+
+// First page of a segment file. The bloom filter holds the NodeID of
+// every record, so lookups of one node skip segments that never saw it.
+struct JournalHeader {
+    char magic[8];
+    uint32_t record_size;
+    uint32_t header_size;
+    uint64_t capacity;   // records the segment holds
+    uint64_t count;      // records written so far
+    int64_t first_ms;
+    int64_t last_ms;
+    uint64_t reserved[2];
+    uint8_t bloom[JOURNAL_BLOOM_BYTES];
+};
+static_assert(sizeof(JournalHeader) == JOURNAL_HEADER_BYTES, "journal header is one page");
+
+struct JournalConfig {
+    std::string directory;              // empty disables the journal
+    std::string name = "neighbours";    // segment files are directory/name.N.journal
+    size_t segment_bytes = JOURNAL_SEGMENT_BYTES;
+    size_t segments = JOURNAL_SEGMENTS;
+};
+
+// Append-only journal of neighbour table events in fixed-size segment
+// files mapped into memory. Appending copies one record into the mapping
+// and updates the header, with no system call until the segment is full;
+// then the next one is created and the oldest beyond the limit removed.
+// Segments already on disk are picked up again at startup.
+//
+// Queries skip segments that end before the start time or whose bloom
+// filter rules the node out, and binary search the first record in time.
+class NeighbourJournal {
+    struct Segment {
+        uint64_t number;
+        JournalHeader* header;
+        size_t bytes;
+    };
+
+    JournalConfig config;
+    std::vector<Segment> segments;  // oldest first; the last one is written to
+    uint64_t next_number = 1;
+    int64_t retry_ms = 0;             // no new segment is tried before this after a failure
+    uint64_t dropped_records = 0;
+
+    std::string segment_path(uint64_t number) const;
+    int load_segment(uint64_t number);
+    int create_segment();
+    void close();
+    static const JournalRecord* records(const JournalHeader* header);
+    static bool may_contain(const JournalHeader* header, const NodeID& id);
+    static size_t first_at(const JournalHeader* header, int64_t since_ms);
+public:
+    NeighbourJournal() = default;
+    ~NeighbourJournal();
+    NeighbourJournal(const NeighbourJournal&) = delete;
+    NeighbourJournal& operator=(const NeighbourJournal&) = delete;
+
+    int open(const JournalConfig& config);
+    bool is_open() const { return !segments.empty(); }
+    void append(JournalEvent event, const NodeID& id, in_addr_t ip, const MAC_Bytes& mac,
+                const std::string& interface);
+
+    size_t size() const;  // records kept over all segments
+    uint64_t dropped() const { return dropped_records; }  // events lost while no segment could be created
+    // fn(record) for every record of id (every record if id is null) at
+    // or after since_ms, oldest first. Stops early if fn returns false.
+    template <typename Fn>
+    void for_each(const NodeID* id, int64_t since_ms, Fn&& fn) const;
+};
+
+template <typename Fn>
+void NeighbourJournal::for_each(const NodeID* id, int64_t since_ms, Fn&& fn) const {
+    for (const Segment& segment : segments) {
+        const JournalHeader* header = segment.header;
+        if (header->count == 0 || header->last_ms < since_ms || (id && !may_contain(header, *id))) {
+            continue;
+        }
+        const JournalRecord* begin = records(header);
+        for (size_t i = first_at(header, since_ms); i < header->count; ++i) {
+            if ((!id || begin[i].id == *id) && !fn(begin[i])) {
+                return;
+            }
+        }
+    }
+}
+
+#endif // NEIGHBOUR_JOURNAL_H
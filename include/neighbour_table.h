@@ -0,0 +1,143 @@
+#ifndef NEIGHBOUR_TABLE_H
+#define NEIGHBOUR_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "common/types.h"
+#include "common/node_id.h"
+
+const int NEIGHBOUR_TIMEOUT_SECONDS = 30;
+const size_t EVICTION_SAMPLE_SIZE = 16;
+
+enum class SlotState : uint8_t {
+    Empty,
+    Occupied,
+    Deleted,
+};
+
+enum class EvictionPolicy : uint8_t {
+    LeastRecentlySeen,  // evict the entry closest to expiring
+    PreferUnconfirmed,  // evict entries seen only once first, then least recently seen
+};
+
+struct NeighbourTableStats {
+    uint64_t evictions = 0;
+    uint64_t unconfirmed_evictions = 0;
+    uint64_t probe_recoveries = 0; // entries refreshed while a probe was outstanding
+    uint64_t refused_links = 0;    // connections not added because their heap storage was over budget
+};
+
+// Hot per-neighbour data, scanned on every lookup and expiry pass.
+// Kept separate from NetworkNeighbor so two slots share a cache line.
+struct NeighbourSlot {
+    NodeID id;
+    int64_t deadline;   // neighbour expires once the monotonic clock (ms) reaches this
+    uint32_t sequence;  // table sequence number of the last change
+    uint8_t hits;       // hellos seen, saturating
+    uint8_t probes;     // unicast probes sent since the deadline passed
+    SlotState state;
+
+    bool is_active(int64_t now) const { return now < deadline; }
+};
+
+// Open-addressing neighbour table keyed by binary NodeID. Hot slots and cold
+// records live in two parallel flat arrays indexed by the same position.
+// The table never grows past its limits; inserting into a full table evicts
+// an existing entry according to the eviction policy.
+class NeighbourTable {
+    std::vector<NeighbourSlot> slots;
+    std::vector<NetworkNeighbor> records;
+    size_t count = 0;
+    size_t deleted = 0;
+    size_t max_entries;
+    size_t max_capacity;
+    size_t connection_bytes = 0;           // heap storage of connections past the inline one
+    size_t connection_budget = SIZE_MAX;   // what the full slot array leaves of the memory budget
+    uint32_t next_sequence = 1;
+    uint64_t seed;
+    EvictionPolicy eviction_policy = EvictionPolicy::PreferUnconfirmed;
+    NeighbourTableStats table_stats;
+    NodeID evicted{};
+
+    size_t hash(const NodeID& id) const;
+    size_t find_index(const NodeID& id) const;
+    void rehash(size_t new_capacity);
+    bool is_better_victim(const NeighbourSlot& candidate, const NeighbourSlot& current) const;
+    void evict_one(size_t start);
+    void remove_at(size_t i);
+public:
+    static const size_t npos = static_cast<size_t>(-1);
+    static const size_t bytes_per_slot = sizeof(NeighbourSlot) + sizeof(NetworkNeighbor);
+    static const size_t capacity_limit = static_cast<size_t>(1) << (sizeof(size_t) * 8 - 2);
+    static const size_t min_memory_budget = 16 * bytes_per_slot; // the smallest table
+
+    explicit NeighbourTable(size_t initial_capacity = 16, uint64_t seed = 0);
+
+    // Caps the table at max_entries and at whatever fits in memory_budget bytes
+    // of slot storage, whichever is smaller. Connections that spill to the
+    // heap get what the slot array leaves of the budget.
+    void set_limits(size_t max_entries, size_t memory_budget, EvictionPolicy policy);
+
+    NetworkNeighbor* find(const NodeID& id);
+    const NetworkNeighbor* find(const NodeID& id) const;
+    const NeighbourSlot* find_slot(const NodeID& id) const;
+
+    // Returns the record for id, inserting an empty one if needed, and pushes
+    // its deadline out to at least the given time.
+    NetworkNeighbor& refresh(const NodeID& id, int64_t deadline, bool& inserted);
+    void mark_changed(const NodeID& id);
+    // NetworkNeighbor::add_connection on a record of this table. Also returns
+    // nullptr, counting a refused link, when a new connection would take the
+    // heap storage of connections over budget.
+    NetworkConnection* add_connection(NetworkNeighbor& record, const NetworkConnection& connection, bool& changed);
+    bool erase(const NodeID& id);
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    size_t capacity() const { return slots.size(); }
+    size_t max_size() const { return max_entries; }
+    size_t memory_usage() const;
+    const NeighbourTableStats& stats() const { return table_stats; }
+    const NodeID& last_evicted() const { return evicted; }
+    uint32_t sequence() const { return next_sequence - 1; } // moves on every insert, change and removal
+
+    template <typename Fn>
+    void for_each(Fn&& fn) const {
+        for (size_t i = 0; i < slots.size(); ++i) {
+            if (slots[i].state == SlotState::Occupied) {
+                fn(slots[i], records[i]);
+            }
+        }
+    }
+
+    // As above; fn may pull deadlines in and update connections, but not
+    // add or remove entries
+    template <typename Fn>
+    void for_each(Fn&& fn) {
+        for (size_t i = 0; i < slots.size(); ++i) {
+            if (slots[i].state == SlotState::Occupied) {
+                fn(slots[i], records[i]);
+            }
+        }
+    }
+
+    // Removes every entry for which pred(slot, record) holds, calling
+    // on_erase(slot, record) just before each removal. pred may update the
+    // deadline and probe count of entries it keeps and drop their connections.
+    template <typename Pred, typename OnErase>
+    size_t erase_if(Pred&& pred, OnErase&& on_erase) {
+        size_t removed = 0;
+        for (size_t i = 0; i < slots.size(); ++i) {
+            if (slots[i].state == SlotState::Occupied && pred(slots[i], records[i])) {
+                on_erase(slots[i], records[i]);
+                remove_at(i);
+                ++removed;
+            }
+        }
+        return removed;
+    }
+};
+
+#endif // NEIGHBOUR_TABLE_H
@@ -0,0 +1,30 @@
+#ifndef PACKET_FILTER_H
+#define PACKET_FILTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <linux/filter.h>
+
+const size_t MIN_DISCOVERY_PACKET_LENGTH = 64; // shortest valid hello payload
+
+// Six-byte prefix every discovery message starts with
+struct PacketMagic {
+    char prefix[7];
+};
+
+const PacketMagic DISCOVERY_PACKET_MAGICS[] = {
+    {"HELLO "},
+    {"PROBE "},
+    {"DIGEST"},
+    {"RELAY "},
+    {"GOSSIP"},
+};
+
+// Builds a classic BPF program for SO_ATTACH_FILTER that only lets datagrams
+// through when the payload is long enough and starts with a known magic.
+// UDP socket filters see the UDP header at offset 0.
+std::vector<sock_filter> build_discovery_filter();
+int attach_discovery_filter(int socket_fd);
+
+#endif // PACKET_FILTER_H
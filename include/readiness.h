@@ -0,0 +1,19 @@
+#ifndef READINESS_H
+#define READINESS_H
+
+#include <string>
+
+// Readiness handshake with whoever started the service. Two channels,
+// either or both may be set in the environment:
+//   GRAW_READY_FD  an inherited pipe; gets "READY=1\n" or "ERROR=<reason>\n"
+//                  and is closed (graw_cli start uses this)
+//   NOTIFY_SOCKET  the sd_notify datagram socket of a service manager
+namespace readiness {
+
+// Every socket is bound and the first hellos are out
+void notify_ready();
+void notify_failed(const std::string& reason);
+
+} // namespace readiness
+
+#endif // READINESS_H
@@ -0,0 +1,67 @@
+#ifndef RELAY_CACHE_H
+#define RELAY_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <netinet/in.h>
+
+#include "common/types.h"
+#include "common/node_id.h"
+
+const size_t RELAY_CACHE_SIZE = 65536;
+
+// A neighbour of some other site, as its relay reported it
+struct RelayedNeighbour {
+    NodeID relay;          // relay that listed it last
+    in_addr_t relay_ip;
+    in_addr_t ip;
+    MAC_Bytes mac;
+    int64_t last_seen_ms;  // when that relay last heard from it
+    int64_t expires_ms;
+    uint32_t snapshot;     // relay snapshot that listed it last
+};
+
+// Neighbours learned from downstream relays, kept apart from direct
+// neighbours. Each relay sends full snapshots of its table split over
+// several datagrams; once every part of a snapshot is in, the entries it
+// no longer lists are dropped. Entries of a relay that goes silent expire
+// after the TTL it advertised. A neighbour listed by several relays is kept
+// once, attributed to whichever listed it most recently.
+class RelayCache {
+    struct Source {
+        in_addr_t ip;
+        uint32_t snapshot;
+        uint32_t parts_seen;
+        bool listed;  // still lists something, as of the last expiry pass
+    };
+
+    std::map<NodeID, RelayedNeighbour> entries;
+    std::map<NodeID, Source> sources;
+    size_t max_entries;
+    int64_t next_expiry_ms = INT64_MAX;
+    uint64_t dropped_entries = 0;
+
+    void sweep(const NodeID& relay, uint32_t snapshot);
+public:
+    explicit RelayCache(size_t max_entries = RELAY_CACHE_SIZE) : max_entries(max_entries) {}
+
+    // Folds one part of a relay snapshot in. Returns false if an entry line
+    // was malformed; the entries before it are kept.
+    bool add_part(DiscoveryDigest part, in_addr_t relay_ip, int64_t now_ms);
+    // Drops expired entries once the earliest expiry has passed
+    void expire(int64_t now_ms);
+
+    size_t size() const { return entries.size(); }
+    size_t relays() const { return sources.size(); }
+    uint64_t dropped() const { return dropped_entries; } // entries refused because the cache was full
+
+    template <typename Fn>
+    void for_each(Fn&& fn) const {
+        for (const auto& [id, entry] : entries) {
+            fn(id, entry);
+        }
+    }
+};
+
+#endif // RELAY_CACHE_H
@@ -11,34 +11,159 @@
 #include <iostream>
 #include <unistd.h>
 #include <memory>
+#include <cstdarg>
 
 #include "neighbour_discovery.h"
+#include "event_loop.h"
+#include "neighbour_cache.h"
 #include "common/types.h"
 #include "common/node_id.h"
 #include "common/helper.h"
+#include "common/logger.h"
+#include "common/metrics.h"
+#include "common/trace.h"
 
-class Service {
+const int METRICS_FILE_INTERVAL_SECONDS = 15;
+const size_t MAX_CLI_SESSIONS = 64;
+const size_t MAX_CLI_REQUEST = 4096;    // bytes of one command line
+const int CLI_SEND_TIMEOUT_MS = 1000;   // a client that takes no reply bytes for this long is dropped
+const size_t MAX_DOMAIN_NAME = 32;
+const size_t HISTORY_MAX_EVENTS = 1000;  // events in one HISTORY reply
+
+// A named discovery domain, e.g. one tenant or VRF. Domains only see hellos
+// on their own port, so they need distinct ports.
+struct DomainConfig {
+    std::string name;
+    int port;
+    std::vector<std::string> interfaces; // interface names, empty for all
+};
+
+struct ServiceConfig {
+    std::string metrics_file;  // empty disables the Prometheus textfile
+    int stall_budget_ms = 100; // loop iterations slower than this are logged, 0 disables
+    bool include_loopback = false; // discover on lo too, for graw_loadgen
+    IoBackend io_backend = IoBackend::Auto;
+    std::vector<DomainConfig> domains; // empty for one unnamed domain on every interface
+};
+
+// Domain names are letters, digits, '-' and '_'
+bool valid_domain_name(std::string_view name);
+
+struct ServiceMetrics {
+    Counter* wakeups_activity;
+    Counter* wakeups_timeout;
+    Histogram* loop_time;
+    Counter* stalls;
+    Counter* io_syscalls;
+    Counter* cli_ping;
+    Counter* cli_list;
+    Counter* cli_stats;
+    Counter* cli_trace;
+    Counter* cli_relayed;
+    Counter* cli_topology;
+    Counter* cli_history;
+    Counter* cli_domains;
+    Counter* cli_unknown;
+    Counter* cli_refused;
+    Gauge* cli_sessions;
+    Histogram* cli_time;
+};
+
+// A CLI connection. Commands are newline terminated and may be pipelined;
+// every reply ends with a NUL byte, in the order the commands came in. The
+// socket is non-blocking: replies the client has not taken yet wait in
+// output, and no further commands are read until they are sent.
+struct CliSession {
+    std::string input;            // bytes after the last complete command
+    std::string output;           // replies not yet sent
+    int64_t stalled_since_ms = 0; // last progress while output is pending, 0 when empty
+    bool reading = true;
+    bool closing = false;         // close once output is sent
+};
+
+// Formats the LIST reply, with each connection's link quality as of now_ms
+std::string render_neighbour_list(const NeighbourTable& neighbors, const std::vector<NetworkInterface>& interfaces,
+                                  int64_t now_ms);
+// Formats the LIST JSON reply: {"neighbours":[{"id":..,"connections":[..]}]}
+std::string render_neighbour_json(const NeighbourTable& neighbors, const std::vector<NetworkInterface>& interfaces,
+                                  int64_t now_ms);
+// Formats the RELAYED reply
+std::string render_relayed_list(const RelayCache& relayed, int64_t now_ms);
+// Formats the TOPOLOGY reply, one line per node with the neighbours it hears
+std::string render_topology(const Topology& topology);
+// Reads the arguments of "HISTORY <node|*> [SINCE <time>]". The time is unix
+// seconds or a span before now_ms such as 90S, 30M, 12H or 7D; without it
+// the whole journal is read. Returns false if the arguments are malformed.
+bool parse_history_query(std::string_view args, int64_t now_ms, NodeID& id, bool& every_node, int64_t& since_ms);
+// Formats the HISTORY reply, oldest event first, at most HISTORY_MAX_EVENTS
+std::string render_history(const NeighbourJournal& journal, const NodeID* id, int64_t since_ms);
+
+// One discovery domain hosted by the service, with its own NodeID, sockets
+// and neighbour table. The event loop, the interface list and the CLI
+// socket are shared.
+struct Domain {
+    std::string name;  // empty for the unnamed domain
+    int port;
     NodeID node_id;
+    std::vector<NetworkInterface> interfaces; // the subset of the service's interfaces it runs on
+    UdpTransport transport;
+    std::unique_ptr<NeighbourDiscovery> discovery;
+};
+
+class Service : public AcceptHandler, public StreamHandler {
     const char* cli_socket_path;
     int cli_socket_fd;
     int discovery_port;
-    bool quiet_mode;
     bool running = false;
+    DiscoveryConfig discovery_config;
+    ServiceConfig service_config;
+    int64_t last_metrics_write = 0;
+    MetricsRegistry metrics_registry;
+    ServiceMetrics metrics;
+    LoopBreakdown breakdown; // phases of the current loop iteration
+    std::string init_error;
+    std::unordered_map<int, CliSession> sessions; // by client fd
 
-    std::unique_ptr<NeighbourDiscovery> neighbour_discovery;
+    SystemClock clock;
+    SeededRandom random{std::random_device{}()};
+    std::unique_ptr<EventLoop> event_loop;
+    NeighbourCacheMonitor neighbour_cache; // open while some interface is passive
     std::vector<NetworkInterface> interfaces;
+    std::vector<std::unique_ptr<Domain>> domains; // in configuration order, the first answers unscoped commands
 
     int init();
+    int init_domain(const DomainConfig& config);
+    int init_failed(const char* format, ...) __attribute__((format(printf, 2, 3)));
     int update_network_interfaces();
     int init_interfaces();
     int init_cli_socket();
+    void init_neighbour_cache();
     void cleanup_cli_socket();
-    void handle_cli_connection();
+    void on_accept(int client_fd) override;
+    void on_readable(int client_fd) override;
+    void on_writable(int client_fd) override;
+    void flush_session(int client_fd, CliSession& session);
+    void close_session(int client_fd);
+    void expire_stalled_sessions();
+    std::string handle_command(std::string_view command);
+    std::string handle_domain_command(Domain& domain, std::string_view command);
+    Domain* find_domain(std::string_view name);
+    std::string render_domains() const;
+    void register_metrics();
+    void update_metrics();
+    std::string render_metrics();
+    void write_metrics_file(bool force);
+    void check_stall(int64_t iteration_us);
 public:
-    Service(const char* cli_socket_path, int discovery_port, bool quiet_mode);
-    ~Service();
+    Service(const char* cli_socket_path, int discovery_port,
+            const DiscoveryConfig& discovery_config = DiscoveryConfig(),
+            const ServiceConfig& service_config = ServiceConfig());
+    ~Service() override;
 
+    // Binds every socket and sends the first hellos; on failure
+    // start_error() says what went wrong
     int start();
+    const std::string& start_error() const { return init_error; }
     int loop();
     void stop();
     void update_neighbors();
@@ -0,0 +1,136 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string_view>
+#include <vector>
+
+#include "common/node_id.h"
+
+const size_t TOPOLOGY_MAX_LINKS = 262144;
+const size_t TOPOLOGY_TREE_DEPTH = 16;   // hex digits of a link's position
+
+// Directed link, origin bytes then neighbour bytes
+using LinkKey = std::array<uint8_t, 2 * sizeof(NodeID)>;
+
+LinkKey make_link_key(const NodeID& origin, const NodeID& neighbour);
+NodeID link_origin(const LinkKey& key);
+NodeID link_neighbour(const LinkKey& key);
+
+// What the origin last said about a link: it hears the neighbour (alive)
+// or no longer does (a tombstone). Only the origin raises the version, so
+// the higher version wins a merge, and on a tie the tombstone does.
+struct LinkState {
+    uint32_t version;
+    bool alive;
+    int64_t changed_ms;  // local time the state last changed
+};
+
+// Hash and link count of one subtree of the anti-entropy tree
+struct TopologySummary {
+    uint64_t hash;
+    uint32_t count;
+};
+
+// The links of every node on the segment, as gossiped between peers. Each
+// node owns its outgoing links and versions them; everyone else only
+// merges what they hear. Replicas are compared top down by the hashes of
+// the 16 subtrees under a hex prefix of the link key, so two peers that
+// agree exchange one datagram and peers that differ only descend into the
+// subtrees that differ.
+//
+// Links sit in the tree at a 64-bit hash of their key, which spreads the
+// links of one origin over the whole tree. A subtree hash is the XOR of its
+// links' hashes. The first two levels are kept up to date on every change;
+// deeper ones are summed on demand from the few links under them.
+class Topology {
+    using Position = std::pair<uint64_t, LinkKey>;  // hash of the key, then the key
+
+    NodeID self;
+    std::map<Position, LinkState> links;
+    std::array<TopologySummary, 16> level1{};
+    std::array<TopologySummary, 256> level2{};
+    std::vector<NodeID> own_links;            // neighbours of our live links, sorted
+    std::map<NodeID, int64_t> unheard_since;  // origins no chain of live links from us reaches
+    uint32_t own_version = 0;
+    size_t max_links;
+    size_t alive_links = 0;
+    uint64_t dropped_links = 0;
+
+    static Position position(const LinkKey& key);
+    static uint64_t link_hash(const Position& at, const LinkState& state);
+    void account(const Position& at, const LinkState& state, bool add);
+    void store(const Position& at, const LinkState& state);
+public:
+    explicit Topology(const NodeID& self, size_t max_links = TOPOLOGY_MAX_LINKS)
+        : self(self), max_links(max_links) {}
+
+    // Makes our own links exactly the given neighbours, versioning whatever
+    // changed
+    void set_own(const std::vector<NodeID>& neighbours, int64_t now_ms);
+    // Folds in a link heard from a peer. A newer claim about one of our own
+    // links (from before a restart, or a peer's orphan cleanup) is refuted
+    // by reissuing our state at a higher version. Returns true if anything
+    // changed.
+    bool merge(const LinkKey& key, uint32_t version, bool alive, int64_t now_ms);
+    // Tombstones the links of origins that no chain of live links from us
+    // has reached for orphan_ms, and forgets tombstones older than
+    // tombstone_ms
+    void expire(int64_t now_ms, int64_t orphan_ms, int64_t tombstone_ms);
+
+    // Identifies one state of a link in hash lists
+    static uint64_t hash(const LinkKey& key, const LinkState& state) { return link_hash(position(key), state); }
+    // Summaries of the 16 subtrees under prefix, given as hex digits
+    void children(std::string_view prefix, TopologySummary* out) const;
+
+    size_t size() const { return links.size(); }
+    size_t alive() const { return alive_links; }
+    size_t nodes() const;
+    uint64_t dropped() const { return dropped_links; } // links refused because the table was full
+
+    // fn(key, state) for every link, tombstones included, under prefix
+    template <typename Fn>
+    void for_each(std::string_view prefix, Fn&& fn) const;
+    // fn(origin, neighbours) for every origin with live links, in NodeID order
+    template <typename Fn>
+    void for_each_node(Fn&& fn) const;
+};
+
+// Reads a tree prefix; false if it is not lowercase hex or too long
+bool parse_link_prefix(std::string_view prefix, uint64_t& value);
+
+template <typename Fn>
+void Topology::for_each(std::string_view prefix, Fn&& fn) const {
+    uint64_t value;
+    if (!parse_link_prefix(prefix, value)) {
+        return;
+    }
+    unsigned shift = 64 - 4 * prefix.size();
+    uint64_t start = prefix.empty() ? 0 : value << shift;
+    for (auto it = links.lower_bound(Position{start, LinkKey{}}); it != links.end(); ++it) {
+        if (!prefix.empty() && it->first.first >> shift != value) {
+            break;
+        }
+        fn(it->first.second, it->second);
+    }
+}
+
+template <typename Fn>
+void Topology::for_each_node(Fn&& fn) const {
+    std::map<NodeID, std::vector<NodeID>> nodes;
+    for (const auto& [at, state] : links) {
+        if (state.alive) {
+            nodes[link_origin(at.second)].push_back(link_neighbour(at.second));
+        }
+    }
+    for (auto& [origin, neighbours] : nodes) {
+        std::sort(neighbours.begin(), neighbours.end());
+        fn(origin, neighbours);
+    }
+}
+
+#endif // TOPOLOGY_H
@@ -0,0 +1,74 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <netinet/in.h>
+
+#include "common/types.h"
+
+class EventLoop;
+
+// Largest datagram the engine sends (digests, relay parts, gossip); fits
+// one unfragmented Ethernet frame. Transports must receive at least this
+// much and drop anything longer rather than pass on a truncated datagram.
+const size_t MAX_DATAGRAM_SIZE = 1400;
+
+// Receives datagrams from a transport
+class DatagramSink {
+public:
+    virtual ~DatagramSink() = default;
+    // device is the interface the datagram arrived on, or nullptr if unknown.
+    // rx_us is the arrival time on the monotonic clock, 0 if the transport
+    // has no timestamp of its own.
+    virtual void on_datagram(std::string_view data, in_addr_t sender_ip, const std::string* device,
+                             int64_t rx_us) = 0;
+    virtual void on_receive_error(int error) = 0;
+};
+
+// How the discovery engine reaches the network. UdpTransport talks to real
+// sockets; the simulator substitutes an in-process network.
+class DiscoveryTransport {
+public:
+    virtual ~DiscoveryTransport() = default;
+
+    virtual int open(const std::vector<NetworkInterface>& interfaces, int port) = 0;
+    virtual bool is_open() const = 0;
+    // Sends out of interface_id; returns the bytes sent or -1 with errno set
+    virtual ssize_t send(uint16_t interface_id, in_addr_t destination, std::string_view data) = 0;
+
+    // Has loop deliver received datagrams to sink and carry the sends
+    virtual void attach(EventLoop& loop, DatagramSink& sink) = 0;
+};
+
+struct DiscoverySocket {
+    int fd;
+    std::string device; // empty for the wildcard fallback socket
+};
+
+// One UDP socket per interface name, bound with SO_BINDTODEVICE and
+// filtered in the kernel, or a single wildcard socket without CAP_NET_RAW.
+// Datagrams carry kernel receive timestamps (SO_TIMESTAMPNS) when available.
+class UdpTransport final : public DiscoveryTransport {
+    int port = 0;
+    std::vector<DiscoverySocket> sockets;
+    std::vector<int> interface_sockets; // interface id -> index into sockets
+    EventLoop* loop = nullptr;          // sends go straight to sendto until attached
+
+    int open_socket(const std::string& device);
+    int bind_to_interface(const NetworkInterface& interface);
+    void close_sockets();
+public:
+    UdpTransport() = default;
+    ~UdpTransport() override;
+    UdpTransport(const UdpTransport&) = delete;
+    UdpTransport& operator=(const UdpTransport&) = delete;
+
+    int open(const std::vector<NetworkInterface>& interfaces, int port) override;
+    bool is_open() const override { return !sockets.empty(); }
+    ssize_t send(uint16_t interface_id, in_addr_t destination, std::string_view data) override;
+    void attach(EventLoop& loop, DatagramSink& sink) override;
+};
+
+#endif // TRANSPORT_H
@@ -0,0 +1,168 @@
+#include "sim.h"
+#include "common/logger.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+using namespace std;
+
+static void print_usage(const char* program) {
+    cerr << "Usage: " << program << " [options]" << endl
+         << "Runs many discovery engines against a simulated network in virtual time," << endl
+         << "or replays a trace recorded with graw_service --record-trace." << endl
+         << "  --nodes N              Number of simulated nodes (default 1000)" << endl
+         << "  --segments N           Broadcast domains the nodes are spread over (default 20)" << endl
+         << "  --duration SECONDS     Virtual time to simulate (default 3600)" << endl
+         << "  --latency-ms MS        One-way delivery delay (default 1)" << endl
+         << "  --jitter-ms MS         Extra random delay on top of the latency (default 1)" << endl
+         << "  --loss P               Probability that a datagram is lost (default 0)" << endl
+         << "  --mtu BYTES            Longest datagram the network carries (default 1400)" << endl
+         << "  --fail-fraction F      Share of nodes that crash during the run (default 0)" << endl
+         << "  --fail-at SECONDS      When the nodes crash (default half the duration)" << endl
+         << "  --interval-ms MS       Hello interval of every node (default 6000)" << endl
+         << "  --multiplier N         Missed hellos before a neighbour is down (default 5)" << endl
+         << "  --max-neighbours N     Neighbour table limit of every node (default 4096)" << endl
+         << "  --aggregate-ms MS      Designated reporter mode with a digest every MS (default off)" << endl
+         << "  --gossip-ms MS         Gossip the segment topology every MS (default off)" << endl
+         << "  --seed N               Random seed; equal seeds give identical runs (default 1)" << endl
+         << "  --log-level LEVEL      Engine log level (default warn)" << endl
+         << "  --replay PATH          Replay a recorded hello trace instead of simulating" << endl
+         << "  --help                 Show this help message" << endl;
+}
+
+static bool parse_number(const char* text, double& value) {
+    char* end = nullptr;
+    errno = 0;
+    double parsed = strtod(text, &end);
+    if (errno != 0 || end == text || *end != '\0' || parsed < 0) {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+static int parse_arguments(int argc, char* argv[], sim::SimConfig& config) {
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        double number = 0;
+        LogLevel log_level;
+
+        if (arg == "--help") {
+            print_usage(argv[0]);
+            return 1;
+        } else if (!value) {
+            cerr << "Missing value for: " << arg << endl;
+            return -1;
+        } else if (arg == "--replay") {
+            config.replay_path = value;
+        } else if (arg == "--log-level" && logger::parse_level(value, log_level)) {
+            logger::set_level(log_level);
+        } else if (!parse_number(value, number)) {
+            cerr << "Invalid value for " << arg << ": " << value << endl;
+            return -1;
+        } else if (arg == "--nodes" && number >= 1 && number <= 1000000) {
+            config.nodes = (size_t)number;
+        } else if (arg == "--segments" && number >= 1 && number <= 256) {
+            config.segments = (size_t)number;
+        } else if (arg == "--duration") {
+            config.duration = number;
+        } else if (arg == "--latency-ms") {
+            config.latency_ms = number;
+        } else if (arg == "--jitter-ms") {
+            config.jitter_ms = number;
+        } else if (arg == "--loss" && number <= 1) {
+            config.loss = number;
+        } else if (arg == "--mtu" && number >= 1) {
+            config.mtu = (size_t)number;
+        } else if (arg == "--fail-fraction" && number <= 1) {
+            config.fail_fraction = number;
+        } else if (arg == "--fail-at") {
+            config.fail_at = number;
+        } else if (arg == "--interval-ms" && number >= MIN_INTERVAL_MS) {
+            config.liveness.interval_ms = (int64_t)number;
+        } else if (arg == "--multiplier" && number >= 2 && number <= 255) {
+            config.liveness.multiplier = (uint32_t)number;
+        } else if (arg == "--aggregate-ms" && number >= MIN_INTERVAL_MS) {
+            config.digest_interval_ms = (int64_t)number;
+        } else if (arg == "--gossip-ms" && number >= MIN_INTERVAL_MS) {
+            config.gossip_interval_ms = (int64_t)number;
+        } else if (arg == "--max-neighbours" && number >= 1) {
+            config.max_neighbours = (size_t)number;
+        } else if (arg == "--seed") {
+            config.seed = (uint64_t)number;
+        } else {
+            cerr << "Invalid argument: " << arg << endl;
+            print_usage(argv[0]);
+            return -1;
+        }
+        ++i;
+    }
+
+    // Addresses are 10.<segment>.x.y, so a segment holds at most 65534 nodes
+    if ((config.nodes + config.segments - 1) / config.segments > 65534) {
+        cerr << "Too many nodes per segment, raise --segments" << endl;
+        return -1;
+    }
+    return 0;
+}
+
+static void print_seconds(const char* label, int64_t ms) {
+    if (ms < 0) {
+        printf("  %-22s never\n", label);
+    } else {
+        printf("  %-22s %.3f s\n", label, ms / 1000.0);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    sim::SimConfig config;
+    logger::set_level(LogLevel::Warn);
+    int parsed = parse_arguments(argc, argv, config);
+    if (parsed != 0) {
+        return parsed < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    if (!config.replay_path.empty()) {
+        int result = sim::replay(config);
+        logger::flush();
+        return result < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    printf("Simulating %zu nodes in %zu segments for %.0f s, latency %.1f+%.1f ms, loss %.3f, seed %llu\n",
+           config.nodes, config.segments, config.duration, config.latency_ms, config.jitter_ms, config.loss,
+           (unsigned long long)config.seed);
+
+    int64_t wall_start = sim::now_ns();
+    sim::Network network(config);
+    network.run();
+    double wall_s = (sim::now_ns() - wall_start) / 1e9;
+    logger::flush();
+
+    const sim::SimStats& stats = network.stats();
+    printf("Results:\n");
+    printf("  events                 %llu\n", (unsigned long long)stats.events);
+    printf("  hellos sent            %llu\n", (unsigned long long)stats.sent);
+    printf("  datagrams              %llu delivered, %llu lost, %llu to stopped nodes, %llu over the MTU\n",
+           (unsigned long long)stats.delivered, (unsigned long long)stats.lost,
+           (unsigned long long)stats.dropped_dead, (unsigned long long)stats.oversized);
+    printf("  probes                 %llu sent, %llu answered, %llu neighbours recovered\n",
+           (unsigned long long)stats.probes_sent, (unsigned long long)stats.probes_answered,
+           (unsigned long long)stats.recovered);
+    print_seconds("convergence", stats.convergence_ms);
+    if (stats.failed > 0) {
+        printf("  failed nodes           %zu\n", stats.failed);
+        print_seconds("reconvergence", stats.reconvergence_ms);
+    }
+    if (config.gossip_interval_ms > 0) {
+        printf("  topology               %zu of %zu live nodes complete, %llu gossip datagrams\n",
+               stats.topology_complete, config.nodes - stats.failed, (unsigned long long)stats.gossip_sent);
+    }
+    printf("  cpu per hello          %.0f ns\n", stats.delivered ? (double)stats.hello_ns / stats.delivered : 0.0);
+    printf("  wall time              %.3f s (%.0fx virtual time)\n", wall_s,
+           wall_s > 0 ? config.duration / wall_s : 0.0);
+    printf("  digest                 %016llx\n", (unsigned long long)network.digest());
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,325 @@
+#include "sim.h"
+#include "common/helper.h"
+
+#include <arpa/inet.h>
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+
+namespace sim {
+
+const int SIM_DISCOVERY_PORT = 50000;
+
+int64_t now_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+ssize_t SimTransport::send(uint16_t interface_id, in_addr_t destination, std::string_view data) {
+    return network->send(node, interface_id, destination, data);
+}
+
+// Node k of a segment gets 10.<segment>.x.y, counting from .0.1
+static NetworkInterface sim_interface(uint32_t segment, uint32_t k) {
+    char ip[32];
+    char broadcast[32];
+    snprintf(ip, sizeof(ip), "10.%u.%u.%u", segment, (k + 1) >> 8, (k + 1) & 0xff);
+    snprintf(broadcast, sizeof(broadcast), "10.%u.255.255", segment);
+
+    NetworkInterface interface;
+    interface.name = "sim0";
+    interface.ip_address = ip;
+    interface.subnet_mask = "255.255.0.0";
+    interface.network_cidr = helper::network_cidr(interface.ip_address, 16);
+    interface.broadcast_address = broadcast;
+    interface.is_ipv4 = true;
+    interface.is_active = true;
+    interface.ipv4_address = inet_addr(ip);
+    interface.ipv4_netmask = inet_addr(interface.subnet_mask.c_str());
+    interface.ipv4_broadcast = inet_addr(broadcast);
+    return interface;
+}
+
+Network::Network(const SimConfig& config) : config(config), random(config.seed) {
+    segments.resize(config.segments);
+    segment_alive.assign(config.segments, 0);
+    for (uint32_t i = 0; i < config.nodes; ++i) {
+        auto node = std::make_unique<SimNode>(this, i, random.next());
+        uint64_t halves[2] = {random.next(), random.next()};
+        memcpy(node->id.data(), halves, sizeof(halves));
+        node->segment = i % config.segments;
+
+        NetworkInterface interface = sim_interface(node->segment, i / config.segments);
+        MAC_Bytes mac = {0x02, 0x47, 0x52, (uint8_t)(i >> 16), (uint8_t)(i >> 8), (uint8_t)i};
+        interface.mac_address = helper::mac_to_string(mac);
+        node_by_ip[interface.ipv4_address] = i;
+        node->interfaces.push_back(interface);
+
+        segments[node->segment].push_back(i);
+        ++segment_alive[node->segment];
+        ++alive;
+        nodes.push_back(std::move(node));
+
+        // Boots are spread over one broadcast interval
+        schedule((int64_t)random.below(BROADCAST_INTERVAL_MS), EventKind::Start, i);
+    }
+}
+
+void Network::schedule(int64_t time_ms, EventKind kind, uint32_t node, in_addr_t sender_ip,
+                       std::shared_ptr<const std::string> payload) {
+    events.push({time_ms, next_sequence++, kind, node, sender_ip, std::move(payload)});
+}
+
+ssize_t Network::send(uint32_t node, uint16_t interface_id, in_addr_t destination, std::string_view data) {
+    const SimNode& sender = *nodes[node];
+    const NetworkInterface& interface = sender.interfaces[interface_id];
+    if (data.size() > config.mtu) {
+        ++sim_stats.oversized;
+        errno = EMSGSIZE;
+        return -1;
+    }
+    auto payload = std::make_shared<const std::string>(data);
+    ++sim_stats.sent;
+
+    if (destination == interface.ipv4_broadcast) {
+        for (uint32_t peer : segments[sender.segment]) {
+            if (peer != node) {
+                deliver(payload, interface.ipv4_address, peer);
+            }
+        }
+    } else {
+        auto it = node_by_ip.find(destination);
+        if (it != node_by_ip.end()) {
+            deliver(payload, interface.ipv4_address, it->second);
+        }
+    }
+    return (ssize_t)data.size();
+}
+
+void Network::deliver(const std::shared_ptr<const std::string>& payload, in_addr_t sender_ip, uint32_t to) {
+    auto uniform = [this]() { return (random.next() >> 11) * 0x1.0p-53; };
+    if (config.loss > 0 && uniform() < config.loss) {
+        ++sim_stats.lost;
+        return;
+    }
+    double delay = config.latency_ms + (config.jitter_ms > 0 ? uniform() * config.jitter_ms : 0);
+    schedule(clock.now_ms() + std::llround(delay), EventKind::Deliver, to, sender_ip, payload);
+}
+
+void Network::start_node(uint32_t index) {
+    SimNode& node = *nodes[index];
+    DiscoveryConfig discovery_config;
+    discovery_config.max_neighbours = config.max_neighbours;
+    discovery_config.liveness = config.liveness;
+    if (config.digest_interval_ms > 0) {
+        discovery_config.interface_aggregation[node.interfaces[0].name].digest_interval_ms = config.digest_interval_ms;
+    }
+    if (config.gossip_interval_ms > 0) {
+        discovery_config.gossip.enabled = true;
+        discovery_config.gossip.interval_ms = config.gossip_interval_ms;
+    }
+    discovery_config.memory_budget = std::max(discovery_config.memory_budget,
+                                              config.max_neighbours * 2 * NeighbourTable::bytes_per_slot);
+    node.discovery = std::make_unique<DynamicNeighbourDiscovery>(node.interfaces, SIM_DISCOVERY_PORT, node.id,
+                                                                 node.registry, clock, node.random, node.transport,
+                                                                 discovery_config);
+    // Like Service::init, announce immediately instead of waiting an interval
+    node.discovery->broadcast_hello();
+    node.discovery->update();
+}
+
+// Keeps exactly one live Wake event per node, at its next deadline
+void Network::reschedule(uint32_t index) {
+    SimNode& node = *nodes[index];
+    int64_t deadline = node.discovery->next_deadline();
+    if (deadline == INT64_MAX || deadline == node.wake_ms) {
+        return;
+    }
+    node.wake_ms = std::max(deadline, clock.now_ms());
+    schedule(node.wake_ms, EventKind::Wake, index);
+}
+
+// A node has converged once it knows every live node on its segment
+bool Network::is_converged(const SimNode& node) const {
+    return node.alive && node.discovery && node.discovery->get_neighbours().size() == segment_alive[node.segment] - 1;
+}
+
+void Network::update_convergence(uint32_t index) {
+    SimNode& node = *nodes[index];
+    bool converged_now = is_converged(node);
+    if (converged_now == node.converged) {
+        return;
+    }
+    node.converged = converged_now;
+    converged += converged_now ? 1 : -1;
+    if (converged != alive) {
+        return;
+    }
+    if (sim_stats.failed == 0 && sim_stats.convergence_ms < 0) {
+        sim_stats.convergence_ms = clock.now_ms();
+    } else if (sim_stats.failed > 0 && sim_stats.reconvergence_ms < 0) {
+        sim_stats.reconvergence_ms = clock.now_ms() - fail_ms;
+    }
+}
+
+void Network::fail_nodes() {
+    size_t count = std::min(nodes.size(), (size_t)std::llround(config.fail_fraction * nodes.size()));
+    std::vector<uint32_t> order(nodes.size());
+    for (uint32_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        std::swap(order[i], order[i + random.below(order.size() - i)]);
+        SimNode& node = *nodes[order[i]];
+        node.alive = false;
+        --segment_alive[node.segment];
+        --alive;
+    }
+    sim_stats.failed = count;
+
+    // Survivors still list the crashed nodes, so recount from scratch
+    converged = 0;
+    for (const auto& node : nodes) {
+        node->converged = is_converged(*node);
+        converged += node->converged;
+    }
+    if (converged == alive) {
+        sim_stats.reconvergence_ms = 0;
+    }
+}
+
+void Network::run() {
+    int64_t end_ms = std::llround(config.duration * 1000);
+    bool fail_pending = config.fail_fraction > 0;
+    fail_ms = std::llround((config.fail_at >= 0 ? config.fail_at : config.duration / 2) * 1000);
+
+    while (!events.empty() && events.top().time_ms <= end_ms) {
+        if (fail_pending && events.top().time_ms >= fail_ms) {
+            clock.set(fail_ms);
+            fail_nodes();
+            fail_pending = false;
+            continue;
+        }
+
+        Event event = events.top();
+        events.pop();
+        clock.set(event.time_ms);
+        ++sim_stats.events;
+
+        SimNode& node = *nodes[event.node];
+        switch (event.kind) {
+        case EventKind::Start:
+            if (!node.alive) {
+                continue;
+            }
+            start_node(event.node);
+            break;
+        case EventKind::Deliver: {
+            if (!node.alive || !node.discovery) {
+                ++sim_stats.dropped_dead;
+                continue;
+            }
+            int64_t start = now_ns();
+            node.discovery->on_datagram(*event.payload, event.sender_ip, &node.interfaces[0].name, 0);
+            sim_stats.hello_ns += now_ns() - start;
+            ++sim_stats.delivered;
+            node.discovery->update();
+            break;
+        }
+        case EventKind::Wake:
+            if (!node.alive || event.time_ms != node.wake_ms) {
+                continue; // superseded by a later reschedule
+            }
+            node.wake_ms = -1;
+            node.discovery->update();
+            break;
+        }
+        reschedule(event.node);
+        update_convergence(event.node);
+    }
+    clock.set(end_ms);
+
+    for (const auto& node : nodes) {
+        if (node->discovery) {
+            const DiscoveryMetrics& metrics = node->discovery->get_metrics();
+            sim_stats.probes_sent += metrics.probes_sent->value;
+            sim_stats.probes_answered += metrics.probes_answered->value;
+            sim_stats.recovered += node->discovery->get_neighbours().stats().probe_recoveries;
+            sim_stats.gossip_sent += metrics.gossip_sent->value;
+        }
+    }
+    if (config.gossip_interval_ms > 0) {
+        sim_stats.topology_complete = complete_topologies();
+    }
+}
+
+// Counts the live nodes whose gossiped topology holds exactly the links
+// from every live node on their segment to the neighbours it hears directly
+size_t Network::complete_topologies() const {
+    int64_t now = clock.now_ms();
+    size_t complete = 0;
+    for (const std::vector<uint32_t>& segment : segments) {
+        std::vector<LinkKey> expected;
+        for (uint32_t index : segment) {
+            const SimNode& node = *nodes[index];
+            if (!node.alive || !node.discovery) {
+                continue;
+            }
+            node.discovery->get_neighbours().for_each([&](const NeighbourSlot& slot, const NetworkNeighbor& neighbor) {
+                for (const NetworkConnection& connection : neighbor.connections) {
+                    if (slot.is_active(now) && !connection.link.via_digest && now < connection.link.deadline_ms()) {
+                        expected.push_back(make_link_key(node.id, slot.id));
+                        break;
+                    }
+                }
+            });
+        }
+        std::sort(expected.begin(), expected.end());
+
+        std::vector<LinkKey> known;
+        for (uint32_t index : segment) {
+            const SimNode& node = *nodes[index];
+            if (!node.alive || !node.discovery) {
+                continue;
+            }
+            known.clear();
+            node.discovery->get_topology().for_each("", [&known](const LinkKey& key, const LinkState& state) {
+                if (state.alive) {
+                    known.push_back(key);
+                }
+            });
+            std::sort(known.begin(), known.end());
+            complete += known == expected;
+        }
+    }
+    return complete;
+}
+
+// FNV-1a over every node's final table, so runs with the same seed can be
+// compared for bit-for-bit determinism
+uint64_t Network::digest() const {
+    uint64_t hash = 14695981039346656037ULL;
+    auto mix = [&hash](const void* data, size_t size) {
+        const uint8_t* bytes = (const uint8_t*)data;
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * 1099511628211ULL;
+        }
+    };
+
+    for (const auto& node : nodes) {
+        mix(&node->alive, sizeof(node->alive));
+        if (!node->discovery) {
+            continue;
+        }
+        node->discovery->get_neighbours().for_each([&mix](const NeighbourSlot& slot, const NetworkNeighbor&) {
+            mix(slot.id.data(), slot.id.size());
+            mix(&slot.deadline, sizeof(slot.deadline));
+        });
+    }
+    mix(&sim_stats.delivered, sizeof(sim_stats.delivered));
+    mix(&sim_stats.lost, sizeof(sim_stats.lost));
+    return hash;
+}
+
+} // namespace sim
@@ -0,0 +1,146 @@
+#ifndef SIM_SIM_H
+#define SIM_SIM_H
+
+#include <cstdint>
+#include <memory>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common/clock.h"
+#include "common/random.h"
+#include "common/metrics.h"
+#include "neighbour_discovery.h"
+#include "transport.h"
+
+namespace sim {
+
+struct SimConfig {
+    size_t nodes = 1000;
+    size_t segments = 20;          // nodes are spread round-robin over this many broadcast domains
+    double duration = 3600;        // virtual seconds
+    double latency_ms = 1;         // base one-way delay
+    double jitter_ms = 1;          // extra uniform delay on top of latency_ms
+    double loss = 0;               // probability that a datagram is dropped
+    size_t mtu = MAX_DATAGRAM_SIZE; // longer datagrams are refused, as receivers would drop them
+    double fail_fraction = 0;      // share of nodes that crash at fail_at
+    double fail_at = -1;           // virtual seconds; defaults to half the duration
+    uint64_t seed = 1;
+    size_t max_neighbours = 4096;
+    LivenessConfig liveness;       // hello timing of every simulated interface
+    int64_t digest_interval_ms = 0; // designated reporter mode when non-zero
+    int64_t gossip_interval_ms = 0; // topology gossip when non-zero
+    std::string replay_path;
+};
+
+enum class EventKind : uint8_t {
+    Start,   // node boots and sends its first hello
+    Deliver, // datagram arrives at node
+    Wake,    // node's next_deadline() is due
+};
+
+struct Event {
+    int64_t time_ms;
+    uint64_t sequence; // breaks ties so equal-time events run in schedule order
+    EventKind kind;
+    uint32_t node;
+    in_addr_t sender_ip;
+    std::shared_ptr<const std::string> payload;
+
+    bool operator>(const Event& other) const {
+        return time_ms != other.time_ms ? time_ms > other.time_ms : sequence > other.sequence;
+    }
+};
+
+class Network;
+
+// A node's view of the simulated network: broadcasts reach every node on
+// the same segment, unicasts reach the node owning the destination address.
+class SimTransport : public DiscoveryTransport {
+    Network* network;
+    uint32_t node;
+public:
+    SimTransport(Network* network, uint32_t node) : network(network), node(node) {}
+
+    int open(const std::vector<NetworkInterface>&, int) override { return 0; }
+    bool is_open() const override { return true; }
+    ssize_t send(uint16_t interface_id, in_addr_t destination, std::string_view data) override;
+    void attach(EventLoop&, DatagramSink&) override {}
+};
+
+struct SimNode {
+    NodeID id;
+    uint32_t segment;
+    std::vector<NetworkInterface> interfaces;
+    SeededRandom random;
+    MetricsRegistry registry;
+    SimTransport transport;
+    std::unique_ptr<DynamicNeighbourDiscovery> discovery; // created by the Start event
+    int64_t wake_ms = -1;                           // time of the pending Wake event
+    bool alive = true;
+    bool converged = false;
+
+    SimNode(Network* network, uint32_t index, uint64_t seed) : random(seed), transport(network, index) {}
+};
+
+struct SimStats {
+    uint64_t events = 0;
+    uint64_t sent = 0;
+    uint64_t delivered = 0;
+    uint64_t lost = 0;
+    uint64_t dropped_dead = 0;  // addressed to a crashed or not yet started node
+    uint64_t oversized = 0;     // refused for exceeding the MTU
+    int64_t hello_ns = 0;       // wall time spent in on_datagram
+    uint64_t probes_sent = 0;
+    uint64_t probes_answered = 0;
+    uint64_t recovered = 0;     // neighbours that answered a probe in time
+    int64_t convergence_ms = -1;
+    int64_t reconvergence_ms = -1;
+    size_t failed = 0;
+    uint64_t gossip_sent = 0;
+    size_t topology_complete = 0; // live nodes whose topology matches their segment at the end
+};
+
+class Network {
+    SimConfig config;
+    ManualClock clock;
+    SeededRandom random;
+    std::vector<std::unique_ptr<SimNode>> nodes;
+    std::vector<std::vector<uint32_t>> segments;        // segment -> node indices
+    std::vector<size_t> segment_alive;
+    std::unordered_map<in_addr_t, uint32_t> node_by_ip;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+    uint64_t next_sequence = 0;
+    size_t alive = 0;
+    size_t converged = 0;
+    int64_t fail_ms = -1;
+    SimStats sim_stats;
+
+    void schedule(int64_t time_ms, EventKind kind, uint32_t node, in_addr_t sender_ip = 0,
+                  std::shared_ptr<const std::string> payload = nullptr);
+    void deliver(const std::shared_ptr<const std::string>& payload, in_addr_t sender_ip, uint32_t to);
+    void start_node(uint32_t index);
+    void reschedule(uint32_t index);
+    bool is_converged(const SimNode& node) const;
+    void update_convergence(uint32_t index);
+    void fail_nodes();
+    size_t complete_topologies() const;
+public:
+    explicit Network(const SimConfig& config);
+
+    // Broadcast or unicast from node over its interface_id
+    ssize_t send(uint32_t node, uint16_t interface_id, in_addr_t destination, std::string_view data);
+    void run();
+    uint64_t digest() const;
+    const SimStats& stats() const { return sim_stats; }
+};
+
+int64_t now_ns();
+
+// Feeds a recorded hello trace through one engine in virtual time
+int replay(const SimConfig& config);
+
+} // namespace sim
+
+#endif // SIM_SIM_H
@@ -0,0 +1,96 @@
+#include "admission_control.h"
+
+#include <cstring>
+
+AdmissionControl::AdmissionControl(const AdmissionConfig& config, uint64_t seed)
+    : config(config), seed(seed)
+{
+}
+
+bool AdmissionControl::take(Bucket& bucket, int64_t now_ms, uint32_t rate) {
+    const uint64_t burst = (uint64_t)rate * 2 * 1000;
+
+    if (!bucket.used) {
+        bucket.used = true;
+        bucket.tokens = (uint32_t)burst;
+        bucket.updated_ms = now_ms;
+    } else if (now_ms > bucket.updated_ms) {
+        uint64_t refill = (uint64_t)(now_ms - bucket.updated_ms) * rate;
+        uint64_t tokens = bucket.tokens + refill;
+        bucket.tokens = (uint32_t)(tokens > burst ? burst : tokens);
+        bucket.updated_ms = now_ms;
+    }
+
+    if (bucket.tokens < 1000) {
+        return false;
+    }
+    bucket.tokens -= 1000;
+    return true;
+}
+
+uint64_t AdmissionControl::hash(uint64_t lo, uint64_t hi) const {
+    // Keys are chosen by peers, so mix in a per-table seed
+    uint64_t h = (lo ^ seed) * 0x9E3779B97F4A7C15ULL;
+    h ^= hi + (h >> 29);
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 32;
+    return h;
+}
+
+AdmissionControl::Bucket* AdmissionControl::lookup(std::array<Bucket, ADMISSION_TABLE_SIZE>& buckets, uint64_t key,
+                                                   int64_t now_ms) {
+    size_t set = (size_t)(key >> 32) & (ADMISSION_TABLE_SIZE / ADMISSION_WAYS - 1);
+    Bucket* ways = &buckets[set * ADMISSION_WAYS];
+    Bucket* victim = nullptr;
+    for (size_t i = 0; i < ADMISSION_WAYS; ++i) {
+        Bucket& bucket = ways[i];
+        if (bucket.used && bucket.key == key) {
+            return &bucket;
+        }
+        if (bucket.used && bucket.trusted && now_ms - bucket.updated_ms < ADMISSION_TRUST_IDLE_MS) {
+            continue;
+        }
+        if (!victim || !bucket.used || (victim->used && bucket.updated_ms < victim->updated_ms)) {
+            victim = &bucket;
+        }
+    }
+    if (victim) {
+        *victim = Bucket();
+        victim->key = key;
+    }
+    return victim;
+}
+
+bool AdmissionControl::admit_source(in_addr_t source, int64_t now_ms) {
+    Bucket* bucket = lookup(source_buckets, hash(source, 0), now_ms);
+    if (bucket && !take(*bucket, now_ms, config.source_rate)) {
+        ++admission_stats.dropped_source;
+        return false;
+    }
+    if ((!bucket || !bucket->trusted) && !take(global_bucket, now_ms, config.global_rate)) {
+        ++admission_stats.dropped_global;
+        return false;
+    }
+    return true;
+}
+
+bool AdmissionControl::admit_node(const NodeID& id, int64_t now_ms) {
+    uint64_t lo, hi;
+    std::memcpy(&lo, id.data(), sizeof(lo));
+    std::memcpy(&hi, id.data() + sizeof(lo), sizeof(hi));
+
+    // Node buckets are never trusted, so lookup always finds one
+    if (!take(*lookup(node_buckets, hash(lo, hi), now_ms), now_ms, config.node_rate)) {
+        ++admission_stats.dropped_node;
+        return false;
+    }
+    ++admission_stats.admitted;
+    return true;
+}
+
+void AdmissionControl::mark_trusted(in_addr_t source, int64_t now_ms) {
+    Bucket* bucket = lookup(source_buckets, hash(source, 0), now_ms);
+    if (bucket) {
+        bucket->trusted = true;
+    }
+}
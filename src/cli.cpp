@@ -2,7 +2,7 @@
 
 using namespace std;
 
-ServiceConnection service_connection(CLI_SOCKET_PATH);
+GrawClient service_connection(CLI_SOCKET_PATH);
 
 
 pid_t read_pid_file() {
@@ -27,32 +27,93 @@ bool is_service_running() {
     return (read_pid_file() > 0);
 }
 
+// Reads the service's readiness line from the pipe, or "" if it closed the
+// pipe (exited) without one. Sets timed_out if nothing came in time.
+static string read_readiness(int fd, int timeout_ms, bool& timed_out) {
+    string line;
+    timed_out = false;
+    int64_t deadline = helper::monotonic_ms() + timeout_ms;
+    char buffer[256];
+    while (line.find('\n') == string::npos) {
+        int64_t remaining = deadline - helper::monotonic_ms();
+        pollfd pfd = {fd, POLLIN, 0};
+        int ready = remaining > 0 ? poll(&pfd, 1, (int)remaining) : 0;
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready <= 0) {
+            timed_out = true;
+            break;
+        }
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        line.append(buffer, n);
+    }
+    return line.substr(0, line.find('\n'));
+}
+
 int start_service() {
     helper::log_info("Starting service...", false);
 
+    // The service writes one line to this pipe once its sockets are bound
+    int ready_pipe[2];
+    if (pipe2(ready_pipe, O_CLOEXEC) < 0) {
+        helper::log_error(string("pipe failed: ") + strerror(errno), false);
+        return -1;
+    }
+
+    int64_t started = helper::monotonic_ms();
     pid_t pid = fork();
     if (pid < 0) {
         helper::log_error("fork failed", false);
+        close(ready_pipe[0]);
+        close(ready_pipe[1]);
         return -1;
     } else if (pid == 0) {
+        close(ready_pipe[0]);
+        fcntl(ready_pipe[1], F_SETFD, 0); // survives the exec
+        setenv("GRAW_READY_FD", std::to_string(ready_pipe[1]).c_str(), 1);
         execl(SERVICE_BINARY, "graw_service", nullptr);
-        helper::log_error("execl failed", false);
-        exit(EXIT_FAILURE);
+        helper::log_error(string("execl failed: ") + strerror(errno), false);
+        _exit(EXIT_FAILURE);
     }
+    close(ready_pipe[1]);
+    service_pid = pid;
 
-    helper::log_info("Service started with PID: " + std::to_string(pid), false);
-    sleep(2);
+    bool timed_out = false;
+    string line = read_readiness(ready_pipe[0], SERVICE_READY_TIMEOUT_MS, timed_out);
+    close(ready_pipe[0]);
+    int64_t elapsed = helper::monotonic_ms() - started;
 
-    for( int i = 0; i < 5; ++i) {
-        if (is_service_running()) {
-            helper::log_info("Service is ready.", false);
-            return 0;
-        }
-        helper::log_info("Waiting for service to be ready...", false);
-        usleep(500000);
+    if (line == "READY=1") {
+        helper::log_info("Service (PID " + std::to_string(pid) + ") is ready after " + std::to_string(elapsed) + " ms.",
+                         false);
+        return 0;
+    }
+    if (timed_out) {
+        helper::log_error("Service (PID " + std::to_string(pid) + ") did not report readiness within " +
+                          std::to_string(SERVICE_READY_TIMEOUT_MS) + " ms.", false);
+        return -1;
     }
 
-    helper::log_error("Service did not start in time.", false);
+    // It failed: collect the exit status so no zombie is left behind
+    int status = 0;
+    waitpid(pid, &status, 0);
+    service_pid = -1;
+    if (line.compare(0, 6, "ERROR=") == 0) {
+        helper::log_error("Service failed to start: " + line.substr(6), false);
+    } else if (WIFEXITED(status)) {
+        helper::log_error("Service exited with status " + std::to_string(WEXITSTATUS(status)) +
+                          " before it was ready.", false);
+    } else {
+        helper::log_error("Service was killed by signal " + std::to_string(WTERMSIG(status)) +
+                          " before it was ready.", false);
+    }
     return -1;
 }
 
@@ -78,32 +139,126 @@ void stop_service() {
     }
 }
 
-int main() {
+void print_help() {
+    cout << "Available commands:" << endl;
+    cout << "start - Start the neighbor discovery service" << endl;
+    cout << "stop - Stop the neighbor discovery service" << endl;
+    cout << "status - Check the status of the neighbor discovery service" << endl;
+    cout << "help - Show this help message" << endl;
+    cout << "DOMAINS - List the discovery domains the service hosts" << endl;
+    cout << "DOMAIN <name> <command> - Run LIST, RELAYED, TOPOLOGY or HISTORY in one domain (default: the first)" << endl;
+    cout << "HISTORY <node|*> [SINCE <time>] - Show journaled neighbour events, since unix seconds or e.g. 30M ago" << endl;
+    cout << "LIST - List all discovered neighbors from service (LIST JSON for JSON)" << endl;
+    cout << "PING - Send a PING request to the service" << endl;
+    cout << "RELAYED - List neighbours relayed from other subnets" << endl;
+    cout << "STATS - Show service metrics in Prometheus text format" << endl;
+    cout << "TOPOLOGY - Show the links of every node on the segment, as gossiped" << endl;
+    cout << "TRACE - Dump recent event loop spans as Chrome trace JSON" << endl;
+    cout << "quit - Exit the CLI" << endl;
+}
+
+void print_status() {
+    if (is_service_running()) {
+        helper::log_info("Service is running", false);
+    } else {
+        helper::log_info("Service is not running", false);
+    }
+    if (service_connection.ping()) {
+        helper::log_info("Can connect to service.", false);
+    } else {
+        helper::log_info("Cannot connect to service.", false);
+    }
+}
+
+// One command from the command line, e.g. "graw_cli list --json", with the
+// reply printed as is for scripts
+int run_once(int argc, char* argv[]) {
+    string command;
+    string domain;
+    bool json = false;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--json") {
+            json = true;
+            continue;
+        }
+        if (arg == "--domain" && i + 1 < argc) {
+            domain = argv[++i];
+            continue;
+        }
+        if (!command.empty()) {
+            command += ' ';
+        }
+        command += arg;
+    }
+
+    if (command == "help" || command == "--help") {
+        cout << "Usage: " << argv[0] << " [COMMAND [--json] [--domain NAME]]" << endl
+             << "Without a command, reads commands interactively." << endl;
+        print_help();
+        return 0;
+    } else if (command == "start") {
+        if (is_service_running() && service_connection.ping()) {
+            helper::log_info("Service is already running", false);
+            return 0;
+        }
+        return start_service() < 0 ? 1 : 0;
+    } else if (command == "stop") {
+        stop_service();
+        return 0;
+    } else if (command == "status") {
+        print_status();
+        return is_service_running() ? 0 : 1;
+    }
+
+    for (char& c : command) {
+        c = (char)toupper((unsigned char)c);
+    }
+    if (json) {
+        if (command != "LIST") {
+            cerr << "--json is only supported by list" << endl;
+            return 1;
+        }
+        command += " JSON";
+    }
+    if (!domain.empty()) {
+        command = "DOMAIN " + domain + " " + command;
+    }
+
+    string response;
+    if (!service_connection.request(command, response)) {
+        cerr << response << endl;
+        return 1;
+    }
+    cout << response;
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1) {
+        return run_once(argc, argv);
+    }
+
     helper::log_info("Connecting to neighbor discovery service...", false);
 
     while (true) {
         cout << "> ";
         string input;
-        getline(cin, input);
+        if (!getline(cin, input)) {
+            break;
+        }
 
         if (input == "quit" || input == "exit") {
             break;
         }
 
         if (input == "help") {
-            cout << "Available commands:" << endl;
-            cout << "start - Start the neighbor discovery service" << endl;
-            cout << "stop - Stop the neighbor discovery service" << endl;
-            cout << "status - Check the status of the neighbor discovery service" << endl;
-            cout << "help - Show this help message" << endl;
-            cout << "LIST - List all discovered neighbors from service" << endl;
-            cout << "PING - Send a PING request to the service" << endl;
-            cout << "quit - Exit the CLI" << endl;
+            print_help();
             continue;
         }
 
         if (input == "start") {
-            if (is_service_running() && service_connection.can_connect()) {
+            if (is_service_running() && service_connection.ping()) {
                 helper::log_info("Service is already running", false);
             } else {
                 start_service();
@@ -118,16 +273,7 @@ int main() {
         }
 
         if (input == "status") {
-            if (is_service_running()) {
-                helper::log_info("Service is running", false);
-            } else {
-                helper::log_info("Service is not running", false);
-            }
-            if (service_connection.can_connect()) {
-                helper::log_info("Can connect to service.", false);
-            } else {
-                helper::log_info("Cannot connect to service.", false);
-            }
+            print_status();
             continue;
         }
 
@@ -135,14 +281,14 @@ int main() {
             continue;
         }
         string response;
-        if (service_connection.send_and_receive(input, response)) {
+        if (service_connection.request(input, response)) {
             cout << "Response: " + response << endl;
         } else {
-            helper::log_error("Failed to send command or receive response.", false);
+            helper::log_error("Failed to send command or receive response: " + response, false);
         }
     }
     stop_service();
     helper::log_info("Disconnected from service.", false);
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,10 @@
+#include "common/clock.h"
+#include "common/helper.h"
+
+int64_t SystemClock::now_ms() const {
+    return helper::monotonic_ms();
+}
+
+int64_t SystemClock::now_us() const {
+    return helper::monotonic_us();
+}
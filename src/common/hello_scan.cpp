@@ -0,0 +1,302 @@
+#include "common/hello_scan.h"
+
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Masks of one 64 byte block
+struct BlockMasks {
+    uint64_t ends;
+    uint64_t breaks;
+    uint64_t colons;
+    uint64_t hex;
+};
+
+struct SimdImpl {
+    void (*classify)(const char* block, BlockMasks& masks);
+    bool (*decode)(const char* hex, uint8_t* out);
+};
+
+int hex_digit_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Eight bytes at a time in a 64-bit word, for CPUs without the vector
+// paths below. Each helper leaves the high bit set in the matching bytes.
+const uint64_t ONES = 0x0101010101010101ULL;
+const uint64_t HIGH = 0x8080808080808080ULL;
+
+inline uint64_t swar_equal(uint64_t x, char c) {
+    uint64_t y = x ^ (ONES * (uint8_t)c);
+    return ~(((y & ~HIGH) + ~HIGH) | y) & HIGH;
+}
+
+// Bytes in [lo, hi], both below 0x80. The sums stay within their bytes
+// because the high bits are cleared first.
+inline uint64_t swar_range(uint64_t x, uint8_t lo, uint8_t hi) {
+    uint64_t low = x & ~HIGH;
+    return (low + ONES * (0x80 - lo)) & ~(low + ONES * (0x7F - hi)) & ~x & HIGH;
+}
+
+// Gathers the high bits into the low byte, first byte lowest
+inline uint64_t swar_bits(uint64_t high) {
+    return ((high >> 7) * 0x0102040810204080ULL) >> 56;
+}
+
+void classify_scalar(const char* block, BlockMasks& masks) {
+    masks = BlockMasks{0, 0, 0, 0};
+    for (unsigned i = 0; i < 64; i += 8) {
+        uint64_t x;
+        std::memcpy(&x, block + i, sizeof(x));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        x = __builtin_bswap64(x);
+#endif
+        uint64_t breaks = swar_equal(x, '\r') | swar_equal(x, '\n');
+        uint64_t hex = swar_range(x, '0', '9') | swar_range(x | (ONES * 0x20), 'a', 'f');
+        masks.ends |= swar_bits(breaks | swar_equal(x, ' ')) << i;
+        masks.breaks |= swar_bits(breaks) << i;
+        masks.colons |= swar_bits(swar_equal(x, ':')) << i;
+        masks.hex |= swar_bits(hex) << i;
+    }
+}
+
+bool decode_scalar(const char* hex, uint8_t* out) {
+    for (size_t i = 0; i < sizeof(NodeID); ++i) {
+        int hi = hex_digit_value(hex[i * 2]);
+        int lo = hex_digit_value(hex[i * 2 + 1]);
+        if (hi < 0 || lo < 0) return false;
+        out[i] = (uint8_t)((hi << 4) | lo);
+    }
+    return true;
+}
+
+#if defined(__x86_64__)
+
+// Bytes above 0x7f compare as negative, so the signed range checks below
+// never take them for digits or letters
+
+void classify_sse2(const char* block, BlockMasks& masks) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    masks = BlockMasks{0, 0, 0, 0};
+    for (unsigned i = 0; i < 64; i += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i*)(block + i));
+        __m128i lower = _mm_or_si128(c, case_bit);
+        __m128i breaks = _mm_or_si128(_mm_cmpeq_epi8(c, cr), _mm_cmpeq_epi8(c, lf));
+        __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+                                      _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+        __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                       _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+        masks.ends |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_or_si128(breaks, _mm_cmpeq_epi8(c, space))) << i;
+        masks.breaks |= (uint64_t)(uint16_t)_mm_movemask_epi8(breaks) << i;
+        masks.colons |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(c, colon)) << i;
+        masks.hex |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_or_si128(digit, letter)) << i;
+    }
+}
+
+// Nibble values of 16 hex digits, or false if one is not a hex digit
+inline bool hex_nibbles_sse2(__m128i c, __m128i& nibbles) {
+    __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+                                  _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+    __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                   _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    if (_mm_movemask_epi8(_mm_or_si128(digit, letter)) != 0xFFFF) {
+        return false;
+    }
+    nibbles = _mm_or_si128(_mm_and_si128(digit, _mm_sub_epi8(c, _mm_set1_epi8('0'))),
+                           _mm_andnot_si128(digit, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+    return true;
+}
+
+// Joins nibble pairs into bytes, one per 16-bit lane: high nibble first
+inline __m128i join_nibbles_sse2(__m128i nibbles) {
+    return _mm_or_si128(_mm_and_si128(_mm_slli_epi16(nibbles, 4), _mm_set1_epi16(0x00F0)),
+                        _mm_srli_epi16(nibbles, 8));
+}
+
+bool decode_sse2(const char* hex, uint8_t* out) {
+    __m128i first, second;
+    if (!hex_nibbles_sse2(_mm_loadu_si128((const __m128i*)hex), first) ||
+        !hex_nibbles_sse2(_mm_loadu_si128((const __m128i*)(hex + 16)), second)) {
+        return false;
+    }
+    _mm_storeu_si128((__m128i*)out, _mm_packus_epi16(join_nibbles_sse2(first), join_nibbles_sse2(second)));
+    return true;
+}
+
+__attribute__((target("avx2")))
+void classify_avx2(const char* block, BlockMasks& masks) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+    masks = BlockMasks{0, 0, 0, 0};
+    for (unsigned i = 0; i < 64; i += 32) {
+        __m256i c = _mm256_loadu_si256((const __m256i*)(block + i));
+        __m256i lower = _mm256_or_si256(c, case_bit);
+        __m256i breaks = _mm256_or_si256(_mm256_cmpeq_epi8(c, cr), _mm256_cmpeq_epi8(c, lf));
+        __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('0' - 1)),
+                                         _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), c));
+        __m256i letter = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                                          _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), lower));
+        masks.ends |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_or_si256(breaks, _mm256_cmpeq_epi8(c, space))) << i;
+        masks.breaks |= (uint64_t)(uint32_t)_mm256_movemask_epi8(breaks) << i;
+        masks.colons |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, colon)) << i;
+        masks.hex |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_or_si256(digit, letter)) << i;
+    }
+}
+
+__attribute__((target("avx2")))
+bool decode_avx2(const char* hex, uint8_t* out) {
+    __m256i c = _mm256_loadu_si256((const __m256i*)hex);
+    __m256i lower = _mm256_or_si256(c, _mm256_set1_epi8(0x20));
+    __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('0' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), c));
+    __m256i letter = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                                      _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), lower));
+    if ((uint32_t)_mm256_movemask_epi8(_mm256_or_si256(digit, letter)) != 0xFFFFFFFFu) {
+        return false;
+    }
+    __m256i nibbles = _mm256_or_si256(_mm256_and_si256(digit, _mm256_sub_epi8(c, _mm256_set1_epi8('0'))),
+                                      _mm256_andnot_si256(digit, _mm256_sub_epi8(lower, _mm256_set1_epi8('a' - 10))));
+    __m256i bytes = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi16(nibbles, 4), _mm256_set1_epi16(0x00F0)),
+                                    _mm256_srli_epi16(nibbles, 8));
+    // packus works within 128-bit lanes, so pack the two halves by hand
+    _mm_storeu_si128((__m128i*)out, _mm_packus_epi16(_mm256_castsi256_si128(bytes),
+                                                     _mm256_extracti128_si256(bytes, 1)));
+    return true;
+}
+
+#endif
+
+const SimdImpl IMPLS[] = {
+    {classify_scalar, decode_scalar},
+#if defined(__x86_64__)
+    {classify_sse2, decode_sse2},
+    {classify_avx2, decode_avx2},
+#endif
+};
+
+bool supported(SimdLevel level) {
+#if defined(__x86_64__)
+    if (level == SimdLevel::AVX2) {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    }
+    return true;
+#else
+    return level == SimdLevel::Scalar;
+#endif
+}
+
+SimdLevel detect() {
+    for (SimdLevel level : {SimdLevel::AVX2, SimdLevel::SSE2}) {
+        if (supported(level)) {
+            return level;
+        }
+    }
+    return SimdLevel::Scalar;
+}
+
+// Constant initialised, so parsing works even from other static
+// initialisers; the best level is switched in during dynamic initialisation
+SimdLevel active_level = SimdLevel::Scalar;
+const SimdImpl* active = &IMPLS[0];
+
+} // namespace
+
+size_t HelloScan::next(const uint64_t* mask, size_t from) const {
+    if (from >= size) {
+        return size;
+    }
+    size_t word = from / 64;
+    uint64_t bits = mask[word] & (~0ULL << (from % 64));
+    while (bits == 0) {
+        if (++word >= HELLO_SCAN_WORDS) {
+            return size;
+        }
+        bits = mask[word];
+    }
+    return word * 64 + __builtin_ctzll(bits);
+}
+
+bool HelloScan::any(const uint64_t* mask, size_t from, size_t to) const {
+    return count(mask, from, to) != 0;
+}
+
+size_t HelloScan::count(const uint64_t* mask, size_t from, size_t to) const {
+    size_t total = 0;
+    to = to < size ? to : size;
+    while (from < to) {
+        size_t word = from / 64;
+        size_t end = (word + 1) * 64 < to ? (word + 1) * 64 : to;
+        uint64_t bits = mask[word] >> (from % 64);
+        size_t width = end - from;
+        if (width < 64) {
+            bits &= (1ULL << width) - 1;
+        }
+        total += __builtin_popcountll(bits);
+        from = end;
+    }
+    return total;
+}
+
+void scan_hello(std::string_view data, HelloScan& scan) {
+    scan.size = data.size() < HELLO_SCAN_BYTES ? data.size() : HELLO_SCAN_BYTES;
+    for (size_t word = 0; word < HELLO_SCAN_WORDS; ++word) {
+        size_t offset = word * 64;
+        BlockMasks masks{0, 0, 0, 0};
+        if (offset + 64 <= scan.size) {
+            active->classify(data.data() + offset, masks);
+        } else if (offset < scan.size) {
+            // Zero padding belongs to no class, so the tail reads past nothing
+            char block[64] = {};
+            std::memcpy(block, data.data() + offset, scan.size - offset);
+            active->classify(block, masks);
+        }
+        scan.ends[word] = masks.ends;
+        scan.breaks[word] = masks.breaks;
+        scan.colons[word] = masks.colons;
+        scan.hex[word] = masks.hex;
+    }
+}
+
+bool decode_node_id(const char* hex, NodeID& id) {
+    return active->decode(hex, id.data());
+}
+
+SimdLevel simd_level() {
+    return active_level;
+}
+
+const char* simd_level_name(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::Scalar: return "scalar";
+        case SimdLevel::SSE2: return "SSE2";
+        case SimdLevel::AVX2: return "AVX2";
+    }
+    return "unknown";
+}
+
+bool set_simd_level(SimdLevel level) {
+    if (!supported(level)) {
+        return false;
+    }
+    active_level = level;
+    active = &IMPLS[(size_t)level];
+    return true;
+}
+
+[[maybe_unused]] static const bool simd_detected = set_simd_level(detect());
@@ -75,13 +75,58 @@ namespace helper {
         return (ntohl(ip_addr.s_addr) & mask) == (ntohl(network_addr.s_addr) & mask);
     }
 
-    void log_error(const std::string& message, bool quiet_mode) {
+    std::string ip_to_string(in_addr_t ip) {
+        char buffer[INET_ADDRSTRLEN];
+        struct in_addr address;
+        address.s_addr = ip;
+        inet_ntop(AF_INET, &address, buffer, sizeof(buffer));
+        return std::string(buffer);
+    }
+
+    std::string mac_to_string(const MAC_Bytes& mac) {
+        // Same formatting as ether_ntoa so LIST output is unchanged
+        char buffer[18];
+        ether_ntoa_r((const struct ether_addr*)mac.data(), buffer);
+        return std::string(buffer);
+    }
+
+    bool parse_mac(std::string_view text, MAC_Bytes& mac) {
+        char buffer[18];
+        if (text.empty() || text.size() >= sizeof(buffer)) return false;
+        std::memcpy(buffer, text.data(), text.size());
+        buffer[text.size()] = '\0';
+
+        struct ether_addr addr;
+        if (!ether_aton_r(buffer, &addr)) return false;
+        std::memcpy(mac.data(), addr.ether_addr_octet, mac.size());
+        return true;
+    }
+
+    int64_t monotonic_ms() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    }
+
+    int64_t monotonic_us() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    }
+
+    int64_t realtime_ms() {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    }
+
+    void log_error(std::string_view message, bool quiet_mode) {
         if (!quiet_mode) {
             std::cerr << "Error: " << message << std::endl;
         }
     }
     
-    void log_info(const std::string& message, bool quiet_mode) {
+    void log_info(std::string_view message, bool quiet_mode) {
         if (!quiet_mode) {
             std::cout << "Info: " << message << std::endl;
         }
@@ -0,0 +1,155 @@
+#include "common/logger.h"
+#include "common/helper.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <sys/uio.h>
+
+namespace logger {
+
+LogLevel current_level = LogLevel::Info;
+
+namespace {
+
+struct LogRecord {
+    LogLevel level;
+    uint16_t length;
+    char text[LOG_RECORD_SIZE - sizeof(uint16_t) - sizeof(LogLevel)];
+};
+
+// Records are added at head and written out from tail, both on the
+// event-loop thread; flush() runs between ticks
+LogRecord records[LOG_RING_SIZE];
+uint32_t head = 0;
+uint32_t tail = 0;
+uint64_t dropped_records = 0;
+
+const char* level_prefix(LogLevel level) {
+    switch (level) {
+        case LogLevel::Debug: return "Debug: ";
+        case LogLevel::Info: return "Info: ";
+        case LogLevel::Warn: return "Warning: ";
+        default: return "Error: ";
+    }
+}
+
+int level_fd(LogLevel level) {
+    return level >= LogLevel::Warn ? STDERR_FILENO : STDOUT_FILENO;
+}
+
+LogRecord* reserve() {
+    if (head - tail >= LOG_RING_SIZE) {
+        ++dropped_records;
+        return nullptr;
+    }
+    return &records[head & (LOG_RING_SIZE - 1)];
+}
+
+void commit() {
+    ++head;
+}
+
+void append(LogLevel level, const char* fmt, va_list args) {
+    LogRecord* record = reserve();
+    if (!record) {
+        return;
+    }
+
+    size_t capacity = sizeof(record->text) - 1; // keep room for the newline
+    int prefix = snprintf(record->text, capacity, "%s", level_prefix(level));
+    int body = vsnprintf(record->text + prefix, capacity - prefix, fmt, args);
+    size_t length = prefix + (body < 0 ? 0 : std::min<size_t>(body, capacity - prefix - 1));
+    record->text[length++] = '\n';
+    record->length = (uint16_t)length;
+    record->level = level;
+    commit();
+}
+
+} // namespace
+
+void set_level(LogLevel level) {
+    current_level = level;
+}
+
+bool parse_level(const char* text, LogLevel& level) {
+    static const char* names[] = {"debug", "info", "warn", "error", "off"};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        if (strcmp(text, names[i]) == 0) {
+            level = (LogLevel)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void write(LogLevel level, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    append(level, fmt, args);
+    va_end(args);
+}
+
+void write_limited(RateLimit& limit, LogLevel level, const char* fmt, ...) {
+    int64_t now = helper::monotonic_ms();
+    if (now - limit.window_start >= LOG_RATE_LIMIT_WINDOW_MS) {
+        if (limit.suppressed > 0) {
+            write(LogLevel::Warn, "Suppressed %u messages like \"%s\"", limit.suppressed, fmt);
+        }
+        limit.window_start = now;
+        limit.emitted = 0;
+        limit.suppressed = 0;
+    }
+    if (limit.emitted >= LOG_RATE_LIMIT_BURST) {
+        ++limit.suppressed;
+        return;
+    }
+    ++limit.emitted;
+
+    va_list args;
+    va_start(args, fmt);
+    append(level, fmt, args);
+    va_end(args);
+}
+
+void flush() {
+    const size_t batch = 64;
+    struct iovec iov[batch];
+
+    while (tail != head) {
+        // Gather consecutive records bound for the same stream into one writev
+        int fd = level_fd(records[tail & (LOG_RING_SIZE - 1)].level);
+        size_t count = 0;
+        while (tail != head && count < batch) {
+            LogRecord& record = records[tail & (LOG_RING_SIZE - 1)];
+            if (level_fd(record.level) != fd) {
+                break;
+            }
+            iov[count].iov_base = record.text;
+            iov[count].iov_len = record.length;
+            ++count;
+            ++tail;
+        }
+        if (writev(fd, iov, (int)count) < 0) {
+            // Nothing sensible to do if stdout/stderr are gone
+        }
+    }
+
+    uint64_t lost = dropped_records;
+    dropped_records = 0;
+    if (lost > 0) {
+        char text[64];
+        int length = snprintf(text, sizeof(text), "Warning: log ring full, dropped %llu messages\n",
+                              (unsigned long long)lost);
+        if (::write(STDERR_FILENO, text, length) < 0) {
+            // As above
+        }
+    }
+}
+
+uint64_t dropped() {
+    return dropped_records;
+}
+
+} // namespace logger
@@ -0,0 +1,166 @@
+#include "common/metrics.h"
+#include "common/helper.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+const char* type_name(MetricType type) {
+    switch (type) {
+        case MetricType::Counter: return "counter";
+        case MetricType::Gauge: return "gauge";
+        default: return "histogram";
+    }
+}
+
+void append_sample(std::string& out, const char* name, const char* suffix, const std::string& labels,
+                   const char* extra_label, const char* value) {
+    out += name;
+    out += suffix;
+    if (!labels.empty() || extra_label) {
+        out += '{';
+        out += labels;
+        if (extra_label) {
+            if (!labels.empty()) {
+                out += ',';
+            }
+            out += extra_label;
+        }
+        out += '}';
+    }
+    out += ' ';
+    out += value;
+    out += '\n';
+}
+
+} // namespace
+
+std::string MetricsRegistry::scoped(const std::string& labels) const {
+    if (scope_labels.empty() || labels.empty()) {
+        return scope_labels + labels;
+    }
+    return scope_labels + "," + labels;
+}
+
+Counter& MetricsRegistry::counter(const char* name, const char* help, const std::string& labels) {
+    counters.emplace_back();
+    entries.push_back({name, help, scoped(labels), MetricType::Counter, counters.size() - 1});
+    return counters.back();
+}
+
+Gauge& MetricsRegistry::gauge(const char* name, const char* help, const std::string& labels) {
+    gauges.emplace_back();
+    entries.push_back({name, help, scoped(labels), MetricType::Gauge, gauges.size() - 1});
+    return gauges.back();
+}
+
+Histogram& MetricsRegistry::histogram(const char* name, const char* help, const std::string& labels) {
+    histograms.emplace_back();
+    entries.push_back({name, help, scoped(labels), MetricType::Histogram, histograms.size() - 1});
+    return histograms.back();
+}
+
+void MetricsRegistry::render_entry(const Entry& entry, std::string& out) const {
+    char value[32];
+
+    if (entry.type == MetricType::Counter) {
+        snprintf(value, sizeof(value), "%llu", (unsigned long long)counters[entry.index].value);
+        append_sample(out, entry.name, "", entry.labels, nullptr, value);
+        return;
+    }
+    if (entry.type == MetricType::Gauge) {
+        snprintf(value, sizeof(value), "%lld", (long long)gauges[entry.index].value);
+        append_sample(out, entry.name, "", entry.labels, nullptr, value);
+        return;
+    }
+
+    // Histograms are kept in microseconds and exported in seconds
+    const Histogram& histogram = histograms[entry.index];
+    char le[32];
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i <= HISTOGRAM_BUCKETS; ++i) {
+        cumulative += histogram.buckets[i];
+        if (i < HISTOGRAM_BUCKETS) {
+            snprintf(le, sizeof(le), "le=\"%g\"", HISTOGRAM_BOUNDS_US[i] / 1e6);
+        } else {
+            snprintf(le, sizeof(le), "le=\"+Inf\"");
+        }
+        snprintf(value, sizeof(value), "%llu", (unsigned long long)cumulative);
+        append_sample(out, entry.name, "_bucket", entry.labels, le, value);
+    }
+    snprintf(value, sizeof(value), "%.6f", histogram.sum_us / 1e6);
+    append_sample(out, entry.name, "_sum", entry.labels, nullptr, value);
+    snprintf(value, sizeof(value), "%llu", (unsigned long long)histogram.count);
+    append_sample(out, entry.name, "_count", entry.labels, nullptr, value);
+}
+
+std::string MetricsRegistry::render() const {
+    std::string out;
+    out.reserve(entries.size() * 128);
+
+    // Samples sharing a name must follow a single HELP/TYPE header
+    std::vector<bool> rendered(entries.size(), false);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (rendered[i]) {
+            continue;
+        }
+        out += "# HELP ";
+        out += entries[i].name;
+        out += ' ';
+        out += entries[i].help;
+        out += "\n# TYPE ";
+        out += entries[i].name;
+        out += ' ';
+        out += type_name(entries[i].type);
+        out += '\n';
+        for (size_t j = i; j < entries.size(); ++j) {
+            if (!rendered[j] && std::string(entries[j].name) == entries[i].name) {
+                render_entry(entries[j], out);
+                rendered[j] = true;
+            }
+        }
+    }
+    return out;
+}
+
+int MetricsRegistry::write_textfile(const std::string& path) const {
+    std::string tmp_path = path + ".tmp";
+    std::string text = render();
+
+    int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+
+    size_t written = 0;
+    while (written < text.size()) {
+        ssize_t n = write(fd, text.data() + written, text.size() - written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            close(fd);
+            unlink(tmp_path.c_str());
+            return -1;
+        }
+        written += n;
+    }
+
+    if (close(fd) < 0 || rename(tmp_path.c_str(), path.c_str()) < 0) {
+        unlink(tmp_path.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+ScopedTimer::ScopedTimer(Histogram& histogram)
+    : histogram(histogram), start_us(helper::monotonic_us())
+{
+}
+
+ScopedTimer::~ScopedTimer() {
+    histogram.observe(helper::monotonic_us() - start_us);
+}
@@ -58,7 +58,7 @@ static bool ensure_dir(const char* dirpath) {
     return !(mkdir(dirpath, 0700) != 0 && errno != EEXIST);
 }
 
-NodeID generate_node_id()
+NodeID generate_node_id(const std::string& domain)
 {
     NodeID id{};
     const char* home = getenv("HOME");
@@ -67,7 +67,7 @@ NodeID generate_node_id()
     char dirpath[1024];
     char filepath[1024];
     snprintf(dirpath, sizeof(dirpath), "%s/%s", home, kNodeIdDir);
-    snprintf(filepath, sizeof(filepath), "%s/%s", home, kNodeIdFile);
+    snprintf(filepath, sizeof(filepath), "%s/%s%s%s", home, kNodeIdFile, domain.empty() ? "" : ".", domain.c_str());
 
     if (read_file(filepath, id.data(), id.size())) return id;
 
@@ -87,8 +87,33 @@ NodeID generate_node_id()
 
 NodeIDHex node_id_to_hex(const NodeID& id) {
     char hex_str[33]; // 32 hex digits + null terminator
+    node_id_to_hex(id, hex_str);
+    return NodeIDHex(hex_str);
+}
+
+void node_id_to_hex(const NodeID& id, char* out) {
+    static const char digits[] = "0123456789abcdef";
     for (size_t i = 0; i < id.size(); ++i) {
-        snprintf(hex_str + i * 2, 3, "%02x", id[i]);
+        out[i * 2] = digits[id[i] >> 4];
+        out[i * 2 + 1] = digits[id[i] & 0x0F];
     }
-    return NodeIDHex(hex_str);
-}
\ No newline at end of file
+    out[id.size() * 2] = '\0';
+}
+
+static int hex_digit_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool node_id_from_hex(std::string_view hex, NodeID& id) {
+    if (hex.size() != id.size() * 2) return false;
+    for (size_t i = 0; i < id.size(); ++i) {
+        int hi = hex_digit_value(hex[i * 2]);
+        int lo = hex_digit_value(hex[i * 2 + 1]);
+        if (hi < 0 || lo < 0) return false;
+        id[i] = (uint8_t)((hi << 4) | lo);
+    }
+    return true;
+}
@@ -0,0 +1,83 @@
+#include "common/trace.h"
+#include "common/helper.h"
+
+#include <cstdio>
+#include <unistd.h>
+
+namespace trace {
+
+bool enabled = false;
+
+namespace {
+
+TraceEvent events[TRACE_RING_SIZE];
+uint64_t head = 0;
+
+} // namespace
+
+void set_enabled(bool value) {
+    enabled = value;
+}
+
+void record(const char* name, int64_t start_us, int64_t end_us) {
+    TraceEvent& event = events[head & (TRACE_RING_SIZE - 1)];
+    event.name = name;
+    event.start_us = start_us;
+    event.duration_us = (uint32_t)(end_us - start_us);
+    ++head;
+}
+
+std::string to_chrome_json() {
+    std::string out;
+    uint64_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+    out.reserve((head - first) * 80 + 32);
+    out += "{\"traceEvents\":[";
+
+    char line[160];
+    int pid = getpid();
+    for (uint64_t i = first; i < head; ++i) {
+        const TraceEvent& event = events[i & (TRACE_RING_SIZE - 1)];
+        snprintf(line, sizeof(line),
+                 "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%u,\"pid\":%d,\"tid\":%d}",
+                 i == first ? "" : ",", event.name, (long long)event.start_us, event.duration_us, pid, pid);
+        out += line;
+    }
+    out += "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return out;
+}
+
+} // namespace trace
+
+void LoopBreakdown::format(char* out, size_t size) const {
+    size_t used = 0;
+    out[0] = '\0';
+    for (size_t i = 0; i < count && used < size; ++i) {
+        int written = snprintf(out + used, size - used, "%s%s %.3f ms", i == 0 ? "" : ", ", phases[i],
+                               durations_us[i] / 1000.0);
+        if (written < 0) {
+            break;
+        }
+        used += written;
+    }
+}
+
+TraceSpan::TraceSpan(const char* name, LoopBreakdown* breakdown)
+    : name(name), breakdown(breakdown), start_us(0)
+{
+    if (breakdown || trace::enabled) {
+        start_us = helper::monotonic_us();
+    }
+}
+
+TraceSpan::~TraceSpan() {
+    if (!breakdown && !trace::enabled) {
+        return;
+    }
+    int64_t end_us = helper::monotonic_us();
+    if (trace::enabled) {
+        trace::record(name, start_us, end_us);
+    }
+    if (breakdown) {
+        breakdown->add(name, (uint32_t)(end_us - start_us));
+    }
+}
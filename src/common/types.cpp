@@ -1,6 +1,8 @@
 #include "common/types.h"
 #include "common/helper.h"
 
+#include <charconv>
+
 NetworkInterface NetworkInterface::from_ifaddrs(struct ifaddrs* ifa) {
     // Only handle IPv4 for this function
     if (ifa->ifa_addr->sa_family != AF_INET) { 
@@ -14,79 +16,425 @@ NetworkInterface NetworkInterface::from_ifaddrs(struct ifaddrs* ifa) {
 
     struct sockaddr_in* addr_in = (struct sockaddr_in*)ifa->ifa_addr;
     interface.ip_address = inet_ntoa(addr_in->sin_addr);
+    interface.ipv4_address = addr_in->sin_addr.s_addr;
     interface.mac_address = helper::get_mac_address(interface.name);
     
     if (ifa->ifa_netmask) {
         struct sockaddr_in* netmask_in = (struct sockaddr_in*)ifa->ifa_netmask;
         interface.subnet_mask = inet_ntoa(netmask_in->sin_addr);
+        interface.ipv4_netmask = netmask_in->sin_addr.s_addr;
         int cidr = helper::netmask_to_cidr(netmask_in);
         interface.network_cidr = helper::network_cidr(interface.ip_address, cidr);
     }
     interface.broadcast_address = helper::broadcast_address(interface.network_cidr);
+    if (!interface.broadcast_address.empty()) {
+        interface.ipv4_broadcast = inet_addr(interface.broadcast_address.c_str());
+    }
 
     return interface;
 }
 
-void NetworkNeighbor::update_last_seen() {
-    last_seen = time(nullptr);
+int list_network_interfaces(std::vector<NetworkInterface>& interfaces, bool include_loopback) {
+    struct ifaddrs* ifaddr;
+    if (getifaddrs(&ifaddr) == -1) {
+        return -1;
+    }
+    for (struct ifaddrs* ifa = ifaddr; ifa != nullptr; ifa = ifa->ifa_next) {
+        if (ifa->ifa_addr == nullptr || ((ifa->ifa_flags & IFF_LOOPBACK) && !include_loopback)) {
+            continue;
+        }
+        NetworkInterface interface = NetworkInterface::from_ifaddrs(ifa);
+        if (!interface.ip_address.empty()) {
+            interfaces.push_back(interface);
+        }
+    }
+    freeifaddrs(ifaddr);
+    return 0;
 }
 
-bool NetworkNeighbor::is_active() const {
-    return (time(nullptr) - last_seen) < 30; // Active if seen in the last 30 seconds
+NetworkConnection* NetworkNeighbor::find_connection(const MAC_Bytes& mac_address) {
+    for (auto& conn : connections) {
+        if (conn.mac_address == mac_address) {
+            return &conn;
+        }
+    }
+    return nullptr;
 }
 
-void NetworkNeighbor::add_interface(const NetworkInterface& interface) {
-    if (std::find(interface_names.begin(), interface_names.end(), interface.name) == interface_names.end()) {
-        interface_names.push_back(interface.name);
+NetworkConnection* NetworkNeighbor::add_connection(const NetworkConnection& connection, bool& changed) {
+    changed = false;
+    if (NetworkConnection* conn = find_connection(connection.mac_address)) {
+        if (conn->ip != connection.ip || conn->interface_id != connection.interface_id) {
+            *conn = connection; // Same MAC on a new address or interface is a new link
+            changed = true;
+        }
+        return conn;
+    }
+    if (connections.size() >= MAX_CONNECTIONS_PER_NEIGHBOUR || !connections.push_back(connection)) {
+        return nullptr;
     }
+    changed = true;
+    return &connections[connections.size() - 1];
 }
 
-void NetworkNeighbor::add_connection(const NetworkConnection& connection) {
-    auto it = std::find_if(connections.begin(), connections.end(),
-        [&connection](const NetworkConnection& conn) { 
-            return conn.mac_address == connection.mac_address; 
-        });
+bool NetworkNeighbor::has_interface(uint16_t interface_id) const {
+    for (const auto& conn : connections) {
+        if (conn.interface_id == interface_id) {
+            return true;
+        }
+    }
+    return false;
+}
 
-    if (it != connections.end()) {
-        it->ip = connection.ip; // Update IP if MAC already exists
-    } else {
-        connections.push_back(connection); // Add new connection
+bool DiscoveryPackage::from_string(std::string_view data, DiscoveryPackage& pkg) {
+    HelloScan scan;
+    scan_hello(data, scan);
+    switch (parse_layout(data, scan, pkg)) {
+        case Layout::Parsed:
+            return true;
+        case Layout::Invalid:
+            return false;
+        case Layout::Unusual:
+            break;
     }
+    return from_string_generic(data, pkg);
 }
 
-DiscoveryPackage DiscoveryPackage::from_string(std::string& data) {
-    DiscoveryPackage pkg;
-    
-    pkg.hello_message = data;
+// Characters already known to be hex digits
+static uint8_t hex_nibble(char c) {
+    return (uint8_t)((c & 0x0F) + (c >> 6) * 9);
+}
+
+// h[h]:h[h]:h[h]:h[h]:h[h]:h[h], which ether_aton_r reads the same way
+static bool parse_mac_layout(std::string_view data, const HelloScan& scan, size_t start, size_t end,
+                             MAC_Bytes& mac) {
+    if (end - start < 11 || end - start > 17 || scan.count(scan.colons, start, end) != 5 ||
+        scan.count(scan.hex, start, end) != end - start - 5) {
+        return false;
+    }
+    for (size_t octet = 0; octet < mac.size(); ++octet) {
+        size_t colon = octet < 5 ? scan.next(scan.colons, start) : end;
+        if (colon == start || colon - start > 2) {
+            return false;
+        }
+        mac[octet] = colon - start == 1 ? hex_nibble(data[start])
+                                        : (uint8_t)(hex_nibble(data[start]) << 4 | hex_nibble(data[start + 1]));
+        start = colon + 1;
+    }
+    return true;
+}
+
+// Four decimal octets without leading zeros, which inet_pton accepts as is
+static bool parse_ipv4_layout(std::string_view text, in_addr_t& ip) {
+    uint8_t octets[4];
+    size_t octet = 0;
+    size_t digits = 0;
+    unsigned value = 0;
+    for (char c : text) {
+        if (c >= '0' && c <= '9') {
+            if (digits == 3 || (digits == 1 && value == 0)) {
+                return false;
+            }
+            value = value * 10 + (c - '0');
+            ++digits;
+        } else if (c == '.' && digits > 0 && octet < 3 && value <= 255) {
+            octets[octet++] = (uint8_t)value;
+            digits = 0;
+            value = 0;
+        } else {
+            return false;
+        }
+    }
+    if (octet != 3 || digits == 0 || value > 255) {
+        return false;
+    }
+    octets[3] = (uint8_t)value;
+    std::memcpy(&ip, octets, sizeof(ip));
+    return true;
+}
+
+// The layout every sender writes:
+//   HELLO|PROBE from <interface> NodeID:<32 hex> MAC:<mac> IP:<ip> [optional fields]
+// with single spaces and no colon in the interface name, so the first
+// NodeID:, MAC: and IP: in the datagram are these fields, as the generic
+// parser expects. Only a malformed node ID is rejected here, since the
+// generic parser would reject it the same way; any other surprise is left
+// to it.
+DiscoveryPackage::Layout DiscoveryPackage::parse_layout(std::string_view data, const HelloScan& scan,
+                                                        DiscoveryPackage& pkg) {
+    const size_t name_start = 11;
+    if (scan.size < name_start ||
+        (std::memcmp(data.data(), "HELLO from ", name_start) != 0 &&
+         std::memcmp(data.data(), "PROBE from ", name_start) != 0)) {
+        return Layout::Unusual;
+    }
+    size_t name_end = scan.next(scan.ends, name_start);
+    if (name_end == name_start || name_end >= scan.size || data[name_end] != ' ' ||
+        scan.any(scan.colons, name_start, name_end) || data.substr(name_end + 1, 7) != "NodeID:") {
+        return Layout::Unusual;
+    }
+
+    size_t id_start = name_end + 8;
+    size_t id_end = scan.next(scan.ends, id_start);
+    if (id_end >= scan.size) {
+        return Layout::Unusual;
+    }
+    if (id_end - id_start != 2 * sizeof(NodeID) || !decode_node_id(data.data() + id_start, pkg.sender_id)) {
+        return Layout::Invalid;
+    }
+    if (data[id_end] != ' ' || data.substr(id_end + 1, 4) != "MAC:") {
+        return Layout::Unusual;
+    }
+
+    size_t mac_start = id_end + 5;
+    size_t mac_end = scan.next(scan.ends, mac_start);
+    if (mac_end >= scan.size || data[mac_end] != ' ' || data.substr(mac_end + 1, 3) != "IP:" ||
+        !parse_mac_layout(data, scan, mac_start, mac_end, pkg.sender_mac)) {
+        return Layout::Unusual;
+    }
+
+    size_t ip_start = mac_end + 4;
+    size_t ip_end = scan.next(scan.ends, ip_start);
+    if ((ip_end == scan.size && scan.size < data.size()) ||
+        !parse_ipv4_layout(data.substr(ip_start, ip_end - ip_start), pkg.sender_ip)) {
+        return Layout::Unusual;
+    }
+
+    pkg.probe = data[0] == 'P';
+    pkg.interface_name = data.substr(name_start, name_end - name_start);
+    return parse_optional(data, ip_end, &scan, pkg) ? Layout::Parsed : Layout::Invalid;
+}
+
+bool DiscoveryPackage::from_string_generic(std::string_view data, DiscoveryPackage& pkg) {
+    pkg.probe = data.substr(0, 6) == "PROBE ";
 
     size_t from_pos = data.find(" from ");
-    if (from_pos != std::string::npos) {
+    if (from_pos != std::string_view::npos) {
         size_t name_start = from_pos + 6; // Skip " from "
-        size_t name_end = data.find(" ", name_start);
-        if (name_end != std::string::npos) {
-            std::string interface_name = data.substr(name_start, name_end - name_start);
+        size_t name_end = data.find(' ', name_start);
+        if (name_end != std::string_view::npos) {
+            pkg.interface_name = data.substr(name_start, name_end - name_start);
         }
     }
-    
+
     // Extract NodeID (after "NodeID:")
-    pkg.sender_id = extract_field(data, "NodeID:");
-    
+    if (!node_id_from_hex(extract_field(data, "NodeID:"), pkg.sender_id)) {
+        return false;
+    }
+
     // Extract MAC address (after "MAC:")
-    pkg.sender_mac = extract_field(data, "MAC:");
-    
+    if (!helper::parse_mac(extract_field(data, "MAC:"), pkg.sender_mac)) {
+        return false;
+    }
+
     // Extract IP address (after "IP:")
-    pkg.sender_ip = extract_field(data, "IP:");
-    
-    return pkg;
+    std::string_view ip = extract_field(data, "IP:");
+    char ip_buffer[INET_ADDRSTRLEN];
+    if (ip.empty() || ip.size() >= sizeof(ip_buffer)) {
+        return false;
+    }
+    std::memcpy(ip_buffer, ip.data(), ip.size());
+    ip_buffer[ip.size()] = '\0';
+    if (inet_pton(AF_INET, ip_buffer, &pkg.sender_ip) != 1) {
+        return false;
+    }
+    return parse_optional(data, (size_t)(ip.data() + ip.size() - data.data()), nullptr, pkg);
+}
+
+// Next space or line break at or after from, using the scan where it
+// covers the data
+static size_t field_end(std::string_view data, size_t from, const HelloScan* scan) {
+    if (scan) {
+        size_t end = scan->next(scan->ends, from);
+        if (end < scan->size || scan->size == data.size()) {
+            return end;
+        }
+        from = std::max(from, scan->size);
+    }
+    size_t end = data.find_first_of(" \r\n", from);
+    return end == std::string_view::npos ? data.size() : end;
+}
+
+// Liveness and link measurement fields are optional so older peers still
+// parse. They all follow IP:, so one pass over the rest picks them up.
+bool DiscoveryPackage::parse_optional(std::string_view data, size_t pos, const HelloScan* scan,
+                                      DiscoveryPackage& pkg) {
+    pkg.interval_ms = 0;
+    pkg.hold_ms = 0;
+    pkg.has_sequence = false;
+    pkg.timestamp_us = -1;
+    pkg.echo_timestamp_us = -1;
+    while (pos < data.size() && data[pos] == ' ') {
+        size_t end = field_end(data, pos + 1, scan);
+        std::string_view field = data.substr(pos + 1, end - pos - 1);
+        pos = end;
+
+        bool valid = true;
+        if (field.substr(0, 4) == "INT:") {
+            valid = parse_number(field.substr(4), pkg.interval_ms);
+        } else if (field.substr(0, 5) == "HOLD:") {
+            valid = parse_number(field.substr(5), pkg.hold_ms);
+        } else if (field.substr(0, 4) == "SEQ:") {
+            valid = pkg.has_sequence = parse_number(field.substr(4), pkg.sequence);
+        } else if (field.substr(0, 3) == "TS:") {
+            valid = parse_number(field.substr(3), pkg.timestamp_us);
+        } else if (field.substr(0, 5) == "ECHO:") {
+            valid = parse_echo(field.substr(5), pkg);
+        }
+        if (!valid) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename T>
+bool DiscoveryPackage::parse_number(std::string_view text, T& value) {
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size();
 }
 
-std::string DiscoveryPackage::extract_field(const std::string& message, const std::string& field_name) {
+// <node id>:<ts>:<delay>
+bool DiscoveryPackage::parse_echo(std::string_view text, DiscoveryPackage& pkg) {
+    size_t first = text.find(':');
+    size_t second = first == std::string_view::npos ? first : text.find(':', first + 1);
+    if (second == std::string_view::npos || first != 2 * sizeof(NodeID) || !decode_node_id(text.data(), pkg.echo_id)) {
+        return false;
+    }
+    return parse_number(text.substr(first + 1, second - first - 1), pkg.echo_timestamp_us) &&
+           parse_number(text.substr(second + 1), pkg.echo_delay_us);
+}
+
+bool DiscoveryDigest::from_string(std::string_view data, DiscoveryDigest& digest) {
+    size_t end = data.find('\n');
+    digest.relay = is_relay(data);
+    if ((!digest.relay && !is_digest(data)) || end == std::string_view::npos) {
+        return false;
+    }
+    std::string_view header = data.substr(0, end);
+    digest.entries = data.substr(end + 1);
+    if (!node_id_from_hex(DiscoveryPackage::extract_field(header, "NodeID:"), digest.reporter_id)) {
+        return false;
+    }
+    if (!digest.relay) {
+        return DiscoveryPackage::parse_number(DiscoveryPackage::extract_field(header, "INT:"), digest.interval_ms);
+    }
+    return DiscoveryPackage::parse_number(DiscoveryPackage::extract_field(header, "SNAP:"), digest.snapshot) &&
+           DiscoveryPackage::parse_number(DiscoveryPackage::extract_field(header, "PART:"), digest.part) &&
+           DiscoveryPackage::parse_number(DiscoveryPackage::extract_field(header, "PARTS:"), digest.parts) &&
+           DiscoveryPackage::parse_number(DiscoveryPackage::extract_field(header, "TTL:"), digest.ttl_ms) &&
+           digest.part < digest.parts;
+}
+
+bool DiscoveryDigest::next(DigestEntry& entry) {
+    size_t end = entries.find('\n');
+    std::string_view line = entries.substr(0, end);
+    entries = end == std::string_view::npos ? std::string_view() : entries.substr(end + 1);
+
+    std::string_view fields[5];
+    size_t count = 0;
+    while (!line.empty() && count < 5) {
+        size_t space = line.find(' ');
+        fields[count++] = line.substr(0, space);
+        line = space == std::string_view::npos ? std::string_view() : line.substr(space + 1);
+    }
+    if (count != 5 || !line.empty() || !node_id_from_hex(fields[0], entry.id) ||
+        !helper::parse_mac(fields[1], entry.mac)) {
+        return false;
+    }
+
+    char ip_buffer[INET_ADDRSTRLEN];
+    if (fields[2].size() >= sizeof(ip_buffer)) {
+        return false;
+    }
+    std::memcpy(ip_buffer, fields[2].data(), fields[2].size());
+    ip_buffer[fields[2].size()] = '\0';
+    return inet_pton(AF_INET, ip_buffer, &entry.ip) == 1 &&
+           DiscoveryPackage::parse_number(fields[3], entry.age_ms) &&
+           DiscoveryPackage::parse_number(fields[4], entry.hold_ms);
+}
+
+bool GossipMessage::from_string(std::string_view data, GossipMessage& message) {
+    size_t end = data.find('\n');
+    if (!is_gossip(data) || end == std::string_view::npos) {
+        return false;
+    }
+    std::string_view header = data.substr(0, end);
+    message.entries = data.substr(end + 1);
+    if (header.substr(7, 5) == "TREE ") {
+        message.kind = GossipKind::Tree;
+    } else if (header.substr(7, 7) == "HASHES ") {
+        message.kind = GossipKind::Hashes;
+    } else if (header.substr(7, 6) == "LINKS ") {
+        message.kind = GossipKind::Links;
+    } else {
+        return false;
+    }
+    if (!node_id_from_hex(DiscoveryPackage::extract_field(header, "NodeID:"), message.sender_id)) {
+        return false;
+    }
+    if (message.kind == GossipKind::Links) {
+        return true;
+    }
+    message.prefix = DiscoveryPackage::extract_field(header, "PREFIX:");
+    if (message.prefix.empty()) {
+        return false;
+    }
+    if (message.prefix == "-") {
+        message.prefix = std::string_view();
+    }
+    if (message.kind == GossipKind::Tree) {
+        return true;
+    }
+    std::string_view ask = DiscoveryPackage::extract_field(header, "ASK:");
+    message.ask = ask == "1";
+    return message.ask || ask == "0";
+}
+
+std::string_view GossipMessage::next_line() {
+    size_t end = entries.find('\n');
+    std::string_view line = entries.substr(0, end);
+    entries = end == std::string_view::npos ? std::string_view() : entries.substr(end + 1);
+    return line;
+}
+
+bool GossipMessage::next_summary(uint64_t& hash, uint32_t& count) {
+    std::string_view line = next_line();
+    size_t space = line.find(' ');
+    if (space == std::string_view::npos) {
+        return false;
+    }
+    auto result = std::from_chars(line.data(), line.data() + space, hash, 16);
+    return result.ec == std::errc() && result.ptr == line.data() + space &&
+           DiscoveryPackage::parse_number(line.substr(space + 1), count);
+}
+
+bool GossipMessage::next_hash(uint64_t& hash) {
+    std::string_view line = next_line();
+    auto result = std::from_chars(line.data(), line.data() + line.size(), hash, 16);
+    return !line.empty() && result.ec == std::errc() && result.ptr == line.data() + line.size();
+}
+
+bool GossipMessage::next_link(NodeID& origin, NodeID& neighbour, uint32_t& version, bool& alive) {
+    std::string_view line = next_line();
+    const size_t hex = 2 * sizeof(NodeID);
+    if (line.size() < 2 * hex + 4 || line[2 * hex] != ' ' || line[line.size() - 2] != ' ') {
+        return false;
+    }
+    std::string_view state = line.substr(line.size() - 1);
+    alive = state == "1";
+    return (alive || state == "0") && node_id_from_hex(line.substr(0, hex), origin) &&
+           node_id_from_hex(line.substr(hex, hex), neighbour) &&
+           DiscoveryPackage::parse_number(line.substr(2 * hex + 1, line.size() - 2 * hex - 3), version);
+}
+
+std::string_view DiscoveryPackage::extract_field(std::string_view message, std::string_view field_name) {
     size_t start_pos = message.find(field_name);
-    if (start_pos == std::string::npos) return "";
+    if (start_pos == std::string_view::npos) return std::string_view();
 
     start_pos += field_name.length();
-    size_t end_pos = message.find(" ", start_pos);
-    if (end_pos == std::string::npos) end_pos = message.length();
+    size_t end_pos = message.find_first_of(" \r\n", start_pos);
+    if (end_pos == std::string_view::npos) end_pos = message.length();
 
     return message.substr(start_pos, end_pos - start_pos);
-}
\ No newline at end of file
+}
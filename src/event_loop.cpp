@@ -0,0 +1,393 @@
+#include "event_loop.h"
+#include "common/helper.h"
+#include "common/logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <sys/epoll.h>
+#include <sys/select.h>
+#include <unistd.h>
+
+const size_t RECV_BATCH = 16;        // datagrams read per recvmmsg
+const int EPOLL_BATCH = 64;
+
+bool parse_io_backend(std::string_view text, IoBackend& backend) {
+    if (text == "auto") {
+        backend = IoBackend::Auto;
+    } else if (text == "select") {
+        backend = IoBackend::Select;
+    } else if (text == "epoll") {
+        backend = IoBackend::Epoll;
+    } else if (text == "uring" || text == "io_uring") {
+        backend = IoBackend::Uring;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* io_backend_name(IoBackend backend) {
+    switch (backend) {
+    case IoBackend::Auto: return "auto";
+    case IoBackend::Select: return "select";
+    case IoBackend::Epoll: return "epoll";
+    case IoBackend::Uring: return "io_uring";
+    }
+    return "unknown";
+}
+
+// Kernel timestamps are wall clock; shift them onto the monotonic clock
+int64_t kernel_rx_us(const msghdr& msg) {
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR((msghdr*)&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            timespec stamp;
+            memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+            timespec realtime;
+            clock_gettime(CLOCK_REALTIME, &realtime);
+            int64_t age_us = ((int64_t)realtime.tv_sec - stamp.tv_sec) * 1000000 +
+                             (realtime.tv_nsec - stamp.tv_nsec) / 1000;
+            return helper::monotonic_us() - std::max<int64_t>(age_us, 0);
+        }
+    }
+    return 0;
+}
+
+namespace {
+
+struct DatagramWatch {
+    int fd;
+    const std::string* device;
+    DatagramSink* sink;
+};
+
+struct ListenerWatch {
+    int fd;
+    AcceptHandler* handler;
+};
+
+struct StreamWatch {
+    int fd;
+    StreamHandler* handler;
+    bool readable = true;
+    bool writable = false;
+};
+
+// Shared by the select and epoll backends: one recvmmsg drains up to
+// RECV_BATCH datagrams, one accept takes one connection
+class ReadinessLoop : public EventLoop {
+    char buffers[RECV_BATCH][MAX_DATAGRAM_SIZE];
+    char controls[RECV_BATCH][CMSG_SPACE(sizeof(timespec)) + CMSG_SPACE(sizeof(in_pktinfo))];
+    sockaddr_in senders[RECV_BATCH];
+    iovec iovecs[RECV_BATCH];
+    mmsghdr messages[RECV_BATCH];
+protected:
+    std::vector<DatagramWatch> datagrams;
+    std::vector<ListenerWatch> listeners;
+    std::vector<StreamWatch> streams;
+
+    StreamWatch* find_stream(int fd) {
+        for (StreamWatch& watch : streams) {
+            if (watch.fd == fd) {
+                return &watch;
+            }
+        }
+        return nullptr;
+    }
+
+    void read_datagrams(const DatagramWatch& watch) {
+        for (size_t i = 0; i < RECV_BATCH; ++i) {
+            iovecs[i] = {buffers[i], sizeof(buffers[i])};
+            messages[i].msg_hdr = {};
+            messages[i].msg_hdr.msg_name = &senders[i];
+            messages[i].msg_hdr.msg_namelen = sizeof(senders[i]);
+            messages[i].msg_hdr.msg_iov = &iovecs[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+            messages[i].msg_hdr.msg_control = controls[i];
+            messages[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+        }
+
+        ++syscall_count;
+        int count = recvmmsg(watch.fd, messages, RECV_BATCH, MSG_DONTWAIT, nullptr);
+        if (count < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                watch.sink->on_receive_error(errno);
+            }
+            return;
+        }
+        for (int i = 0; i < count; ++i) {
+            if (messages[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                watch.sink->on_receive_error(EMSGSIZE);
+                continue;
+            }
+            watch.sink->on_datagram(std::string_view(buffers[i], messages[i].msg_len), senders[i].sin_addr.s_addr,
+                                    watch.device, kernel_rx_us(messages[i].msg_hdr));
+        }
+    }
+
+    void accept_connection(const ListenerWatch& watch) {
+        ++syscall_count;
+        int client_fd = accept(watch.fd, nullptr, nullptr);
+        if (client_fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_ERROR_RATE_LIMITED("CLI accept failed: %s", strerror(errno));
+            }
+            return;
+        }
+        watch.handler->on_accept(client_fd);
+    }
+public:
+    int watch_datagrams(int fd, const std::string* device, DatagramSink& sink) override {
+        datagrams.push_back({fd, device, &sink});
+        return 0;
+    }
+
+    int watch_listener(int fd, AcceptHandler& handler) override {
+        listeners.push_back({fd, &handler});
+        return 0;
+    }
+
+    int watch_stream(int fd, StreamHandler& handler) override {
+        streams.push_back({fd, &handler});
+        return 0;
+    }
+
+    int set_stream_interest(int fd, bool readable, bool writable) override {
+        StreamWatch* watch = find_stream(fd);
+        if (!watch) {
+            errno = ENOENT;
+            return -1;
+        }
+        watch->readable = readable;
+        watch->writable = writable;
+        return 0;
+    }
+
+    void unwatch_stream(int fd) override {
+        for (size_t i = 0; i < streams.size(); ++i) {
+            if (streams[i].fd == fd) {
+                streams[i] = streams.back();
+                streams.pop_back();
+                return;
+            }
+        }
+    }
+
+    ssize_t send_to(int fd, const sockaddr_in& destination, std::string_view data) override {
+        ++syscall_count;
+        return sendto(fd, data.data(), data.size(), 0, (const sockaddr*)&destination, sizeof(destination));
+    }
+};
+
+class SelectLoop : public ReadinessLoop {
+    fd_set ready;
+    fd_set ready_to_write;
+    std::vector<int> ready_streams;
+    std::vector<int> writable_streams;
+public:
+    IoBackend backend() const override { return IoBackend::Select; }
+
+    int watch_stream(int fd, StreamHandler& handler) override {
+        if (fd >= FD_SETSIZE) {
+            errno = EMFILE;
+            return -1;
+        }
+        return ReadinessLoop::watch_stream(fd, handler);
+    }
+
+    int wait(int64_t timeout_ms) override {
+        FD_ZERO(&ready);
+        FD_ZERO(&ready_to_write);
+        int max_fd = -1;
+        for (const DatagramWatch& watch : datagrams) {
+            FD_SET(watch.fd, &ready);
+            max_fd = std::max(max_fd, watch.fd);
+        }
+        for (const ListenerWatch& watch : listeners) {
+            FD_SET(watch.fd, &ready);
+            max_fd = std::max(max_fd, watch.fd);
+        }
+        for (const StreamWatch& watch : streams) {
+            if (watch.readable) {
+                FD_SET(watch.fd, &ready);
+            }
+            if (watch.writable) {
+                FD_SET(watch.fd, &ready_to_write);
+            }
+            max_fd = std::max(max_fd, watch.fd);
+        }
+
+        struct timeval timeout;
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_usec = (timeout_ms % 1000) * 1000;
+        ++syscall_count;
+        int activity = select(max_fd + 1, &ready, &ready_to_write, nullptr, &timeout);
+        if (activity < 0 && errno == EINTR) {
+            FD_ZERO(&ready);
+            FD_ZERO(&ready_to_write);
+            return 0;
+        }
+        return activity;
+    }
+
+    void dispatch() override {
+        // Handlers may unwatch streams, so pick the ready ones out first
+        ready_streams.clear();
+        writable_streams.clear();
+        for (const StreamWatch& watch : streams) {
+            if (FD_ISSET(watch.fd, &ready_to_write)) {
+                writable_streams.push_back(watch.fd);
+            }
+            if (FD_ISSET(watch.fd, &ready)) {
+                ready_streams.push_back(watch.fd);
+            }
+        }
+        for (int fd : writable_streams) {
+            StreamWatch* watch = find_stream(fd);
+            if (watch && watch->writable) {
+                watch->handler->on_writable(fd);
+            }
+        }
+        for (int fd : ready_streams) {
+            StreamWatch* watch = find_stream(fd);
+            if (watch && watch->readable) {
+                watch->handler->on_readable(fd);
+            }
+        }
+        for (const ListenerWatch& watch : listeners) {
+            if (FD_ISSET(watch.fd, &ready)) {
+                accept_connection(watch);
+            }
+        }
+        for (const DatagramWatch& watch : datagrams) {
+            if (FD_ISSET(watch.fd, &ready)) {
+                read_datagrams(watch);
+            }
+        }
+    }
+};
+
+class EpollLoop : public ReadinessLoop {
+    int epoll_fd;
+    epoll_event events[EPOLL_BATCH];
+    int ready = 0;
+
+    // High bits of the event data tell listeners and streams from datagram
+    // sockets. Streams are looked up by fd, so an event for one unwatched
+    // earlier in the same batch is dropped.
+    static const uint64_t LISTENER_BIT = 1ULL << 32;
+    static const uint64_t STREAM_BIT = 1ULL << 33;
+
+    int add(int fd, uint64_t data) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = data;
+        ++syscall_count;
+        return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+public:
+    explicit EpollLoop(int epoll_fd) : epoll_fd(epoll_fd) {}
+    ~EpollLoop() override { close(epoll_fd); }
+
+    IoBackend backend() const override { return IoBackend::Epoll; }
+    int poll_fd() const override { return epoll_fd; }
+
+    int watch_datagrams(int fd, const std::string* device, DatagramSink& sink) override {
+        if (add(fd, datagrams.size()) < 0) {
+            return -1;
+        }
+        return ReadinessLoop::watch_datagrams(fd, device, sink);
+    }
+
+    int watch_listener(int fd, AcceptHandler& handler) override {
+        if (add(fd, LISTENER_BIT | listeners.size()) < 0) {
+            return -1;
+        }
+        return ReadinessLoop::watch_listener(fd, handler);
+    }
+
+    int watch_stream(int fd, StreamHandler& handler) override {
+        if (add(fd, STREAM_BIT | (uint32_t)fd) < 0) {
+            return -1;
+        }
+        return ReadinessLoop::watch_stream(fd, handler);
+    }
+
+    int set_stream_interest(int fd, bool readable, bool writable) override {
+        epoll_event event{};
+        event.events = (readable ? (uint32_t)EPOLLIN : 0) | (writable ? (uint32_t)EPOLLOUT : 0);
+        event.data.u64 = STREAM_BIT | (uint32_t)fd;
+        ++syscall_count;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event) < 0) {
+            return -1;
+        }
+        return ReadinessLoop::set_stream_interest(fd, readable, writable);
+    }
+
+    void unwatch_stream(int fd) override {
+        ++syscall_count;
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        ReadinessLoop::unwatch_stream(fd);
+    }
+
+    int wait(int64_t timeout_ms) override {
+        ++syscall_count;
+        ready = epoll_wait(epoll_fd, events, EPOLL_BATCH, (int)timeout_ms);
+        if (ready < 0 && errno == EINTR) {
+            ready = 0;
+        }
+        return ready;
+    }
+
+    void dispatch() override {
+        for (int i = 0; i < ready; ++i) {
+            uint64_t data = events[i].data.u64;
+            if (data & STREAM_BIT) {
+                // Hangups and errors go to whichever side is watched
+                int fd = (int)(uint32_t)data;
+                StreamWatch* watch = find_stream(fd);
+                if (watch && watch->writable && (events[i].events & ~EPOLLIN)) {
+                    watch->handler->on_writable(fd);
+                    watch = find_stream(fd);
+                }
+                if (watch && watch->readable && (events[i].events & ~EPOLLOUT)) {
+                    watch->handler->on_readable(fd);
+                }
+            } else if (data & LISTENER_BIT) {
+                accept_connection(listeners[(uint32_t)data]);
+            } else {
+                read_datagrams(datagrams[data]);
+            }
+        }
+        ready = 0;
+    }
+};
+
+std::unique_ptr<EventLoop> make_epoll_loop() {
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        LOG_WARN("epoll_create1 failed: %s", strerror(errno));
+        return nullptr;
+    }
+    return std::make_unique<EpollLoop>(epoll_fd);
+}
+
+} // namespace
+
+std::unique_ptr<EventLoop> make_event_loop(IoBackend backend) {
+    std::unique_ptr<EventLoop> loop;
+    if (backend == IoBackend::Auto || backend == IoBackend::Uring) {
+        loop = make_uring_loop();
+        if (!loop && backend == IoBackend::Uring) {
+            LOG_WARN("io_uring is not available, falling back to epoll");
+        }
+    }
+    if (!loop && backend != IoBackend::Select) {
+        loop = make_epoll_loop();
+    }
+    if (!loop) {
+        loop = std::make_unique<SelectLoop>();
+    }
+    return loop;
+}
@@ -0,0 +1,217 @@
+#include "graw_client.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+static int64_t monotonic_ms() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+GrawClient::GrawClient(std::string socket_path) : socket_path(std::move(socket_path)) {}
+
+GrawClient::~GrawClient() {
+    disconnect();
+}
+
+int GrawClient::connect_socket() {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        error = std::string("socket failed: ") + strerror(errno);
+        return -1;
+    }
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+    // Unix sockets connect at once or not at all (EAGAIN when the backlog is full)
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        error = "Connection to " + socket_path + " failed: " + strerror(errno);
+        close(fd);
+        return -1;
+    }
+    socket_fd = fd;
+    return 0;
+}
+
+void GrawClient::disconnect() {
+    if (socket_fd >= 0) {
+        close(socket_fd);
+        socket_fd = -1;
+    }
+    waiting.clear();
+    output.clear();
+    output_sent = 0;
+    input.clear();
+}
+
+void GrawClient::fail(const Request& request, const std::string& reason) {
+    replies.push_back({request.id, false, std::string(), reason});
+}
+
+void GrawClient::connection_lost(const std::string& reason) {
+    error = reason;
+    close(socket_fd);
+    socket_fd = -1;
+    input.clear();
+    output.clear();
+    output_sent = 0;
+
+    std::deque<Request> retry;
+    for (Request& request : waiting) {
+        if (++request.attempts >= GRAW_CLIENT_ATTEMPTS) {
+            fail(request, reason);
+        } else {
+            retry.push_back(std::move(request));
+        }
+    }
+    waiting.swap(retry);
+    if (waiting.empty()) {
+        return;
+    }
+    if (connect_socket() < 0) {
+        for (const Request& request : waiting) {
+            fail(request, error);
+        }
+        waiting.clear();
+        return;
+    }
+    for (const Request& request : waiting) {
+        output += request.command;
+        output += '\n';
+    }
+    on_writable();
+}
+
+uint64_t GrawClient::submit(std::string_view command) {
+    uint64_t id = next_id++;
+    Request request{id, std::string(command), 0};
+    // The service skips blank lines and splits on newlines, so such a
+    // command would never get a reply of its own
+    if (command.empty() || command == "\r" || command.find('\n') != std::string_view::npos) {
+        fail(request, "Invalid command: empty or containing a newline");
+        return id;
+    }
+    if (socket_fd < 0 && connect_socket() < 0) {
+        fail(request, error);
+        return id;
+    }
+    output += command;
+    output += '\n';
+    waiting.push_back(std::move(request));
+    on_writable(); // usually goes out at once
+    return id;
+}
+
+int GrawClient::on_writable() {
+    while (socket_fd >= 0 && output_sent < output.size()) {
+        ssize_t sent = send(socket_fd, output.data() + output_sent, output.size() - output_sent, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            }
+            connection_lost(std::string("Failed to send command: ") + strerror(errno));
+            return -1;
+        }
+        output_sent += sent;
+    }
+    output.clear();
+    output_sent = 0;
+    return 0;
+}
+
+int GrawClient::on_readable() {
+    int finished = 0;
+    char buffer[65536];
+    while (socket_fd >= 0) {
+        ssize_t received = recv(socket_fd, buffer, sizeof(buffer), 0);
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            connection_lost(std::string("Failed to receive response: ") + strerror(errno));
+            return -1;
+        }
+        if (received == 0) {
+            connection_lost("Service closed the connection");
+            return -1;
+        }
+
+        // Each reply ends with a NUL; the search starts in the new bytes
+        size_t scanned = input.size();
+        input.append(buffer, received);
+        size_t start = 0;
+        size_t end;
+        while ((end = input.find('\0', scanned)) != std::string::npos) {
+            if (!waiting.empty()) {
+                replies.push_back({waiting.front().id, true, input.substr(start, end - start), std::string()});
+                waiting.pop_front();
+                ++finished;
+            }
+            start = end + 1;
+            scanned = start;
+        }
+        input.erase(0, start);
+    }
+    return finished;
+}
+
+bool GrawClient::next_reply(GrawReply& reply) {
+    if (replies.empty()) {
+        return false;
+    }
+    reply = std::move(replies.front());
+    replies.pop_front();
+    return true;
+}
+
+bool GrawClient::request(std::string_view command, std::string& reply, int timeout_ms) {
+    uint64_t id = submit(command);
+    int64_t deadline = monotonic_ms() + timeout_ms;
+    while (true) {
+        auto found = std::find_if(replies.begin(), replies.end(), [&](const GrawReply& r) { return r.id == id; });
+        if (found != replies.end()) {
+            bool ok = found->ok;
+            reply = ok ? std::move(found->body) : std::move(found->error);
+            replies.erase(found);
+            return ok;
+        }
+
+        int64_t remaining = deadline - monotonic_ms();
+        pollfd pfd = {socket_fd, (short)(POLLIN | (wants_write() ? POLLOUT : 0)), 0};
+        int ready = remaining > 0 ? poll(&pfd, 1, (int)remaining) : 0;
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready <= 0) {
+            // The service is stuck or gone; start over on the next request
+            disconnect();
+            error = "Timeout waiting for response";
+            reply = error;
+            return false;
+        }
+        if (pfd.revents & POLLOUT) {
+            on_writable();
+        }
+        if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+            on_readable();
+        }
+    }
+}
+
+bool GrawClient::ping(int timeout_ms) {
+    std::string reply;
+    return request("PING", reply, timeout_ms) && reply == "WORLD\n";
+}
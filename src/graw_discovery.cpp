@@ -0,0 +1,258 @@
+#include "graw_discovery.h"
+#include "neighbour_discovery.h"
+#include "event_loop.h"
+#include "transport.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <random>
+
+struct GrawDiscovery::Engine {
+    std::vector<NetworkInterface> interfaces;
+    NodeID node_id;
+    SystemClock clock;
+    SeededRandom random{std::random_device{}()};
+    UdpTransport transport;
+    MetricsRegistry registry;
+    std::unique_ptr<EventLoop> loop;
+    std::unique_ptr<NeighbourDiscovery> discovery;
+    graw_event_fn on_event = nullptr;
+    void* user = nullptr;
+};
+
+struct graw_discovery {
+    GrawDiscovery discovery;
+};
+
+static void fill_neighbour(graw_neighbour& out, const NodeID& id, const NetworkConnection* connection,
+                           const std::vector<NetworkInterface>& interfaces) {
+    memcpy(out.id, id.data(), sizeof(out.id));
+    if (!connection) {
+        out.ip = 0;
+        memset(out.mac, 0, sizeof(out.mac));
+        out.interface = "";
+        out.last_seen_ms = 0;
+        out.hold_ms = out.rtt_us = out.jitter_us = 0;
+        out.loss = 0;
+        return;
+    }
+    out.ip = connection->ip;
+    memcpy(out.mac, connection->mac_address.data(), sizeof(out.mac));
+    out.interface = interfaces[connection->interface_id].name.c_str();
+    out.last_seen_ms = connection->link.last_seen_ms;
+    out.hold_ms = connection->link.hold_ms;
+    out.rtt_us = connection->link.rtt_us;
+    out.jitter_us = connection->link.jitter_us;
+    out.loss = connection->link.loss();
+}
+
+// Splits "eth0,eth1" into names; an empty list selects every interface
+static std::vector<std::string> split_names(const char* list) {
+    std::vector<std::string> names;
+    std::string_view rest = list ? list : "";
+    while (!rest.empty()) {
+        size_t comma = rest.find(',');
+        if (comma != 0) {
+            names.emplace_back(rest.substr(0, comma));
+        }
+        rest = comma == std::string_view::npos ? std::string_view() : rest.substr(comma + 1);
+    }
+    return names;
+}
+
+GrawDiscovery::GrawDiscovery() = default;
+
+GrawDiscovery::~GrawDiscovery() = default;
+
+int GrawDiscovery::open(const graw_discovery_options& options) {
+    close();
+    error.clear();
+    LogLevel level = LogLevel::Warn;
+    if (options.log_level && !logger::parse_level(options.log_level, level)) {
+        error = std::string("Unknown log level: ") + options.log_level;
+        return -1;
+    }
+    logger::set_level(level);
+    if (options.port <= 0 || options.port > 65535 || options.interval_ms < MIN_INTERVAL_MS ||
+        options.multiplier == 0 || options.max_neighbours == 0) {
+        error = "Invalid options";
+        return -1;
+    }
+
+    auto state = std::make_unique<Engine>();
+    std::vector<std::string> names = split_names(options.interfaces);
+    std::vector<NetworkInterface> found;
+    // Loopback only when asked for by name
+    if (list_network_interfaces(found, !names.empty()) < 0) {
+        error = std::string("Failed to list network interfaces: ") + strerror(errno);
+        return -1;
+    }
+    for (const NetworkInterface& interface : found) {
+        if (names.empty() || std::find(names.begin(), names.end(), interface.name) != names.end()) {
+            state->interfaces.push_back(interface);
+        }
+    }
+    for (const std::string& name : names) {
+        if (std::none_of(found.begin(), found.end(),
+                         [&](const NetworkInterface& interface) { return interface.name == name; })) {
+            LOG_WARN("Interface %s has no IPv4 address, skipping it", name.c_str());
+        }
+    }
+    if (state->interfaces.empty()) {
+        error = "No matching network interface has an IPv4 address";
+        return -1;
+    }
+
+    state->loop = make_event_loop(IoBackend::Epoll);
+    if (state->loop->poll_fd() < 0) {
+        error = "epoll is not available";
+        return -1;
+    }
+    state->node_id = generate_node_id(options.domain ? options.domain : "");
+    state->on_event = options.on_event;
+    state->user = options.user;
+
+    DiscoveryConfig config;
+    config.max_neighbours = options.max_neighbours;
+    config.liveness.interval_ms = options.interval_ms;
+    config.liveness.multiplier = options.multiplier;
+    if (options.on_event) {
+        Engine* engine_state = state.get();
+        config.on_event = [engine_state](JournalEvent event, const NodeID& id, const NetworkConnection* connection) {
+            graw_neighbour neighbour;
+            fill_neighbour(neighbour, id, connection, engine_state->interfaces);
+            engine_state->on_event((int)event, &neighbour, engine_state->user);
+        };
+    }
+    state->discovery = std::make_unique<NeighbourDiscovery>(state->interfaces, options.port, state->node_id,
+                                                            state->registry, state->clock, state->random,
+                                                            state->transport, config);
+    if (!state->transport.is_open()) {
+        error = "Failed to bind discovery port " + std::to_string(options.port);
+        return -1;
+    }
+    state->discovery->attach(*state->loop);
+    state->discovery->broadcast_hello();
+    engine = std::move(state);
+    return 0;
+}
+
+void GrawDiscovery::close() {
+    engine.reset();
+}
+
+int GrawDiscovery::fd() const {
+    return engine ? engine->loop->poll_fd() : -1;
+}
+
+int GrawDiscovery::timeout_ms() const {
+    if (!engine) {
+        return -1;
+    }
+    int64_t wait = engine->discovery->next_deadline() - engine->clock.now_ms();
+    return (int)std::clamp<int64_t>(wait, 0, INT_MAX);
+}
+
+int GrawDiscovery::process() {
+    if (!engine) {
+        errno = EBADF;
+        return -1;
+    }
+    int ready = engine->loop->wait(0);
+    if (ready < 0) {
+        return -1;
+    }
+    if (ready > 0) {
+        engine->loop->dispatch();
+    }
+    engine->discovery->update();
+    logger::flush();
+    return 0;
+}
+
+size_t GrawDiscovery::size() const {
+    return engine ? engine->discovery->get_neighbours().size() : 0;
+}
+
+uint32_t GrawDiscovery::sequence() const {
+    return engine ? engine->discovery->get_neighbours().sequence() : 0;
+}
+
+const uint8_t* GrawDiscovery::node_id() const {
+    return engine ? engine->node_id.data() : nullptr;
+}
+
+int GrawDiscovery::for_each_link(graw_neighbour_fn fn, void* user) const {
+    if (!engine) {
+        return 0;
+    }
+    int stopped = 0;
+    graw_neighbour neighbour;
+    engine->discovery->get_neighbours().for_each([&](const NeighbourSlot& slot, const NetworkNeighbor& record) {
+        for (const NetworkConnection& connection : record.connections) {
+            if (stopped) {
+                return;
+            }
+            fill_neighbour(neighbour, slot.id, &connection, engine->interfaces);
+            stopped = fn(&neighbour, user);
+        }
+    });
+    return stopped;
+}
+
+extern "C" {
+
+void graw_discovery_options_init(graw_discovery_options* options) {
+    DiscoveryConfig defaults;
+    memset(options, 0, sizeof(*options));
+    options->port = GRAW_DISCOVERY_DEFAULT_PORT;
+    options->max_neighbours = defaults.max_neighbours;
+    options->interval_ms = defaults.liveness.interval_ms;
+    options->multiplier = defaults.liveness.multiplier;
+}
+
+graw_discovery* graw_discovery_open(const graw_discovery_options* options, char* error, size_t error_size) {
+    auto handle = std::make_unique<graw_discovery>();
+    if (handle->discovery.open(*options) < 0) {
+        if (error && error_size) {
+            snprintf(error, error_size, "%s", handle->discovery.last_error().c_str());
+        }
+        return nullptr;
+    }
+    return handle.release();
+}
+
+void graw_discovery_close(graw_discovery* discovery) {
+    delete discovery;
+}
+
+int graw_discovery_fd(const graw_discovery* discovery) {
+    return discovery->discovery.fd();
+}
+
+int graw_discovery_timeout_ms(const graw_discovery* discovery) {
+    return discovery->discovery.timeout_ms();
+}
+
+int graw_discovery_process(graw_discovery* discovery) {
+    return discovery->discovery.process();
+}
+
+size_t graw_discovery_size(const graw_discovery* discovery) {
+    return discovery->discovery.size();
+}
+
+uint32_t graw_discovery_sequence(const graw_discovery* discovery) {
+    return discovery->discovery.sequence();
+}
+
+void graw_discovery_node_id(const graw_discovery* discovery, uint8_t id[16]) {
+    memcpy(id, discovery->discovery.node_id(), 16);
+}
+
+int graw_discovery_for_each(const graw_discovery* discovery, graw_neighbour_fn fn, void* user) {
+    return discovery->discovery.for_each_link(fn, user);
+}
+
+} // extern "C"
@@ -0,0 +1,137 @@
+#include "hello_recorder.h"
+#include "common/helper.h"
+
+#include <arpa/inet.h>
+#include <cstdlib>
+#include <cstring>
+
+static const char* TRACE_HEADER = "# graw hello trace v1";
+
+HelloRecorder::~HelloRecorder() {
+    if (file) {
+        fclose(file);
+    }
+}
+
+int HelloRecorder::open(const std::string& path, const char* node_id_hex, const std::vector<NetworkInterface>& interfaces) {
+    file = fopen(path.c_str(), "w");
+    if (!file) {
+        return -1;
+    }
+    fprintf(file, "%s\n", TRACE_HEADER);
+    fprintf(file, "# node %s\n", node_id_hex);
+    for (const NetworkInterface& interface : interfaces) {
+        fprintf(file, "# interface %s %s %s %s\n", interface.name.c_str(), interface.ip_address.c_str(),
+                interface.subnet_mask.c_str(), interface.mac_address.c_str());
+    }
+    return 0;
+}
+
+void HelloRecorder::record(int64_t time_ms, in_addr_t sender_ip, const std::string* device, std::string_view data) {
+    if (!file) {
+        return;
+    }
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &sender_ip, ip, sizeof(ip));
+    fprintf(file, "%lld\t%s\t%s\t", (long long)time_ms, ip, device ? device->c_str() : "-");
+    for (unsigned char c : data) {
+        if (c >= 0x20 && c < 0x7f && c != '\\') {
+            fputc(c, file);
+        } else {
+            fprintf(file, "\\x%02x", c);
+        }
+    }
+    fputc('\n', file);
+}
+
+void HelloRecorder::flush() {
+    if (file) {
+        fflush(file);
+    }
+}
+
+static NetworkInterface trace_interface(const char* name, const char* ip, const char* netmask, const char* mac) {
+    NetworkInterface interface;
+    interface.name = name;
+    interface.ip_address = ip;
+    interface.subnet_mask = netmask;
+    interface.mac_address = mac;
+    interface.is_ipv4 = true;
+    interface.is_active = true;
+    interface.ipv4_address = inet_addr(ip);
+    interface.ipv4_netmask = inet_addr(netmask);
+
+    sockaddr_in mask{};
+    mask.sin_addr.s_addr = interface.ipv4_netmask;
+    interface.network_cidr = helper::network_cidr(interface.ip_address, helper::netmask_to_cidr(&mask));
+    interface.broadcast_address = helper::broadcast_address(interface.network_cidr);
+    interface.ipv4_broadcast = inet_addr(interface.broadcast_address.c_str());
+    return interface;
+}
+
+int load_hello_trace(const std::string& path, HelloTrace& trace) {
+    FILE* file = fopen(path.c_str(), "r");
+    if (!file) {
+        return -1;
+    }
+
+    char line[4096];
+    bool header = false;
+    while (fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\n")] = '\0';
+        if (!header) {
+            header = strcmp(line, TRACE_HEADER) == 0;
+            if (!header) {
+                break;
+            }
+            continue;
+        }
+
+        if (strncmp(line, "# node ", 7) == 0) {
+            node_id_from_hex(line + 7, trace.node_id);
+            continue;
+        }
+
+        char name[64], ip[INET_ADDRSTRLEN], netmask[INET_ADDRSTRLEN], mac[32];
+        if (strncmp(line, "# interface ", 12) == 0) {
+            if (sscanf(line + 12, "%63s %15s %15s %31s", name, ip, netmask, mac) == 4) {
+                trace.interfaces.push_back(trace_interface(name, ip, netmask, mac));
+            }
+            continue;
+        }
+
+        char* fields[4];
+        char* cursor = line;
+        int count = 0;
+        while (count < 3 && cursor) {
+            fields[count++] = cursor;
+            cursor = strchr(cursor, '\t');
+            if (cursor) {
+                *cursor++ = '\0';
+            }
+        }
+        if (count < 3 || !cursor) {
+            continue;
+        }
+        fields[3] = cursor;
+
+        RecordedHello hello;
+        hello.time_ms = strtoll(fields[0], nullptr, 10);
+        hello.sender_ip = inet_addr(fields[1]);
+        if (strcmp(fields[2], "-") != 0) {
+            hello.device = fields[2];
+        }
+        for (const char* c = fields[3]; *c; ++c) {
+            unsigned int byte;
+            if (c[0] == '\\' && c[1] == 'x' && sscanf(c + 2, "%2x", &byte) == 1) {
+                hello.data += (char)byte;
+                c += 3;
+            } else {
+                hello.data += *c;
+            }
+        }
+        trace.hellos.push_back(hello);
+    }
+    fclose(file);
+    return header ? 0 : -1;
+}
@@ -0,0 +1,400 @@
+#include "loadgen.h"
+#include "graw_client.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <queue>
+#include <random>
+#include <unordered_map>
+
+using namespace std;
+
+typedef pair<int64_t, size_t> ScheduledHello; // send time, node index
+
+static in_addr_t offset_address(in_addr_t base, uint32_t offset) {
+    return htonl(ntohl(base) + offset);
+}
+
+static void build_hello(VirtualNode& node, const string& interface_name) {
+    char id_hex[33];
+    char buffer[256];
+    node_id_to_hex(node.id, id_hex);
+    snprintf(buffer, sizeof(buffer), "HELLO from %s NodeID:%s MAC:%s IP:%s\n", interface_name.c_str(), id_hex,
+             helper::mac_to_string(node.mac).c_str(), helper::ip_to_string(node.ip).c_str());
+    node.hello = buffer;
+}
+
+// Sends from the node's own address on a single unbound socket by passing
+// the source in IP_PKTINFO, so thousands of nodes need no extra sockets.
+static bool send_hello(int fd, const VirtualNode& node, const sockaddr_in& target) {
+    char control[CMSG_SPACE(sizeof(in_pktinfo))] = {};
+    iovec iov = {(void*)node.hello.data(), node.hello.size()};
+
+    msghdr msg = {};
+    msg.msg_name = (void*)&target;
+    msg.msg_namelen = sizeof(target);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = IPPROTO_IP;
+    cmsg->cmsg_type = IP_PKTINFO;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(in_pktinfo));
+    in_pktinfo* info = (in_pktinfo*)CMSG_DATA(cmsg);
+    info->ipi_spec_dst.s_addr = node.ip;
+
+    return sendmsg(fd, &msg, 0) == (ssize_t)node.hello.size();
+}
+
+// Extracts NodeID -> advertised connection IPs from a LIST reply
+static void parse_list(const string& reply, unordered_map<string, vector<in_addr_t>>& listed) {
+    listed.clear();
+    vector<in_addr_t>* current = nullptr;
+    bool in_connections = false;
+
+    size_t pos = 0;
+    while (pos < reply.size()) {
+        size_t end = reply.find('\n', pos);
+        if (end == string::npos) {
+            end = reply.size();
+        }
+        string_view line(reply.data() + pos, end - pos);
+        pos = end + 1;
+
+        NodeID id;
+        if (line.size() > 32 && line[32] == ' ' && node_id_from_hex(line.substr(0, 32), id)) {
+            current = &listed[string(line.substr(0, 32))];
+            in_connections = true;
+        } else if (line.rfind("Interfaces:", 0) == 0) {
+            in_connections = false;
+        } else if (current && in_connections && line.rfind(" - ", 0) == 0) {
+            string ip(line.substr(3, line.find(' ', 3) - 3));
+            current->push_back(inet_addr(ip.c_str()));
+        }
+    }
+}
+
+static void print_distribution(const char* label, vector<int64_t> values_us) {
+    if (values_us.empty()) {
+        printf("  %-22s no samples\n", label);
+        return;
+    }
+    sort(values_us.begin(), values_us.end());
+    auto at = [&](double q) { return values_us[(size_t)(q * (values_us.size() - 1))] / 1000.0; };
+    printf("  %-22s n=%zu min=%.1f p50=%.1f p90=%.1f p99=%.1f max=%.1f ms\n", label, values_us.size(),
+           values_us.front() / 1000.0, at(0.5), at(0.9), at(0.99), values_us.back() / 1000.0);
+}
+
+void print_usage(const char* program) {
+    cerr << "Usage: " << program << " [options]" << endl
+         << "Emulates many discovery peers against a local graw_service started with" << endl
+         << "--include-loopback. Every node sends from its own 127.x address." << endl
+         << "  --nodes N              Number of virtual nodes (default 1000)" << endl
+         << "  --interval SECONDS     Hello interval per node (default 5)" << endl
+         << "  --churn RATE           Join/leave/IP change events per second (default 0)" << endl
+         << "  --duration SECONDS     How long to send hellos (default 60)" << endl
+         << "  --linger SECONDS       Keep polling LIST after stopping, to measure expiry (default 0)" << endl
+         << "  --list-interval SECONDS  Time between LIST polls (default 0.5)" << endl
+         << "  --target IP            Service address (default 127.0.0.1)" << endl
+         << "  --port PORT            Discovery port (default 50000)" << endl
+         << "  --source-base IP       Source address of the first node (default 127.1.0.1)" << endl
+         << "  --interface NAME       Interface name put in hellos (default lo)" << endl
+         << "  --cli-socket PATH      Service CLI socket (default /tmp/graw_service.sock)" << endl
+         << "  --timeout SECONDS      Neighbour timeout the service uses (default 30)" << endl
+         << "  --seed N               Random seed (default 1)" << endl
+         << "  --help                 Show this help message" << endl;
+}
+
+static bool parse_number(const char* text, double& value) {
+    char* end = nullptr;
+    errno = 0;
+    double parsed = strtod(text, &end);
+    if (errno != 0 || end == text || *end != '\0' || parsed < 0) {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+int parse_arguments(int argc, char* argv[], LoadgenConfig& config) {
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        double number = 0;
+
+        if (arg == "--help") {
+            print_usage(argv[0]);
+            return 1;
+        } else if (!value) {
+            cerr << "Missing value for: " << arg << endl;
+            return -1;
+        } else if (arg == "--target") {
+            config.target = value;
+        } else if (arg == "--source-base") {
+            config.source_base = value;
+        } else if (arg == "--interface") {
+            config.interface_name = value;
+        } else if (arg == "--cli-socket") {
+            config.cli_socket = value;
+        } else if (!parse_number(value, number)) {
+            cerr << "Invalid value for " << arg << ": " << value << endl;
+            return -1;
+        } else if (arg == "--nodes" && number >= 1 && number <= 1000000) {
+            config.nodes = (size_t)number;
+        } else if (arg == "--interval" && number > 0) {
+            config.hello_interval = number;
+        } else if (arg == "--churn") {
+            config.churn_rate = number;
+        } else if (arg == "--duration") {
+            config.duration = number;
+        } else if (arg == "--linger") {
+            config.linger = number;
+        } else if (arg == "--list-interval" && number > 0) {
+            config.list_interval = number;
+        } else if (arg == "--port" && number >= 1 && number <= 65535) {
+            config.port = (int)number;
+        } else if (arg == "--timeout") {
+            config.expected_timeout = (int)number;
+        } else if (arg == "--seed") {
+            config.seed = (uint64_t)number;
+        } else {
+            cerr << "Invalid argument: " << arg << endl;
+            print_usage(argv[0]);
+            return -1;
+        }
+        ++i;
+    }
+
+    if (inet_addr(config.target.c_str()) == INADDR_NONE || inet_addr(config.source_base.c_str()) == INADDR_NONE) {
+        cerr << "Invalid target or source address" << endl;
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    LoadgenConfig config;
+    int parsed = parse_arguments(argc, argv, config);
+    if (parsed != 0) {
+        return parsed < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        cerr << "socket failed: " << strerror(errno) << endl;
+        return EXIT_FAILURE;
+    }
+
+    sockaddr_in target = {};
+    target.sin_family = AF_INET;
+    target.sin_port = htons(config.port);
+    target.sin_addr.s_addr = inet_addr(config.target.c_str());
+
+    mt19937_64 gen(config.seed);
+    in_addr_t source_base = inet_addr(config.source_base.c_str());
+    int64_t interval_us = (int64_t)(config.hello_interval * 1e6);
+    uniform_int_distribution<int64_t> phase(0, interval_us - 1);
+    uniform_int_distribution<int64_t> jitter(0, interval_us / 5);
+
+    vector<VirtualNode> nodes(config.nodes);
+    unordered_map<string, size_t> node_by_hex;
+    priority_queue<ScheduledHello, vector<ScheduledHello>, greater<ScheduledHello>> schedule;
+    LoadgenStats stats;
+
+    int64_t start = helper::monotonic_us();
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        VirtualNode& node = nodes[i];
+        uint64_t halves[2] = {gen(), gen()};
+        memcpy(node.id.data(), halves, sizeof(halves));
+        node.mac = {0x02, 0x47, 0x52, (uint8_t)(i >> 16), (uint8_t)(i >> 8), (uint8_t)i};
+        node.ip = offset_address(source_base, (uint32_t)i);
+        build_hello(node, config.interface_name);
+
+        // Spread the initial joins over one hello interval
+        node.active = true;
+        node.awaiting_discovery = true;
+        node.next_hello_us = start + phase(gen);
+        schedule.push({node.next_hello_us, i});
+
+        char id_hex[33];
+        node_id_to_hex(node.id, id_hex);
+        node_by_hex[id_hex] = i;
+    }
+
+    int64_t traffic_end = start + (int64_t)(config.duration * 1e6);
+    int64_t end = traffic_end + (int64_t)(config.linger * 1e6);
+    int64_t churn_step_us = config.churn_rate > 0 ? (int64_t)(1e6 / config.churn_rate) : 0;
+    int64_t next_churn = churn_step_us ? start + churn_step_us : INT64_MAX;
+    int64_t list_step_us = (int64_t)(config.list_interval * 1e6);
+    int64_t next_list = start + list_step_us;
+    uint32_t spare_addresses = (uint32_t)nodes.size();
+    bool stopped = false;
+
+    unordered_map<string, vector<in_addr_t>> listed;
+    string reply;
+    GrawClient client(config.cli_socket); // one connection for every LIST poll
+    uniform_int_distribution<size_t> pick(0, nodes.size() - 1);
+    uniform_int_distribution<int> event(0, 2);
+
+    printf("Sending hellos for %zu nodes to %s:%d for %.0f s, churn %.1f/s\n", nodes.size(), config.target.c_str(),
+           config.port, config.duration, config.churn_rate);
+
+    while (true) {
+        int64_t now = helper::monotonic_us();
+        if (now >= end) {
+            break;
+        }
+
+        if (now >= traffic_end && !stopped) {
+            // Everyone leaves at once; the linger phase measures their expiry
+            for (VirtualNode& node : nodes) {
+                if (node.active) {
+                    node.active = false;
+                    node.awaiting_discovery = false;
+                    node.awaiting_expiry = node.listed;
+                }
+            }
+            stopped = true;
+        }
+
+        while (!stopped && !schedule.empty() && schedule.top().first <= now) {
+            size_t index = schedule.top().second;
+            int64_t due = schedule.top().first;
+            schedule.pop();
+            VirtualNode& node = nodes[index];
+            if (!node.active || node.next_hello_us != due) {
+                continue; // left or rescheduled since this entry was queued
+            }
+            if (send_hello(fd, node, target)) {
+                ++stats.hellos_sent;
+            } else {
+                ++stats.send_errors;
+            }
+            if (node.joined_us == 0) {
+                node.joined_us = now;
+            }
+            node.last_hello_us = now;
+            node.next_hello_us = now + interval_us + jitter(gen);
+            schedule.push({node.next_hello_us, index});
+        }
+
+        while (!stopped && now >= next_churn) {
+            next_churn += churn_step_us;
+            size_t index = pick(gen);
+            VirtualNode& node = nodes[index];
+            int kind = event(gen);
+
+            if (!node.active) {
+                node.active = true;
+                node.awaiting_expiry = false;
+                node.awaiting_discovery = !node.listed;
+                node.joined_us = 0;
+                ++stats.joins;
+            } else if (kind == 0) {
+                node.active = false;
+                node.awaiting_discovery = false;
+                node.awaiting_ip_change = false;
+                node.awaiting_expiry = node.listed;
+                ++stats.leaves;
+                continue;
+            } else {
+                node.ip = offset_address(source_base, spare_addresses++);
+                build_hello(node, config.interface_name);
+                node.awaiting_ip_change = node.listed;
+                node.ip_changed_us = now;
+                ++stats.ip_changes;
+            }
+            node.next_hello_us = now;
+            schedule.push({now, index});
+        }
+
+        if (now >= next_list) {
+            next_list = now + list_step_us;
+            int64_t list_start = helper::monotonic_us();
+            if (!client.request("LIST", reply)) {
+                ++stats.list_failures;
+            } else {
+                int64_t list_end = helper::monotonic_us();
+                stats.list_us.push_back(list_end - list_start);
+                stats.max_list_bytes = max(stats.max_list_bytes, reply.size());
+                parse_list(reply, listed);
+                stats.max_listed = max(stats.max_listed, listed.size());
+
+                for (VirtualNode& node : nodes) {
+                    node.listed = false;
+                }
+                for (const auto& entry : listed) {
+                    auto found = node_by_hex.find(entry.first);
+                    if (found == node_by_hex.end()) {
+                        continue;
+                    }
+                    VirtualNode& node = nodes[found->second];
+                    node.listed = true;
+                    if (node.awaiting_discovery && node.active && node.joined_us != 0) {
+                        stats.discovery_us.push_back(list_end - node.joined_us);
+                        node.awaiting_discovery = false;
+                    }
+                    if (node.awaiting_ip_change &&
+                        find(entry.second.begin(), entry.second.end(), node.ip) != entry.second.end()) {
+                        stats.ip_change_us.push_back(list_end - node.ip_changed_us);
+                        node.awaiting_ip_change = false;
+                    }
+                }
+                for (VirtualNode& node : nodes) {
+                    if (node.awaiting_expiry && !node.listed) {
+                        int64_t lifetime = list_end - node.last_hello_us;
+                        stats.expiry_error_us.push_back(lifetime - (int64_t)config.expected_timeout * 1000000);
+                        node.awaiting_expiry = false;
+                    }
+                }
+            }
+        }
+
+        int64_t wake = min(next_list, end);
+        if (!stopped) {
+            wake = min(wake, min(next_churn, traffic_end));
+            if (!schedule.empty()) {
+                wake = min(wake, schedule.top().first);
+            }
+        }
+        int64_t sleep_us = wake - helper::monotonic_us();
+        if (sleep_us > 0) {
+            usleep((useconds_t)min<int64_t>(sleep_us, 100000));
+        }
+    }
+    close(fd);
+
+    size_t undiscovered = 0;
+    size_t unexpired = 0;
+    for (const VirtualNode& node : nodes) {
+        undiscovered += node.awaiting_discovery;
+        unexpired += node.awaiting_expiry;
+    }
+
+    printf("Results:\n");
+    printf("  hellos sent            %llu (%llu send errors)\n", (unsigned long long)stats.hellos_sent,
+           (unsigned long long)stats.send_errors);
+    printf("  churn                  %llu joins, %llu leaves, %llu IP changes\n", (unsigned long long)stats.joins,
+           (unsigned long long)stats.leaves, (unsigned long long)stats.ip_changes);
+    printf("  most listed            %zu neighbours, largest LIST reply %zu bytes\n", stats.max_listed,
+           stats.max_list_bytes);
+    printf("  never discovered       %zu\n", undiscovered);
+    printf("  never expired          %zu\n", unexpired);
+    printf("  LIST failures          %llu\n", (unsigned long long)stats.list_failures);
+    print_distribution("discovery latency", stats.discovery_us);
+    print_distribution("IP change latency", stats.ip_change_us);
+    print_distribution("expiry error", stats.expiry_error_us);
+    print_distribution("LIST response time", stats.list_us);
+    printf("Latencies include up to %.0f ms of LIST polling delay; expiry error is relative to a %d s timeout.\n",
+           config.list_interval * 1000, config.expected_timeout);
+    printf("Removals well before the timeout usually mean the service's neighbour table is full\n"
+           "(see graw_neighbours_evicted_total in STATS and --max-neighbours).\n");
+
+    return EXIT_SUCCESS;
+}
@@ -19,7 +19,7 @@ vector<NetworkInterface> get_network_interfaces() {
     struct ifaddrs *ifaddr, *ifa;
 
     if (getifaddrs(&ifaddr) == -1) {
-        helper::log_error("getifaddrs", quiet_mode);
+        LOG_ERROR("getifaddrs failed: %s", strerror(errno));
         return interfaces;
     }
 
@@ -39,20 +39,296 @@ vector<NetworkInterface> get_network_interfaces() {
     return interfaces;
 }
 
-int main() {
+void print_usage(const char* program) {
+    cerr << "Usage: " << program << " [options]" << endl
+         << "  --max-neighbours N     Maximum number of neighbours kept in the table" << endl
+         << "  --memory-budget BYTES  Memory budget for the neighbour table, at least "
+         << NeighbourTable::min_memory_budget << endl
+         << "  --eviction POLICY      'unconfirmed' (default) or 'lru'" << endl
+         << "  --source-rate PPS      Hellos admitted per second from one source IP" << endl
+         << "  --node-rate PPS        Hellos admitted per second for one NodeID" << endl
+         << "  --global-rate PPS      Hellos admitted per second from untrusted sources" << endl
+         << "  --log-level LEVEL      debug, info (default), warn, error or off" << endl
+         << "  --metrics-file PATH    Periodically write Prometheus metrics to PATH" << endl
+         << "  --trace                Record loop phase spans for the TRACE command" << endl
+         << "  --stall-budget-ms MS   Log loop iterations slower than MS (default 100, 0 disables)" << endl
+         << "  --include-loopback     Also run discovery on loopback (for graw_loadgen)" << endl
+         << "  --record-trace PATH    Record received hellos to PATH for replay in graw_sim" << endl
+         << "  --fast-interface NAME[:MS[:N]]  Send hellos on NAME every MS (default 100) and declare" << endl
+         << "                         neighbours down after N missed hellos (default 3)" << endl
+         << "  --aggregate NAME[:MS]  Designated reporter mode on NAME; the reporter sends a digest" << endl
+         << "                         of the segment every MS (default 18000)" << endl
+         << "  --passive NAME[:MS]    Follow the kernel neighbour cache on NAME: probe new addresses at once" << endl
+         << "                         and broadcast hellos only every MS (default 60000)" << endl
+         << "  --relay-to IP          Relay the neighbour table to the service at IP (repeatable)" << endl
+         << "  --relay-interval MS    Send changes to relay upstreams at most every MS (default 5000)" << endl
+         << "  --accept-relays        Cache neighbours relayed from other subnets (RELAYED command)" << endl
+         << "  --gossip               Gossip the segment topology with neighbours (TOPOLOGY command)" << endl
+         << "  --gossip-interval MS   Compare topologies with neighbours every MS (default 2000)" << endl
+         << "  --journal DIR          Journal neighbour events to DIR for the HISTORY command" << endl
+         << "  --journal-segment-size BYTES  Size of one journal segment file (default 4194304)" << endl
+         << "  --journal-segments N   Journal segments kept before the oldest is removed (default 8)" << endl
+         << "  --domain NAME:PORT[:IFACE,...]  Host a discovery domain on PORT, on the listed interfaces" << endl
+         << "                         (default all), with its own NodeID and table (repeatable)" << endl
+         << "  --io-backend BACKEND   auto (default), uring, epoll or select" << endl
+         << "  --help                 Show this help message" << endl;
+}
+
+static bool parse_rate(const char* text, uint32_t& value) {
+    char* end = nullptr;
+    errno = 0;
+    unsigned long parsed = strtoul(text, &end, 10);
+    if (errno != 0 || end == text || *end != '\0' || parsed == 0 || parsed > 1000000) {
+        return false;
+    }
+    value = (uint32_t)parsed;
+    return true;
+}
+
+static bool parse_size(const char* text, size_t& value) {
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long parsed = strtoull(text, &end, 10);
+    if (errno != 0 || end == text || *end != '\0') {
+        return false;
+    }
+    value = (size_t)parsed;
+    return true;
+}
+
+// NAME[:INTERVAL_MS[:MULTIPLIER]]
+static bool parse_fast_interface(const char* text, DiscoveryConfig& config) {
+    string spec = text;
+    size_t colon = spec.find(':');
+    string name = spec.substr(0, colon);
+    LivenessConfig liveness;
+    liveness.interval_ms = FAST_INTERVAL_MS;
+    liveness.multiplier = FAST_HOLD_MULTIPLIER;
+
+    size_t interval = 0;
+    size_t multiplier = 0;
+    if (colon != string::npos) {
+        string rest = spec.substr(colon + 1);
+        size_t second = rest.find(':');
+        if (!parse_size(rest.substr(0, second).c_str(), interval) || interval < (size_t)MIN_INTERVAL_MS ||
+            interval > (size_t)BROADCAST_INTERVAL_MS) {
+            return false;
+        }
+        liveness.interval_ms = (int64_t)interval;
+        if (second != string::npos) {
+            if (!parse_size(rest.substr(second + 1).c_str(), multiplier) || multiplier < 2 || multiplier > 255) {
+                return false;
+            }
+            liveness.multiplier = (uint32_t)multiplier;
+        }
+    }
+    if (name.empty()) {
+        return false;
+    }
+    config.interface_liveness[name] = liveness;
+    return true;
+}
+
+// NAME[:DIGEST_INTERVAL_MS]
+static bool parse_aggregate(const char* text, DiscoveryConfig& config) {
+    string spec = text;
+    size_t colon = spec.find(':');
+    string name = spec.substr(0, colon);
+    AggregationConfig aggregation;
+
+    size_t interval = 0;
+    if (colon != string::npos) {
+        if (!parse_size(spec.substr(colon + 1).c_str(), interval) || interval < (size_t)MIN_INTERVAL_MS ||
+            interval > (size_t)MAX_HOLD_MS) {
+            return false;
+        }
+        aggregation.digest_interval_ms = (int64_t)interval;
+    }
+    if (name.empty()) {
+        return false;
+    }
+    config.interface_aggregation[name] = aggregation;
+    return true;
+}
+
+// NAME[:BROADCAST_INTERVAL_MS]
+static bool parse_passive(const char* text, DiscoveryConfig& config) {
+    string spec = text;
+    size_t colon = spec.find(':');
+    string name = spec.substr(0, colon);
+    PassiveConfig passive;
+
+    size_t interval = 0;
+    if (colon != string::npos) {
+        if (!parse_size(spec.substr(colon + 1).c_str(), interval) || interval < (size_t)MIN_INTERVAL_MS ||
+            interval > (size_t)MAX_HOLD_MS) {
+            return false;
+        }
+        passive.interval_ms = (int64_t)interval;
+    }
+    if (name.empty()) {
+        return false;
+    }
+    config.interface_passive[name] = passive;
+    return true;
+}
+
+// NAME:PORT[:IFACE[,IFACE...]]
+static bool parse_domain(const char* text, ServiceConfig& service_config) {
+    string spec = text;
+    size_t colon = spec.find(':');
+    if (colon == string::npos) {
+        return false;
+    }
+    DomainConfig domain;
+    domain.name = spec.substr(0, colon);
+    string rest = spec.substr(colon + 1);
+    size_t second = rest.find(':');
+    size_t port = 0;
+    if (!valid_domain_name(domain.name) || !parse_size(rest.substr(0, second).c_str(), port) || port == 0 ||
+        port > 65535) {
+        return false;
+    }
+    domain.port = (int)port;
+    if (second != string::npos) {
+        string list = rest.substr(second + 1);
+        size_t start = 0;
+        while (start <= list.size()) {
+            size_t comma = list.find(',', start);
+            string name = list.substr(start, comma == string::npos ? string::npos : comma - start);
+            if (name.empty() || name.size() >= IFNAMSIZ) {
+                return false;
+            }
+            domain.interfaces.push_back(name);
+            start = comma == string::npos ? list.size() + 1 : comma + 1;
+        }
+    }
+    for (const DomainConfig& other : service_config.domains) {
+        if (other.port == domain.port || strcasecmp(other.name.c_str(), domain.name.c_str()) == 0) {
+            cerr << "Domain " << domain.name << " reuses the name or port of domain " << other.name << endl;
+            return false;
+        }
+    }
+    service_config.domains.push_back(domain);
+    return true;
+}
+
+int parse_arguments(int argc, char* argv[], DiscoveryConfig& config, ServiceConfig& service_config) {
+    LogLevel log_level;
+    size_t stall_budget;
+    size_t relay_interval;
+    size_t gossip_interval;
+    in_addr upstream;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        if (arg == "--help") {
+            print_usage(argv[0]);
+            return 1;
+        } else if (arg == "--max-neighbours" && value && parse_size(value, config.max_neighbours)) {
+            ++i;
+        } else if (arg == "--memory-budget" && value && parse_size(value, config.memory_budget) &&
+                   config.memory_budget >= NeighbourTable::min_memory_budget) {
+            ++i;
+        } else if (arg == "--eviction" && value && (string(value) == "lru" || string(value) == "unconfirmed")) {
+            config.eviction_policy = string(value) == "lru" ? EvictionPolicy::LeastRecentlySeen
+                                                            : EvictionPolicy::PreferUnconfirmed;
+            ++i;
+        } else if (arg == "--log-level" && value && logger::parse_level(value, log_level)) {
+            logger::set_level(log_level);
+            ++i;
+        } else if (arg == "--metrics-file" && value && *value) {
+            service_config.metrics_file = value;
+            ++i;
+        } else if (arg == "--fast-interface" && value && parse_fast_interface(value, config)) {
+            ++i;
+        } else if (arg == "--aggregate" && value && parse_aggregate(value, config)) {
+            ++i;
+        } else if (arg == "--passive" && value && parse_passive(value, config)) {
+            ++i;
+        } else if (arg == "--relay-to" && value && inet_pton(AF_INET, value, &upstream) == 1) {
+            config.relay.upstreams.push_back(upstream.s_addr);
+            ++i;
+        } else if (arg == "--relay-interval" && value && parse_size(value, relay_interval) &&
+                   relay_interval >= (size_t)MIN_INTERVAL_MS && relay_interval <= (size_t)RELAY_REFRESH_MS) {
+            config.relay.interval_ms = (int64_t)relay_interval;
+            ++i;
+        } else if (arg == "--accept-relays") {
+            config.relay.accept = true;
+        } else if (arg == "--gossip") {
+            config.gossip.enabled = true;
+        } else if (arg == "--gossip-interval" && value && parse_size(value, gossip_interval) &&
+                   gossip_interval >= (size_t)MIN_INTERVAL_MS && gossip_interval <= (size_t)MAX_HOLD_MS) {
+            config.gossip.interval_ms = (int64_t)gossip_interval;
+            ++i;
+        } else if (arg == "--record-trace" && value && *value) {
+            config.record_trace_path = value;
+            ++i;
+        } else if (arg == "--journal" && value && *value) {
+            config.journal.directory = value;
+            ++i;
+        } else if (arg == "--journal-segment-size" && value && parse_size(value, config.journal.segment_bytes) &&
+                   config.journal.segment_bytes >= JOURNAL_MIN_SEGMENT_BYTES) {
+            ++i;
+        } else if (arg == "--journal-segments" && value && parse_size(value, config.journal.segments) &&
+                   config.journal.segments >= 1 && config.journal.segments <= 100000) {
+            ++i;
+        } else if (arg == "--domain" && value && parse_domain(value, service_config)) {
+            ++i;
+        } else if (arg == "--io-backend" && value && parse_io_backend(value, service_config.io_backend)) {
+            ++i;
+        } else if (arg == "--include-loopback") {
+            service_config.include_loopback = true;
+        } else if (arg == "--trace") {
+            trace::set_enabled(true);
+        } else if (arg == "--stall-budget-ms" && value && parse_size(value, stall_budget) && stall_budget <= 3600000) {
+            service_config.stall_budget_ms = (int)stall_budget;
+            ++i;
+        } else if (arg == "--source-rate" && value && parse_rate(value, config.admission.source_rate)) {
+            ++i;
+        } else if (arg == "--node-rate" && value && parse_rate(value, config.admission.node_rate)) {
+            ++i;
+        } else if (arg == "--global-rate" && value && parse_rate(value, config.admission.global_rate)) {
+            ++i;
+        } else {
+            cerr << "Invalid argument: " << arg << endl;
+            print_usage(argv[0]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    DiscoveryConfig discovery_config;
+    ServiceConfig service_config;
+    int parsed = parse_arguments(argc, argv, discovery_config, service_config);
+    if (parsed != 0) {
+        if (parsed < 0) {
+            readiness::notify_failed("Invalid command line");
+        }
+        return parsed < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
     write_pid_file();
-    Service service(CLI_SOCKET_PATH, DISCOVERY_PORT, quiet_mode);
+    Service service(CLI_SOCKET_PATH, DISCOVERY_PORT, discovery_config, service_config);
 
     if (service.start() != 0) {
-        helper::log_error("Failed to start service.", quiet_mode);
+        LOG_ERROR("Failed to start service.");
+        readiness::notify_failed(service.start_error());
+        cleanup_pid_file();
+        logger::flush();
         return -1;
     }
+    readiness::notify_ready();
     service.loop();
 
     service.stop();
     cleanup_pid_file();
-    helper::log_info("Network discovery service finished.", quiet_mode);
-    helper::log_info("Exiting...", quiet_mode);
+    LOG_INFO("Network discovery service finished.");
+    LOG_INFO("Exiting...");
+    logger::flush();
 
     return 0;
 }
\ No newline at end of file
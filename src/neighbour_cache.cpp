@@ -0,0 +1,152 @@
+#include "neighbour_cache.h"
+#include "common/logger.h"
+
+#include <cerrno>
+#include <cstring>
+#include <linux/neighbour.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// From iproute2; the uapi headers only define the RTM_ variants, which
+// assume an rtmsg header
+#ifndef NDA_RTA
+#define NDA_RTA(r) ((struct rtattr*)(((char*)(r)) + NLMSG_ALIGN(sizeof(struct ndmsg))))
+#endif
+
+static const uint16_t KNOWN_STATES = NUD_REACHABLE | NUD_STALE | NUD_DELAY | NUD_PROBE | NUD_PERMANENT;
+
+NeighbourCacheMonitor::~NeighbourCacheMonitor() {
+    if (socket_fd >= 0) {
+        close(socket_fd);
+    }
+}
+
+int NeighbourCacheMonitor::open(Handler neighbour_handler) {
+    socket_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (socket_fd < 0) {
+        LOG_ERROR("Failed to open rtnetlink socket: %s", strerror(errno));
+        return -1;
+    }
+    int rcvbuf = NEIGHBOUR_CACHE_RCVBUF;
+    setsockopt(socket_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    sockaddr_nl address{};
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = RTMGRP_NEIGH;
+    if (bind(socket_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || request_dump() < 0) {
+        LOG_ERROR("Failed to subscribe to neighbour cache events: %s", strerror(errno));
+        close(socket_fd);
+        socket_fd = -1;
+        return -1;
+    }
+    handler = std::move(neighbour_handler);
+    return 0;
+}
+
+int NeighbourCacheMonitor::request_dump() {
+    struct {
+        nlmsghdr header;
+        ndmsg body;
+    } request{};
+    request.header.nlmsg_len = sizeof(request);
+    request.header.nlmsg_type = RTM_GETNEIGH;
+    request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.header.nlmsg_seq = ++dump_sequence;
+    request.body.ndm_family = AF_INET;
+
+    sockaddr_nl kernel{};
+    kernel.nl_family = AF_NETLINK;
+    return sendto(socket_fd, &request, sizeof(request), 0, reinterpret_cast<sockaddr*>(&kernel), sizeof(kernel)) < 0
+               ? -1
+               : 0;
+}
+
+const std::string* NeighbourCacheMonitor::device_name(int ifindex) {
+    auto found = devices.find(ifindex);
+    if (found != devices.end()) {
+        return &found->second;
+    }
+    char name[IF_NAMESIZE];
+    if (!if_indextoname(ifindex, name)) {
+        return nullptr;
+    }
+    return &devices.emplace(ifindex, name).first->second;
+}
+
+void NeighbourCacheMonitor::on_readable(int) {
+    alignas(nlmsghdr) char buffer[NEIGHBOUR_CACHE_BUFFER];
+    for (;;) {
+        sockaddr_nl sender{};
+        socklen_t sender_length = sizeof(sender);
+        ssize_t length = recvfrom(socket_fd, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr*>(&sender),
+                                  &sender_length);
+        if (length < 0) {
+            if (errno == ENOBUFS) {
+                // Events were lost; the dump brings the handler up to date
+                LOG_WARN_RATE_LIMITED("Neighbour cache events overflowed the socket, reading the cache again");
+                devices.clear();
+                request_dump();
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                LOG_ERROR_RATE_LIMITED("Failed to read neighbour cache events: %s", strerror(errno));
+            }
+            return;
+        }
+        if (sender.nl_pid != 0) {
+            continue; // only the kernel speaks for the cache
+        }
+        int remaining = (int)length;
+        for (const nlmsghdr* header = reinterpret_cast<const nlmsghdr*>(buffer); NLMSG_OK(header, remaining);
+             header = NLMSG_NEXT(header, remaining)) {
+            handle_message(header);
+        }
+    }
+}
+
+void NeighbourCacheMonitor::handle_message(const nlmsghdr* header) {
+    if ((header->nlmsg_type != RTM_NEWNEIGH && header->nlmsg_type != RTM_DELNEIGH) ||
+        header->nlmsg_len < NLMSG_LENGTH(sizeof(ndmsg))) {
+        return;
+    }
+    const ndmsg* body = static_cast<const ndmsg*>(NLMSG_DATA(header));
+    if (body->ndm_family != AF_INET || (body->ndm_flags & NTF_PROXY)) {
+        return;
+    }
+
+    KernelNeighbour entry{};
+    bool has_ip = false;
+    bool has_mac = false;
+    int attributes_length = (int)NLMSG_PAYLOAD(header, sizeof(ndmsg));
+    for (const rtattr* attribute = NDA_RTA(body); RTA_OK(attribute, attributes_length);
+         attribute = RTA_NEXT(attribute, attributes_length)) {
+        if (attribute->rta_type == NDA_DST && RTA_PAYLOAD(attribute) == sizeof(entry.ip)) {
+            memcpy(&entry.ip, RTA_DATA(attribute), sizeof(entry.ip));
+            has_ip = true;
+        } else if (attribute->rta_type == NDA_LLADDR && RTA_PAYLOAD(attribute) == entry.mac.size()) {
+            memcpy(entry.mac.data(), RTA_DATA(attribute), entry.mac.size());
+            has_mac = true;
+        }
+    }
+    if (!has_ip) {
+        return;
+    }
+    if (header->nlmsg_type == RTM_DELNEIGH) {
+        entry.state = KernelNeighbourState::Deleted;
+        entry.mac = MAC_Bytes{};
+    } else if (body->ndm_state & NUD_FAILED) {
+        entry.state = KernelNeighbourState::Failed;
+        entry.mac = MAC_Bytes{};
+    } else if (has_mac && (body->ndm_state & KNOWN_STATES)) {
+        entry.state = KernelNeighbourState::Known;
+    } else {
+        return; // still resolving, or an address without ARP
+    }
+    entry.device = device_name(body->ndm_ifindex);
+    if (entry.device) {
+        handler(entry);
+    }
+}
@@ -1,251 +1,1424 @@
 #include "neighbour_discovery.h"
-#include <random>
 
-int NeighbourDiscovery::bind_all_interfaces() {
-    socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (socket_fd < 0) {
-        helper::log_error("Failed to create socket", quiet_mode);
-        return -1;
+template <typename Policy>
+void BasicNeighbourDiscovery<Policy>::register_metrics(MetricsRegistry& registry) {
+    metrics.interfaces.resize(interfaces.size());
+    for (size_t i = 0; i < interfaces.size(); ++i) {
+        size_t first = i;
+        for (size_t j = 0; j < i; ++j) {
+            if (interfaces[j].name == interfaces[i].name) {
+                first = j;
+                break;
+            }
+        }
+        if (first != i) {
+            metrics.interfaces[i] = metrics.interfaces[first];
+            continue;
+        }
+
+        std::string label = "interface=\"" + interfaces[i].name + "\"";
+        InterfaceMetrics& m = metrics.interfaces[i];
+        m.rx_packets = &registry.counter("graw_discovery_rx_packets_total", "Hellos received and matched to an interface", label);
+        m.rx_bytes = &registry.counter("graw_discovery_rx_bytes_total", "Bytes of hellos received and matched to an interface", label);
+        m.tx_packets = &registry.counter("graw_discovery_tx_packets_total", "Hellos broadcast", label);
+        m.tx_bytes = &registry.counter("graw_discovery_tx_bytes_total", "Bytes of hellos broadcast", label);
+        m.tx_errors = &registry.counter("graw_discovery_tx_errors_total", "Hello broadcasts that failed", label);
     }
-    
-    int reuse = 1;
-    if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0) {
-        helper::log_error("setsockopt SO_REUSEADDR failed", quiet_mode);
-        close(socket_fd);
-        return -1;
+
+    metrics.recv_errors = &registry.counter("graw_discovery_recv_errors_total", "Failed reads from discovery sockets");
+    metrics.unmatched_drops = &registry.counter("graw_discovery_unmatched_drops_total", "Packets from senders outside every local network");
+    metrics.parse_failures = &registry.counter("graw_discovery_parse_failures_total", "Packets that did not parse as a hello");
+    metrics.admission_drops_source = &registry.counter("graw_discovery_admission_drops_total", "Packets dropped by admission control", "reason=\"source\"");
+    metrics.admission_drops_node = &registry.counter("graw_discovery_admission_drops_total", "Packets dropped by admission control", "reason=\"node\"");
+    metrics.admission_drops_global = &registry.counter("graw_discovery_admission_drops_total", "Packets dropped by admission control", "reason=\"global\"");
+    metrics.neighbours_added = &registry.counter("graw_neighbours_added_total", "Neighbours discovered");
+    metrics.neighbours_expired = &registry.counter("graw_neighbours_expired_total", "Neighbours removed after the timeout");
+    metrics.neighbours_evicted = &registry.counter("graw_neighbours_evicted_total", "Neighbours evicted from a full table");
+    metrics.links_refused = &registry.counter("graw_neighbour_links_refused_total", "Links not kept because the memory budget was used up");
+    metrics.neighbours_recovered = &registry.counter("graw_neighbours_recovered_total", "Neighbours that answered a probe after their hold time ran out");
+    metrics.probes_sent = &registry.counter("graw_discovery_probes_sent_total", "Unicast probes sent to neighbours past their hold time");
+    metrics.probes_answered = &registry.counter("graw_discovery_probes_answered_total", "Probes answered with a unicast hello");
+    metrics.digests_sent = &registry.counter("graw_discovery_digests_sent_total", "Digest datagrams broadcast as designated reporter");
+    metrics.digests_received = &registry.counter("graw_discovery_digests_received_total", "Digest datagrams received from a designated reporter");
+    metrics.relay_parts_sent = &registry.counter("graw_relay_parts_sent_total", "Snapshot datagrams sent to upstream relays");
+    metrics.relay_parts_received = &registry.counter("graw_relay_parts_received_total", "Snapshot datagrams accepted from downstream relays");
+    metrics.relayed_dropped = &registry.counter("graw_relayed_dropped_total", "Relayed neighbours refused because the relay cache was full");
+    metrics.gossip_sent = &registry.counter("graw_gossip_sent_total", "Topology gossip datagrams sent");
+    metrics.gossip_received = &registry.counter("graw_gossip_received_total", "Topology gossip datagrams accepted from peers");
+    metrics.journal_dropped = &registry.counter("graw_journal_dropped_total", "Neighbour events lost while no journal segment could be created");
+    metrics.kernel_events = &registry.counter("graw_kernel_neighbour_events_total", "Kernel neighbour cache events on passive interfaces");
+    metrics.kernel_probes = &registry.counter("graw_kernel_probes_sent_total", "Unicast probes sent to addresses new in the kernel neighbour cache");
+    metrics.kernel_mac_mismatches = &registry.counter("graw_kernel_mac_mismatches_total", "Links whose MAC differs from the kernel neighbour cache");
+    metrics.neighbours = &registry.gauge("graw_neighbours", "Neighbours currently in the table");
+    metrics.relayed_neighbours = &registry.gauge("graw_relayed_neighbours", "Neighbours currently in the relay cache");
+    metrics.topology_nodes = &registry.gauge("graw_topology_nodes", "Nodes with live links in the gossiped topology");
+    metrics.topology_links = &registry.gauge("graw_topology_links", "Live links in the gossiped topology");
+    metrics.table_bytes = &registry.gauge("graw_neighbour_table_bytes", "Memory used by the neighbour table");
+    metrics.packet_time = &registry.histogram("graw_discovery_packet_seconds", "Time to receive and process one discovery packet");
+    metrics.broadcast_time = &registry.histogram("graw_discovery_broadcast_seconds", "Time to broadcast hellos on all interfaces");
+    metrics.cleanup_time = &registry.histogram("graw_discovery_cleanup_seconds", "Time to expire inactive neighbours");
+}
+
+// Copies counters that other components already keep into the registry
+template <typename Policy>
+void BasicNeighbourDiscovery<Policy>::update_metrics() {
+    const AdmissionStats& admission_stats = admission.stats();
+    metrics.admission_drops_source->value = admission_stats.dropped_source;
+    metrics.admission_drops_node->value = admission_stats.dropped_node;
+    metrics.admission_drops_global->value = admission_stats.dropped_global;
+    metrics.neighbours_evicted->value = neighbors.stats().evictions;
+    metrics.neighbours_recovered->value = neighbors.stats().probe_recoveries;
+    metrics.links_refused->value = neighbors.stats().refused_links;
+    metrics.neighbours->set(neighbors.size());
+    metrics.table_bytes->set(neighbors.memory_usage());
+    metrics.relayed_dropped->value = relay_cache.dropped();
+    metrics.relayed_neighbours->set(relay_cache.size());
+    metrics.journal_dropped->value = journal.dropped();
+}
+
+template <typename Policy>
+bool BasicNeighbourDiscovery<Policy>::neighbor_exists(const NodeID& id) const {
+    return neighbors.find(id) != nullptr;
+}
+
+template <typename Policy>
+NetworkNeighbor* BasicNeighbourDiscovery<Policy>::get_neighbor(const NodeID& id) {
+    return neighbors.find(id);
+}
+
+template <typename Policy>
+NetworkConnection* BasicNeighbourDiscovery<Policy>::add_or_update_neighbor(const NodeID& id,
+                                                                           const NetworkConnection& connection,
+                                                                           int64_t hold_ms, uint32_t interval_ms) {
+    bool inserted = false;
+    bool changed = false;
+    int64_t deadline = clock.now_ms() + hold_ms;
+    uint64_t evictions = neighbors.stats().evictions;
+    NetworkNeighbor& neighbor = neighbors.refresh(id, deadline, inserted);
+    if (neighbors.stats().evictions != evictions) {
+        neighbour_event(JournalEvent::Evicted, neighbors.last_evicted(), nullptr);
+    }
+    neighbor.interval_ms = interval_ms;
+    next_expiry_ms = std::min(next_expiry_ms, deadline);
+    size_t links = neighbor.connections.size();
+    NetworkConnection* stored = neighbors.add_connection(neighbor, connection, changed);
+    if (changed && !inserted) {
+        neighbors.mark_changed(id);
     }
+    if (inserted || changed) {
+        neighbour_event(inserted ? JournalEvent::Added
+                                 : neighbor.connections.size() > links ? JournalEvent::LinkUp : JournalEvent::LinkMoved,
+                        id, &connection);
+    }
+    return stored;
+}
 
-    int broadcast = 1;
-    if(setsockopt(socket_fd, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast)) < 0) {
-        helper::log_error("setsockopt SO_BROADCAST failed", quiet_mode);
-        close(socket_fd);
-        return -1;
+template <typename Policy>
+void BasicNeighbourDiscovery<Policy>::neighbour_event(JournalEvent event, const NodeID& id,
+                                                      const NetworkConnection* connection) {
+    if (on_event) {
+        on_event(event, id, connection);
+    }
+    if (!journal.is_open()) {
+        return;
     }
+    static const std::string no_interface;
+    if (connection) {
+        journal.append(event, id, connection->ip, connection->mac_address, interfaces[connection->interface_id].name);
+    } else {
+        journal.append(event, id, 0, MAC_Bytes{}, no_interface);
+    }
+}
+
+// Folds one hello into the link's liveness, loss, jitter and RTT
+template <typename Policy>
+void BasicNeighbourDiscovery<Policy>::update_link(NetworkConnection& connection, const DiscoveryPackage& pkg,
+                                                  int64_t hold_ms, int64_t arrival_us) {
+    LinkStats& link = connection.link;
+    int64_t now = clock.now_ms();
+    link.last_seen_ms = now;
+    link.hold_ms = (uint32_t)hold_ms;
+    link.via_digest = false;
 
-    int pktinfo = 1;
-    if (setsockopt(socket_fd, IPPROTO_IP, IP_PKTINFO, &pktinfo, sizeof(pktinfo)) < 0) {
-        helper::log_error("setsockopt IP_PKTINFO failed", quiet_mode);
-        close(socket_fd);
-        return -1;
+    if (pkg.has_sequence) {
+        uint16_t gap = (uint16_t)(pkg.sequence - link.last_sequence);
+        if (link.expected != 0 && gap == 0) {
+            return; // duplicate
+        }
+        if (link.expected != 0 && gap <= LOSS_WINDOW) {
+            link.expected += (uint16_t)gap;
+            link.received += 1;
+            // Halving keeps the ratio while older hellos fade out
+            if (link.expected >= LOSS_WINDOW) {
+                link.expected /= 2;
+                link.received /= 2;
+            }
+        } else {
+            // First hello, or the peer restarted or was gone too long
+            link.expected = 1;
+            link.received = 1;
+            link.has_transit = false;
+        }
+        link.last_sequence = (uint16_t)pkg.sequence;
     }
 
-    int flags = fcntl(socket_fd, F_GETFL, 0);
-    if (flags == -1) {
-        helper::log_error("fcntl F_GETFL failed", quiet_mode);
-        close(socket_fd);
-        return -1;
+    if (pkg.timestamp_us >= 0) {
+        // Both clocks are monotonic but unrelated, so only changes in
+        // transit time mean anything (RFC 3550 section 6.4.1). Wrapping
+        // 32-bit arithmetic keeps the difference exact for gaps under 35 min.
+        uint32_t transit = (uint32_t)(arrival_us - pkg.timestamp_us);
+        if (link.has_transit) {
+            int64_t d = std::abs((int64_t)(int32_t)(transit - link.last_transit_us));
+            link.jitter_us = (uint32_t)((int64_t)link.jitter_us + (d - (int64_t)link.jitter_us) / 16);
+        }
+        link.last_transit_us = transit;
+        link.has_transit = true;
     }
-    if (fcntl(socket_fd, F_SETFL, flags | O_NONBLOCK) == -1) {
-        helper::log_error("fcntl F_SETFL failed", quiet_mode);
-        close(socket_fd);
-        return -1;
+
+    if (pkg.echo_timestamp_us >= 0 && pkg.echo_id == node_id) {
+        int64_t rtt = arrival_us - pkg.echo_timestamp_us - pkg.echo_delay_us;
+        if (rtt >= 0 && rtt < hold_ms * 1000) {
+            rtt = std::max<int64_t>(rtt, 1);
+            link.rtt_us = link.rtt_us ? (uint32_t)(link.rtt_us + (rtt - (int64_t)link.rtt_us) / 8) : (uint32_t)rtt;
+        }
     }
+}
 
-    struct sockaddr_in addr;
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(discovery_port);
-    addr.sin_addr.s_addr = INADDR_ANY;
+// Drops the connections of a live neighbour that stopped hearing hellos on
+// them, and returns whether any were dropped. The neighbour itself goes
+// through the usual probe and expiry once its last connection is dead.
+template <typename Policy>
+bool BasicNeighbourDiscovery<Policy>::expire_links(const NeighbourSlot& slot, NetworkNeighbor& neighbor, int64_t now) {
+    size_t live = 0;
+    for (const NetworkConnection& connection : neighbor.connections) {
+        live += now < connection.link.deadline_ms();
+    }
+    if (live == 0 || live == neighbor.connections.size()) {
+        return false;
+    }
 
-    if (bind(socket_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        helper::log_error("bind failed", quiet_mode);
-        close(socket_fd);
-        return -1;
+    for (size_t i = neighbor.connections.size(); i-- > 0;) {
+        const NetworkConnection& connection = neighbor.connections[i];
+        if (now < connection.link.deadline_ms()) {
+            continue;
+        }
+        if (logger::enabled(LogLevel::Info)) {
+            char id_hex[33];
+            node_id_to_hex(slot.id, id_hex);
+            LOG_INFO("Link to neighbor %s via %s (%s) is down", id_hex, helper::ip_to_string(connection.ip).c_str(),
+                     interfaces[connection.interface_id].name.c_str());
+        }
+        neighbour_event(JournalEvent::LinkDown, slot.id, &connection);
+        neighbor.connections.erase(&neighbor.connections[i]);
     }
+    return true;
+}
 
-    for (auto& interface : interfaces) {
-        helper::log_info("Binding to interface: " + interface.name
-                         + " (" + interface.ip_address + ":" + std::to_string(discovery_port) + ")"
-                         + " with broadcast address: " + interface.broadcast_address, quiet_mode);
-        sockaddr_in broadcast_addr{};
-        broadcast_addr.sin_family = AF_INET;
-        broadcast_addr.sin_port = htons(discovery_port);
+// Compares the links to the addresses in kernel_checks with the MAC the
+// kernel has for each (none if resolution failed). Links that disagree are
+// due now: a lone link gets its probe, one of several is dropped. Addresses
+// the kernel resolved without a matching link are probed. Events arrive in
+// bursts, e.g. the dump at startup, so they are batched into one table walk.
+template <typename Policy>
+void BasicNeighbourDiscovery<Policy>::check_kernel_links(int64_t now) {
+    last_kernel_check_ms = now;
+    next_kernel_check_ms = INT64_MAX;
+    neighbors.for_each([&](NeighbourSlot& slot, NetworkNeighbor& neighbor) {
+        for (NetworkConnection& connection : neighbor.connections) {
+            auto found = kernel_checks.find((uint64_t)connection.interface_id << 32 | connection.ip);
+            if (found == kernel_checks.end()) {
+                continue;
+            }
+            KernelCheck& check = found->second;
+            if (check.resolved && connection.mac_address == check.mac) {
+                check.known = true;
+                continue;
+            }
+            if (check.resolved) {
+                metrics.kernel_mac_mismatches->inc();
+                LOG_WARN_RATE_LIMITED("Neighbour at %s on %s claims another MAC than the kernel has for it",
+                                      helper::ip_to_string(connection.ip).c_str(),
+                                      interfaces[connection.interface_id].name.c_str());
+            }
+            if (neighbor.connections.size() > 1) {
+                connection.link.last_seen_ms = std::min(connection.link.last_seen_ms, now - connection.link.hold_ms);
+            } else if (slot.probes == 0) {
+                slot.deadline = std::min(slot.deadline, now);
+            }
+            next_expiry_ms = now;
+        }
+    });
 
-        if(inet_pton(AF_INET, interface.broadcast_address.c_str(), &broadcast_addr.sin_addr) <= 0) {
-            helper::log_error("inet_pton failed for broadcast address: " + interface.broadcast_address, quiet_mode);
-            close(socket_fd);
-            return -1;
+    // A new address, or a new MAC behind a known one, is probed rather
+    // than left to the next broadcast: the peer learns us from the probe
+    // and answers with a hello we learn it from
+    char buffer[MAX_MESSAGE_SIZE];
+    for (const auto& [key, check] : kernel_checks) {
+        if (!check.resolved || check.known) {
+            continue;
+        }
+        uint16_t interface_id = (uint16_t)(key >> 32);
+        std::string_view message = format_message(buffer, probe_messages[interface_id], nullptr, nullptr);
+        if (transport.send(interface_id, (in_addr_t)key, message) >= 0) {
+            metrics.kernel_probes->inc();
         }
+    }
+    kernel_checks.clear();
+}
 
-        helper::log_info("Successfully bound socket to interface: " + interface.name, quiet_mode);
+template <typename Policy>
+void BasicNeighbourDiscovery<Policy>::on_kernel_neighbour(const KernelNeighbour& entry) {
+    uint16_t interface_id = 0;
+    while (interface_id < interfaces.size() &&
+           !(passive[interface_id] && interfaces[interface_id].name == *entry.device &&
+             interfaces[interface_id].contains(entry.ip) && interfaces[interface_id].ipv4_address != entry.ip)) {
+        ++interface_id;
     }
+    if (interface_id == interfaces.size()) {
+        return;
+    }
+    metrics.kernel_events->inc();
 
-    return 0;
+    uint64_t key = (uint64_t)interface_id << 32 | entry.ip;
+    if (entry.state != KernelNeighbourState::Known) {
+        kernel_neighbours.erase(key);
+        if (entry.state == KernelNeighbourState::Failed) {
+            queue_kernel_check(key, nullptr);
+        }
+        return;
+    }
+    auto found = kernel_neighbours.find(key);
+    if (found != kernel_neighbours.end() && found->second == entry.mac) {
+        return; // only the entry's state moved, e.g. reachable to stale
+    }
+    if (found == kernel_neighbours.end() && kernel_neighbours.size() >= KERNEL_NEIGHBOURS_SIZE) {
+        return;
+    }
+    kernel_neighbours[key] = entry.mac;
+    queue_kernel_check(key, &entry.mac);
 }
 
-void NeighbourDiscovery::cleanup_bound_sockets() {
-    close(socket_fd);
+// The latest event for an address wins; the batch runs from update()
+template <typename Policy>
+void BasicNeighbourDiscovery<Policy>::queue_kernel_check(uint64_t key, const MAC_Bytes* mac) {
+    if (kernel_checks.size() >= KERNEL_NEIGHBOURS_SIZE && kernel_checks.find(key) == kernel_checks.end()) {
+        return;
+    }
+    kernel_checks[key] = {mac ? *mac : MAC_Bytes{}, mac != nullptr, false};
+    if (next_kernel_check_ms == INT64_MAX) {
+        next_kernel_check_ms = std::max(clock.now_ms(), last_kernel_check_ms + KERNEL_CHECK_INTERVAL_MS);
+        next_hello_ms = std::min(next_hello_ms, next_kernel_check_ms);
+    }
 }
 
-bool NeighbourDiscovery::neighbor_exists(const NodeIDHex& id) const {
-    return neighbors.find(id) != neighbors.end();
-}
+template <typename Policy>
+BasicNeighbourDiscovery<Policy>::BasicNeighbourDiscovery(const std::vector<NetworkInterface>& interfaces,
+                                                         int discovery_port, NodeID node_id, MetricsRegistry& registry,
+                                                         ClockType& clock, RandomType& random, TransportType& transport,
+                                                         const DiscoveryConfig& config)
+    : node_id(node_id), discovery_port(discovery_port), interfaces(interfaces), clock(clock), random(random),
+      transport(transport), neighbors(16, random.next()), admission(config.admission, random.next()),
+      on_event(config.on_event), relay(config.relay), relay_cache(config.relay.cache_size), gossip(config.gossip),
+      topology(node_id, config.gossip.max_links) {
+    node_id_to_hex(node_id, node_id_hex);
+    register_metrics(registry);
+    neighbors.set_limits(config.max_neighbours, config.memory_budget, config.eviction_policy);
+    LOG_INFO("Neighbour table limited to %zu entries", neighbors.max_size());
 
-NetworkNeighbor* NeighbourDiscovery::get_neighbor(const NodeIDHex& id) {
-    auto it = neighbors.find(id);
-    if (it != neighbors.end()) {
-        return &it->second;
+    int64_t now = clock.now_ms();
+    for (size_t i = 0; i < interfaces.size(); ++i) {
+        auto it = config.interface_liveness.find(interfaces[i].name);
+        liveness.push_back(it != config.interface_liveness.end() ? it->second : config.liveness);
+        auto passive_it = config.interface_passive.find(interfaces[i].name);
+        passive.push_back(passive_it != config.interface_passive.end());
+        if (passive[i]) {
+            liveness[i].interval_ms = passive_it->second.interval_ms;
+            LOG_INFO("Passive mode on %s: new kernel neighbours are probed, broadcasts every %lld ms",
+                     interfaces[i].name.c_str(), (long long)liveness[i].interval_ms);
+        } else if (it != config.interface_liveness.end()) {
+            LOG_INFO("Hellos on %s every %lld ms, hold time %lld ms", interfaces[i].name.c_str(),
+                     (long long)liveness[i].interval_ms, (long long)liveness[i].hold_ms());
+        }
+        build_hello_message(hello_messages.emplace_back(), interfaces[i], node_id_hex, liveness[i]);
+        build_hello_message(probe_messages.emplace_back(), interfaces[i], node_id_hex, liveness[i], "PROBE");
+        hello_sequence.push_back((uint32_t)random.next());
+        echoes.emplace_back();
+        segments.emplace_back();
+        auto aggregation = config.interface_aggregation.find(interfaces[i].name);
+        if (aggregation != config.interface_aggregation.end()) {
+            segments[i].aggregated = true;
+            segments[i].digest_interval_ms = aggregation->second.digest_interval_ms;
+            LOG_INFO("Designated reporter mode on %s, digests every %lld ms", interfaces[i].name.c_str(),
+                     (long long)segments[i].digest_interval_ms);
+        }
+        next_broadcast_ms.push_back(now + hello_gap(i));
+        next_hello_ms = std::min(next_hello_ms, next_broadcast_ms[i]);
+    }
+    if (transport.open(interfaces, discovery_port) < 0) {
+        LOG_ERROR("Failed to bind to any interfaces.");
+    }
+    if (!relay.upstreams.empty() && !interfaces.empty()) {
+        // An upstream on a local subnet is reached out of that interface,
+        // anything else out of the first one and the routing table
+        for (in_addr_t upstream : relay.upstreams) {
+            uint16_t interface_id = 0;
+            for (size_t i = 0; i < interfaces.size(); ++i) {
+                if (interfaces[i].contains(upstream)) {
+                    interface_id = (uint16_t)i;
+                    break;
+                }
+            }
+            upstream_interfaces.push_back(interface_id);
+            LOG_INFO("Relaying neighbours to %s via %s", helper::ip_to_string(upstream).c_str(),
+                     interfaces[interface_id].name.c_str());
+        }
+        relayed_sequence = neighbors.sequence() - 1; // first snapshot goes out even if empty
+        next_relay_ms = now + relay.interval_ms;
+        next_hello_ms = std::min(next_hello_ms, next_relay_ms);
+    }
+    if (relay.accept) {
+        LOG_INFO("Accepting relayed neighbours, cache limited to %zu entries", relay.cache_size);
+    }
+    if (gossip.enabled) {
+        LOG_INFO("Gossiping topology every %lld ms to %zu neighbours", (long long)gossip.interval_ms, gossip.fanout);
+        next_gossip_ms = now + gossip.interval_ms;
+        next_hello_ms = std::min(next_hello_ms, next_gossip_ms);
+    }
+    if (!config.journal.directory.empty()) {
+        if (journal.open(config.journal) < 0) {
+            LOG_ERROR("Failed to open the neighbour journal in %s", config.journal.directory.c_str());
+        } else {
+            LOG_INFO("Journaling neighbour events to %s/%s.*.journal, %zu events kept", config.journal.directory.c_str(),
+                     config.journal.name.c_str(), journal.size());
+        }
+    }
+    if (!config.record_trace_path.empty()) {
+        if (recorder.open(config.record_trace_path, node_id_hex, interfaces) < 0) {
+            LOG_ERROR("Failed to open hello trace %s: %s", config.record_trace_path.c_str(), strerror(errno));
+        } else {
+            LOG_INFO("Recording received hellos to %s", config.record_trace_path.c_str());
+        }
     }
-    return nullptr;
 }
 
-void NeighbourDiscovery::add_or_update_neighbor(const NodeIDHex& id, const NetworkInterface& interface, const NetworkConnection& connection) {
-    NetworkNeighbor* neighbor = get_neighbor(id);
-    if (neighbor) {
-        neighbor->update_last_seen();
-        neighbor->add_interface(interface);
-        neighbor->add_connection(connection);
+template <typename Policy>
+BasicNeighbourDiscovery<Policy>::~BasicNeighbourDiscovery() {
+    recorder.flush();
+}
+
+template <typename Policy>
+void BasicNeighbourDiscovery<Policy>::on_datagram(std::string_view data, in_addr_t sender_ip, const std::string* device,
+                                                  int64_t rx_us) {
+    TRACE_SPAN("discovery_packet");
+    ScopedTimer timer(*metrics.packet_time);
+    recorder.record(clock.now_ms(), sender_ip, device, data);
+    process_datagram(data, sender_ip, device, rx_us);
+}
+
+template <typename Policy>
+void BasicNeighbourDiscovery<Policy>::on_receive_error(int error) {
+    metrics.recv_errors->inc();
+    LOG_ERROR_RATE_LIMITED("recvmsg failed: %s", strerror(error));
+}
+
+template <typename Policy>
+void BasicNeighbourDiscovery<Policy>::process_datagram(std::string_view data, in_addr_t sender_ip,
+                                                       const std::string* device, int64_t rx_us) {
+    if (!admission.admit_source(sender_ip, clock.now_ms())) {
+        return;
+    }
+    // Relays are not expected to share a subnet with us
+    if (DiscoveryDigest::is_relay(data)) {
+        handle_relay(data, sender_ip);
+        return;
+    }
+
+    int receiving_interface = -1;
+
+    for (size_t i = 0; i < interfaces.size(); ++i) {
+        if (device && interfaces[i].name != *device) {
+            continue;
+        }
+        if (interfaces[i].contains(sender_ip)) {
+            receiving_interface = (int)i;
+            break;
+        }
+    }
+
+    if (receiving_interface < 0) {
+        metrics.unmatched_drops->inc();
+        if (logger::enabled(LogLevel::Warn)) {
+            char ip[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &sender_ip, ip, sizeof(ip));
+            LOG_WARN_RATE_LIMITED("No matching interface found for sender IP: %s", ip);
+        }
+        return;
+    }
+
+    metrics.interfaces[receiving_interface].rx_packets->inc();
+    metrics.interfaces[receiving_interface].rx_bytes->inc(data.size());
+    if (DiscoveryDigest::is_digest(data)) {
+        handle_digest(data, sender_ip, (uint16_t)receiving_interface);
+    } else if (GossipMessage::is_gossip(data)) {
+        handle_gossip(data, sender_ip, (uint16_t)receiving_interface);
     } else {
-        NetworkNeighbor new_neighbor;
-        new_neighbor.update_last_seen();
-        new_neighbor.add_interface(interface);
-        new_neighbor.add_connection(connection);
-        neighbors[id] = new_neighbor;
+        listen_for_hello(data, sender_ip, (uint16_t)receiving_interface, rx_us);
+    }
+}
+
+template <typename Policy>
+void BasicNeighbourDiscovery<Policy>::attach(EventLoop& loop) {
+    transport.attach(loop, *this);
+}
+
+// BFD-style jitter: the next hello goes out after 75-100% of the interval
+template <typename Policy>
+int64_t BasicNeighbourDiscovery<Policy>::hello_gap(size_t interface_id) {
+    int64_t interval = liveness[interface_id].interval_ms;
+    return interval - (int64_t)random.below(interval / 4 + 1);
+}
+
+template <typename Policy>
+void BasicNeighbourDiscovery<Policy>::update()
+{
+    int64_t now = clock.now_ms();
+    if (now >= next_hello_ms) {
+        TRACE_SPAN("broadcast_hello");
+        ScopedTimer timer(*metrics.broadcast_time);
+        next_hello_ms = INT64_MAX;
+        for (size_t i = 0; i < interfaces.size(); ++i) {
+            if (now >= next_broadcast_ms[i]) {
+                PendingEcho echo;
+                bool has_echo = echoes[i].pop(echo);
+                send_periodic_hello(i, has_echo ? &echo : nullptr);
+                next_broadcast_ms[i] = now + hello_gap(i);
+            }
+            if (now >= segments[i].next_digest_ms) {
+                send_digest(i);
+                segments[i].next_digest_ms = now + segments[i].digest_interval_ms;
+            }
+            next_hello_ms = std::min({next_hello_ms, next_broadcast_ms[i], segments[i].next_digest_ms});
+        }
+        if (now >= next_relay_ms) {
+            if (relay_next_part == relay_parts.size()) {
+                take_relay_snapshot(now);
+            }
+            send_relay_parts(now);
+        }
+        if (now >= next_gossip_ms) {
+            gossip_round(now);
+        }
+        if (now >= next_kernel_check_ms) {
+            check_kernel_links(now);
+        }
+        next_hello_ms = std::min({next_hello_ms, next_relay_ms, next_gossip_ms, next_kernel_check_ms});
+    }
+
+    cleanup_inactive_neighbors();
+    relay_cache.expire(now);
+    recorder.flush();
+}
+
+template <typename Policy>
+void BasicNeighbourDiscovery<Policy>::cleanup_inactive_neighbors() {
+    int64_t now = clock.now_ms();
+    // Only walk the table once the earliest deadline has passed
+    if (now >= next_expiry_ms) {
+        TRACE_SPAN("cleanup_inactive_neighbors");
+        ScopedTimer timer(*metrics.cleanup_time);
+        next_expiry_ms = INT64_MAX;
+        size_t expired = neighbors.erase_if(
+            [this, now](NeighbourSlot& slot, NetworkNeighbor& neighbor) {
+                if (slot.is_active(now) && expire_links(slot, neighbor, now)) {
+                    neighbors.mark_changed(slot.id);
+                }
+                if (!slot.is_active(now)) {
+                    // Peers that advertise an interval understand probes; give
+                    // them one more interval to answer before removing them
+                    if (slot.probes != 0 || neighbor.interval_ms == 0 || !probe(neighbor)) {
+                        return true;
+                    }
+                    slot.probes = 1;
+                    slot.deadline = now + std::min<int64_t>(neighbor.interval_ms, MAX_PROBE_WAIT_MS);
+                }
+                next_expiry_ms = std::min(next_expiry_ms, slot.deadline);
+                if (slot.probes == 0 && neighbor.connections.size() > 1) {
+                    for (const NetworkConnection& connection : neighbor.connections) {
+                        next_expiry_ms = std::min(next_expiry_ms, connection.link.deadline_ms());
+                    }
+                }
+                return false;
+            },
+            [this](const NeighbourSlot& slot, const NetworkNeighbor& neighbor) {
+                neighbour_event(JournalEvent::Removed, slot.id,
+                                neighbor.connections.size() ? &neighbor.connections[0] : nullptr);
+                if (logger::enabled(LogLevel::Info)) {
+                    char id_hex[33];
+                    node_id_to_hex(slot.id, id_hex);
+                    LOG_INFO("Removing inactive neighbor: %s", id_hex);
+                }
+            });
+        metrics.neighbours_expired->inc(expired);
+    }
+
+    const NeighbourTableStats& stats = neighbors.stats();
+    if (stats.evictions != reported_evictions) {
+        LOG_WARN("Neighbour table full (%zu entries): evicted %llu neighbours, %llu unconfirmed",
+                 neighbors.max_size(), (unsigned long long)(stats.evictions - reported_evictions),
+                 (unsigned long long)stats.unconfirmed_evictions);
+        reported_evictions = stats.evictions;
+    }
+
+    const AdmissionStats& admission_stats = admission.stats();
+    if (admission_stats.dropped() != reported_drops) {
+        LOG_WARN("Admission control dropped %llu packets (source %llu, node %llu, global %llu)",
+                 (unsigned long long)(admission_stats.dropped() - reported_drops),
+                 (unsigned long long)admission_stats.dropped_source,
+                 (unsigned long long)admission_stats.dropped_node,
+                 (unsigned long long)admission_stats.dropped_global);
+        reported_drops = admission_stats.dropped();
+    }
+}
+
+void build_hello_message(std::string& out, const NetworkInterface& interface, const char* node_id_hex,
+                         const LivenessConfig& liveness, const char* magic) {
+    char buffer[MAX_MESSAGE_SIZE];
+    int written = snprintf(buffer, sizeof(buffer), "%s from %s NodeID:%s MAC:%s IP:%s INT:%lld HOLD:%lld", magic,
+                           interface.name.c_str(), node_id_hex, interface.mac_address.c_str(),
+                           interface.ip_address.c_str(), (long long)liveness.interval_ms,
+                           (long long)liveness.hold_ms());
+    out.assign(buffer, std::clamp(written, 0, (int)sizeof(buffer) - 1));
+}
+
+void EchoQueue::push(const PendingEcho& echo) {
+    for (size_t i = 0; i < count; ++i) {
+        PendingEcho& pending = entries[(head + i) % ECHO_QUEUE_SIZE];
+        if (pending.id == echo.id) {
+            pending = echo;
+            return;
+        }
+    }
+    if (count < ECHO_QUEUE_SIZE) {
+        entries[(head + count++) % ECHO_QUEUE_SIZE] = echo;
     }
 }
 
-NeighbourDiscovery::NeighbourDiscovery(const std::vector<NetworkInterface>& interfaces, int discovery_port, NodeID node_id, bool quiet_mode)
-    : node_id(node_id), discovery_port(discovery_port), interfaces(interfaces), quiet_mode(quiet_mode) {
-    if (bind_all_interfaces() < 0) {
-        helper::log_error("Failed to bind to any interfaces.", quiet_mode);
+bool EchoQueue::pop(PendingEcho& echo) {
+    if (count == 0) {
+        return false;
     }
+    echo = entries[head];
+    head = (head + 1) % ECHO_QUEUE_SIZE;
+    --count;
+    return true;
 }
 
-NeighbourDiscovery::~NeighbourDiscovery() {
-    cleanup_bound_sockets();
+// Appends the per-message fields to the fixed part of a hello or probe:
+// our send time, the broadcast sequence number and one echoed timestamp
+template <typename Policy>
+std::string_view BasicNeighbourDiscovery<Policy>::format_message(char* buffer, const std::string& fixed,
+                                                                 const uint32_t* sequence, const PendingEcho* echo) {
+    int64_t now_us = clock.now_us();
+    int length = snprintf(buffer, MAX_MESSAGE_SIZE, "%s TS:%lld", fixed.c_str(), (long long)now_us);
+    if (sequence && length > 0 && (size_t)length < MAX_MESSAGE_SIZE) {
+        length += snprintf(buffer + length, MAX_MESSAGE_SIZE - length, " SEQ:%u", *sequence);
+    }
+    if (echo && length > 0 && (size_t)length < MAX_MESSAGE_SIZE) {
+        char echo_hex[33];
+        node_id_to_hex(echo->id, echo_hex);
+        length += snprintf(buffer + length, MAX_MESSAGE_SIZE - length, " ECHO:%s:%lld:%lld", echo_hex,
+                           (long long)echo->timestamp_us, (long long)(now_us - echo->arrival_us));
+    }
+    if (length < 0 || (size_t)length + 1 >= MAX_MESSAGE_SIZE) {
+        return {};
+    }
+    buffer[length++] = '\n';
+    return std::string_view(buffer, length);
 }
 
-void NeighbourDiscovery::handle_discovery_packet(int socket_fd) {
-    char buffer[1024];
-    sockaddr_in sender_addr{};
-    socklen_t addr_len = sizeof(sender_addr);
+// Periodic hellos carry a sequence number; probe answers do not, so they
+// never count as lost or duplicate hellos
+template <typename Policy>
+bool BasicNeighbourDiscovery<Policy>::send_hello(size_t interface_id, in_addr_t destination, const uint32_t* sequence,
+                                                 const PendingEcho* echo) {
+    if (!transport.is_open()) {
+        LOG_ERROR_RATE_LIMITED("Socket is not valid.");
+        return false;
+    }
+
+    const NetworkInterface& interface = interfaces[interface_id];
+    char buffer[MAX_MESSAGE_SIZE];
+    std::string_view message = format_message(buffer, hello_messages[interface_id], sequence, echo);
+    if (message.empty()) {
+        LOG_ERROR_RATE_LIMITED("Hello for %s does not fit in %zu bytes", interface.name.c_str(), MAX_MESSAGE_SIZE);
+        return false;
+    }
+    ssize_t sent = transport.send((uint16_t)interface_id, destination, message);
+    if (sent < 0) {
+        metrics.interfaces[interface_id].tx_errors->inc();
+        LOG_WARN_RATE_LIMITED("Failed to send hello on %s: %s", interface.name.c_str(), strerror(errno));
+        return false;
+    }
+    metrics.interfaces[interface_id].tx_packets->inc();
+    metrics.interfaces[interface_id].tx_bytes->inc(sent);
+    LOG_DEBUG("Sent hello on interface: %s (%s:%d)", interface.name.c_str(), interface.ip_address.c_str(),
+              discovery_port);
+    return true;
+}
 
-    ssize_t bytes_read = recvfrom(socket_fd, buffer, sizeof(buffer) - 1, 0,
-                                   (struct sockaddr*)&sender_addr, &addr_len);
-    if (bytes_read < 0) {
-        helper::log_error("recvmsg failed", quiet_mode);
+template <typename Policy>
+void BasicNeighbourDiscovery<Policy>::broadcast_hello() {
+    if (!transport.is_open()) {
+        LOG_ERROR("Socket is not valid.");
         return;
     }
+    TRACE_SPAN("broadcast_hello");
+    ScopedTimer timer(*metrics.broadcast_time);
+
+    for (size_t i = 0; i < interfaces.size(); ++i) {
+        send_hello(i, interfaces[i].ipv4_broadcast, &hello_sequence[i], nullptr);
+        ++hello_sequence[i];
+    }
+}
 
-    buffer[bytes_read] = '\0';
-    IP_Address sender_ip = inet_ntoa(sender_addr.sin_addr);
+// Broadcasts, unless the interface is aggregated and we are neither reporter
+// nor backup: then the hello goes unicast to both, with one sequence number
+template <typename Policy>
+void BasicNeighbourDiscovery<Policy>::send_periodic_hello(size_t interface_id, const PendingEcho* echo) {
+    const SegmentState& segment = segments[interface_id];
+    if (segment.aggregated) {
+        elect_reporter(interface_id);
+    }
+    const uint32_t* sequence = &hello_sequence[interface_id];
+    if (!segment.aggregated || segment.role != SegmentRole::Member) {
+        send_hello(interface_id, interfaces[interface_id].ipv4_broadcast, sequence, echo);
+    } else {
+        send_hello(interface_id, segment.reporter_ip, sequence, echo);
+        if (segment.backup_ip) {
+            send_hello(interface_id, segment.backup_ip, sequence, echo);
+        }
+    }
+    ++hello_sequence[interface_id];
+}
 
-    const NetworkInterface* receiving_interface = nullptr;
+static const char* segment_role_name(SegmentRole role) {
+    switch (role) {
+    case SegmentRole::Reporter: return "reporter";
+    case SegmentRole::Backup: return "backup";
+    case SegmentRole::Member: return "member";
+    }
+    return "unknown";
+}
 
-    for (const auto& interface : interfaces) {
-        if (helper::is_ip_in_network(sender_ip, interface.network_cidr)) {
-            receiving_interface = &interface;
+// The reporter and backup are the two lowest NodeIDs among us and every
+// live neighbour on the interface, whether heard directly or from a digest.
+// Everyone on the segment sees the same members, so they agree.
+template <typename Policy>
+void BasicNeighbourDiscovery<Policy>::elect_reporter(size_t interface_id) {
+    int64_t now = clock.now_ms();
+    NodeID lowest[2];
+    in_addr_t lowest_ip[2] = {0, 0};
+    size_t found = 0;
+    neighbors.for_each([&](const NeighbourSlot& slot, const NetworkNeighbor& neighbor) {
+        if (!slot.is_active(now) || (found == 2 && slot.id >= lowest[1])) {
+            return;
+        }
+        for (const NetworkConnection& connection : neighbor.connections) {
+            if (connection.interface_id != interface_id) {
+                continue;
+            }
+            if (found == 0 || slot.id < lowest[0]) {
+                lowest[1] = lowest[0];
+                lowest_ip[1] = lowest_ip[0];
+                lowest[0] = slot.id;
+                lowest_ip[0] = connection.ip;
+            } else {
+                lowest[1] = slot.id;
+                lowest_ip[1] = connection.ip;
+            }
+            found = std::min<size_t>(found + 1, 2);
             break;
         }
+    });
+
+    SegmentState& segment = segments[interface_id];
+    SegmentRole role = SegmentRole::Member;
+    if (found == 0 || node_id < lowest[0]) {
+        role = SegmentRole::Reporter;
+    } else if (found == 1 || node_id < lowest[1]) {
+        role = SegmentRole::Backup;
+    }
+    NodeID reporter = role == SegmentRole::Reporter ? node_id : lowest[0];
+    segment.reporter_ip = role == SegmentRole::Reporter ? 0 : lowest_ip[0];
+    segment.backup_ip = role == SegmentRole::Member && found == 2 ? lowest_ip[1] : 0;
+
+    if (role == segment.role && reporter == segment.reporter) {
+        return;
+    }
+    if (role == SegmentRole::Reporter) {
+        segment.next_digest_ms = now; // announce the members right away
+    } else {
+        segment.next_digest_ms = INT64_MAX;
+    }
+    segment.role = role;
+    segment.reporter = reporter;
+    if (logger::enabled(LogLevel::Info)) {
+        char id_hex[33];
+        node_id_to_hex(reporter, id_hex);
+        LOG_INFO("Designated reporter on %s is %s, this node is %s", interfaces[interface_id].name.c_str(), id_hex,
+                 segment_role_name(role));
     }
+}
 
-    if (!receiving_interface) {
-        helper::log_error("No matching interface found for sender IP: " + sender_ip, quiet_mode);
+// Lists every member heard directly on the interface, split over as many
+// datagrams as it takes
+template <typename Policy>
+void BasicNeighbourDiscovery<Policy>::send_digest(size_t interface_id) {
+    const NetworkInterface& interface = interfaces[interface_id];
+    int64_t now = clock.now_ms();
+    char buffer[MAX_DIGEST_SIZE];
+    int header = snprintf(buffer, sizeof(buffer), "DIGEST from %s NodeID:%s INT:%lld\n", interface.name.c_str(),
+                          node_id_hex, (long long)segments[interface_id].digest_interval_ms);
+    if (header < 0 || (size_t)header >= sizeof(buffer)) {
         return;
     }
+    size_t length = header;
+
+    auto flush = [&]() {
+        if (length == (size_t)header) {
+            return;
+        }
+        ssize_t sent = transport.send((uint16_t)interface_id, interface.ipv4_broadcast,
+                                      std::string_view(buffer, length));
+        if (sent < 0) {
+            metrics.interfaces[interface_id].tx_errors->inc();
+            LOG_WARN_RATE_LIMITED("Failed to send digest on %s: %s", interface.name.c_str(), strerror(errno));
+        } else {
+            metrics.digests_sent->inc();
+            metrics.interfaces[interface_id].tx_bytes->inc(sent);
+        }
+        length = header;
+    };
 
-    std::string packet_data(buffer);
-    listen_for_hello(packet_data, sender_ip, *receiving_interface);
+    neighbors.for_each([&](const NeighbourSlot& slot, const NetworkNeighbor& neighbor) {
+        for (const NetworkConnection& connection : neighbor.connections) {
+            const LinkStats& link = connection.link;
+            if (connection.interface_id != interface_id || link.via_digest || now >= link.deadline_ms()) {
+                continue;
+            }
+            char id_hex[33];
+            char mac[18];
+            char ip[INET_ADDRSTRLEN];
+            node_id_to_hex(slot.id, id_hex);
+            ether_ntoa_r((const struct ether_addr*)connection.mac_address.data(), mac);
+            inet_ntop(AF_INET, &connection.ip, ip, sizeof(ip));
+            char line[128];
+            int size = snprintf(line, sizeof(line), "%s %s %s %lld %u\n", id_hex, mac, ip,
+                                (long long)(now - link.last_seen_ms), link.hold_ms);
+            if (size < 0 || (size_t)size >= sizeof(line)) {
+                continue;
+            }
+            if (length + size > sizeof(buffer)) {
+                flush();
+            }
+            memcpy(buffer + length, line, size);
+            length += size;
+        }
+    });
+    flush();
 }
 
-void NeighbourDiscovery::handle_activity(const fd_set& read_fds) {
-    if (FD_ISSET(socket_fd, &read_fds)) {
-        handle_discovery_packet(socket_fd);
+template <typename Policy>
+void BasicNeighbourDiscovery<Policy>::handle_digest(std::string_view data, in_addr_t sender_ip, uint16_t interface_id) {
+    DiscoveryDigest digest;
+    if (!DiscoveryDigest::from_string(data, digest)) {
+        metrics.parse_failures->inc();
+        LOG_WARN_RATE_LIMITED("Invalid digest received.");
+        return;
+    }
+    int64_t now = clock.now_ms();
+    if (digest.reporter_id == node_id || !admission.admit_node(digest.reporter_id, now)) {
+        return;
+    }
+    metrics.digests_received->inc();
+    if (neighbor_exists(digest.reporter_id)) {
+        admission.mark_trusted(sender_ip, now);
+    }
+
+    // Members stay listed until the reporter's own hold time for them runs
+    // out, plus a couple of digests in case one is lost
+    int64_t slack = DIGEST_SLACK_INTERVALS * std::clamp<int64_t>(digest.interval_ms, MIN_INTERVAL_MS, MAX_HOLD_MS);
+    DigestEntry entry;
+    while (digest.next(entry)) {
+        if (entry.id == node_id) {
+            continue;
+        }
+        int64_t hold_ms = std::clamp<int64_t>(entry.hold_ms, MIN_HOLD_MS, MAX_HOLD_MS) + slack;
+        int64_t last_seen_ms = now - std::min<int64_t>(entry.age_ms, hold_ms);
+        learn_member(entry, interface_id, last_seen_ms, hold_ms);
+    }
+    if (!digest.entries.empty()) {
+        metrics.parse_failures->inc();
+        LOG_WARN_RATE_LIMITED("Malformed digest entry from %s", helper::ip_to_string(sender_ip).c_str());
     }
 }
 
-void NeighbourDiscovery::update()
-{
-    static auto last_broadcast = std::chrono::steady_clock::now();
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::uniform_int_distribution<> jitter_dist(0, 1000); // jitter between 0 and 1000 ms
+// Adds or refreshes a member from a digest. A connection we hear hellos on
+// ourselves is only taken over once the reporter has heard the member a
+// whole interval later than we did, i.e. it stopped broadcasting to us.
+template <typename Policy>
+void BasicNeighbourDiscovery<Policy>::learn_member(const DigestEntry& entry, uint16_t interface_id,
+                                                   int64_t last_seen_ms, int64_t hold_ms) {
+    if (!admission.admit_node(entry.id, clock.now_ms())) {
+        return;
+    }
+    int64_t now = clock.now_ms();
+    int64_t deadline = last_seen_ms + hold_ms;
+    if (deadline <= now) {
+        return;
+    }
+
+    NetworkConnection connection{};
+    connection.ip = entry.ip;
+    connection.mac_address = entry.mac;
+    connection.interface_id = interface_id;
+
+    bool inserted = false;
+    bool changed = false;
+    uint64_t evictions = neighbors.stats().evictions;
+    NetworkNeighbor& neighbor = neighbors.refresh(entry.id, deadline, inserted);
+    if (neighbors.stats().evictions != evictions) {
+        neighbour_event(JournalEvent::Evicted, neighbors.last_evicted(), nullptr);
+    }
+    next_expiry_ms = std::min(next_expiry_ms, deadline);
+    size_t links = neighbor.connections.size();
+    NetworkConnection* stored = neighbors.add_connection(neighbor, connection, changed);
+    if (changed && !inserted) {
+        neighbors.mark_changed(entry.id);
+    }
+    if (inserted || changed) {
+        neighbour_event(inserted ? JournalEvent::Added
+                                 : neighbor.connections.size() > links ? JournalEvent::LinkUp : JournalEvent::LinkMoved,
+                        entry.id, &connection);
+    }
+    if (stored) {
+        LinkStats& link = stored->link;
+        if (!changed && !link.via_digest && last_seen_ms <= link.last_seen_ms + (int64_t)neighbor.interval_ms) {
+            return;
+        }
+        if (last_seen_ms > link.last_seen_ms) {
+            link.last_seen_ms = last_seen_ms;
+            link.hold_ms = (uint32_t)hold_ms;
+            link.via_digest = true;
+        }
+    }
 
-    auto now = std::chrono::steady_clock::now();
+    // Learned members are not probed; the reporter already watches them
+    bool heard_directly = false;
+    for (const NetworkConnection& conn : neighbor.connections) {
+        heard_directly |= !conn.link.via_digest;
+    }
+    if (!heard_directly) {
+        neighbor.interval_ms = 0;
+    }
 
-    auto broadcast_interval = std::chrono::seconds(5) + std::chrono::milliseconds(jitter_dist(gen));
+    if (inserted) {
+        metrics.neighbours_added->inc();
+        if (logger::enabled(LogLevel::Info)) {
+            char id_hex[33];
+            node_id_to_hex(entry.id, id_hex);
+            LOG_INFO("New neighbor learned from digest: %s (IP: %s, interface: %s)", id_hex,
+                     helper::ip_to_string(entry.ip).c_str(), interfaces[interface_id].name.c_str());
+        }
+    }
+}
 
-    if (now - last_broadcast > broadcast_interval) {
-        broadcast_hello();
-        last_broadcast = now;
+// Splits the table into relay parts, one line per neighbour from its most
+// recently heard connection. Unchanged tables are only sent again once the
+// refresh is due, so the upstream's entries do not run out.
+template <typename Policy>
+void BasicNeighbourDiscovery<Policy>::take_relay_snapshot(int64_t now) {
+    relay_parts.clear();
+    relay_next_part = 0;
+    if (neighbors.sequence() == relayed_sequence && now < last_snapshot_ms + relay.refresh_ms) {
+        return;
     }
+    ++relay_snapshot;
+    relayed_sequence = neighbors.sequence();
+    last_snapshot_ms = now;
 
-    cleanup_inactive_neighbors();
+    const size_t room = MAX_DIGEST_SIZE - 160; // leaves room for the header
+    relay_parts.emplace_back(); // an empty table still needs one part
+    neighbors.for_each([&](const NeighbourSlot& slot, const NetworkNeighbor& neighbor) {
+        const NetworkConnection* latest = nullptr;
+        for (const NetworkConnection& connection : neighbor.connections) {
+            if (!latest || connection.link.last_seen_ms > latest->link.last_seen_ms) {
+                latest = &connection;
+            }
+        }
+        if (!latest) {
+            return;
+        }
+        char id_hex[33];
+        char mac[18];
+        char ip[INET_ADDRSTRLEN];
+        node_id_to_hex(slot.id, id_hex);
+        ether_ntoa_r((const struct ether_addr*)latest->mac_address.data(), mac);
+        inet_ntop(AF_INET, &latest->ip, ip, sizeof(ip));
+        char line[128];
+        int size = snprintf(line, sizeof(line), "%s %s %s %lld %u\n", id_hex, mac, ip,
+                            (long long)(now - latest->link.last_seen_ms), latest->link.hold_ms);
+        if (size < 0 || (size_t)size >= sizeof(line)) {
+            return;
+        }
+        if (relay_parts.back().size() + size > room) {
+            relay_parts.emplace_back();
+        }
+        relay_parts.back().append(line, size);
+    });
 }
 
-void NeighbourDiscovery::cleanup_inactive_neighbors() {
-    for (auto it = neighbors.begin(); it != neighbors.end();) {
-        if (!it->second.is_active()) {
-            helper::log_info("Removing inactive neighbor: " + it->first, quiet_mode);
-            it = neighbors.erase(it);
-        } else {
-            ++it;
+// Sends the next few parts of the current snapshot to every upstream
+template <typename Policy>
+void BasicNeighbourDiscovery<Policy>::send_relay_parts(int64_t now) {
+    uint32_t ttl_ms = (uint32_t)std::clamp<int64_t>(relay.refresh_ms * RELAY_TTL_REFRESHES, MIN_HOLD_MS, MAX_HOLD_MS);
+    size_t end = std::min(relay_parts.size(), relay_next_part + RELAY_PARTS_PER_TICK);
+    for (; relay_next_part < end; ++relay_next_part) {
+        const std::string& body = relay_parts[relay_next_part];
+        for (size_t u = 0; u < relay.upstreams.size(); ++u) {
+            uint16_t interface_id = upstream_interfaces[u];
+            char buffer[MAX_DIGEST_SIZE];
+            int header = snprintf(buffer, sizeof(buffer), "RELAY from %s NodeID:%s SNAP:%u PART:%zu PARTS:%zu TTL:%u\n",
+                                  interfaces[interface_id].name.c_str(), node_id_hex, relay_snapshot,
+                                  relay_next_part, relay_parts.size(), ttl_ms);
+            if (header < 0 || (size_t)header + body.size() > sizeof(buffer)) {
+                continue;
+            }
+            memcpy(buffer + header, body.data(), body.size());
+            ssize_t sent = transport.send(interface_id, relay.upstreams[u],
+                                          std::string_view(buffer, header + body.size()));
+            if (sent < 0) {
+                metrics.interfaces[interface_id].tx_errors->inc();
+                LOG_WARN_RATE_LIMITED("Failed to relay neighbours to %s: %s",
+                                      helper::ip_to_string(relay.upstreams[u]).c_str(), strerror(errno));
+            } else {
+                metrics.relay_parts_sent->inc();
+                metrics.interfaces[interface_id].tx_bytes->inc(sent);
+            }
+        }
+    }
+    next_relay_ms = now + (relay_next_part < relay_parts.size() ? RELAY_PACING_MS : relay.interval_ms);
+}
+
+template <typename Policy>
+void BasicNeighbourDiscovery<Policy>::handle_relay(std::string_view data, in_addr_t sender_ip) {
+    if (!relay.accept) {
+        metrics.unmatched_drops->inc();
+        LOG_WARN_RATE_LIMITED("Relayed neighbours from %s ignored, start with --accept-relays to cache them",
+                              helper::ip_to_string(sender_ip).c_str());
+        return;
+    }
+    DiscoveryDigest part;
+    if (!DiscoveryDigest::from_string(data, part)) {
+        metrics.parse_failures->inc();
+        LOG_WARN_RATE_LIMITED("Invalid relay snapshot received.");
+        return;
+    }
+    int64_t now = clock.now_ms();
+    if (part.reporter_id == node_id || !admission.admit_node(part.reporter_id, now)) {
+        return;
+    }
+    metrics.relay_parts_received->inc();
+    part.ttl_ms = (uint32_t)std::clamp<int64_t>(part.ttl_ms, MIN_HOLD_MS, MAX_HOLD_MS);
+    if (!relay_cache.add_part(part, sender_ip, now)) {
+        metrics.parse_failures->inc();
+        LOG_WARN_RATE_LIMITED("Malformed relay entry from %s", helper::ip_to_string(sender_ip).c_str());
+    }
+}
+
+// Folds our directly heard neighbours into the topology as our own links
+// and starts a comparison with a few of them at the root of the tree
+template <typename Policy>
+void BasicNeighbourDiscovery<Policy>::gossip_round(int64_t now) {
+    struct Peer {
+        in_addr_t ip;
+        uint16_t interface_id;
+    };
+    std::vector<NodeID> heard;
+    std::vector<Peer> peers;
+    neighbors.for_each([&](const NeighbourSlot& slot, const NetworkNeighbor& neighbor) {
+        if (!slot.is_active(now)) {
+            return;
+        }
+        for (const NetworkConnection& connection : neighbor.connections) {
+            if (!connection.link.via_digest && now < connection.link.deadline_ms()) {
+                heard.push_back(slot.id);
+                peers.push_back(Peer{connection.ip, connection.interface_id});
+                break;
+            }
+        }
+    });
+    topology.set_own(heard, now);
+    topology.expire(now, GOSSIP_ORPHAN_INTERVALS * gossip.interval_ms, GOSSIP_TOMBSTONE_INTERVALS * gossip.interval_ms);
+    metrics.topology_nodes->set(topology.nodes());
+    metrics.topology_links->set(topology.alive());
+
+    for (size_t i = 0; i < gossip.fanout && i < peers.size(); ++i) {
+        std::swap(peers[i], peers[i + random.below(peers.size() - i)]);
+        send_tree(peers[i].interface_id, peers[i].ip, std::string_view());
+    }
+    next_gossip_ms = now + gossip.interval_ms;
+}
+
+template <typename Policy>
+bool BasicNeighbourDiscovery<Policy>::send_gossip(uint16_t interface_id, in_addr_t destination,
+                                                  std::string_view message) {
+    ssize_t sent = transport.send(interface_id, destination, message);
+    if (sent < 0) {
+        metrics.interfaces[interface_id].tx_errors->inc();
+        LOG_WARN_RATE_LIMITED("Failed to send gossip to %s: %s", helper::ip_to_string(destination).c_str(),
+                              strerror(errno));
+        return false;
+    }
+    metrics.gossip_sent->inc();
+    metrics.interfaces[interface_id].tx_bytes->inc(sent);
+    return true;
+}
+
+// Hashes and counts of the 16 subtrees under prefix
+template <typename Policy>
+bool BasicNeighbourDiscovery<Policy>::send_tree(uint16_t interface_id, in_addr_t destination, std::string_view prefix) {
+    char buffer[MAX_DIGEST_SIZE];
+    int length = snprintf(buffer, sizeof(buffer), "GOSSIP TREE from %s NodeID:%s PREFIX:%.*s\n",
+                          interfaces[interface_id].name.c_str(), node_id_hex, prefix.empty() ? 1 : (int)prefix.size(),
+                          prefix.empty() ? "-" : prefix.data());
+    TopologySummary children[16];
+    topology.children(prefix, children);
+    for (const TopologySummary& child : children) {
+        if (length < 0 || (size_t)length >= sizeof(buffer)) {
+            return false;
+        }
+        length += snprintf(buffer + length, sizeof(buffer) - length, "%016llx %u\n",
+                           (unsigned long long)child.hash, child.count);
+    }
+    if (length < 0 || (size_t)length >= sizeof(buffer)) {
+        return false;
+    }
+    return send_gossip(interface_id, destination, std::string_view(buffer, length));
+}
+
+// Lists the hash of every link under each prefix, with as many whole
+// prefixes per datagram as fit. Returns the datagrams sent.
+template <typename Policy>
+size_t BasicNeighbourDiscovery<Policy>::send_hashes(uint16_t interface_id, in_addr_t destination,
+                                                    const std::vector<std::string>& prefixes, bool ask, size_t limit) {
+    const size_t header_room = 100; // header without the prefixes, for any interface name
+    const size_t line_size = 17;
+    std::string group;
+    std::string body;
+    size_t sent = 0;
+
+    auto flush = [&]() {
+        char buffer[MAX_DIGEST_SIZE];
+        int header = snprintf(buffer, sizeof(buffer), "GOSSIP HASHES from %s NodeID:%s PREFIX:%s ASK:%d\n",
+                              interfaces[interface_id].name.c_str(), node_id_hex, group.c_str(), ask ? 1 : 0);
+        if (header > 0 && (size_t)header < sizeof(buffer)) {
+            size_t length = std::min(body.size(), sizeof(buffer) - header);
+            length -= length % line_size; // an oversized subtree is cut short
+            memcpy(buffer + header, body.data(), length);
+            sent += send_gossip(interface_id, destination, std::string_view(buffer, header + length));
+        }
+        group.clear();
+        body.clear();
+    };
+
+    for (const std::string& prefix : prefixes) {
+        std::string hashes;
+        topology.for_each(prefix, [&](const LinkKey& key, const LinkState& state) {
+            char line[line_size + 1];
+            snprintf(line, sizeof(line), "%016llx\n", (unsigned long long)Topology::hash(key, state));
+            hashes.append(line, line_size);
+        });
+        if (!group.empty() &&
+            header_room + group.size() + prefix.size() + 1 + body.size() + hashes.size() > MAX_DIGEST_SIZE) {
+            flush();
+            if (sent >= limit) {
+                return sent;
+            }
+        }
+        group += group.empty() ? "" : ",";
+        group += prefix.empty() ? "-" : prefix;
+        body += hashes;
+    }
+    if (!group.empty()) {
+        flush();
+    }
+    return sent;
+}
+
+// Sends links in as many datagrams as they take, up to limit. The list
+// starts at a random link, so whatever a capped answer leaves out gets its
+// turn in a later exchange. Returns the datagrams sent.
+template <typename Policy>
+size_t BasicNeighbourDiscovery<Policy>::send_links(uint16_t interface_id, in_addr_t destination,
+                                                   const std::vector<std::pair<LinkKey, LinkState>>& links,
+                                                   size_t limit) {
+    char buffer[MAX_DIGEST_SIZE];
+    int header = snprintf(buffer, sizeof(buffer), "GOSSIP LINKS from %s NodeID:%s\n",
+                          interfaces[interface_id].name.c_str(), node_id_hex);
+    if (header < 0 || (size_t)header >= sizeof(buffer)) {
+        return 0;
+    }
+    size_t length = header;
+    size_t sent = 0;
+    size_t first = random.below(links.size());
+    for (size_t i = 0; i < links.size() && sent < limit; ++i) {
+        const auto& [key, state] = links[(first + i) % links.size()];
+        char line[96];
+        node_id_to_hex(link_origin(key), line);
+        node_id_to_hex(link_neighbour(key), line + 32);
+        int size = 64 + snprintf(line + 64, sizeof(line) - 64, " %u %d\n", state.version, state.alive ? 1 : 0);
+        if (length + size > sizeof(buffer)) {
+            sent += send_gossip(interface_id, destination, std::string_view(buffer, length));
+            length = header;
+            if (sent >= limit) {
+                break;
+            }
         }
+        memcpy(buffer + length, line, size);
+        length += size;
+    }
+    if (sent < limit && length > (size_t)header) {
+        sent += send_gossip(interface_id, destination, std::string_view(buffer, length));
     }
+    return sent;
 }
 
-void NeighbourDiscovery::broadcast_hello() {
-    if (socket_fd < 0) {
-        helper::log_error("Socket is not valid.", quiet_mode);
+// A tree is answered for every subtree that differs from ours: large ones
+// with the next level of hashes, small ones with the hashes of our links.
+// A hash list is answered with the links the peer lacks, and, if it asks,
+// with our own list when we lack some of its links.
+template <typename Policy>
+void BasicNeighbourDiscovery<Policy>::handle_gossip(std::string_view data, in_addr_t sender_ip, uint16_t interface_id) {
+    if (!gossip.enabled) {
+        return;
+    }
+    GossipMessage message;
+    if (!GossipMessage::from_string(data, message)) {
+        metrics.parse_failures->inc();
+        LOG_WARN_RATE_LIMITED("Invalid gossip received.");
+        return;
+    }
+    std::vector<std::string> prefixes;
+    for (std::string_view list = message.prefix; message.kind != GossipKind::Links;) {
+        size_t comma = list.find(',');
+        std::string_view prefix = list.substr(0, comma);
+        uint64_t value;
+        if (!parse_link_prefix(prefix, value) || (message.kind == GossipKind::Tree && comma != std::string_view::npos)) {
+            metrics.parse_failures->inc();
+            LOG_WARN_RATE_LIMITED("Invalid gossip prefix from %s", helper::ip_to_string(sender_ip).c_str());
+            return;
+        }
+        prefixes.emplace_back(prefix);
+        if (comma == std::string_view::npos) {
+            break;
+        }
+        list = list.substr(comma + 1);
+    }
+    int64_t now = clock.now_ms();
+    if (message.sender_id == node_id || !admission.admit_node(message.sender_id, now)) {
+        return;
+    }
+    metrics.gossip_received->inc();
+    if (neighbor_exists(message.sender_id)) {
+        admission.mark_trusted(sender_ip, now);
+    }
+
+    std::vector<std::pair<LinkKey, LinkState>> links; // to send the peer
+    if (message.kind == GossipKind::Tree) {
+        const std::string& prefix = prefixes[0];
+        TopologySummary ours[16];
+        TopologySummary theirs[16];
+        topology.children(prefix, ours);
+        size_t differing[16];
+        size_t count = 0;
+        for (size_t i = 0; i < 16; ++i) {
+            if (!message.next_summary(theirs[i].hash, theirs[i].count)) {
+                metrics.parse_failures->inc();
+                LOG_WARN_RATE_LIMITED("Malformed gossip tree from %s", helper::ip_to_string(sender_ip).c_str());
+                return;
+            }
+            if (theirs[i].hash != ours[i].hash || theirs[i].count != ours[i].count) {
+                differing[count++] = i;
+            }
+        }
+        std::vector<std::string> compare;
+        size_t replies = 0;
+        size_t first = random.below(count);
+        for (size_t i = 0; i < count && replies < GOSSIP_MAX_REPLIES; ++i) {
+            size_t child = differing[(first + i) % count];
+            std::string child_prefix = prefix + "0123456789abcdef"[child];
+            if (theirs[child].count == 0) {
+                // Nothing to compare against, the peer just needs ours
+                topology.for_each(child_prefix, [&](const LinkKey& key, const LinkState& state) {
+                    links.emplace_back(key, state);
+                });
+            } else if (ours[child].count > GOSSIP_LEAF_LINKS && child_prefix.size() < TOPOLOGY_TREE_DEPTH) {
+                replies += send_tree(interface_id, sender_ip, child_prefix);
+            } else {
+                compare.push_back(child_prefix);
+            }
+        }
+        if (replies < GOSSIP_MAX_REPLIES) {
+            replies += send_hashes(interface_id, sender_ip, compare, true, GOSSIP_MAX_REPLIES - replies);
+        }
+        if (replies < GOSSIP_MAX_REPLIES) {
+            send_links(interface_id, sender_ip, links, GOSSIP_MAX_REPLIES - replies);
+        }
+        return;
+    }
+
+    if (message.kind == GossipKind::Hashes) {
+        std::vector<uint64_t> theirs;
+        uint64_t hash;
+        while (!message.entries.empty()) {
+            if (!message.next_hash(hash)) {
+                metrics.parse_failures->inc();
+                LOG_WARN_RATE_LIMITED("Malformed gossip hash from %s", helper::ip_to_string(sender_ip).c_str());
+                return;
+            }
+            theirs.push_back(hash);
+        }
+        std::sort(theirs.begin(), theirs.end());
+        size_t matched = 0;
+        for (const std::string& prefix : prefixes) {
+            topology.for_each(prefix, [&](const LinkKey& key, const LinkState& state) {
+                if (std::binary_search(theirs.begin(), theirs.end(), Topology::hash(key, state))) {
+                    ++matched;
+                } else {
+                    links.emplace_back(key, state);
+                }
+            });
+        }
+        size_t replies = 0;
+        if (message.ask && matched < theirs.size()) {
+            replies += send_hashes(interface_id, sender_ip, prefixes, false, GOSSIP_MAX_REPLIES);
+        }
+        if (replies < GOSSIP_MAX_REPLIES) {
+            send_links(interface_id, sender_ip, links, GOSSIP_MAX_REPLIES - replies);
+        }
         return;
     }
-    
-    for (auto& interface : interfaces) {
-        NodeIDHex owner_id = node_id_to_hex(node_id);
-        NetworkConnection connection;
-        connection.ip = interface.ip_address;
-        connection.mac_address = interface.mac_address;
-        std::string hello_message = "HELLO from " + interface.name +
-                                    " NodeID:" + owner_id +
-                                    " MAC:" + connection.mac_address +
-                                    " IP:" + connection.ip + "\n";
-        sockaddr_in broadcast_addr{};
-        broadcast_addr.sin_family = AF_INET;
-        broadcast_addr.sin_port = htons(discovery_port);
-        broadcast_addr.sin_addr.s_addr = interface.broadcast_address.empty() ? INADDR_BROADCAST : inet_addr(interface.broadcast_address.c_str());
 
-        sendto(socket_fd, hello_message.c_str(), hello_message.size(), 0,
-            (struct sockaddr*)&broadcast_addr, sizeof(struct sockaddr_in));
-        helper::log_info("Broadcasted hello on interface: " + interface.name
-                  + " (" + interface.ip_address + ":" + std::to_string(discovery_port) + ")", quiet_mode);
+    NodeID origin;
+    NodeID neighbour;
+    uint32_t version;
+    bool alive;
+    while (!message.entries.empty()) {
+        if (!message.next_link(origin, neighbour, version, alive)) {
+            metrics.parse_failures->inc();
+            LOG_WARN_RATE_LIMITED("Malformed gossip link from %s", helper::ip_to_string(sender_ip).c_str());
+            break;
+        }
+        topology.merge(make_link_key(origin, neighbour), version, alive, now);
+    }
+}
+
+// Asks a quiet neighbour for a unicast hello on every link it was seen on
+template <typename Policy>
+bool BasicNeighbourDiscovery<Policy>::probe(const NetworkNeighbor& neighbor) {
+    bool sent_any = false;
+    char buffer[MAX_MESSAGE_SIZE];
+    for (const NetworkConnection& connection : neighbor.connections) {
+        std::string_view message = format_message(buffer, probe_messages[connection.interface_id], nullptr, nullptr);
+        if (transport.send(connection.interface_id, connection.ip, message) >= 0) {
+            metrics.probes_sent->inc();
+            sent_any = true;
+        }
     }
+    return sent_any;
 }
 
-void NeighbourDiscovery::listen_for_hello(std::string& hello_message, IP_Address sender_ip, const NetworkInterface& interface) {
-    DiscoveryPackage pkg = DiscoveryPackage::from_string(hello_message);
-    if (pkg.sender_id.empty() || pkg.sender_ip.empty() || pkg.sender_mac.empty()) {
-        helper::log_error("Invalid hello message received.", quiet_mode);
+template <typename Policy>
+void BasicNeighbourDiscovery<Policy>::listen_for_hello(std::string_view hello_message, in_addr_t sender_ip,
+                                                       uint16_t interface_id, int64_t rx_us) {
+    DiscoveryPackage pkg;
+    if (!DiscoveryPackage::from_string(hello_message, pkg)) {
+        metrics.parse_failures->inc();
+        LOG_WARN_RATE_LIMITED("Invalid hello message received.");
         return;
     }
-    NodeIDHex sender_id = pkg.sender_id;
-    NodeIDHex owner_id = node_id_to_hex(node_id);
 
-    if (sender_id == owner_id) {
+    if (pkg.sender_id == node_id) {
         return;
     }
 
-    auto it = neighbors.find(sender_id);
-    if (it == neighbors.end()) {
-        NetworkNeighbor new_neighbor;
-        new_neighbor.update_last_seen();
-        new_neighbor.add_interface(interface);
-        NetworkConnection connection = {sender_ip, pkg.sender_mac};
-        new_neighbor.add_connection(connection);
-        std::cout << "New neighbor discovered: " << sender_id << std::endl;
-        std::cout << "Sender IP: " << pkg.sender_ip << ", MAC: " << pkg.sender_mac << std::endl;
-        std::cout << "Interface: " << interface.name << std::endl;
-        std::cout << "Network CIDR: " << interface.network_cidr << std::endl;
-        neighbors[sender_id] = new_neighbor;
-    } else {
-        NetworkNeighbor& neighbor = it->second;
-        neighbor.update_last_seen();
-        NetworkConnection connection = {sender_ip, pkg.sender_mac};
-        neighbor.add_interface(interface);
-        neighbor.add_connection(connection);
+    if (!admission.admit_node(pkg.sender_id, clock.now_ms())) {
+        return;
+    }
+
+    NetworkConnection connection;
+    connection.ip = sender_ip;
+    connection.mac_address = pkg.sender_mac;
+    connection.interface_id = interface_id;
+
+    // Like BFD, the slower side of the link sets the detection time. Peers
+    // that do not advertise a hold time get the classic timeout.
+    int64_t peer_hold = pkg.hold_ms ? std::clamp<int64_t>(pkg.hold_ms, MIN_HOLD_MS, MAX_HOLD_MS)
+                                    : NEIGHBOUR_TIMEOUT_SECONDS * 1000;
+    int64_t hold_ms = std::max(liveness[interface_id].hold_ms(), peer_hold);
+
+    int64_t arrival_us = rx_us ? rx_us : clock.now_us();
+    bool is_new = !neighbor_exists(pkg.sender_id);
+    NetworkConnection* stored = add_or_update_neighbor(pkg.sender_id, connection, hold_ms, pkg.interval_ms);
+    if (stored) {
+        update_link(*stored, pkg, hold_ms, arrival_us);
+    }
+
+    if (pkg.timestamp_us >= 0) {
+        // A probe is answered at once with its own timestamp echoed; other
+        // timestamps ride along on our next broadcasts, one per hello
+        PendingEcho echo{pkg.sender_id, pkg.timestamp_us, arrival_us};
+        if (pkg.probe) {
+            if (send_hello(interface_id, sender_ip, nullptr, &echo)) {
+                metrics.probes_answered->inc();
+            }
+        } else {
+            echoes[interface_id].push(echo);
+        }
+    } else if (pkg.probe && send_hello(interface_id, sender_ip, nullptr, nullptr)) {
+        metrics.probes_answered->inc();
+    }
+    if (!is_new) {
+        admission.mark_trusted(sender_ip, clock.now_ms());
+        return;
+    }
+
+    metrics.neighbours_added->inc();
+    SegmentState& segment = segments[interface_id];
+    if (segment.aggregated && segment.role == SegmentRole::Reporter) {
+        // Members heard the newcomer's first broadcast; list it before that
+        // times out rather than waiting for the regular digest
+        segment.next_digest_ms = std::min(segment.next_digest_ms, clock.now_ms() + liveness[interface_id].interval_ms);
+        next_hello_ms = std::min(next_hello_ms, segment.next_digest_ms);
+    }
+    if (logger::enabled(LogLevel::Info)) {
+        const NetworkInterface& interface = interfaces[interface_id];
+        char id_hex[33];
+        char ip[INET_ADDRSTRLEN];
+        char mac[18];
+        node_id_to_hex(pkg.sender_id, id_hex);
+        inet_ntop(AF_INET, &pkg.sender_ip, ip, sizeof(ip));
+        ether_ntoa_r((const struct ether_addr*)pkg.sender_mac.data(), mac);
+        LOG_INFO("New neighbor discovered: %s (IP: %s, MAC: %s, interface: %s, network: %s)",
+                 id_hex, ip, mac, interface.name.c_str(), interface.network_cidr.c_str());
     }
 }
 
-const std::unordered_map<NodeIDHex, NetworkNeighbor>& NeighbourDiscovery::get_neighbours() const {
+template <typename Policy>
+const NeighbourTable& BasicNeighbourDiscovery<Policy>::get_neighbours() const {
     return neighbors;
 }
 
+template class BasicNeighbourDiscovery<SystemDiscoveryPolicy>;
+template class BasicNeighbourDiscovery<DynamicDiscoveryPolicy>;
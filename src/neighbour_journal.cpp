@@ -0,0 +1,253 @@
+#include "neighbour_journal.h"
+#include "common/helper.h"
+#include "common/logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char JOURNAL_MAGIC[8] = {'G', 'R', 'A', 'W', 'J', 'N', 'L', '1'};
+static const char* JOURNAL_SUFFIX = ".journal";
+static const size_t JOURNAL_BLOOM_BITS = JOURNAL_BLOOM_BYTES * 8;
+
+const char* journal_event_name(JournalEvent event) {
+    switch (event) {
+        case JournalEvent::Added: return "added";
+        case JournalEvent::Removed: return "removed";
+        case JournalEvent::Evicted: return "evicted";
+        case JournalEvent::LinkUp: return "link up";
+        case JournalEvent::LinkDown: return "link down";
+        case JournalEvent::LinkMoved: return "link moved";
+    }
+    return "unknown";
+}
+
+// Two independent hashes of a NodeID for double hashing into the bloom
+// filter. NodeIDs are chosen by peers, so mix both halves.
+static void bloom_hashes(const NodeID& id, uint64_t& h1, uint64_t& h2) {
+    uint64_t lo, hi;
+    memcpy(&lo, id.data(), sizeof(lo));
+    memcpy(&hi, id.data() + sizeof(lo), sizeof(hi));
+    h1 = (lo ^ (hi >> 29)) * 0x9E3779B97F4A7C15ULL;
+    h1 ^= h1 >> 32;
+    h2 = (hi ^ (lo >> 31)) * 0xBF58476D1CE4E5B9ULL;
+    h2 = (h2 ^ (h2 >> 29)) | 1;
+}
+
+// Maps a hash onto the filter with a multiply rather than a division
+static size_t bloom_bit(uint64_t hash) {
+    return (size_t)(((hash >> 32) * JOURNAL_BLOOM_BITS) >> 32);
+}
+
+NeighbourJournal::~NeighbourJournal() {
+    close();
+}
+
+void NeighbourJournal::close() {
+    for (Segment& segment : segments) {
+        munmap(segment.header, segment.bytes);
+    }
+    segments.clear();
+}
+
+std::string NeighbourJournal::segment_path(uint64_t number) const {
+    char file[64];
+    snprintf(file, sizeof(file), ".%08llu%s", (unsigned long long)number, JOURNAL_SUFFIX);
+    return config.directory + "/" + config.name + file;
+}
+
+const JournalRecord* NeighbourJournal::records(const JournalHeader* header) {
+    return reinterpret_cast<const JournalRecord*>(reinterpret_cast<const char*>(header) + header->header_size);
+}
+
+bool NeighbourJournal::may_contain(const JournalHeader* header, const NodeID& id) {
+    uint64_t h1, h2;
+    bloom_hashes(id, h1, h2);
+    for (uint32_t i = 0; i < JOURNAL_BLOOM_HASHES; ++i) {
+        size_t bit = bloom_bit(h1 + i * h2);
+        if (!(header->bloom[bit / 8] & (1 << (bit % 8)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Index of the first record at or after since_ms; times never decrease
+// within a segment
+size_t NeighbourJournal::first_at(const JournalHeader* header, int64_t since_ms) {
+    const JournalRecord* begin = records(header);
+    return std::partition_point(begin, begin + header->count,
+                                [since_ms](const JournalRecord& record) { return record.time_ms < since_ms; }) -
+           begin;
+}
+
+// Maps an existing segment; -1 if the file is not a whole segment
+int NeighbourJournal::load_segment(uint64_t number) {
+    std::string path = segment_path(number);
+    int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(JournalHeader)) {
+        ::close(fd);
+        return -1;
+    }
+    void* map = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    JournalHeader* header = static_cast<JournalHeader*>(map);
+    if (memcmp(header->magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 ||
+        header->record_size != sizeof(JournalRecord) || header->header_size != sizeof(JournalHeader) ||
+        header->count > header->capacity ||
+        header->header_size + header->capacity * header->record_size != (uint64_t)st.st_size) {
+        munmap(map, st.st_size);
+        return -1;
+    }
+    segments.push_back(Segment{number, header, (size_t)st.st_size});
+    return 0;
+}
+
+// Starts the next segment, with its blocks allocated up front so a full
+// disk fails here rather than on a write through the mapping
+int NeighbourJournal::create_segment() {
+    uint64_t capacity = (config.segment_bytes - sizeof(JournalHeader)) / sizeof(JournalRecord);
+    size_t bytes = sizeof(JournalHeader) + capacity * sizeof(JournalRecord);
+    std::string path = segment_path(next_number);
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LOG_ERROR("Failed to create journal segment %s: %s", path.c_str(), strerror(errno));
+        return -1;
+    }
+    int error = posix_fallocate(fd, 0, bytes);
+    void* map = error ? MAP_FAILED : mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        LOG_ERROR("Failed to allocate journal segment %s: %s", path.c_str(), strerror(error ? error : errno));
+        ::close(fd);
+        unlink(path.c_str());
+        return -1;
+    }
+    ::close(fd);
+
+    JournalHeader* header = static_cast<JournalHeader*>(map);
+    memcpy(header->magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    header->record_size = sizeof(JournalRecord);
+    header->header_size = sizeof(JournalHeader);
+    header->capacity = capacity;
+    segments.push_back(Segment{next_number++, header, bytes});
+
+    while (segments.size() > config.segments) {
+        munmap(segments.front().header, segments.front().bytes);
+        unlink(segment_path(segments.front().number).c_str());
+        segments.erase(segments.begin());
+    }
+    return 0;
+}
+
+int NeighbourJournal::open(const JournalConfig& journal_config) {
+    close();
+    config = journal_config;
+    if (mkdir(config.directory.c_str(), 0755) < 0 && errno != EEXIST) {
+        LOG_ERROR("Failed to create journal directory %s: %s", config.directory.c_str(), strerror(errno));
+        return -1;
+    }
+    DIR* dir = opendir(config.directory.c_str());
+    if (!dir) {
+        LOG_ERROR("Failed to open journal directory %s: %s", config.directory.c_str(), strerror(errno));
+        return -1;
+    }
+
+    // name.N.journal, in the order they were written
+    std::vector<uint64_t> numbers;
+    std::string prefix = config.name + ".";
+    size_t suffix_length = strlen(JOURNAL_SUFFIX);
+    while (dirent* entry = readdir(dir)) {
+        std::string_view file = entry->d_name;
+        if (file.size() <= prefix.size() + suffix_length || file.compare(0, prefix.size(), prefix) != 0 ||
+            file.compare(file.size() - suffix_length, suffix_length, JOURNAL_SUFFIX) != 0) {
+            continue;
+        }
+        std::string_view digits = file.substr(prefix.size(), file.size() - prefix.size() - suffix_length);
+        if (digits.size() > 18 ||
+            !std::all_of(digits.begin(), digits.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            continue;
+        }
+        numbers.push_back(std::stoull(std::string(digits)));
+    }
+    closedir(dir);
+    std::sort(numbers.begin(), numbers.end());
+
+    for (uint64_t number : numbers) {
+        if (load_segment(number) < 0) {
+            LOG_WARN("Skipping damaged journal segment %s", segment_path(number).c_str());
+        }
+        next_number = number + 1;
+    }
+    if (segments.empty() || segments.back().header->count == segments.back().header->capacity ||
+        segments.size() > config.segments) {
+        if (create_segment() < 0) {
+            close();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void NeighbourJournal::append(JournalEvent event, const NodeID& id, in_addr_t ip, const MAC_Bytes& mac,
+                              const std::string& interface) {
+    if (segments.empty()) {
+        return;
+    }
+    int64_t now = helper::realtime_ms();
+    JournalHeader* header = segments.back().header;
+    if (header->count == header->capacity) {
+        // On a full disk, events are dropped until the next segment fits
+        if (now < retry_ms || create_segment() < 0) {
+            retry_ms = std::max(retry_ms, now + JOURNAL_RETRY_MS);
+            ++dropped_records;
+            return;
+        }
+        header = segments.back().header;
+    }
+
+    now = std::max(now, header->last_ms);
+    JournalRecord& record =
+        reinterpret_cast<JournalRecord*>(reinterpret_cast<char*>(header) + header->header_size)[header->count];
+    record.time_ms = now;
+    record.id = id;
+    record.ip = ip;
+    record.mac = mac;
+    record.event = event;
+    memset(record.reserved, 0, sizeof(record.reserved));
+    memset(record.interface, 0, sizeof(record.interface));
+    memcpy(record.interface, interface.data(), std::min(interface.size(), sizeof(record.interface)));
+
+    uint64_t h1, h2;
+    bloom_hashes(id, h1, h2);
+    for (uint32_t i = 0; i < JOURNAL_BLOOM_HASHES; ++i) {
+        size_t bit = bloom_bit(h1 + i * h2);
+        header->bloom[bit / 8] |= (uint8_t)(1 << (bit % 8));
+    }
+    if (header->count == 0) {
+        header->first_ms = now;
+    }
+    header->last_ms = now;
+    ++header->count;  // last, so a crash mid-append leaves the record out
+}
+
+size_t NeighbourJournal::size() const {
+    size_t total = 0;
+    for (const Segment& segment : segments) {
+        total += segment.header->count;
+    }
+    return total;
+}
@@ -0,0 +1,235 @@
+#include "neighbour_table.h"
+
+#include <algorithm>
+
+NeighbourTable::NeighbourTable(size_t initial_capacity, uint64_t seed)
+    : seed(seed)
+{
+    size_t capacity = 16;
+    while (capacity < initial_capacity && capacity < capacity_limit) {
+        capacity *= 2;
+    }
+    slots.assign(capacity, NeighbourSlot{});
+    records.resize(capacity);
+    max_capacity = capacity_limit;
+    max_entries = max_capacity / 4 * 3;
+}
+
+void NeighbourTable::set_limits(size_t entries, size_t memory_budget, EvictionPolicy policy) {
+    eviction_policy = policy;
+
+    // Largest power of two slot array that fits the budget, at 3/4 load
+    size_t capacity = 16;
+    while (capacity < capacity_limit && capacity <= memory_budget / (2 * bytes_per_slot)) {
+        capacity *= 2;
+    }
+    max_entries = std::max<size_t>(1, std::min(entries, capacity / 4 * 3));
+
+    max_capacity = 16;
+    while (max_capacity / 4 * 3 < max_entries) {
+        max_capacity *= 2;
+    }
+    connection_budget = memory_budget - std::min(memory_budget, max_capacity * bytes_per_slot);
+
+    while (count > max_entries) {
+        evict_one(0);
+    }
+    if (slots.size() > max_capacity) {
+        rehash(max_capacity);
+    }
+}
+
+size_t NeighbourTable::hash(const NodeID& id) const {
+    uint64_t lo, hi;
+    std::memcpy(&lo, id.data(), sizeof(lo));
+    std::memcpy(&hi, id.data() + sizeof(lo), sizeof(hi));
+
+    // NodeIDs are chosen by peers, so mix in a per-table seed
+    uint64_t h = (lo ^ seed) * 0x9E3779B97F4A7C15ULL;
+    h ^= hi + (h >> 29);
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 32;
+    return static_cast<size_t>(h);
+}
+
+size_t NeighbourTable::find_index(const NodeID& id) const {
+    size_t mask = slots.size() - 1;
+    for (size_t i = hash(id) & mask, probes = 0; probes < slots.size(); i = (i + 1) & mask, ++probes) {
+        const NeighbourSlot& slot = slots[i];
+        if (slot.state == SlotState::Empty) {
+            return npos;
+        }
+        if (slot.state == SlotState::Occupied && slot.id == id) {
+            return i;
+        }
+    }
+    return npos;
+}
+
+void NeighbourTable::rehash(size_t new_capacity) {
+    std::vector<NeighbourSlot> old_slots(new_capacity, NeighbourSlot{});
+    std::vector<NetworkNeighbor> old_records(new_capacity);
+    old_slots.swap(slots);
+    old_records.swap(records);
+    deleted = 0;
+
+    size_t mask = slots.size() - 1;
+    for (size_t j = 0; j < old_slots.size(); ++j) {
+        if (old_slots[j].state != SlotState::Occupied) {
+            continue;
+        }
+        size_t i = hash(old_slots[j].id) & mask;
+        while (slots[i].state == SlotState::Occupied) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = old_slots[j];
+        records[i] = std::move(old_records[j]);
+    }
+}
+
+NetworkNeighbor* NeighbourTable::find(const NodeID& id) {
+    size_t i = find_index(id);
+    return i == npos ? nullptr : &records[i];
+}
+
+const NetworkNeighbor* NeighbourTable::find(const NodeID& id) const {
+    size_t i = find_index(id);
+    return i == npos ? nullptr : &records[i];
+}
+
+const NeighbourSlot* NeighbourTable::find_slot(const NodeID& id) const {
+    size_t i = find_index(id);
+    return i == npos ? nullptr : &slots[i];
+}
+
+NetworkNeighbor& NeighbourTable::refresh(const NodeID& id, int64_t deadline, bool& inserted) {
+    size_t i = find_index(id);
+    if (i != npos) {
+        inserted = false;
+        slots[i].deadline = std::max(slots[i].deadline, deadline);
+        if (slots[i].probes) {
+            slots[i].probes = 0;
+            ++table_stats.probe_recoveries;
+        }
+        if (slots[i].hits < UINT8_MAX) {
+            ++slots[i].hits;
+        }
+        return records[i];
+    }
+
+    if (count >= max_entries) {
+        evict_one(hash(id) + table_stats.evictions * 0x9E3779B97F4A7C15ULL);
+    }
+
+    // Keep live entries under 3/4 load and clear tombstones before they
+    // push the probe chains past 7/8
+    if ((count + 1) * 4 > slots.size() * 3 && slots.size() < max_capacity) {
+        rehash(slots.size() * 2);
+    } else if ((count + deleted + 1) * 8 > slots.size() * 7) {
+        rehash(slots.size());
+    }
+
+    size_t mask = slots.size() - 1;
+    i = hash(id) & mask;
+    while (slots[i].state == SlotState::Occupied) {
+        i = (i + 1) & mask;
+    }
+    if (slots[i].state == SlotState::Deleted) {
+        --deleted;
+    }
+
+    slots[i].id = id;
+    slots[i].deadline = deadline;
+    slots[i].sequence = next_sequence++;
+    slots[i].hits = 1;
+    slots[i].probes = 0;
+    slots[i].state = SlotState::Occupied;
+    records[i].connections.clear();
+    records[i].interval_ms = 0;
+    ++count;
+    inserted = true;
+    return records[i];
+}
+
+void NeighbourTable::mark_changed(const NodeID& id) {
+    size_t i = find_index(id);
+    if (i != npos) {
+        slots[i].sequence = next_sequence++;
+    }
+}
+
+NetworkConnection* NeighbourTable::add_connection(NetworkNeighbor& record, const NetworkConnection& connection,
+                                                  bool& changed) {
+    size_t before = record.connections.heap_bytes();
+    size_t after = record.connections.heap_bytes_after_push();
+    if (after > before && connection_bytes - before + after > connection_budget &&
+        !record.find_connection(connection.mac_address)) {
+        changed = false;
+        ++table_stats.refused_links;
+        return nullptr;
+    }
+    NetworkConnection* stored = record.add_connection(connection, changed);
+    connection_bytes += record.connections.heap_bytes() - before;
+    return stored;
+}
+
+bool NeighbourTable::erase(const NodeID& id) {
+    size_t i = find_index(id);
+    if (i == npos) {
+        return false;
+    }
+    remove_at(i);
+    return true;
+}
+
+void NeighbourTable::remove_at(size_t i) {
+    ++next_sequence; // removals are changes too
+    slots[i].state = SlotState::Deleted;
+    connection_bytes -= records[i].connections.heap_bytes();
+    records[i].connections.release();
+    --count;
+    ++deleted;
+}
+
+bool NeighbourTable::is_better_victim(const NeighbourSlot& candidate, const NeighbourSlot& current) const {
+    if (eviction_policy == EvictionPolicy::PreferUnconfirmed) {
+        bool candidate_unconfirmed = candidate.hits <= 1;
+        bool current_unconfirmed = current.hits <= 1;
+        if (candidate_unconfirmed != current_unconfirmed) {
+            return candidate_unconfirmed;
+        }
+    }
+    return candidate.deadline < current.deadline;
+}
+
+void NeighbourTable::evict_one(size_t start) {
+    // Approximate LRU: pick the best victim from a small sample of occupied
+    // slots so eviction stays O(1) under junk traffic.
+    size_t mask = slots.size() - 1;
+    size_t victim = npos;
+    size_t sampled = 0;
+    for (size_t i = start & mask, probes = 0; probes < slots.size() && sampled < EVICTION_SAMPLE_SIZE;
+         i = (i + 1) & mask, ++probes) {
+        if (slots[i].state != SlotState::Occupied) {
+            continue;
+        }
+        ++sampled;
+        if (victim == npos || is_better_victim(slots[i], slots[victim])) {
+            victim = i;
+        }
+    }
+    if (victim == npos) {
+        return;
+    }
+
+    ++table_stats.evictions;
+    if (slots[victim].hits <= 1) {
+        ++table_stats.unconfirmed_evictions;
+    }
+    evicted = slots[victim].id;
+    remove_at(victim);
+}
+
+size_t NeighbourTable::memory_usage() const {
+    return slots.capacity() * sizeof(NeighbourSlot) + records.capacity() * sizeof(NetworkNeighbor) + connection_bytes;
+}
@@ -0,0 +1,45 @@
+#include "packet_filter.h"
+
+#include <netinet/udp.h>
+#include <sys/socket.h>
+
+static uint32_t prefix_word(const char* prefix) {
+    return ((uint32_t)(uint8_t)prefix[0] << 24) | ((uint32_t)(uint8_t)prefix[1] << 16)
+         | ((uint32_t)(uint8_t)prefix[2] << 8) | (uint32_t)(uint8_t)prefix[3];
+}
+
+static uint16_t prefix_half(const char* prefix) {
+    return (uint16_t)(((uint8_t)prefix[4] << 8) | (uint8_t)prefix[5]);
+}
+
+std::vector<sock_filter> build_discovery_filter() {
+    const size_t magic_count = sizeof(DISCOVERY_PACKET_MAGICS) / sizeof(DISCOVERY_PACKET_MAGICS[0]);
+    const size_t payload = sizeof(struct udphdr);
+    const size_t drop = 2 + 4 * magic_count;
+    const size_t accept = drop + 1;
+
+    std::vector<sock_filter> program;
+    program.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0));
+    program.push_back(BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, payload + MIN_DISCOVERY_PACKET_LENGTH, 0, (uint8_t)(drop - 2)));
+
+    // Each magic: compare the first four bytes, then the next two
+    for (const PacketMagic& magic : DISCOVERY_PACKET_MAGICS) {
+        size_t block = program.size();
+        program.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, payload));
+        program.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, prefix_word(magic.prefix), 0, 2));
+        program.push_back(BPF_STMT(BPF_LD | BPF_H | BPF_ABS, payload + 4));
+        program.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, prefix_half(magic.prefix), (uint8_t)(accept - (block + 4)), 0));
+    }
+
+    program.push_back(BPF_STMT(BPF_RET | BPF_K, 0));
+    program.push_back(BPF_STMT(BPF_RET | BPF_K, 0xFFFFFFFF));
+    return program;
+}
+
+int attach_discovery_filter(int socket_fd) {
+    std::vector<sock_filter> program = build_discovery_filter();
+    struct sock_fprog fprog;
+    fprog.len = (unsigned short)program.size();
+    fprog.filter = program.data();
+    return setsockopt(socket_fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog));
+}
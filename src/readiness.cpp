@@ -0,0 +1,83 @@
+#include "readiness.h"
+#include "common/logger.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace readiness {
+
+// Writes the one line the pipe ever carries, then closes it so a reader
+// that missed the line still sees EOF
+static void write_pipe(const std::string& line) {
+    const char* value = getenv("GRAW_READY_FD");
+    if (!value) {
+        return;
+    }
+    char* end = nullptr;
+    long fd = strtol(value, &end, 10);
+    unsetenv("GRAW_READY_FD");
+    if (end == value || *end != '\0' || fd < 0) {
+        LOG_WARN("Ignoring GRAW_READY_FD=%s", value);
+        return;
+    }
+    size_t written = 0;
+    while (written < line.size()) {
+        ssize_t n = write((int)fd, line.data() + written, line.size() - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            LOG_WARN("Failed to report readiness on fd %ld: %s", fd, strerror(errno));
+            break;
+        }
+        written += n;
+    }
+    close((int)fd);
+}
+
+// sd_notify protocol: one datagram of newline separated assignments. A
+// leading '@' names an abstract socket.
+static void send_notify(const std::string& message) {
+    const char* path = getenv("NOTIFY_SOCKET");
+    if (!path || (path[0] != '/' && path[0] != '@')) {
+        return;
+    }
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    size_t length = strlen(path);
+    if (length >= sizeof(addr.sun_path)) {
+        LOG_WARN("NOTIFY_SOCKET path too long");
+        return;
+    }
+    memcpy(addr.sun_path, path, length);
+    if (path[0] == '@') {
+        addr.sun_path[0] = '\0';
+    }
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        LOG_WARN("Failed to create notify socket: %s", strerror(errno));
+        return;
+    }
+    socklen_t size = (socklen_t)(offsetof(sockaddr_un, sun_path) + length);
+    if (sendto(fd, message.data(), message.size(), MSG_NOSIGNAL, (sockaddr*)&addr, size) < 0) {
+        LOG_WARN("Failed to notify the service manager: %s", strerror(errno));
+    }
+    close(fd);
+}
+
+void notify_ready() {
+    write_pipe("READY=1\n");
+    send_notify("READY=1\nMAINPID=" + std::to_string(getpid()) + "\nSTATUS=Discovering neighbours\n");
+}
+
+void notify_failed(const std::string& reason) {
+    write_pipe("ERROR=" + reason + "\n");
+    send_notify("STATUS=" + reason + "\n");
+}
+
+} // namespace readiness
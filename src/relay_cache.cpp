@@ -0,0 +1,80 @@
+#include "relay_cache.h"
+
+#include <algorithm>
+
+bool RelayCache::add_part(DiscoveryDigest part, in_addr_t relay_ip, int64_t now_ms) {
+    Source& source = sources[part.reporter_id];
+    if (source.parts_seen == 0 || source.snapshot != part.snapshot) {
+        source.snapshot = part.snapshot;
+        source.parts_seen = 0;
+    }
+    source.ip = relay_ip;
+    ++source.parts_seen;
+
+    int64_t expires = now_ms + part.ttl_ms;
+    next_expiry_ms = std::min(next_expiry_ms, expires);
+    DigestEntry entry;
+    while (part.next(entry)) {
+        auto it = entries.find(entry.id);
+        if (it == entries.end()) {
+            if (entries.size() >= max_entries) {
+                ++dropped_entries;
+                continue;
+            }
+            it = entries.emplace(entry.id, RelayedNeighbour()).first;
+        } else if (it->second.relay != part.reporter_id &&
+                   now_ms - (int64_t)entry.age_ms < it->second.last_seen_ms) {
+            continue; // another relay heard it more recently
+        }
+
+        RelayedNeighbour& relayed = it->second;
+        relayed.relay = part.reporter_id;
+        relayed.relay_ip = relay_ip;
+        relayed.ip = entry.ip;
+        relayed.mac = entry.mac;
+        relayed.last_seen_ms = now_ms - entry.age_ms;
+        relayed.expires_ms = expires;
+        relayed.snapshot = part.snapshot;
+    }
+
+    if (source.parts_seen >= part.parts) {
+        sweep(part.reporter_id, part.snapshot);
+        source.parts_seen = 0;
+    }
+    return part.entries.empty();
+}
+
+// Removes what the relay listed before but left out of a complete snapshot
+void RelayCache::sweep(const NodeID& relay, uint32_t snapshot) {
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (it->second.relay == relay && it->second.snapshot != snapshot) {
+            it = entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void RelayCache::expire(int64_t now_ms) {
+    if (now_ms < next_expiry_ms) {
+        return;
+    }
+    next_expiry_ms = INT64_MAX;
+    for (auto& [id, source] : sources) {
+        source.listed = false;
+    }
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (it->second.expires_ms <= now_ms) {
+            it = entries.erase(it);
+        } else {
+            next_expiry_ms = std::min(next_expiry_ms, it->second.expires_ms);
+            sources[it->second.relay].listed = true;
+            ++it;
+        }
+    }
+
+    // Forget relays that no longer list anything
+    for (auto it = sources.begin(); it != sources.end();) {
+        it = it->second.listed ? std::next(it) : sources.erase(it);
+    }
+}
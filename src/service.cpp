@@ -1,81 +1,464 @@
 #include "service.h"
 
-Service::Service(const char* cli_socket_path, int discovery_port, bool quiet_mode)
-    : cli_socket_path(cli_socket_path), cli_socket_fd(-1), discovery_port(discovery_port), quiet_mode(quiet_mode)
+#include <strings.h>
+
+// One connection line with its link quality, e.g. " - 10.0.0.2 (52:54:0:12:34:56)
+// seen 1.2 s ago, rtt 0.4 ms, loss 0%, jitter 0.1 ms". "-" marks what has
+// not been measured yet.
+static void append_connection(std::string& out, const NetworkConnection& conn, int64_t now_ms) {
+    const LinkStats& link = conn.link;
+    char ip[INET_ADDRSTRLEN];
+    char mac[18];
+    char rtt[16] = "-";
+    char loss[16] = "-";
+    char jitter[16] = "-";
+    inet_ntop(AF_INET, &conn.ip, ip, sizeof(ip));
+    ether_ntoa_r((const struct ether_addr*)conn.mac_address.data(), mac);
+    if (link.rtt_us) {
+        snprintf(rtt, sizeof(rtt), "%.1f ms", link.rtt_us / 1000.0);
+    }
+    if (link.expected) {
+        snprintf(loss, sizeof(loss), "%.0f%%", link.loss() * 100);
+    }
+    if (link.has_transit) {
+        snprintf(jitter, sizeof(jitter), "%.1f ms", link.jitter_us / 1000.0);
+    }
+
+    char line[160];
+    int length = snprintf(line, sizeof(line), " - %s (%s) seen %.1f s ago, rtt %s, loss %s, jitter %s\n", ip, mac,
+                          (now_ms - link.last_seen_ms) / 1000.0, rtt, loss, jitter);
+    out.append(line, std::min<size_t>(length, sizeof(line) - 1));
+}
+
+std::string render_neighbour_list(const NeighbourTable& neighbors, const std::vector<NetworkInterface>& interfaces,
+                                  int64_t now_ms) {
+    std::string response = "Neighbors:\n";
+
+    if (neighbors.empty()) {
+        response = "No neighbors found.\n";
+    } else {
+        neighbors.for_each([&](const NeighbourSlot& slot, const NetworkNeighbor& neighbor) {
+            std::string connections = "Connections:\n";
+            std::string interface_list = "Interfaces:\n";
+            for (size_t i = 0; i < neighbor.connections.size(); ++i) {
+                const NetworkConnection& conn = neighbor.connections[i];
+                append_connection(connections, conn, now_ms);
+
+                // Several connections may share an interface name; list each name once
+                const std::string& iface_name = interfaces[conn.interface_id].name;
+                bool listed = false;
+                for (size_t j = 0; j < i; ++j) {
+                    if (interfaces[neighbor.connections[j].interface_id].name == iface_name) {
+                        listed = true;
+                        break;
+                    }
+                }
+                if (!listed) {
+                    interface_list += " - " + iface_name + "\n";
+                }
+            }
+            response += node_id_to_hex(slot.id) + " - " + connections + interface_list + "\n";
+        });
+    }
+    return response;
+}
+
+static void append_json_string(std::string& out, std::string_view text) {
+    out += '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char)c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+std::string render_neighbour_json(const NeighbourTable& neighbors, const std::vector<NetworkInterface>& interfaces,
+                                  int64_t now_ms) {
+    std::string response = "{\"neighbours\":[";
+    bool first = true;
+    neighbors.for_each([&](const NeighbourSlot& slot, const NetworkNeighbor& neighbor) {
+        char id_hex[33];
+        node_id_to_hex(slot.id, id_hex);
+        response += first ? "\n" : ",\n";
+        first = false;
+        response += "{\"id\":\"";
+        response += id_hex;
+        response += "\",\"connections\":[";
+        for (size_t i = 0; i < neighbor.connections.size(); ++i) {
+            const NetworkConnection& conn = neighbor.connections[i];
+            const LinkStats& link = conn.link;
+            char ip[INET_ADDRSTRLEN];
+            char mac[18];
+            char rtt[16] = "null";
+            char loss[16] = "null";
+            char jitter[16] = "null";
+            inet_ntop(AF_INET, &conn.ip, ip, sizeof(ip));
+            ether_ntoa_r((const struct ether_addr*)conn.mac_address.data(), mac);
+            if (link.rtt_us) {
+                snprintf(rtt, sizeof(rtt), "%u", link.rtt_us);
+            }
+            if (link.expected) {
+                snprintf(loss, sizeof(loss), "%.3f", link.loss());
+            }
+            if (link.has_transit) {
+                snprintf(jitter, sizeof(jitter), "%u", link.jitter_us);
+            }
+
+            response += i == 0 ? "{\"interface\":" : ",{\"interface\":";
+            append_json_string(response, interfaces[conn.interface_id].name);
+            char fields[192];
+            int length = snprintf(fields, sizeof(fields),
+                                  ",\"ip\":\"%s\",\"mac\":\"%s\",\"seen_ms_ago\":%lld,\"rtt_us\":%s,\"loss\":%s,\"jitter_us\":%s}",
+                                  ip, mac, (long long)(now_ms - link.last_seen_ms), rtt, loss, jitter);
+            response.append(fields, std::min<size_t>(length, sizeof(fields) - 1));
+        }
+        response += "]}";
+    });
+    response += "\n]}\n";
+    return response;
+}
+
+std::string render_relayed_list(const RelayCache& relayed, int64_t now_ms) {
+    if (relayed.size() == 0) {
+        return "No relayed neighbours.\n";
+    }
+    std::string response = "Relayed neighbours:\n";
+    relayed.for_each([&](const NodeID& id, const RelayedNeighbour& entry) {
+        char id_hex[33];
+        char relay_hex[33];
+        char ip[INET_ADDRSTRLEN];
+        char relay_ip[INET_ADDRSTRLEN];
+        char mac[18];
+        node_id_to_hex(id, id_hex);
+        node_id_to_hex(entry.relay, relay_hex);
+        inet_ntop(AF_INET, &entry.ip, ip, sizeof(ip));
+        inet_ntop(AF_INET, &entry.relay_ip, relay_ip, sizeof(relay_ip));
+        ether_ntoa_r((const struct ether_addr*)entry.mac.data(), mac);
+
+        char line[192];
+        int length = snprintf(line, sizeof(line), "%s - %s (%s) via %s (%s), seen %.1f s ago\n", id_hex, ip, mac,
+                              relay_hex, relay_ip, (now_ms - entry.last_seen_ms) / 1000.0);
+        response.append(line, std::min<size_t>(length, sizeof(line) - 1));
+    });
+    return response;
+}
+
+bool parse_history_query(std::string_view args, int64_t now_ms, NodeID& id, bool& every_node, int64_t& since_ms) {
+    size_t space = args.find(' ');
+    std::string_view node = args.substr(0, space);
+    every_node = node == "*";
+    if (!every_node && !node_id_from_hex(node, id)) {
+        return false;
+    }
+    since_ms = 0;
+    if (space == std::string_view::npos) {
+        return true;
+    }
+
+    std::string_view rest = args.substr(space + 1);
+    if (rest.size() <= 6 || strncasecmp(rest.data(), "SINCE ", 6) != 0) {
+        return false;
+    }
+    std::string text(rest.substr(6));
+    char* end = nullptr;
+    errno = 0;
+    long long value = strtoll(text.c_str(), &end, 10);
+    if (errno != 0 || end == text.c_str() || !isdigit((unsigned char)text[0])) {
+        return false;
+    }
+    if (*end == '\0') {
+        since_ms = value <= INT64_MAX / 1000 ? value * 1000 : INT64_MAX;
+        return true;
+    }
+    static const struct { char unit; int64_t ms; } units[] = {{'S', 1000}, {'M', 60000}, {'H', 3600000}, {'D', 86400000}};
+    for (const auto& unit : units) {
+        if (toupper((unsigned char)*end) == unit.unit && end[1] == '\0' && value <= now_ms / unit.ms) {
+            since_ms = now_ms - value * unit.ms;
+            return true;
+        }
+    }
+    return false;
+}
+
+// One line per event: UTC time, node, event, and the link it concerns
+std::string render_history(const NeighbourJournal& journal, const NodeID* id, int64_t since_ms) {
+    std::string response = "History:\n";
+    size_t events = 0;
+    journal.for_each(id, since_ms, [&](const JournalRecord& record) {
+        if (events++ == HISTORY_MAX_EVENTS) {
+            return false;
+        }
+        time_t seconds = record.time_ms / 1000;
+        struct tm utc;
+        gmtime_r(&seconds, &utc);
+        char stamp[32];
+        strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &utc);
+        char id_hex[33];
+        node_id_to_hex(record.id, id_hex);
+
+        char line[192];
+        int length = snprintf(line, sizeof(line), "%s.%03dZ %s %s", stamp, (int)(record.time_ms % 1000), id_hex,
+                              journal_event_name(record.event));
+        response.append(line, std::min<size_t>(length, sizeof(line) - 1));
+        if (record.ip) {
+            char ip[INET_ADDRSTRLEN];
+            char mac[18];
+            inet_ntop(AF_INET, &record.ip, ip, sizeof(ip));
+            ether_ntoa_r((const struct ether_addr*)record.mac.data(), mac);
+            length = snprintf(line, sizeof(line), " %s (%s) on %.*s", ip, mac,
+                              (int)strnlen(record.interface, sizeof(record.interface)), record.interface);
+            response.append(line, std::min<size_t>(length, sizeof(line) - 1));
+        }
+        response += '\n';
+        return true;
+    });
+    if (events == 0) {
+        return "No events in the journal.\n";
+    }
+    if (events > HISTORY_MAX_EVENTS) {
+        response += "Stopped after " + std::to_string(HISTORY_MAX_EVENTS) + " events, give a later SINCE time.\n";
+    }
+    return response;
+}
+
+std::string render_topology(const Topology& topology) {
+    char header[64];
+    snprintf(header, sizeof(header), "Topology: %zu nodes, %zu links\n", topology.nodes(), topology.alive());
+    std::string response = header;
+    topology.for_each_node([&](const NodeID& origin, const std::vector<NodeID>& neighbours) {
+        char id_hex[33];
+        node_id_to_hex(origin, id_hex);
+        response += id_hex;
+        response += " ->";
+        for (const NodeID& neighbour : neighbours) {
+            node_id_to_hex(neighbour, id_hex);
+            response += ' ';
+            response += id_hex;
+        }
+        response += '\n';
+    });
+    return response;
+}
+
+bool valid_domain_name(std::string_view name) {
+    if (name.empty() || name.size() > MAX_DOMAIN_NAME) {
+        return false;
+    }
+    for (char c : name) {
+        if (!isalnum((unsigned char)c) && c != '-' && c != '_') {
+            return false;
+        }
+    }
+    return true;
+}
+
+Service::Service(const char* cli_socket_path, int discovery_port, const DiscoveryConfig& discovery_config,
+                 const ServiceConfig& service_config)
+    : cli_socket_path(cli_socket_path), cli_socket_fd(-1), discovery_port(discovery_port),
+      discovery_config(discovery_config), service_config(service_config)
 {
-    node_id = generate_node_id();
+    register_metrics();
 }
 
 Service::~Service() {
+    while (!sessions.empty()) {
+        close_session(sessions.begin()->first);
+    }
     if (cli_socket_fd >= 0) {
         cleanup_cli_socket();
     }
 }
 
+// Logs why init failed and keeps the reason for the readiness report
+int Service::init_failed(const char* format, ...) {
+    char reason[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(reason, sizeof(reason), format, args);
+    va_end(args);
+    init_error = reason;
+    LOG_ERROR("%s", reason);
+    return -1;
+}
+
 int Service::init() {
     if (init_interfaces() < 0) {
-        helper::log_error("Failed to initialize network interfaces.", quiet_mode);
         return -1;
     }
     if (init_cli_socket() < 0) {
-        helper::log_error("Failed to initialize CLI socket.", quiet_mode);
         return -1;
     }
 
-    neighbour_discovery = std::make_unique<NeighbourDiscovery>(interfaces, discovery_port, node_id, quiet_mode);
-    if (!neighbour_discovery) {
-        helper::log_error("Failed to create NeighbourDiscovery instance.", quiet_mode);
-        return -1;
-    } else {
-        helper::log_info("NeighbourDiscovery initialized with discovery port: " + std::to_string(discovery_port), quiet_mode);
-        neighbour_discovery->broadcast_hello();
+    event_loop = make_event_loop(service_config.io_backend);
+    LOG_INFO("Using the %s I/O backend", io_backend_name(event_loop->backend()));
+    if (event_loop->watch_listener(cli_socket_fd, *this) < 0) {
+        return init_failed("Failed to watch CLI socket: %s", strerror(errno));
     }
+    init_neighbour_cache();
 
+    if (service_config.domains.empty()) {
+        return init_domain(DomainConfig{"", discovery_port, {}});
+    }
+    for (const DomainConfig& domain : service_config.domains) {
+        if (init_domain(domain) < 0) {
+            return -1;
+        }
+    }
     return 0;
 }
 
+// Passive interfaces only stretch their broadcasts while the kernel's
+// neighbour cache can be followed; otherwise they run as usual
+void Service::init_neighbour_cache() {
+    if (discovery_config.interface_passive.empty()) {
+        return;
+    }
+    int opened = neighbour_cache.open([this](const KernelNeighbour& entry) {
+        for (auto& domain : domains) {
+            domain->discovery->on_kernel_neighbour(entry);
+        }
+    });
+    if (opened < 0 || neighbour_cache.attach(*event_loop) < 0) {
+        LOG_WARN("Cannot follow the kernel neighbour cache, passive interfaces keep the regular hello interval");
+        discovery_config.interface_passive.clear();
+    }
+}
+
+int Service::init_domain(const DomainConfig& config) {
+    auto domain = std::make_unique<Domain>();
+    domain->name = config.name;
+    domain->port = config.port;
+    domain->node_id = generate_node_id(config.name);
+    for (const NetworkInterface& interface : interfaces) {
+        if (config.interfaces.empty() ||
+            std::find(config.interfaces.begin(), config.interfaces.end(), interface.name) != config.interfaces.end()) {
+            domain->interfaces.push_back(interface);
+        }
+    }
+    for (const std::string& name : config.interfaces) {
+        auto found = std::find_if(interfaces.begin(), interfaces.end(),
+                                  [&](const NetworkInterface& interface) { return interface.name == name; });
+        if (found == interfaces.end()) {
+            LOG_WARN("Domain %s: interface %s has no IPv4 address, skipping it", config.name.c_str(), name.c_str());
+        }
+    }
+    if (domain->interfaces.empty()) {
+        return init_failed("Domain %s has none of its interfaces", config.name.c_str());
+    }
+
+    // Only one domain can append to the hello trace
+    DiscoveryConfig domain_config = discovery_config;
+    if (!domains.empty()) {
+        domain_config.record_trace_path.clear();
+    }
+    if (!config.name.empty()) {
+        domain_config.journal.name = config.name;
+    }
+    metrics_registry.set_scope(config.name.empty() ? "" : "domain=\"" + config.name + "\"");
+    domain->discovery = std::make_unique<NeighbourDiscovery>(domain->interfaces, config.port, domain->node_id,
+                                                             metrics_registry, clock, random, domain->transport,
+                                                             domain_config);
+    metrics_registry.set_scope("");
+    if (!domain->transport.is_open()) {
+        return config.name.empty() ? init_failed("Failed to bind discovery port %d", config.port)
+                                   : init_failed("Failed to bind discovery port %d for domain %s", config.port,
+                                                 config.name.c_str());
+    }
+    if (config.name.empty()) {
+        LOG_INFO("NeighbourDiscovery initialized with discovery port: %d", config.port);
+    } else {
+        LOG_INFO("Domain %s: discovery on port %d over %zu interfaces, NodeID %s", config.name.c_str(), config.port,
+                 domain->interfaces.size(), node_id_to_hex(domain->node_id).c_str());
+    }
+    domain->discovery->attach(*event_loop);
+    domain->discovery->broadcast_hello();
+    domains.push_back(std::move(domain));
+    return 0;
+}
+
+
+void Service::register_metrics() {
+    metrics.wakeups_activity = &metrics_registry.counter("graw_loop_wakeups_total", "Event loop wakeups", "reason=\"activity\"");
+    metrics.wakeups_timeout = &metrics_registry.counter("graw_loop_wakeups_total", "Event loop wakeups", "reason=\"timeout\"");
+    metrics.loop_time = &metrics_registry.histogram("graw_loop_iteration_seconds", "Time spent handling one event loop wakeup");
+    metrics.stalls = &metrics_registry.counter("graw_loop_stalls_total", "Event loop iterations over the stall budget");
+    metrics.io_syscalls = &metrics_registry.counter("graw_io_syscalls_total", "System calls made by the I/O backend");
+    metrics.cli_ping = &metrics_registry.counter("graw_cli_requests_total", "CLI requests", "command=\"PING\"");
+    metrics.cli_list = &metrics_registry.counter("graw_cli_requests_total", "CLI requests", "command=\"LIST\"");
+    metrics.cli_stats = &metrics_registry.counter("graw_cli_requests_total", "CLI requests", "command=\"STATS\"");
+    metrics.cli_trace = &metrics_registry.counter("graw_cli_requests_total", "CLI requests", "command=\"TRACE\"");
+    metrics.cli_relayed = &metrics_registry.counter("graw_cli_requests_total", "CLI requests", "command=\"RELAYED\"");
+    metrics.cli_topology = &metrics_registry.counter("graw_cli_requests_total", "CLI requests", "command=\"TOPOLOGY\"");
+    metrics.cli_history = &metrics_registry.counter("graw_cli_requests_total", "CLI requests", "command=\"HISTORY\"");
+    metrics.cli_domains = &metrics_registry.counter("graw_cli_requests_total", "CLI requests", "command=\"DOMAINS\"");
+    metrics.cli_unknown = &metrics_registry.counter("graw_cli_requests_total", "CLI requests", "command=\"other\"");
+    metrics.cli_refused = &metrics_registry.counter("graw_cli_sessions_refused_total", "CLI connections refused over the session limit");
+    metrics.cli_sessions = &metrics_registry.gauge("graw_cli_sessions", "Open CLI connections");
+    metrics.cli_time = &metrics_registry.histogram("graw_cli_request_seconds", "Time to serve one CLI command");
+}
+
+void Service::update_metrics() {
+    for (auto& domain : domains) {
+        domain->discovery->update_metrics();
+    }
+    if (event_loop) {
+        metrics.io_syscalls->value = event_loop->syscalls();
+    }
+}
+
+std::string Service::render_metrics() {
+    update_metrics();
+    return metrics_registry.render();
+}
+
+void Service::write_metrics_file(bool force) {
+    if (service_config.metrics_file.empty()) {
+        return;
+    }
+    int64_t now = time(nullptr);
+    if (!force && now - last_metrics_write < METRICS_FILE_INTERVAL_SECONDS) {
+        return;
+    }
+    last_metrics_write = now;
+
+    update_metrics();
+    if (metrics_registry.write_textfile(service_config.metrics_file) < 0) {
+        LOG_WARN_RATE_LIMITED("Failed to write metrics file %s: %s", service_config.metrics_file.c_str(), strerror(errno));
+    }
+}
 
 int Service::update_network_interfaces()
 {
-    struct ifaddrs *ifaddr, *ifa;
-
-    if (getifaddrs(&ifaddr) == -1) {
-        helper::log_error("getifaddrs failed", quiet_mode);
+    // Loopback is only used for local load testing
+    if (list_network_interfaces(interfaces, service_config.include_loopback) < 0) {
+        LOG_ERROR("getifaddrs failed: %s", strerror(errno));
         return -1;
     }
 
-    for( ifa = ifaddr; ifa != nullptr; ifa = ifa->ifa_next) {
-        if (ifa->ifa_addr == nullptr || (ifa->ifa_flags & IFF_LOOPBACK)) {
-            continue; // Skip null addresses and loopback interfaces
-        }
-
-        NetworkInterface interface;
-        interface = NetworkInterface::from_ifaddrs(ifa);
-        if (interface.ip_address.empty()) {
-            continue; // Skip interfaces without an IP address
-        }
-        std::cout << "Interface: " << interface.name 
-                  << ", IP: " << interface.ip_address 
-                  << ", MAC: " << interface.mac_address 
-                  << ", Subnet Mask: " << interface.subnet_mask 
-                  << ", Network CIDR: " << interface.network_cidr 
-                  << ", Broadcast Address: " << interface.broadcast_address 
-                  << std::endl;
-        interfaces.push_back(interface);
+    for (const NetworkInterface& interface : interfaces) {
+        LOG_INFO("Interface: %s, IP: %s, MAC: %s, Subnet Mask: %s, Network CIDR: %s, Broadcast Address: %s",
+                 interface.name.c_str(), interface.ip_address.c_str(), interface.mac_address.c_str(),
+                 interface.subnet_mask.c_str(), interface.network_cidr.c_str(),
+                 interface.broadcast_address.c_str());
     }
-    freeifaddrs(ifaddr);
     return 0;
 }
 
 int Service::init_interfaces()
 {
     if (update_network_interfaces() < 0) {
-        helper::log_error("Failed to update network interfaces.", quiet_mode);
-        return -1;
+        return init_failed("Failed to list network interfaces (getifaddrs).");
     }
     if (interfaces.empty()) {
-        helper::log_error("No active network interfaces found.", quiet_mode);
-        return -1;
+        return init_failed("No active network interfaces found.");
     }
     return 0;
 }
@@ -84,23 +467,9 @@ int Service::init_cli_socket()
 {
     unlink(cli_socket_path); 
 
-    cli_socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    cli_socket_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
     if (cli_socket_fd < 0) {
-        helper::log_error("CLI socket creation failed", quiet_mode);
-        return -1;
-    }
-
-    int flags = fcntl(cli_socket_fd, F_GETFL, 0);
-    if (flags == -1) {
-        helper::log_error("fcntl F_GETFL failed", quiet_mode);
-        close(cli_socket_fd);
-        return -1;
-    }
-
-    if (fcntl(cli_socket_fd, F_SETFL, flags | O_NONBLOCK) == -1) {
-        helper::log_error("fcntl F_SETFL failed", quiet_mode);
-        close(cli_socket_fd);
-        return -1;
+        return init_failed("CLI socket creation failed: %s", strerror(errno));
     }
 
     struct sockaddr_un addr;
@@ -108,19 +477,20 @@ int Service::init_cli_socket()
     addr.sun_family = AF_UNIX;
     strncpy(addr.sun_path, cli_socket_path, sizeof(addr.sun_path) - 1);
 
-    if(bind(cli_socket_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        helper::log_error("CLI socket bind failed", quiet_mode);
-        close(cli_socket_fd);
-        return -1;
+    const char* step = nullptr;
+    if (bind(cli_socket_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        step = "bind";
+    } else if (listen(cli_socket_fd, 5) < 0) {
+        step = "listen";
     }
-
-    if (listen(cli_socket_fd, 5) < 0) {
-        helper::log_error("CLI socket listen failed", quiet_mode);
+    if (step) {
+        int error = errno;
         close(cli_socket_fd);
-        return -1;
+        cli_socket_fd = -1;
+        return init_failed("CLI socket %s on %s failed: %s", step, cli_socket_path, strerror(error));
     }
 
-    helper::log_info("CLI socket created and listening at: " + std::string(cli_socket_path), quiet_mode);
+    LOG_INFO("CLI socket created and listening at: %s", cli_socket_path);
     return 0;
 }
 
@@ -129,68 +499,258 @@ void Service::cleanup_cli_socket() {
         close(cli_socket_fd);
         unlink(cli_socket_path);
         cli_socket_fd = -1;
-        helper::log_info("CLI socket cleaned up.", quiet_mode);
+        LOG_INFO("CLI socket cleaned up.");
     }
 }
 
-void Service::handle_cli_connection() {
-    struct sockaddr_un cli_addr;
-    socklen_t cli_len = sizeof(cli_addr);
+void Service::on_accept(int client_fd) {
+    if (sessions.size() >= MAX_CLI_SESSIONS) {
+        metrics.cli_refused->inc();
+        LOG_WARN_RATE_LIMITED("Refusing CLI client, %zu sessions open", sessions.size());
+        close(client_fd);
+        return;
+    }
+    int flags = fcntl(client_fd, F_GETFL);
+    if (flags < 0 || fcntl(client_fd, F_SETFL, flags | O_NONBLOCK) < 0 ||
+        event_loop->watch_stream(client_fd, *this) < 0) {
+        LOG_WARN_RATE_LIMITED("Failed to watch CLI client: %s", strerror(errno));
+        close(client_fd);
+        return;
+    }
+    sessions[client_fd];
+    metrics.cli_sessions->set(sessions.size());
+    LOG_DEBUG("CLI client connected");
+}
+
+void Service::close_session(int client_fd) {
+    event_loop->unwatch_stream(client_fd);
+    close(client_fd);
+    sessions.erase(client_fd);
+    metrics.cli_sessions->set(sessions.size());
+    LOG_DEBUG("CLI client disconnected");
+}
+
+// Answers every complete command received so far
+void Service::on_readable(int client_fd) {
+    TraceSpan span("cli", &breakdown);
+    TRACE_SPAN("cli_request");
+    auto found = sessions.find(client_fd);
+    if (found == sessions.end()) {
+        return;
+    }
+    CliSession& session = found->second;
+
+    bool closed = false;
+    char buffer[4096];
+    while (session.input.size() <= MAX_CLI_REQUEST) {
+        ssize_t bytes_read = recv(client_fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (bytes_read > 0) {
+            session.input.append(buffer, bytes_read);
+            continue;
+        }
+        if (bytes_read < 0 && errno == EINTR) {
+            continue;
+        }
+        closed = bytes_read == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+        break;
+    }
+    // A client that shuts down its side without a final newline still
+    // gets an answer to its last command
+    if (closed && !session.input.empty() && session.input.back() != '\n') {
+        session.input += '\n';
+    }
+
+    size_t start = 0;
+    size_t end;
+    while ((end = session.input.find('\n', start)) != std::string::npos) {
+        std::string_view command(session.input.data() + start, end - start);
+        if (!command.empty() && command.back() == '\r') {
+            command.remove_suffix(1);
+        }
+        start = end + 1;
+        if (command.empty()) {
+            continue;
+        }
+        ScopedTimer timer(*metrics.cli_time);
+        LOG_DEBUG("Received from CLI: %.*s", (int)command.size(), command.data());
+        session.output += handle_command(command);
+        session.output += '\0';
+    }
+    session.input.erase(0, start);
+    if (session.input.size() > MAX_CLI_REQUEST) {
+        LOG_WARN_RATE_LIMITED("CLI command longer than %zu bytes, closing the session", MAX_CLI_REQUEST);
+        closed = true;
+    }
+
+    session.closing = closed;
+    flush_session(client_fd, session);
+}
+
+void Service::on_writable(int client_fd) {
+    auto found = sessions.find(client_fd);
+    if (found == sessions.end()) {
+        return;
+    }
+    flush_session(client_fd, found->second);
+    // Read the commands that arrived while the reply was pending
+    found = sessions.find(client_fd);
+    if (found != sessions.end() && found->second.reading) {
+        on_readable(client_fd);
+    }
+}
 
-    int client_fd = accept(cli_socket_fd, (struct sockaddr*)&cli_addr, &cli_len);
-    if (client_fd < 0) {
-        if (errno != EAGAIN && errno != EWOULDBLOCK) {
-            perror("CLI accept failed");
+// Sends as much pending output as the socket takes, then watches for room
+// while some is left, or closes the session once a closing one is done
+void Service::flush_session(int client_fd, CliSession& session) {
+    size_t sent = 0;
+    while (sent < session.output.size()) {
+        ssize_t n = send(client_fd, session.output.data() + sent, session.output.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (n <= 0) {
+            LOG_WARN_RATE_LIMITED("Failed to send CLI reply: %s", strerror(errno));
+            close_session(client_fd);
+            return;
         }
+        sent += n;
+    }
+    session.output.erase(0, sent);
+    if (session.output.empty() && session.closing) {
+        close_session(client_fd);
         return;
     }
+    if (session.output.empty()) {
+        session.stalled_since_ms = 0;
+    } else if (sent > 0 || session.stalled_since_ms == 0) {
+        session.stalled_since_ms = clock.now_ms();
+    }
 
-    helper::log_info("CLI client connected", quiet_mode);
+    bool reading = session.output.empty() && !session.closing;
+    if (reading != session.reading) {
+        session.reading = reading;
+        event_loop->set_stream_interest(client_fd, reading, !reading);
+    }
+}
 
-    char buffer[256];
-    ssize_t bytes_read = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
-    if (bytes_read > 0) {
-        buffer[bytes_read] = '\0'; // Null-terminate the string
-        helper::log_info("Received from CLI: " + std::string(buffer), quiet_mode);
-        std::string command(buffer);
+void Service::expire_stalled_sessions() {
+    int64_t now = clock.now_ms();
+    for (auto it = sessions.begin(); it != sessions.end();) {
+        int client_fd = it->first;
+        bool stalled = it->second.stalled_since_ms && now - it->second.stalled_since_ms >= CLI_SEND_TIMEOUT_MS;
+        ++it;
+        if (stalled) {
+            LOG_WARN_RATE_LIMITED("CLI client took no reply bytes for %d ms, closing the session", CLI_SEND_TIMEOUT_MS);
+            close_session(client_fd);
+        }
+    }
+}
 
-        if (command.find("PING") == 0) {
-            std::string response = "WORLD\n";
-            send(client_fd, response.c_str(), response.size(), 0);
+std::string Service::handle_command(std::string_view command) {
+    if (command.find("PING") == 0) {
+        metrics.cli_ping->inc();
+        return "WORLD\n";
+    } else if (command.find("STATS") == 0) {
+        metrics.cli_stats->inc();
+        TRACE_SPAN("cli_render_stats");
+        return render_metrics();
+    } else if (command.find("TRACE") == 0) {
+        metrics.cli_trace->inc();
+        return trace::is_enabled() ? trace::to_chrome_json()
+                                   : "Tracing is disabled, start the service with --trace.\n";
+    } else if (command.find("DOMAINS") == 0) {
+        metrics.cli_domains->inc();
+        return render_domains();
+    } else if (command.substr(0, 7) == "DOMAIN ") {
+        std::string_view rest = command.substr(7);
+        size_t space = rest.find(' ');
+        Domain* domain = find_domain(rest.substr(0, space));
+        if (!domain) {
+            metrics.cli_unknown->inc();
+            return "Unknown domain " + std::string(rest.substr(0, space)) + ".\n";
         }
+        return handle_domain_command(*domain, space == std::string_view::npos ? "" : rest.substr(space + 1));
+    } else if (!domains.empty()) {
+        return handle_domain_command(*domains.front(), command);
+    }
+    metrics.cli_unknown->inc();
+    return "Unknown command.\n";
+}
 
-        if (command.find("LIST") == 0) {
-            const auto& neighbors = neighbour_discovery->get_neighbours();
-            std::string response = "Neighbors:\n";
+// Commands that read one domain's state
+std::string Service::handle_domain_command(Domain& domain, std::string_view command) {
+    NeighbourDiscovery& discovery = *domain.discovery;
+    if (command.find("LIST") == 0) {
+        metrics.cli_list->inc();
+        TRACE_SPAN("cli_render_list");
+        if (command.substr(4) == " JSON") {
+            return render_neighbour_json(discovery.get_neighbours(), domain.interfaces, clock.now_ms());
+        }
+        return render_neighbour_list(discovery.get_neighbours(), domain.interfaces, clock.now_ms());
+    } else if (command.find("RELAYED") == 0) {
+        metrics.cli_relayed->inc();
+        TRACE_SPAN("cli_render_relayed");
+        return render_relayed_list(discovery.get_relay_cache(), clock.now_ms());
+    } else if (command.find("TOPOLOGY") == 0) {
+        metrics.cli_topology->inc();
+        TRACE_SPAN("cli_render_topology");
+        return discovery_config.gossip.enabled ? render_topology(discovery.get_topology())
+                                               : "Topology gossip is disabled, start the service with --gossip.\n";
+    } else if (command.find("HISTORY") == 0) {
+        metrics.cli_history->inc();
+        TRACE_SPAN("cli_render_history");
+        if (!discovery.get_journal().is_open()) {
+            return "The neighbour journal is disabled, start the service with --journal DIR.\n";
+        }
+        NodeID id{};
+        bool every_node = false;
+        int64_t since_ms = 0;
+        if (command.substr(7, 1) != " " ||
+            !parse_history_query(command.substr(8), helper::realtime_ms(), id, every_node, since_ms)) {
+            return "Usage: HISTORY <node|*> [SINCE <unix seconds|90S|30M|12H|7D>]\n";
+        }
+        return render_history(discovery.get_journal(), every_node ? nullptr : &id, since_ms);
+    }
+    metrics.cli_unknown->inc();
+    return "Unknown command.\n";
+}
 
-            if (neighbors.empty()) {
-                response = "No neighbors found.\n";
-            } else {
-                for (const auto& [id, neighbor] : neighbors) {
-                    std::string connections = "Connections:\n";
-                    std::string interfaces = "Interfaces:\n";
-                    for (const auto& conn : neighbor.connections) {
-                        connections += " - " + conn.ip + " (" + conn.mac_address + ")\n";
-                    }
-                    for (const auto& iface_name : neighbor.interface_names) {
-                        interfaces += " - " + iface_name + "\n";
-                    }
-                    response += id + " - " + connections + interfaces + "\n";
-                }
-            }
-            
-            send(client_fd, response.c_str(), response.size(), 0);
+// graw_cli upper-cases commands, so names match in any case
+Domain* Service::find_domain(std::string_view name) {
+    for (auto& domain : domains) {
+        if (!domain->name.empty() && domain->name.size() == name.size() &&
+            strncasecmp(domain->name.data(), name.data(), name.size()) == 0) {
+            return domain.get();
         }
     }
+    return nullptr;
+}
 
-    close(client_fd);
-    helper::log_info("CLI client disconnected", quiet_mode);
+// One line per domain: name, port, NodeID, interfaces and table size
+std::string Service::render_domains() const {
+    std::string response = "Domains:\n";
+    for (const auto& domain : domains) {
+        char line[160];
+        int length = snprintf(line, sizeof(line), "%s port %d NodeID %s, %zu neighbours, on",
+                              domain->name.empty() ? "-" : domain->name.c_str(), domain->port,
+                              node_id_to_hex(domain->node_id).c_str(), domain->discovery->get_neighbours().size());
+        response.append(line, std::min<size_t>(length, sizeof(line) - 1));
+        for (const NetworkInterface& interface : domain->interfaces) {
+            response += ' ';
+            response += interface.name;
+        }
+        response += '\n';
+    }
+    return response;
 }
 
 int Service::start()
 {
     if (init() < 0) {
-        std::cerr << "Service initialization failed." << std::endl;
+        LOG_ERROR("Service initialization failed.");
         return -1;
     }
     return 0;
@@ -201,52 +761,83 @@ int Service::loop()
     running = true;
 
     while (running) {
-        fd_set read_fds;
-        FD_ZERO(&read_fds);
-        int max_fd = 0;
-
-        if (cli_socket_fd >= 0) {
-            FD_SET(cli_socket_fd, &read_fds);
-            max_fd = cli_socket_fd;
+        // Sleep until some domain next has work to do, but at most 5 seconds
+        int64_t wait_ms = 5000;
+        for (auto& domain : domains) {
+            wait_ms = std::clamp(domain->discovery->next_deadline() - clock.now_ms(), (int64_t)0, wait_ms);
         }
-
-        if (neighbour_discovery) {
-            FD_SET(neighbour_discovery->get_socket_fd(), &read_fds);
-            max_fd = std::max(max_fd, neighbour_discovery->get_socket_fd());
+        for (const auto& [client_fd, session] : sessions) {
+            if (session.stalled_since_ms) {
+                wait_ms = std::clamp(session.stalled_since_ms + CLI_SEND_TIMEOUT_MS - clock.now_ms(), (int64_t)0,
+                                     wait_ms);
+            }
         }
 
-        struct timeval timeout;
-        timeout.tv_sec = 5; // Wait for 5 seconds
-        timeout.tv_usec = 0;
-
-        int activity = select(max_fd + 1, &read_fds, nullptr, nullptr, &timeout);
+        int activity;
+        {
+            TRACE_SPAN("wait");
+            activity = event_loop->wait(wait_ms);
+        }
 
         if (activity < 0) {
-            helper::log_error("select failed", quiet_mode);
+            LOG_ERROR("%s wait failed: %s", io_backend_name(event_loop->backend()), strerror(errno));
             return -1;
         }
 
-        if (activity > 0 && cli_socket_fd >= 0 && FD_ISSET(cli_socket_fd, &read_fds))
-        {
-            handle_cli_connection();
+        TRACE_SPAN("loop_iteration");
+        ScopedTimer timer(*metrics.loop_time);
+        int64_t iteration_start = helper::monotonic_us();
+        breakdown.clear();
+        if (activity > 0) {
+            metrics.wakeups_activity->inc();
+            TraceSpan span("io", &breakdown);
+            event_loop->dispatch();
+        } else {
+            metrics.wakeups_timeout->inc();
         }
-        if (activity > 0 && neighbour_discovery) {
-            neighbour_discovery->handle_activity(read_fds);
+
+        {
+            TraceSpan span("update", &breakdown);
+            for (auto& domain : domains) {
+                domain->discovery->update();
+            }
+            expire_stalled_sessions();
         }
 
-        if (neighbour_discovery) {
-            neighbour_discovery->update();
+        {
+            TraceSpan span("metrics_file", &breakdown);
+            write_metrics_file(false);
         }
+        {
+            TraceSpan span("log_flush", &breakdown);
+            logger::flush();
+        }
+
+        check_stall(helper::monotonic_us() - iteration_start);
     }
 
     return 0;
 }
 
+void Service::check_stall(int64_t iteration_us) {
+    if (service_config.stall_budget_ms <= 0 || iteration_us <= service_config.stall_budget_ms * 1000) {
+        return;
+    }
+    metrics.stalls->inc();
+    if (logger::enabled(LogLevel::Warn)) {
+        char phases[256];
+        breakdown.format(phases, sizeof(phases));
+        LOG_WARN_RATE_LIMITED("Event loop iteration took %.3f ms (budget %d ms): %s", iteration_us / 1000.0,
+                              service_config.stall_budget_ms, phases);
+    }
+}
+
 void Service::stop()
 {
-    if (neighbour_discovery) {
-        neighbour_discovery->cleanup_inactive_neighbors();
+    for (auto& domain : domains) {
+        domain->discovery->cleanup_inactive_neighbors();
     }
+    write_metrics_file(true);
     cleanup_cli_socket();
 }
 
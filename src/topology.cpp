@@ -0,0 +1,237 @@
+#include "topology.h"
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+// splitmix64 finalizer
+static uint64_t mix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+LinkKey make_link_key(const NodeID& origin, const NodeID& neighbour) {
+    LinkKey key;
+    memcpy(key.data(), origin.data(), origin.size());
+    memcpy(key.data() + origin.size(), neighbour.data(), neighbour.size());
+    return key;
+}
+
+NodeID link_origin(const LinkKey& key) {
+    NodeID id;
+    memcpy(id.data(), key.data(), id.size());
+    return id;
+}
+
+NodeID link_neighbour(const LinkKey& key) {
+    NodeID id;
+    memcpy(id.data(), key.data() + id.size(), id.size());
+    return id;
+}
+
+bool parse_link_prefix(std::string_view prefix, uint64_t& value) {
+    if (prefix.size() > TOPOLOGY_TREE_DEPTH) {
+        return false;
+    }
+    value = 0;
+    for (char c : prefix) {
+        int digit = hex_value(c);
+        if (digit < 0) {
+            return false;
+        }
+        value = value << 4 | digit;
+    }
+    return true;
+}
+
+Topology::Position Topology::position(const LinkKey& key) {
+    uint64_t words[4];
+    static_assert(sizeof(words) == sizeof(LinkKey), "link key is four words");
+    memcpy(words, key.data(), sizeof(words));
+    uint64_t hash = 0;
+    for (uint64_t word : words) {
+        hash = mix(hash ^ word);
+    }
+    return Position{hash, key};
+}
+
+uint64_t Topology::link_hash(const Position& at, const LinkState& state) {
+    return mix(at.first ^ (((uint64_t)state.version << 1) | state.alive));
+}
+
+void Topology::account(const Position& at, const LinkState& state, bool add) {
+    uint64_t hash = link_hash(at, state);
+    TopologySummary& first = level1[at.first >> 60];
+    TopologySummary& second = level2[at.first >> 56];
+    first.hash ^= hash;
+    second.hash ^= hash;
+    first.count += add ? 1 : -1;
+    second.count += add ? 1 : -1;
+    if (state.alive) {
+        alive_links += add ? 1 : -1;
+    }
+}
+
+void Topology::store(const Position& at, const LinkState& state) {
+    auto it = links.find(at);
+    if (it != links.end()) {
+        account(at, it->second, false);
+        it->second = state;
+    } else {
+        links.emplace(at, state);
+    }
+    account(at, state, true);
+}
+
+void Topology::set_own(const std::vector<NodeID>& neighbours, int64_t now_ms) {
+    std::vector<NodeID> heard = neighbours;
+    std::sort(heard.begin(), heard.end());
+
+    for (const NodeID& neighbour : own_links) {
+        if (!std::binary_search(heard.begin(), heard.end(), neighbour)) {
+            store(position(make_link_key(self, neighbour)), LinkState{++own_version, false, now_ms});
+        }
+    }
+    own_links.clear();
+    for (const NodeID& neighbour : heard) {
+        Position at = position(make_link_key(self, neighbour));
+        auto it = links.find(at);
+        if (it == links.end() && links.size() >= max_links) {
+            ++dropped_links;
+            continue;
+        }
+        if (it == links.end() || !it->second.alive) {
+            store(at, LinkState{++own_version, true, now_ms});
+        }
+        own_links.push_back(neighbour);
+    }
+}
+
+bool Topology::merge(const LinkKey& key, uint32_t version, bool alive, int64_t now_ms) {
+    Position at = position(key);
+    auto it = links.find(at);
+    bool newer = it == links.end() || version > it->second.version ||
+                 (version == it->second.version && it->second.alive && !alive);
+
+    if (link_origin(key) == self) {
+        own_version = std::max(own_version, version);
+        if (!newer) {
+            return false;
+        }
+        bool ours = it != links.end() && it->second.alive;
+        store(at, LinkState{++own_version, ours, now_ms});
+        return true;
+    }
+    if (!newer || link_neighbour(key) == link_origin(key)) {
+        return false;
+    }
+    if (it == links.end() && links.size() >= max_links) {
+        ++dropped_links;
+        return false;
+    }
+    store(at, LinkState{version, alive, now_ms});
+    return true;
+}
+
+void Topology::expire(int64_t now_ms, int64_t orphan_ms, int64_t tombstone_ms) {
+    std::map<NodeID, std::vector<NodeID>> graph;
+    for (const auto& [at, state] : links) {
+        if (state.alive) {
+            graph[link_origin(at.second)].push_back(link_neighbour(at.second));
+        }
+    }
+    // Crashed nodes still list each other, so only what our live links
+    // lead to counts as heard
+    std::set<NodeID> heard{self};
+    std::vector<NodeID> pending{self};
+    while (!pending.empty()) {
+        auto it = graph.find(pending.back());
+        pending.pop_back();
+        if (it == graph.end()) {
+            continue;
+        }
+        for (const NodeID& neighbour : it->second) {
+            if (heard.insert(neighbour).second) {
+                pending.push_back(neighbour);
+            }
+        }
+    }
+
+    // Only an origin can tombstone its own links; once one that crashed has
+    // gone unheard past the grace period, do it on its behalf
+    std::set<NodeID> orphans;
+    for (const auto& [origin, neighbours] : graph) {
+        if (heard.count(origin)) {
+            unheard_since.erase(origin);
+            continue;
+        }
+        auto since = unheard_since.emplace(origin, now_ms).first;
+        if (now_ms - since->second >= orphan_ms) {
+            orphans.insert(origin);
+            unheard_since.erase(since);
+        }
+    }
+    for (auto it = unheard_since.begin(); it != unheard_since.end();) {
+        it = graph.count(it->first) ? std::next(it) : unheard_since.erase(it);
+    }
+
+    for (auto it = links.begin(); it != links.end();) {
+        LinkState& state = it->second;
+        if (state.alive && orphans.count(link_origin(it->first.second))) {
+            account(it->first, state, false);
+            state.alive = false;
+            state.changed_ms = now_ms;
+            account(it->first, state, true);
+        } else if (!state.alive && now_ms - state.changed_ms >= tombstone_ms) {
+            account(it->first, state, false);
+            it = links.erase(it);
+            continue;
+        }
+        ++it;
+    }
+}
+
+void Topology::children(std::string_view prefix, TopologySummary* out) const {
+    if (prefix.empty()) {
+        std::copy(level1.begin(), level1.end(), out);
+        return;
+    }
+    if (prefix.size() == 1 && hex_value(prefix[0]) >= 0) {
+        std::copy_n(level2.begin() + hex_value(prefix[0]) * 16, 16, out);
+        return;
+    }
+    std::fill_n(out, 16, TopologySummary{0, 0});
+    if (prefix.size() >= TOPOLOGY_TREE_DEPTH) {
+        return;
+    }
+    unsigned shift = 60 - 4 * prefix.size();
+    for_each(prefix, [&](const LinkKey& key, const LinkState& state) {
+        Position at = position(key);
+        TopologySummary& child = out[(at.first >> shift) & 0xF];
+        child.hash ^= link_hash(at, state);
+        ++child.count;
+    });
+}
+
+size_t Topology::nodes() const {
+    std::set<NodeID> seen;
+    for (const auto& [at, state] : links) {
+        if (state.alive) {
+            seen.insert(link_origin(at.second));
+            seen.insert(link_neighbour(at.second));
+        }
+    }
+    return seen.size();
+}
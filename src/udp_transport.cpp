@@ -0,0 +1,164 @@
+#include "transport.h"
+#include "event_loop.h"
+#include "packet_filter.h"
+#include "common/logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+int UdpTransport::open_socket(const std::string& device) {
+    int socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (socket_fd < 0) {
+        LOG_ERROR("Failed to create socket: %s", strerror(errno));
+        return -1;
+    }
+    
+    int reuse = 1;
+    if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0) {
+        LOG_ERROR("setsockopt SO_REUSEADDR failed: %s", strerror(errno));
+        close(socket_fd);
+        return -1;
+    }
+
+    int broadcast = 1;
+    if(setsockopt(socket_fd, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast)) < 0) {
+        LOG_ERROR("setsockopt SO_BROADCAST failed: %s", strerror(errno));
+        close(socket_fd);
+        return -1;
+    }
+
+    int pktinfo = 1;
+    if (setsockopt(socket_fd, IPPROTO_IP, IP_PKTINFO, &pktinfo, sizeof(pktinfo)) < 0) {
+        LOG_ERROR("setsockopt IP_PKTINFO failed: %s", strerror(errno));
+        close(socket_fd);
+        return -1;
+    }
+
+    if (!device.empty() && setsockopt(socket_fd, SOL_SOCKET, SO_BINDTODEVICE, device.c_str(), device.size()) < 0) {
+        LOG_WARN("setsockopt SO_BINDTODEVICE failed for %s: %s", device.c_str(), strerror(errno));
+        close(socket_fd);
+        return -1;
+    }
+
+    int timestamps = 1;
+    if (setsockopt(socket_fd, SOL_SOCKET, SO_TIMESTAMPNS, &timestamps, sizeof(timestamps)) < 0) {
+        LOG_WARN("setsockopt SO_TIMESTAMPNS failed, using receive time instead: %s", strerror(errno));
+    }
+
+    // Drop anything that is not a discovery message before it wakes us up
+    if (attach_discovery_filter(socket_fd) < 0) {
+        LOG_WARN("setsockopt SO_ATTACH_FILTER failed, filtering in user space only: %s", strerror(errno));
+    }
+
+    int flags = fcntl(socket_fd, F_GETFL, 0);
+    if (flags == -1) {
+        LOG_ERROR("fcntl F_GETFL failed: %s", strerror(errno));
+        close(socket_fd);
+        return -1;
+    }
+    if (fcntl(socket_fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        LOG_ERROR("fcntl F_SETFL failed: %s", strerror(errno));
+        close(socket_fd);
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = INADDR_ANY;
+
+    if (bind(socket_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        LOG_ERROR("bind failed: %s", strerror(errno));
+        close(socket_fd);
+        return -1;
+    }
+
+    return socket_fd;
+}
+
+int UdpTransport::bind_to_interface(const NetworkInterface& interface) {
+    // Interfaces with several addresses share one socket per device
+    for (size_t i = 0; i < sockets.size(); ++i) {
+        if (sockets[i].device == interface.name) {
+            return (int)i;
+        }
+    }
+
+    int socket_fd = open_socket(interface.name);
+    if (socket_fd < 0) {
+        return -1;
+    }
+    sockets.push_back({socket_fd, interface.name});
+    LOG_INFO("Successfully bound socket to interface: %s", interface.name.c_str());
+    return (int)sockets.size() - 1;
+}
+
+int UdpTransport::open(const std::vector<NetworkInterface>& interfaces, int port) {
+    this->port = port;
+    interface_sockets.assign(interfaces.size(), -1);
+
+    for (size_t i = 0; i < interfaces.size(); ++i) {
+        const NetworkInterface& interface = interfaces[i];
+        LOG_INFO("Binding to interface: %s (%s:%d) with broadcast address: %s", interface.name.c_str(),
+                 interface.ip_address.c_str(), port, interface.broadcast_address.c_str());
+        int index = bind_to_interface(interface);
+        if (index < 0) {
+            break;
+        }
+        interface_sockets[i] = index;
+    }
+
+    if (std::find(interface_sockets.begin(), interface_sockets.end(), -1) == interface_sockets.end()) {
+        return 0;
+    }
+
+    // SO_BINDTODEVICE needs CAP_NET_RAW; fall back to one wildcard socket
+    LOG_WARN("Per-interface sockets unavailable, using a single wildcard socket");
+    close_sockets();
+    int socket_fd = open_socket("");
+    if (socket_fd < 0) {
+        return -1;
+    }
+    sockets.push_back({socket_fd, ""});
+    interface_sockets.assign(interfaces.size(), 0);
+    return 0;
+}
+
+void UdpTransport::close_sockets() {
+    for (const auto& socket : sockets) {
+        close(socket.fd);
+    }
+    sockets.clear();
+}
+
+UdpTransport::~UdpTransport() {
+    close_sockets();
+}
+
+ssize_t UdpTransport::send(uint16_t interface_id, in_addr_t destination, std::string_view data) {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = destination;
+
+    int fd = sockets[interface_sockets[interface_id]].fd;
+    if (loop) {
+        return loop->send_to(fd, addr, data);
+    }
+    return sendto(fd, data.data(), data.size(), 0, (struct sockaddr*)&addr, sizeof(addr));
+}
+
+void UdpTransport::attach(EventLoop& loop, DatagramSink& sink) {
+    this->loop = &loop;
+    for (const auto& socket : sockets) {
+        if (loop.watch_datagrams(socket.fd, socket.device.empty() ? nullptr : &socket.device, sink) < 0) {
+            LOG_ERROR("Failed to watch discovery socket for %s: %s",
+                      socket.device.empty() ? "all interfaces" : socket.device.c_str(), strerror(errno));
+        }
+    }
+}
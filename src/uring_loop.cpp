@@ -0,0 +1,645 @@
+#include "event_loop.h"
+#include "common/helper.h"
+#include "common/logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Kernel headers older than 6.3 lack the flag that tells us multishot
+// recvmsg (6.0) is there
+#ifndef IORING_FEAT_REG_REG_RING
+#define IORING_FEAT_REG_REG_RING (1U << 13)
+#endif
+
+const unsigned URING_ENTRIES = 256;
+const unsigned URING_BUFFERS = 256;       // provided receive buffers, power of two
+const size_t URING_BUFFER_SIZE = 2048;    // recvmsg header, address, control and payload
+static_assert(URING_BUFFER_SIZE >= MAX_DATAGRAM_SIZE + 256, "receive buffers hold the largest datagram");
+const uint16_t URING_BUFFER_GROUP = 0;
+const size_t URING_SEND_SLOTS = 64;       // sends in flight
+const size_t URING_MAX_SEND = MAX_DATAGRAM_SIZE;
+
+namespace {
+
+enum class Op : uint8_t { Recv, Accept, Send, Provide, Poll, PollRemove, PollWrite };
+
+uint64_t user_data(Op op, uint32_t index) {
+    return (uint64_t)op << 32 | index;
+}
+
+int uring_setup(unsigned entries, io_uring_params& params) {
+    return (int)syscall(__NR_io_uring_setup, entries, &params);
+}
+
+int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, const void* arg, size_t size) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, size);
+}
+
+struct DatagramWatch {
+    int fd;
+    const std::string* device;
+    DatagramSink* sink;
+    bool armed;
+};
+
+struct ListenerWatch {
+    int fd;
+    AcceptHandler* handler;
+    bool armed;
+};
+
+// Streams are keyed by an id that is never reused, so the completion of a
+// cancelled poll cannot be mistaken for one on a new socket with the same fd.
+// Readability has a multishot poll; writability a one-shot poll armed while
+// the handler asks for it.
+struct StreamWatch {
+    uint32_t id;
+    int fd;
+    StreamHandler* handler;
+    bool armed;
+    bool readable;
+    bool writable;
+    bool write_armed;
+};
+
+// A send stays here until its completion arrives; the kernel may read the
+// message after io_uring_enter returns
+struct SendSlot {
+    msghdr message;
+    iovec iov;
+    sockaddr_in destination;
+    char data[URING_MAX_SEND];
+};
+
+// Completion based backend on raw io_uring system calls. Every datagram
+// socket has a multishot recvmsg armed that picks buffers from a provided
+// buffer group, the CLI listener a multishot accept, CLI sessions a
+// multishot poll, and sends and buffer
+// returns are queued and submitted together with the next wait, so steady
+// state traffic costs one io_uring_enter per loop iteration.
+//
+// Buffers are handed back with IORING_OP_PROVIDE_BUFFERS rather than a
+// registered buffer ring: on some 6.x kernels multishot recvmsg fails every
+// receive with ENOBUFS against a ring that is full.
+class UringLoop : public EventLoop {
+    int ring_fd = -1;
+    void* rings = MAP_FAILED; // submission and completion rings share one mapping
+    size_t rings_size = 0;
+    io_uring_sqe* sqes = (io_uring_sqe*)MAP_FAILED;
+    size_t sqes_size = 0;
+
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned to_submit = 0;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    io_uring_cqe* cqes;
+
+    std::vector<char> buffers;
+    msghdr recv_template{};
+
+    std::vector<DatagramWatch> datagrams;
+    std::vector<ListenerWatch> listeners;
+    std::vector<StreamWatch> streams;
+    uint32_t next_stream_id = 0;
+    std::vector<SendSlot> send_slots;
+    std::vector<uint32_t> free_slots;
+
+    io_uring_sqe* next_sqe();
+    void provide_buffers(uint16_t first, uint16_t count);
+    void arm_recv(uint32_t index);
+    void arm_accept(uint32_t index);
+    void arm_poll(StreamWatch& watch);
+    void arm_write_poll(StreamWatch& watch);
+    void remove_poll(Op op, uint32_t id);
+    StreamWatch* find_stream(uint32_t id);
+    void handle_recv(const io_uring_cqe& cqe);
+    void handle_accept(const io_uring_cqe& cqe);
+    void handle_poll(const io_uring_cqe& cqe);
+    void handle_write_poll(const io_uring_cqe& cqe);
+    void handle_send(const io_uring_cqe& cqe);
+    void handle_provide(const io_uring_cqe& cqe);
+    unsigned ready_completions() const;
+    // Submits queued entries and, unless completions are already waiting,
+    // waits up to timeout_ms for one
+    int enter(int64_t timeout_ms);
+public:
+    UringLoop() = default;
+    ~UringLoop() override;
+    UringLoop(const UringLoop&) = delete;
+    UringLoop& operator=(const UringLoop&) = delete;
+
+    int init();
+    IoBackend backend() const override { return IoBackend::Uring; }
+    int watch_datagrams(int fd, const std::string* device, DatagramSink& sink) override;
+    int watch_listener(int fd, AcceptHandler& handler) override;
+    int watch_stream(int fd, StreamHandler& handler) override;
+    int set_stream_interest(int fd, bool readable, bool writable) override;
+    void unwatch_stream(int fd) override;
+    ssize_t send_to(int fd, const sockaddr_in& destination, std::string_view data) override;
+    int wait(int64_t timeout_ms) override;
+    void dispatch() override;
+};
+
+int UringLoop::init() {
+    io_uring_params params{};
+    params.flags = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+    ++syscall_count;
+    ring_fd = uring_setup(URING_ENTRIES, params);
+    if (ring_fd < 0) {
+        LOG_INFO("io_uring_setup failed: %s", strerror(errno));
+        return -1;
+    }
+    unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_EXT_ARG | IORING_FEAT_CQE_SKIP |
+                        IORING_FEAT_REG_REG_RING;
+    if ((params.features & required) != required) {
+        LOG_INFO("io_uring lacks required features (have %#x)", params.features);
+        return -1;
+    }
+
+    rings_size = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                          params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    rings = mmap(nullptr, rings_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (rings == MAP_FAILED) {
+        LOG_WARN("Failed to map the io_uring rings: %s", strerror(errno));
+        return -1;
+    }
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = (io_uring_sqe*)mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                               IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        LOG_WARN("Failed to map the io_uring submission entries: %s", strerror(errno));
+        return -1;
+    }
+
+    char* sq = (char*)rings;
+    sq_head = (unsigned*)(sq + params.sq_off.head);
+    sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    sq_array = (unsigned*)(sq + params.sq_off.array);
+    sq_mask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    sq_entries = params.sq_entries;
+    char* cq = (char*)rings;
+    cq_head = (unsigned*)(cq + params.cq_off.head);
+    cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    cq_mask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    // Queued ahead of the first recvmsg, so the group is never empty
+    buffers.resize(URING_BUFFERS * URING_BUFFER_SIZE);
+    provide_buffers(0, URING_BUFFERS);
+
+    // Every received buffer starts with io_uring_recvmsg_out, then room for
+    // this much address and control data, then the payload
+    recv_template.msg_namelen = sizeof(sockaddr_in);
+    recv_template.msg_controllen = CMSG_SPACE(sizeof(timespec)) + CMSG_SPACE(sizeof(in_pktinfo));
+
+    send_slots.resize(URING_SEND_SLOTS);
+    for (uint32_t i = URING_SEND_SLOTS; i-- > 0;) {
+        free_slots.push_back(i);
+    }
+    return 0;
+}
+
+UringLoop::~UringLoop() {
+    if (sqes != MAP_FAILED) {
+        munmap(sqes, sqes_size);
+    }
+    if (rings != MAP_FAILED) {
+        munmap(rings, rings_size);
+    }
+    // Closing the ring cancels whatever is still armed
+    if (ring_fd >= 0) {
+        close(ring_fd);
+    }
+}
+
+io_uring_sqe* UringLoop::next_sqe() {
+    unsigned tail = *sq_tail;
+    if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+        // Full; hand what is queued to the kernel without waiting
+        ++syscall_count;
+        int submitted = uring_enter(ring_fd, to_submit, 0, 0, nullptr, 0);
+        if (submitted < 0) {
+            return nullptr;
+        }
+        to_submit -= std::min<unsigned>(to_submit, submitted);
+        if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+            return nullptr;
+        }
+    }
+    unsigned index = tail & sq_mask;
+    io_uring_sqe* sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array[index] = index;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++to_submit;
+    return sqe;
+}
+
+// Only a failed return posts a completion
+void UringLoop::provide_buffers(uint16_t first, uint16_t count) {
+    io_uring_sqe* sqe = next_sqe();
+    if (!sqe) {
+        LOG_WARN_RATE_LIMITED("io_uring submission queue full, receive buffer %u lost", first);
+        return;
+    }
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = count;
+    sqe->addr = (uint64_t)(buffers.data() + (size_t)first * URING_BUFFER_SIZE);
+    sqe->len = URING_BUFFER_SIZE;
+    sqe->off = first;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data = user_data(Op::Provide, first);
+}
+
+void UringLoop::arm_recv(uint32_t index) {
+    io_uring_sqe* sqe = next_sqe();
+    if (!sqe) {
+        return; // retried before the next wait
+    }
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = datagrams[index].fd;
+    sqe->addr = (uint64_t)&recv_template;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = user_data(Op::Recv, index);
+    datagrams[index].armed = true;
+}
+
+void UringLoop::arm_accept(uint32_t index) {
+    io_uring_sqe* sqe = next_sqe();
+    if (!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listeners[index].fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = user_data(Op::Accept, index);
+    listeners[index].armed = true;
+}
+
+void UringLoop::arm_poll(StreamWatch& watch) {
+    io_uring_sqe* sqe = next_sqe();
+    if (!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = watch.fd;
+    sqe->poll32_events = POLLIN | POLLRDHUP;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = user_data(Op::Poll, watch.id);
+    watch.armed = true;
+}
+
+void UringLoop::arm_write_poll(StreamWatch& watch) {
+    io_uring_sqe* sqe = next_sqe();
+    if (!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = watch.fd;
+    sqe->poll32_events = POLLOUT;
+    sqe->user_data = user_data(Op::PollWrite, watch.id);
+    watch.write_armed = true;
+}
+
+void UringLoop::remove_poll(Op op, uint32_t id) {
+    io_uring_sqe* sqe = next_sqe();
+    if (sqe) {
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->addr = user_data(op, id);
+        sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+        sqe->user_data = user_data(Op::PollRemove, id);
+    }
+}
+
+StreamWatch* UringLoop::find_stream(uint32_t id) {
+    for (StreamWatch& watch : streams) {
+        if (watch.id == id) {
+            return &watch;
+        }
+    }
+    return nullptr;
+}
+
+int UringLoop::watch_datagrams(int fd, const std::string* device, DatagramSink& sink) {
+    datagrams.push_back({fd, device, &sink, false});
+    arm_recv((uint32_t)datagrams.size() - 1);
+    return 0;
+}
+
+int UringLoop::watch_listener(int fd, AcceptHandler& handler) {
+    listeners.push_back({fd, &handler, false});
+    arm_accept((uint32_t)listeners.size() - 1);
+    return 0;
+}
+
+int UringLoop::watch_stream(int fd, StreamHandler& handler) {
+    streams.push_back({next_stream_id++, fd, &handler, false, true, false, false});
+    arm_poll(streams.back());
+    return 0;
+}
+
+// The read poll stays armed and its reports are ignored while unwanted; a
+// write poll no longer wanted completes and is ignored the same way
+int UringLoop::set_stream_interest(int fd, bool readable, bool writable) {
+    for (StreamWatch& watch : streams) {
+        if (watch.fd == fd) {
+            watch.readable = readable;
+            watch.writable = writable;
+            if (writable && !watch.write_armed) {
+                arm_write_poll(watch);
+            }
+            return 0;
+        }
+    }
+    errno = ENOENT;
+    return -1;
+}
+
+void UringLoop::unwatch_stream(int fd) {
+    for (size_t i = 0; i < streams.size(); ++i) {
+        if (streams[i].fd != fd) {
+            continue;
+        }
+        if (streams[i].armed) {
+            remove_poll(Op::Poll, streams[i].id);
+        }
+        if (streams[i].write_armed) {
+            remove_poll(Op::PollWrite, streams[i].id);
+        }
+        streams[i] = streams.back();
+        streams.pop_back();
+        return;
+    }
+}
+
+ssize_t UringLoop::send_to(int fd, const sockaddr_in& destination, std::string_view data) {
+    io_uring_sqe* sqe = free_slots.empty() || data.size() > URING_MAX_SEND ? nullptr : next_sqe();
+    if (!sqe) {
+        // Out of slots or ring space: send the old way
+        ++syscall_count;
+        return sendto(fd, data.data(), data.size(), 0, (const sockaddr*)&destination, sizeof(destination));
+    }
+
+    uint32_t index = free_slots.back();
+    free_slots.pop_back();
+    SendSlot& slot = send_slots[index];
+    memcpy(slot.data, data.data(), data.size());
+    slot.destination = destination;
+    slot.iov = {slot.data, data.size()};
+    slot.message = {};
+    slot.message.msg_name = &slot.destination;
+    slot.message.msg_namelen = sizeof(slot.destination);
+    slot.message.msg_iov = &slot.iov;
+    slot.message.msg_iovlen = 1;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)&slot.message;
+    sqe->len = 1;
+    sqe->user_data = user_data(Op::Send, index);
+    return (ssize_t)data.size();
+}
+
+unsigned UringLoop::ready_completions() const {
+    return __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE) - *cq_head;
+}
+
+int UringLoop::enter(int64_t timeout_ms) {
+    if (ready_completions() > 0) {
+        if (to_submit == 0) {
+            return 0;
+        }
+        ++syscall_count;
+        int submitted = uring_enter(ring_fd, to_submit, 0, 0, nullptr, 0);
+        if (submitted < 0) {
+            return errno == EINTR ? 0 : -1;
+        }
+        to_submit -= std::min<unsigned>(to_submit, submitted);
+        return 0;
+    }
+
+    __kernel_timespec timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (timeout_ms % 1000) * 1000000;
+    io_uring_getevents_arg arg{};
+    arg.ts = (uint64_t)&timeout;
+
+    ++syscall_count;
+    int submitted = uring_enter(ring_fd, to_submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg,
+                                sizeof(arg));
+    if (submitted < 0) {
+        return errno == ETIME || errno == EINTR ? 0 : -1;
+    }
+    to_submit -= std::min<unsigned>(to_submit, submitted);
+    return 0;
+}
+
+int UringLoop::wait(int64_t timeout_ms) {
+    for (uint32_t i = 0; i < datagrams.size(); ++i) {
+        if (!datagrams[i].armed) {
+            arm_recv(i);
+        }
+    }
+    for (uint32_t i = 0; i < listeners.size(); ++i) {
+        if (!listeners[i].armed) {
+            arm_accept(i);
+        }
+    }
+    for (StreamWatch& watch : streams) {
+        if (!watch.armed) {
+            arm_poll(watch);
+        }
+        if (watch.writable && !watch.write_armed) {
+            arm_write_poll(watch);
+        }
+    }
+
+    int64_t deadline = helper::monotonic_ms() + timeout_ms;
+    while (true) {
+        if (enter(timeout_ms) < 0) {
+            return -1;
+        }
+
+        // Completions of our own sends and buffer returns are not
+        // activity; retire them and keep waiting if nothing else arrived
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes[head & cq_mask];
+            Op op = (Op)(cqe.user_data >> 32);
+            if (op == Op::Send) {
+                handle_send(cqe);
+            } else if (op == Op::Provide) {
+                handle_provide(cqe);
+            } else if (op == Op::PollRemove ||
+                       ((op == Op::Poll || op == Op::PollWrite) && !find_stream((uint32_t)cqe.user_data))) {
+                // A stream already unwatched; nothing to report
+            } else {
+                break;
+            }
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        if (head != tail) {
+            return (int)(tail - head);
+        }
+
+        timeout_ms = deadline - helper::monotonic_ms();
+        if (timeout_ms <= 0) {
+            return 0;
+        }
+    }
+}
+
+void UringLoop::dispatch() {
+    unsigned head = *cq_head;
+    unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        const io_uring_cqe cqe = cqes[head & cq_mask];
+        // Release the entry before the handler runs, it may queue more work
+        __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+        switch ((Op)(cqe.user_data >> 32)) {
+        case Op::Recv:
+            handle_recv(cqe);
+            break;
+        case Op::Accept:
+            handle_accept(cqe);
+            break;
+        case Op::Send:
+            handle_send(cqe);
+            break;
+        case Op::Provide:
+            handle_provide(cqe);
+            break;
+        case Op::Poll:
+            handle_poll(cqe);
+            break;
+        case Op::PollWrite:
+            handle_write_poll(cqe);
+            break;
+        case Op::PollRemove:
+            break; // the poll was already gone
+        }
+    }
+}
+
+void UringLoop::handle_recv(const io_uring_cqe& cqe) {
+    DatagramWatch& watch = datagrams[(uint32_t)cqe.user_data];
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        watch.armed = false; // re-armed before the next wait
+    }
+    if (cqe.res < 0) {
+        if (cqe.res != -ENOBUFS) {
+            watch.sink->on_receive_error(-cqe.res);
+        }
+        return;
+    }
+    if (!(cqe.flags & IORING_CQE_F_BUFFER)) {
+        return;
+    }
+
+    uint16_t id = (uint16_t)(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+    char* buffer = buffers.data() + (size_t)id * URING_BUFFER_SIZE;
+    const io_uring_recvmsg_out* out = (const io_uring_recvmsg_out*)buffer;
+    char* name = buffer + sizeof(*out);
+    char* control = name + recv_template.msg_namelen;
+    char* payload = control + recv_template.msg_controllen;
+    size_t room = URING_BUFFER_SIZE - (payload - buffer);
+
+    sockaddr_in sender{};
+    memcpy(&sender, name, std::min<size_t>(out->namelen, sizeof(sender)));
+    msghdr message{};
+    message.msg_control = control;
+    message.msg_controllen = out->controllen;
+    if ((out->flags & MSG_TRUNC) || out->payloadlen > std::min(room, MAX_DATAGRAM_SIZE)) {
+        watch.sink->on_receive_error(EMSGSIZE);
+    } else {
+        watch.sink->on_datagram(std::string_view(payload, out->payloadlen), sender.sin_addr.s_addr, watch.device,
+                                kernel_rx_us(message));
+    }
+    provide_buffers(id, 1);
+}
+
+void UringLoop::handle_accept(const io_uring_cqe& cqe) {
+    ListenerWatch& watch = listeners[(uint32_t)cqe.user_data];
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        watch.armed = false;
+    }
+    if (cqe.res < 0) {
+        LOG_ERROR_RATE_LIMITED("CLI accept failed: %s", strerror(-cqe.res));
+        return;
+    }
+    watch.handler->on_accept(cqe.res);
+}
+
+void UringLoop::handle_poll(const io_uring_cqe& cqe) {
+    StreamWatch* watch = find_stream((uint32_t)cqe.user_data);
+    if (!watch) {
+        return; // unwatched, this is the cancellation
+    }
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        watch->armed = false;
+    }
+    if (cqe.res < 0) {
+        LOG_WARN_RATE_LIMITED("CLI session poll failed: %s", strerror(-cqe.res));
+        return;
+    }
+    if (!watch->readable) {
+        return;
+    }
+    // The handler may unwatch and so invalidate watch
+    StreamHandler* handler = watch->handler;
+    handler->on_readable(watch->fd);
+}
+
+void UringLoop::handle_write_poll(const io_uring_cqe& cqe) {
+    StreamWatch* watch = find_stream((uint32_t)cqe.user_data);
+    if (!watch) {
+        return; // unwatched, this is the cancellation
+    }
+    watch->write_armed = false; // re-armed before the next wait while still wanted
+    if (cqe.res < 0) {
+        LOG_WARN_RATE_LIMITED("CLI session poll failed: %s", strerror(-cqe.res));
+        return;
+    }
+    if (!watch->writable) {
+        return;
+    }
+    StreamHandler* handler = watch->handler;
+    handler->on_writable(watch->fd);
+}
+
+void UringLoop::handle_provide(const io_uring_cqe& cqe) {
+    LOG_WARN_RATE_LIMITED("Failed to return receive buffer %u: %s", (uint32_t)cqe.user_data, strerror(-cqe.res));
+}
+
+void UringLoop::handle_send(const io_uring_cqe& cqe) {
+    if (cqe.res < 0) {
+        LOG_WARN_RATE_LIMITED("Queued send failed: %s", strerror(-cqe.res));
+    }
+    free_slots.push_back((uint32_t)cqe.user_data);
+}
+
+} // namespace
+
+std::unique_ptr<EventLoop> make_uring_loop() {
+    auto loop = std::make_unique<UringLoop>();
+    if (loop->init() < 0) {
+        return nullptr;
+    }
+    return loop;
+}